@@ -64,16 +64,19 @@ int main(int argc, char* argv[]) {
         printf("Suite only ran %d tests.\n", s->test_index);
     }
 
-    // print summary statistics
+    // print summary statistics; the stats are a view over the suite's
+    // results, so they must be released before the suite is deleted
     suite_stats_t* stats = suite_get_stats(s);
     printf("Suite encountered: %d segmentation faults.\n", s->n_segv);
-
-    // delete the suite and all runners associated with it
-    suite_del(s);
+    printf("\n");
+    suite_print_stats(stats, stdout, 3);
 
     int ret = stats->n_fail;
     suite_stats_del(stats);
 
+    // delete the suite and all runners associated with it
+    suite_del(s);
+
     return ret;
 }
 
@@ -0,0 +1,26 @@
+/**
+ * @private
+ * @file assertutil.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private helpers shared by the failure paths of assertions.
+ */
+#ifndef __TDD_ASSERT_UTIL_H__
+#define __TDD_ASSERT_UTIL_H__
+
+#include <stdbool.h>
+
+#include "tdd.h"
+
+/**
+ * __assert_report() fails a test with the message of a failed assertion,
+ * unless an earlier assertion already failed it, and frees the message.
+ * @private
+ * @internal
+ *
+ * @param t   - the test the assertion was made in, or NULL
+ * @param msg - a heap allocated message, or NULL if it could not be built
+ * @return false, which the assertion returns
+ */
+bool __assert_report(test_t* t, char* msg);
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * @private
+ * @file async.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private event loop functions for running async tests.
+ */
+#ifndef __TDD_ASYNC_H__
+#define __TDD_ASYNC_H__
+
+#include "tdd.h"
+
+/**
+ * __async_run() runs a batch of async tests to completion on one event loop
+ * on the calling thread, stepping each whenever what it awaited is ready.
+ * Each test is timed from its first step to its last, unless it stops its
+ * timer itself. If the loop cannot be made, every test is failed.
+ * @private
+ * @internal
+ *
+ * @param tests - the runners of the tests, whose step functions are set
+ * @param ts    - the tests to record results in
+ * @param n     - the number of tests
+ */
+void __async_run(runner_t** tests, test_t** ts, int n);
+
+#endif
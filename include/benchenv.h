@@ -0,0 +1,54 @@
+/**
+ * @private
+ * @file benchenv.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private benchmark environment control for libtdd.
+ */
+#ifndef __TDD_BENCHENV_H__
+#define __TDD_BENCHENV_H__
+
+#include "tdd.h"
+
+/**
+ * __benchenv_new() creates the record of a benchmark's environment, with
+ * everything unknown.
+ * @private
+ * @internal
+ *
+ * @param s - the suite running the benchmark
+ * @return the record, or NULL if out of memory
+ */
+tdd_bench_env_t* __benchenv_new(const suite_t* s);
+
+/**
+ * __benchenv_lock() locks the memory of the process, so the benchmark
+ * about to run does not page fault.
+ * @private
+ * @internal
+ *
+ * @param env - the record of the benchmark's environment
+ */
+void __benchenv_lock(tdd_bench_env_t* env);
+
+/**
+ * __benchenv_unlock() undoes __benchenv_lock().
+ * @private
+ * @internal
+ *
+ * @param env - the record of the benchmark's environment
+ */
+void __benchenv_unlock(tdd_bench_env_t* env);
+
+/**
+ * __benchenv_enter() pins the calling benchmark thread and raises its
+ * priority as the suite asks, then checks the CPU it runs on and the
+ * system for anything likely to make the benchmark noisy.
+ * @private
+ * @internal
+ *
+ * @param env - the record of the benchmark's environment
+ * @param s   - the suite running the benchmark
+ */
+void __benchenv_enter(tdd_bench_env_t* env, const suite_t* s);
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * @private
+ * @file bulk.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private vectorised buffer comparison for libtdd.
+ */
+#ifndef __TDD_BULK_H__
+#define __TDD_BULK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * __bulk_use() makes bulk comparisons use the kernels of one instruction
+ * set, instead of the fastest the CPU supports, so that each can be checked
+ * against the plain C kernels.
+ * @private
+ * @internal
+ *
+ * @param name - "c", "sse2", "avx2" or "neon"
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if this build or CPU lacks them
+ */
+int __bulk_use(const char* name);
+
+/**
+ * __bulk_mem_find() finds the first byte at which two buffers differ, with
+ * the fastest comparison the CPU supports.
+ * @private
+ * @internal
+ *
+ * @param a - the first buffer
+ * @param b - the second buffer
+ * @param n - the length of both buffers in bytes
+ * @return the offset of the first differing byte, or n if they are equal
+ */
+size_t __bulk_mem_find(const void* a, const void* b, size_t n);
+
+/**
+ * __bulk_f32_find() finds the first pair of floats that are further apart
+ * than a number of units in the last place.
+ * @private
+ * @internal
+ *
+ * @param a    - the first array
+ * @param b    - the second array
+ * @param n    - the number of elements in both arrays
+ * @param ulps - the largest distance allowed between two elements
+ * @return the index of the first pair that is not near, or n if none
+ */
+size_t __bulk_f32_find(const float* a, const float* b, size_t n,
+                       uint32_t ulps);
+
+/**
+ * __bulk_f64_find() finds the first pair of doubles whose relative error is
+ * greater than a bound.
+ * @private
+ * @internal
+ *
+ * @param a   - the first array
+ * @param b   - the second array
+ * @param n   - the number of elements in both arrays
+ * @param rel - the largest relative error allowed
+ * @return the index of the first pair that is not near, or n if none
+ */
+size_t __bulk_f64_find(const double* a, const double* b, size_t n,
+                       double rel);
+
+#endif
@@ -0,0 +1,34 @@
+/**
+ * @private
+ * @file cache.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private cache state and benchmark memory functions for libtdd.
+ */
+#ifndef __TDD_CACHE_H__
+#define __TDD_CACHE_H__
+
+#include "tdd.h"
+
+/**
+ * __cache_free() unmaps the buffers a test allocated with
+ * test_bench_alloc().
+ * @private
+ * @internal
+ *
+ * @param t - the test
+ */
+void __cache_free(test_t* t);
+
+/**
+ * __cache_compare() times a benchmark alternately with cold and with warm
+ * caches on throwaway tests, and records the median of each in
+ * `test_t::cache`. Comparing stops if any run fails.
+ * @private
+ * @internal
+ *
+ * @param fn - the benchmark
+ * @param t  - the test running the benchmark
+ */
+void __cache_compare(void* (*fn)(void* t), test_t* t);
+
+#endif
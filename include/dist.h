@@ -0,0 +1,29 @@
+/**
+ * @private
+ * @file dist.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private socket functions for libtdd.
+ */
+#ifndef __TDD_DIST_H__
+#define __TDD_DIST_H__
+
+#include <stdbool.h>
+
+/** The prefix of addresses of TCP sockets. */
+#define DIST_TCP "tcp:"
+
+/**
+ * __dist_socket() opens a stream socket listening on, or connected to, an
+ * address: the path of a Unix domain socket, or `tcp:HOST:PORT`. A Unix
+ * domain socket listened on replaces any file at its path. An empty HOST
+ * is the loopback interface, and a HOST of `*` listens on every interface.
+ * @private
+ * @internal
+ *
+ * @param address   - the address
+ * @param listening - whether to listen on the address, or connect to it
+ * @return the socket, or -1 with errno set
+ */
+int __dist_socket(const char* address, bool listening);
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * @private
+ * @file eventlog.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private event log writer functions for libtdd.
+ */
+#ifndef __TDD_EVENTLOG_H__
+#define __TDD_EVENTLOG_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "tdd.h"
+
+/**
+ * An event log opened for writing.
+ * @private
+ * @internal
+ */
+typedef struct tdd_eventlog_t tdd_eventlog_t;
+
+/**
+ * __log_open() creates or truncates the log file at path and writes the
+ * log header.
+ * @private
+ * @internal
+ *
+ * @param path - the path of the log file
+ * @return the open log, or NULL on error
+ */
+tdd_eventlog_t* __log_open(const char* path);
+
+/**
+ * __log_stream() writes the log header to a connected socket, and returns
+ * a log that writes its records to the socket. Records are written whole,
+ * one at a time.
+ * @private
+ * @internal
+ *
+ * @param fd - the socket, which is closed with the log
+ * @return the open log, or NULL on error
+ */
+tdd_eventlog_t* __log_stream(int fd);
+
+/**
+ * __log_close() closes a log opened by __log_open() or __log_stream().
+ * @private
+ * @internal
+ *
+ * @param log - the log to close; may be NULL
+ */
+void __log_close(tdd_eventlog_t* log);
+
+/**
+ * __log_path() returns the path a log was opened with.
+ * @private
+ * @internal
+ *
+ * @param log - the log
+ * @return the path of the log, or NULL
+ */
+const char* __log_path(const tdd_eventlog_t* log);
+
+/**
+ * __log_ts() converts a timestamp to nanoseconds.
+ * @private
+ * @internal
+ *
+ * @param ts - the timestamp
+ * @return the timestamp in nanoseconds
+ */
+int64_t __log_ts(const struct timespec* ts);
+
+/**
+ * __log_suite_start() records that a suite started running.
+ * @private
+ * @internal
+ *
+ * @param log     - the log to write to
+ * @param n_tests - the number of tests in the suite
+ */
+void __log_suite_start(tdd_eventlog_t* log, int n_tests);
+
+/**
+ * __log_suite_end() records that a suite stopped running.
+ * @private
+ * @internal
+ *
+ * @param log      - the log to write to
+ * @param finished - whether every test in the suite ran
+ */
+void __log_suite_end(tdd_eventlog_t* log, bool finished);
+
+/**
+ * __log_test_start() records that a test started running.
+ * @private
+ * @internal
+ *
+ * @param log   - the log to write to
+ * @param index - the position of the test in its suite
+ * @param name  - the name of the test
+ * @param desc  - the description of the test; may be NULL
+ */
+void __log_test_start(tdd_eventlog_t* log, int index, const char* name,
+                      const char* desc);
+
+/**
+ * __log_message() records an error or failure of a running test.
+ * @private
+ * @internal
+ *
+ * @param log   - the log to write to
+ * @param type  - TDD_EVENT_ERROR or TDD_EVENT_FAIL
+ * @param index - the position of the test in its suite
+ * @param at    - the time of the error or failure
+ * @param msg   - the message
+ */
+void __log_message(tdd_eventlog_t* log, int type, int index,
+                   const struct timespec* at, const char* msg);
+
+/**
+ * __log_test_end() records the benchmark samples and the outcome of a
+ * finished test.
+ * @private
+ * @internal
+ *
+ * @param log     - the log to write to
+ * @param index   - the position of the test in its suite
+ * @param t       - the finished test
+ * @param crashed - whether the test crashed with a segmentation fault
+ */
+void __log_test_end(tdd_eventlog_t* log, int index, test_t* t,
+                    bool crashed);
+
+/**
+ * A log being read from a stream, such as a socket, as its bytes arrive.
+ * @private
+ * @internal
+ */
+typedef struct tdd_log_stream_t tdd_log_stream_t;
+
+/**
+ * __log_stream_new() creates a reader of a log stream. Tests are rebuilt
+ * from their events as they are read, as by tdd_eventlog_report().
+ * @private
+ * @internal
+ *
+ * @param on_event - called with each event as it is read; may be NULL
+ * @param on_test  - called with each test once its end is read, and
+ *                   whether it crashed; the test is freed once it returns
+ * @param ctx      - passed to on_event and on_test
+ * @return the reader, or NULL if out of memory
+ */
+tdd_log_stream_t* __log_stream_new(void (*on_event)(void* ctx,
+                                                    const tdd_event_t* ev),
+                                   void (*on_test)(void* ctx, int index,
+                                                   test_t* t, bool crashed),
+                                   void* ctx);
+
+/**
+ * __log_stream_feed() reads the next bytes of a stream, handling every
+ * record they complete.
+ * @private
+ * @internal
+ *
+ * @param st   - the reader
+ * @param data - the bytes
+ * @param n    - the number of bytes
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if the stream is not a log or a
+ *         record cannot be read
+ */
+int __log_stream_feed(tdd_log_stream_t* st, const void* data, size_t n);
+
+/**
+ * __log_stream_live() finds a test that has started but not ended in a
+ * stream.
+ * @private
+ * @internal
+ *
+ * @param st    - the reader
+ * @param index - the position of the test in its suite
+ * @return the test as rebuilt so far, or NULL
+ */
+test_t* __log_stream_live(tdd_log_stream_t* st, int index);
+
+/**
+ * __log_stream_drop() frees a test returned by __log_stream_live().
+ * @private
+ * @internal
+ *
+ * @param st    - the reader
+ * @param index - the position of the test in its suite
+ */
+void __log_stream_drop(tdd_log_stream_t* st, int index);
+
+/**
+ * __log_stream_del() frees a stream reader and any tests it holds.
+ * @private
+ * @internal
+ *
+ * @param st - the reader; may be NULL
+ */
+void __log_stream_del(tdd_log_stream_t* st);
+
+#endif
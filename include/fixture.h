@@ -0,0 +1,92 @@
+/**
+ * @private
+ * @file fixture.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private temporary directory and I/O fixture functions for libtdd.
+ */
+#ifndef __TDD_FIXTURE_H__
+#define __TDD_FIXTURE_H__
+
+#include <time.h>
+
+#include "tdd.h"
+
+/**
+ * A fixture file being made, or the temporary directory of a test being
+ * removed, and when it happened.
+ * @private
+ * @internal
+ */
+typedef struct fixture_phase_t {
+    /** "setup" or "teardown". */
+    const char*     what;
+    /** The fixture file or directory; owned by the fixture. */
+    const char*     path;
+    struct timespec start;
+    struct timespec end;
+} fixture_phase_t;
+
+/**
+ * __fixture_free() removes the temporary directory of a test, with
+ * everything in it, and frees the record of its fixture files.
+ * @private
+ * @internal
+ *
+ * @param t - the test
+ */
+void __fixture_free(test_t* t);
+
+/**
+ * __fixture_teardown() removes the temporary directory of a test, with
+ * everything in it, once the test has finished, recording how long that
+ * took. The record of its fixture files is kept until __fixture_free().
+ * @private
+ * @internal
+ *
+ * @param t - the test
+ */
+void __fixture_teardown(test_t* t);
+
+/**
+ * __fixture_phases() finds when the fixtures of a test were set up and torn
+ * down, in the order that happened.
+ * @private
+ * @internal
+ *
+ * @param t      - the test
+ * @param phases - set to the phases, which are valid until __fixture_free()
+ * @return the number of phases
+ */
+int __fixture_phases(const test_t* t, const fixture_phase_t** phases);
+
+/**
+ * __fixture_evict() writes back the fixture files of a test and drops them
+ * from the page cache.
+ * @private
+ * @internal
+ *
+ * @param t - the test
+ */
+void __fixture_evict(test_t* t);
+
+/**
+ * __fixture_warm() reads the fixture files of a test into the page cache.
+ * @private
+ * @internal
+ *
+ * @param t - the test
+ */
+void __fixture_warm(test_t* t);
+
+/**
+ * __fixture_rates() turns the I/O reported in a timed run into throughput
+ * and operation rate metrics, and clears it.
+ * @private
+ * @internal
+ *
+ * @param run  - the test that ran, with its timed region ended
+ * @param into - the test to report the metrics to
+ */
+void __fixture_rates(test_t* run, test_t* into);
+
+#endif
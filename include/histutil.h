@@ -0,0 +1,70 @@
+/**
+ * @private
+ * @file histutil.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private latency histogram functions for libtdd.
+ */
+#ifndef __TDD_HIST_UTIL_H__
+#define __TDD_HIST_UTIL_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * A log-linear histogram of nanosecond values. Values below 128 are
+ * recorded exactly; larger values are recorded with 64 sub-buckets per
+ * power of two, i.e. to within about 1.6%.
+ * @private
+ * @internal
+ */
+typedef struct __hist_t {
+    uint64_t* counts;
+    uint64_t  total;
+    uint64_t  max;
+} __hist_t;
+
+/**
+ * __hist_new() allocates an empty histogram.
+ * @private
+ * @internal
+ *
+ * @return a heap allocated histogram, or NULL if out of memory
+ */
+__hist_t* __hist_new(void);
+
+/**
+ * __hist_del() frees a histogram.
+ * @private
+ * @internal
+ */
+void __hist_del(__hist_t* h);
+
+/**
+ * __hist_reset() empties a histogram.
+ * @private
+ * @internal
+ */
+void __hist_reset(__hist_t* h);
+
+/**
+ * __hist_record() records one value.
+ * @private
+ * @internal
+ *
+ * @param h - the histogram
+ * @param v - the value, in nanoseconds
+ */
+void __hist_record(__hist_t* h, uint64_t v);
+
+/**
+ * __hist_percentile() returns the value at percentile p of the recorded
+ * values, or 0 if the histogram is empty.
+ * @private
+ * @internal
+ *
+ * @param h - the histogram
+ * @param p - the percentile, in [0, 100]
+ */
+double __hist_percentile(const __hist_t* h, double p);
+
+#endif
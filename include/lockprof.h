@@ -0,0 +1,73 @@
+/**
+ * @private
+ * @file lockprof.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private lock contention profiler functions for libtdd.
+ */
+#ifndef __TDD_LOCKPROF_H__
+#define __TDD_LOCKPROF_H__
+
+#include <stdbool.h>
+
+#include "tdd.h"
+
+/**
+ * __lockprof_supported() reports whether the library was built with the
+ * pthread lock functions interposed.
+ * @private
+ * @internal
+ *
+ * @return true if lock contention can be profiled
+ */
+bool __lockprof_supported(void);
+
+/**
+ * __lockprof_begin() clears the call site table and starts recording the
+ * lock operations of every thread in the process.
+ * @private
+ * @internal
+ */
+void __lockprof_begin(void);
+
+/**
+ * __lockprof_end() stops recording and stores the call sites that were
+ * seen since __lockprof_begin() in t->locks, slowest first.
+ * @private
+ * @internal
+ *
+ * @param t - the test that ran
+ */
+void __lockprof_end(test_t* t);
+
+/**
+ * __lockprof_internal() excludes the lock operations of the calling thread
+ * from the profile while the harness synchronizes with test threads. Calls
+ * nest.
+ * @private
+ * @internal
+ *
+ * @param internal - true to enter the harness, false to leave it
+ */
+void __lockprof_internal(bool internal);
+
+/**
+ * __locks_add() appends a copy of a lock call site to a test.
+ * @private
+ * @internal
+ *
+ * @param t    - the test
+ * @param lock - the call site to copy
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if out of memory
+ */
+int __locks_add(test_t* t, const tdd_lock_stats_t* lock);
+
+/**
+ * __locks_free() frees the lock call sites of a test.
+ * @private
+ * @internal
+ *
+ * @param t - the test
+ */
+void __locks_free(test_t* t);
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * @private
+ * @file profile.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private sampling profiler functions for libtdd.
+ */
+#ifndef __TDD_PROFILE_H__
+#define __TDD_PROFILE_H__
+
+#include <stdbool.h>
+
+#include "tdd.h"
+
+/**
+ * The call stack samples taken while one benchmark ran.
+ * @private
+ * @internal
+ */
+typedef struct tdd_profile_t tdd_profile_t;
+
+/**
+ * __profile_supported() reports whether the sampling profiler can run on
+ * this platform.
+ * @private
+ * @internal
+ *
+ * @return true if profiles can be recorded
+ */
+bool __profile_supported(void);
+
+/**
+ * __profile_new() allocates an empty profile and installs the SIGPROF
+ * handler.
+ * @private
+ * @internal
+ *
+ * @param hz - the number of samples to take per second of CPU time
+ * @return the new profile, or NULL on error
+ */
+tdd_profile_t* __profile_new(int hz);
+
+/**
+ * __profile_del() frees a profile. No thread may still be sampling to it.
+ * @private
+ * @internal
+ *
+ * @param p - the profile to free; may be NULL
+ */
+void __profile_del(tdd_profile_t* p);
+
+/**
+ * __profile_thread_start() starts sampling the calling thread into p,
+ * using a timer on the thread's CPU-time clock.
+ * @private
+ * @internal
+ *
+ * @param p - the profile to sample to; if NULL, nothing is sampled
+ */
+void __profile_thread_start(tdd_profile_t* p);
+
+/**
+ * __profile_thread_stop() stops sampling the calling thread.
+ * @private
+ * @internal
+ */
+void __profile_thread_stop(void);
+
+/**
+ * __profile_write() writes the samples in p as folded stacks, one line of
+ * "root;...;leaf count" per distinct stack, to dir/name.folded.
+ * @private
+ * @internal
+ *
+ * @param p    - the profile to write
+ * @param dir  - the directory to write to
+ * @param name - the name of the benchmark
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if the file could not be written
+ */
+int __profile_write(tdd_profile_t* p, const char* dir, const char* name);
+
+#endif
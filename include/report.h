@@ -0,0 +1,30 @@
+/**
+ * @private
+ * @file report.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private text reporter functions for libtdd.
+ */
+#ifndef __TDD_REPORT_H__
+#define __TDD_REPORT_H__
+
+#include <stdio.h>
+
+#include "tdd.h"
+
+/**
+ * __report_test() prints the result of a finished test, followed by any
+ * benchmark, fuzzing or other statistics it recorded.
+ * @private
+ * @internal
+ *
+ * @param f       - the file to print the report to
+ * @param index   - the 1-based position of the test in its suite
+ * @param n_tests - the number of tests in the suite
+ * @param name    - the name of the test
+ * @param desc    - the description of the test; may be NULL
+ * @param t       - the finished test
+ */
+void __report_test(FILE* f, int index, int n_tests, const char* name,
+                   const char* desc, test_t* t);
+
+#endif
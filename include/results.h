@@ -0,0 +1,80 @@
+/**
+ * @private
+ * @file results.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private results store functions for libtdd.
+ */
+#ifndef __TDD_RESULTS_H__
+#define __TDD_RESULTS_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#include "tdd.h"
+
+/**
+ * __results_init() initializes an empty results store.
+ * @private
+ * @internal
+ *
+ * @param r - the store to initialize
+ */
+void __results_init(tdd_results_t* r);
+
+/**
+ * __results_reset() empties a results store, keeping its allocations.
+ * @private
+ * @internal
+ *
+ * @param r - the store to empty
+ */
+void __results_reset(tdd_results_t* r);
+
+/**
+ * __results_free() frees the allocations of a results store.
+ * @private
+ * @internal
+ *
+ * @param r - the store to free
+ */
+void __results_free(tdd_results_t* r);
+
+/**
+ * __results_append() adds the results of a finished test as the next row
+ * of a store.
+ * @private
+ * @internal
+ *
+ * @param r       - the store to append to
+ * @param name    - the name of the test
+ * @param t       - the finished test
+ * @param flags   - extra `tdd_status_t` flags to set on the row
+ * @param started - when the test started running
+ * @param ended   - when the test finished running
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if memory could not be allocated
+ */
+int __results_append(tdd_results_t* r, const char* name, const test_t* t,
+                     uint8_t flags, const struct timespec* started,
+                     const struct timespec* ended);
+
+/**
+ * __stats_new_owned() allocates stats that own an empty results store, to
+ * be filled by the caller and freed by suite_stats_del().
+ * @private
+ * @internal
+ *
+ * @return the stats, or NULL if memory could not be allocated
+ */
+suite_stats_t* __stats_new_owned(void);
+
+/**
+ * __stats_fill() sets the summary counts of stats from their results.
+ * @private
+ * @internal
+ *
+ * @param stats   - the stats to fill in
+ * @param n_tests - the number of tests in the suite
+ */
+void __stats_fill(suite_stats_t* stats, int n_tests);
+
+#endif
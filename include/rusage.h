@@ -0,0 +1,32 @@
+/**
+ * @private
+ * @file rusage.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private resource usage functions for libtdd.
+ */
+#ifndef __TDD_RUSAGE_H__
+#define __TDD_RUSAGE_H__
+
+#include "tdd.h"
+
+/**
+ * __rusage_sample() reads the resource usage of the calling thread so far.
+ * @private
+ * @internal
+ *
+ * @param u - set to the usage of the calling thread
+ */
+void __rusage_sample(tdd_rusage_t* u);
+
+/**
+ * __rusage_since() sets u to the usage of the calling thread since an
+ * earlier sample.
+ * @private
+ * @internal
+ *
+ * @param u     - set to the difference
+ * @param start - the earlier sample
+ */
+void __rusage_since(tdd_rusage_t* u, const tdd_rusage_t* start);
+
+#endif
@@ -0,0 +1,33 @@
+/**
+ * @private
+ * @file sample.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private adaptive benchmark sampling functions for libtdd.
+ */
+#ifndef __TDD_SAMPLE_H__
+#define __TDD_SAMPLE_H__
+
+#include "tdd.h"
+
+/**
+ * __sample_run() runs a benchmark repeatedly on the calling thread, timing
+ * each run, until the confidence interval of its median time is narrow
+ * enough or its time budget runs out, and summarises the timings in
+ * `test_t::samples`. The first run is given the test itself; the others
+ * are given throwaway tests, whose errors, failure, spans, counters and
+ * metrics are reported on the test. Sampling stops once any run fails or
+ * raises an error. Each run is prepared with test_cache_prepare() and timed
+ * by its test timer, which it may restart once its input is set up.
+ * @private
+ * @internal
+ *
+ * @param fn     - the benchmark
+ * @param t      - the test running the benchmark
+ * @param ci     - the target half-width of the interval, as a fraction
+ * @param budget - the most time to spend sampling, in seconds
+ * @return the return value of the first run
+ */
+void* __sample_run(void* (*fn)(void* t), test_t* t, double ci,
+                   double budget);
+
+#endif
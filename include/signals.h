@@ -0,0 +1,28 @@
+/**
+ * @private
+ * @file signals.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private signal handling functions for libtdd.
+ */
+#ifndef __TDD_SIGNALS_H__
+#define __TDD_SIGNALS_H__
+
+#include <setjmp.h>
+
+/**
+ * __sigsegv_resume() sets where a segmentation fault on the calling thread
+ * resumes, so that code which faults for real (rather than by raising the
+ * signal) can be abandoned instead of faulting again forever.
+ * @private
+ * @internal
+ *
+ * A fault that resumes at env is not counted in `tdd_sigsegv_caught`; the
+ * caller reports it. Anything the abandoned code held, such as a lock or
+ * memory it allocated, is left as it was.
+ *
+ * @param env - where sigsetjmp() saved the context to resume, or NULL to
+ *              only count faults again
+ */
+void __sigsegv_resume(sigjmp_buf* env);
+
+#endif
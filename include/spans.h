@@ -0,0 +1,83 @@
+/**
+ * @private
+ * @file spans.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private span, counter and metric functions for libtdd.
+ */
+#ifndef __TDD_SPANS_H__
+#define __TDD_SPANS_H__
+
+#include "tdd.h"
+
+/**
+ * __spans_collect() drains the per-thread buffers of a finished test and
+ * aggregates their spans and counters by name into t->spans, and their
+ * metrics by unit into t->metrics. Every thread
+ * that recorded to the test must have finished.
+ * @private
+ * @internal
+ *
+ * @param t - the finished test
+ */
+void __spans_collect(test_t* t);
+
+/**
+ * __spans_merge() collects the spans, counters and metrics of a finished
+ * run of a test, and adds them to the aggregates of the test the run was
+ * made for, so that repeated runs are reported together.
+ * @private
+ * @internal
+ *
+ * @param run  - the finished run; every thread that recorded to it must
+ *               have finished
+ * @param into - the test to add the aggregates to
+ */
+void __spans_merge(test_t* run, test_t* into);
+
+/**
+ * __spans_free() frees the per-thread buffers and the aggregated spans and
+ * metrics of a test.
+ * @private
+ * @internal
+ *
+ * @param t - the test
+ */
+void __spans_free(test_t* t);
+
+/**
+ * __spans_add() adds measurements to a span or counter in an aggregate
+ * table, creating it if needed.
+ * @private
+ * @internal
+ *
+ * @param spans   - the table
+ * @param n_spans - the number of entries in the table
+ * @param name    - the name of the span or counter
+ * @param counter - whether the entry is a counter
+ * @param count   - the number of measurements
+ * @param total   - the sum of the measurements
+ * @param max     - the largest measurement
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if memory could not be allocated
+ */
+int __spans_add(tdd_span_stats_t** spans, int* n_spans, const char* name,
+                bool counter, long count, int64_t total, int64_t max);
+
+/**
+ * __metrics_add() adds values to a metric in an aggregate table, creating
+ * it if needed.
+ * @private
+ * @internal
+ *
+ * @param metrics   - the table
+ * @param n_metrics - the number of entries in the table
+ * @param unit      - the unit of the metric
+ * @param count     - the number of values
+ * @param sum       - the sum of the values
+ * @param min       - the smallest value
+ * @param max       - the largest value
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if memory could not be allocated
+ */
+int __metrics_add(tdd_metric_t** metrics, int* n_metrics, const char* unit,
+                  long count, double sum, double min, double max);
+
+#endif
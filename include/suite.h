@@ -0,0 +1,38 @@
+/**
+ * @private
+ * @file suite.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private suite functions for libtdd.
+ */
+#ifndef __TDD_SUITE_H__
+#define __TDD_SUITE_H__
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "tdd.h"
+
+/**
+ * __suite_record() records the results of a finished test in the suite's
+ * event log, trace and results, reports them, and moves the suite on to
+ * the next test. Segmentation faults are counted by the caller.
+ * @private
+ * @internal
+ *
+ * @param s              - the suite that ran the test
+ * @param test           - the runner of the test
+ * @param t              - the finished test, whose `test_t::index` is set
+ * @param crashed        - whether the test caused a segmentation fault
+ * @param started        - the time the test started
+ * @param joined         - the time the test finished
+ * @param track          - the trace track of whatever ran the test
+ * @param fatal_failures - whether a failure aborts the suite
+ * @return EXIT_FAILURE if the test failed and failures are fatal, and
+ *         EXIT_SUCCESS otherwise
+ */
+int __suite_record(suite_t* s, runner_t* test, test_t* t, bool crashed,
+                   const struct timespec* started,
+                   const struct timespec* joined, int track,
+                   bool fatal_failures);
+
+#endif
@@ -55,13 +55,14 @@
  *                runner_new(&fatal_func, "fatal ends early", NULL));
  *
  *      // run the test suite
- *      suite_run(s);
- *      stats = suite_get_stats(s);
- *      suite_del(s);
- *      ...
+ *      suite_run(s, false);
  *
- *      int retcode = stats.n_error;
+ *      // the stats are a view over the suite, so release them first
+ *      suite_stats_t* stats = suite_get_stats(s);
+ *      int retcode = stats->n_error;
  *      suite_stats_del(stats);
+ *
+ *      suite_del(s);
  *      return retcode;
  *  }
  *```
@@ -93,6 +94,72 @@
  * suite_add_test(runner_new(&test_func, "test_func", "basic test"));
  * ```
  *
+ * Concurrent code can be benchmarked with `test_run_parallel()`, which runs
+ * a body on many threads that share one iteration counter:
+ * ```
+ * static void push_pop(tdd_pb_t* pb) {
+ *     while (tdd_pb_next(pb)) {
+ *         queue_push(pb->arg, 1);
+ *         queue_pop(pb->arg);
+ *     }
+ * }
+ *
+ * static void* bench_queue(void* t) {
+ *     return test_run_parallel(t, &push_pop, shared_queue);
+ * }
+ * ```
+ *
+ * @section fuzzing Fuzzing
+ * Tests prefixed by `fuzz_` may call `test_fuzz()` with a fuzz target that
+ * takes a byte buffer. In a normal run, every input saved in the target's
+ * corpus is replayed as a regression test. When `suite_t::fuzz` is enabled,
+ * the suite instead runs a coverage-guided fuzz engine for each `fuzz_`
+ * test, growing the corpus and minimizing any crashing input it finds.
+ * ```
+ * static void* parse_target(void* t, const uint8_t* data, size_t len) {
+ *     if (parse(data, len) < 0) test_error(t, "parse failed");
+ *     return NULL;
+ * }
+ *
+ * static void* fuzz_parse(void* t) {
+ *     return test_fuzz(t, &parse_target);
+ * }
+ * ```
+ * Compile the code under test with `-fsanitize-coverage=trace-pc-guard`
+ * (`-fsanitize-coverage=trace-pc` with `gcc`) to give the engine coverage
+ * feedback.
+ *
+ * @section properties Property testing
+ * Invariants can be checked over many generated inputs with
+ * `test_property()`. Generators for integers, doubles, byte buffers, arrays
+ * and tuples may be composed, and the first counterexample found is shrunk
+ * before it is reported.
+ * ```
+ * static bool sorted_after_sort(const void* value, void* ctx) {
+ *     const tdd_vec_t* v = value;
+ *     ...
+ * }
+ *
+ * static void* test_sort(void* t) {
+ *     tdd_gen_t* g = tdd_gen_array(tdd_gen_int(-100, 100), 64);
+ *     test_property(t, g, &sorted_after_sort, NULL);
+ *     tdd_gen_del(g);
+ *     return NULL;
+ * }
+ * ```
+ *
+ * @section migrating Migrating from 0.0.2
+ * Results are no longer kept as one heap object per test:
+ *  - `suite_stats_t::tests_run` and `tdd_result_t` are removed. Read each
+ *    test's row from `suite_stats_t::results` instead, with
+ *    `tdd_results_name()`, `tdd_results_ok()` and `tdd_results_scaling()`,
+ *    where `stats->tests_run[i]->name` becomes
+ *    `tdd_results_name(stats->results, i)`.
+ *  - `suite_t::results` is a `tdd_results_t` store rather than an array of
+ *    `test_t*`; each `test_t` is freed once it has been reported.
+ *  - `suite_get_stats()` returns a view over the suite. Read the stats and
+ *    call `suite_stats_del()` before `suite_del()`, not after.
+ *
  * @section notes Notes
  * This library is multithreaded using POSIX `pthread`s. As such, any binaries
  * built using this library must be compiled with either `gcc` or `clang`'s
@@ -101,9 +168,11 @@
 #ifndef __TDD_H__
 #define __TDD_H__
 
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -116,6 +185,409 @@ extern volatile sig_atomic_t tdd_sigsegv_caught;
 /** Crash handler. **/
 void tdd_sigsegv_handler(int sig);
 
+struct suite_t;
+
+/**
+ * Fuzzing statistics. Records the work done by the fuzz engine for a single
+ * `fuzz_` test.
+ **/
+typedef struct tdd_fuzz_stats_t {
+    /** The total number of times the fuzz target was executed. **/
+    unsigned long execs;
+    /** The average number of executions per second across all workers. **/
+    double execs_per_sec;
+    /** The number of worker threads that ran the fuzz target. **/
+    int workers;
+    /** The number of inputs in the corpus when fuzzing stopped. **/
+    int corpus_size;
+    /** The number of inputs added to the corpus during this run. **/
+    int new_inputs;
+    /** The number of distinct coverage edges observed. **/
+    unsigned long edges;
+    /** The number of (minimized) crashing inputs that were found. **/
+    int crashers;
+} tdd_fuzz_stats_t;
+
+/**
+ * Parallel benchmark statistics. Records the final round of a benchmark run
+ * by `test_run_parallel()`.
+ **/
+typedef struct tdd_parallel_stats_t {
+    /** The number of threads that ran the benchmark body. **/
+    int threads;
+    /** The total number of iterations run by all threads. **/
+    unsigned long n;
+    /** The aggregate wall-clock time per iteration in nanoseconds. **/
+    double ns_per_op;
+    /** The aggregate number of iterations per second. **/
+    double ops_per_sec;
+    /**
+     * The number of iterations per second run by each thread; has `threads`
+     * entries. Heap allocated.
+     **/
+    double* thread_ops_per_sec;
+} tdd_parallel_stats_t;
+
+/**
+ * One point on a thread-scaling curve.
+ **/
+typedef struct tdd_scaling_point_t {
+    /** The number of threads that ran the benchmark body. **/
+    int threads;
+    /** The aggregate wall-clock time per iteration in nanoseconds. **/
+    double ns_per_op;
+    /** The aggregate number of iterations per second. **/
+    double ops_per_sec;
+    /** The throughput relative to the single-threaded run. **/
+    double speedup;
+    /** The speedup divided by the number of threads. **/
+    double efficiency;
+} tdd_scaling_point_t;
+
+/**
+ * Thread-scaling curve of a parallel benchmark, recorded when
+ * `suite_t::bench_sweep` is enabled.
+ **/
+typedef struct tdd_scaling_t {
+    /** The number of points on the curve. **/
+    int n_points;
+    /** The points, in order of increasing thread count. Heap allocated. **/
+    tdd_scaling_point_t* points;
+} tdd_scaling_t;
+
+/**
+ * Frees memory allocated to a `tdd_scaling_t`. Not to be called explicitly.
+ * @private
+ *
+ * @param sc - pointer to the scaling curve to be freed
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+ **/
+int tdd_scaling_del(tdd_scaling_t* sc);
+
+/**
+ * Copies a `tdd_scaling_t`. Not to be called explicitly.
+ * @private
+ *
+ * @param sc - pointer to the scaling curve to copy
+ * @return A heap allocated copy, or `NULL` if sc is `NULL`.
+ **/
+tdd_scaling_t* tdd_scaling_copy(const tdd_scaling_t* sc);
+
+/**
+ * Latency at one offered load of an open-loop benchmark. Latencies are in
+ * nanoseconds and are measured from the time each operation was scheduled
+ * to start, so they include any time spent queued behind a slow operation.
+ **/
+typedef struct tdd_load_point_t {
+    /** The offered load in operations per second. **/
+    double target_rate;
+    /** The rate at which operations were actually completed. **/
+    double achieved_rate;
+    /** The number of operations issued. **/
+    unsigned long ops;
+    /**
+     * The number of operations that were never issued, because those before
+     * them were still running when `suite_t::bench_seconds` ran out. Only
+     * non-zero when the offered load is more than the operation can serve.
+     **/
+    unsigned long dropped;
+    /** The median latency. **/
+    double p50;
+    /** The 90th percentile latency. **/
+    double p90;
+    /** The 99th percentile latency. **/
+    double p99;
+    /** The 99.9th percentile latency. **/
+    double p999;
+    /** The maximum latency. **/
+    double max;
+    /**
+     * The median service time, measured from the time each operation
+     * actually started; this is what a closed-loop benchmark would report.
+     **/
+    double service_p50;
+    /** The 99th percentile service time. **/
+    double service_p99;
+} tdd_load_point_t;
+
+/**
+ * Results of an open-loop benchmark run by `test_run_open_loop()`.
+ **/
+typedef struct tdd_load_t {
+    /**
+     * The peak closed-loop throughput the offered loads were derived from,
+     * or 0 if the loads were set explicitly by `suite_t::bench_rates`.
+     **/
+    double peak_rate;
+    /** The number of offered loads that ran. **/
+    int n_points;
+    /** The results at each offered load. Heap allocated. **/
+    tdd_load_point_t* points;
+} tdd_load_t;
+
+/**
+ * Frees memory allocated to a `tdd_load_t`. Not to be called explicitly.
+ * @private
+ *
+ * @param load - pointer to the results to be freed
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+ **/
+int tdd_load_del(tdd_load_t* load);
+
+/**
+ * Frees memory allocated to a `tdd_parallel_stats_t`. Not to be called
+ * explicitly.
+ * @private
+ *
+ * @param ps - pointer to the statistics to be freed
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+ **/
+int tdd_parallel_stats_del(tdd_parallel_stats_t* ps);
+
+/**
+ * Aggregated measurements of one span or counter recorded inside a test
+ * with `test_span_begin()`/`test_span_end()` or `test_counter_add()`.
+ **/
+typedef struct tdd_span_stats_t {
+    /** The name of the span or counter. Heap allocated. **/
+    char* name;
+    /** Whether this is a counter rather than a span. **/
+    bool counter;
+    /** The number of times the span ended, or the counter was added to. **/
+    long count;
+    /** The total nanoseconds spent in the span, or the counter's sum. **/
+    int64_t total;
+    /** The longest single span in nanoseconds, or the largest addition. **/
+    int64_t max;
+} tdd_span_stats_t;
+
+/**
+ * A custom benchmark metric reported with `test_report_metric()`,
+ * aggregated over every value the test reported in the same unit.
+ **/
+typedef struct tdd_metric_t {
+    /** The unit of the metric, e.g. "rows/s". Heap allocated. **/
+    char* unit;
+    /** The number of values reported. **/
+    long count;
+    /** The sum of the values. **/
+    double sum;
+    /** The smallest value. **/
+    double min;
+    /** The largest value. **/
+    double max;
+    /** The mean of the values. **/
+    double mean;
+} tdd_metric_t;
+
+/** The kinds of call site a `tdd_lock_stats_t` describes. **/
+typedef enum tdd_lock_kind_t {
+    /** `pthread_mutex_lock()` **/
+    TDD_LOCK_MUTEX = 0,
+    /** `pthread_rwlock_rdlock()` **/
+    TDD_LOCK_RDLOCK = 1,
+    /** `pthread_rwlock_wrlock()` **/
+    TDD_LOCK_WRLOCK = 2,
+    /** `pthread_cond_wait()` or `pthread_cond_timedwait()` **/
+    TDD_LOCK_COND = 3,
+} tdd_lock_kind_t;
+
+/**
+ * Lock contention measured at one call site while a test ran with
+ * `suite_t::lock_profile` set.
+ **/
+typedef struct tdd_lock_stats_t {
+    /**
+     * The call site, as "function+offset", or "module+offset" if the
+     * caller has no exported symbol. Heap allocated.
+     **/
+    char* site;
+    /** The kind of lock operation made at the call site. **/
+    tdd_lock_kind_t kind;
+    /** The number of acquisitions, or of waits on a condition variable. **/
+    long count;
+    /** The number of acquisitions that found the lock taken and waited. **/
+    long contended;
+    /**
+     * The total nanoseconds spent waiting to acquire the lock, or waiting
+     * on the condition variable.
+     **/
+    int64_t wait_ns;
+    /** The longest single wait in nanoseconds. **/
+    int64_t max_wait_ns;
+    /**
+     * The total nanoseconds the lock was held after being acquired at the
+     * call site. Always 0 for condition variables.
+     **/
+    int64_t hold_ns;
+    /** The longest single hold in nanoseconds. **/
+    int64_t max_hold_ns;
+} tdd_lock_stats_t;
+
+/**
+ * Resource usage of a test, measured on the thread that ran the test
+ * function. Threads started by the test are not included.
+ **/
+typedef struct tdd_rusage_t {
+    /** CPU time spent in user mode, in nanoseconds. **/
+    int64_t user_ns;
+    /** CPU time spent in the kernel, in nanoseconds. **/
+    int64_t sys_ns;
+    /** Minor page faults, which did not require I/O. **/
+    long minflt;
+    /** Major page faults, which required I/O, e.g. from swap. **/
+    long majflt;
+    /** Voluntary context switches, e.g. waiting on a lock or on I/O. **/
+    long nvcsw;
+    /** Involuntary context switches, i.e. preemptions. **/
+    long nivcsw;
+    /** Bytes read through system calls (Linux only). **/
+    int64_t io_read;
+    /** Bytes written through system calls (Linux only). **/
+    int64_t io_write;
+    /** The peak resident set size of the process after the test, in KiB. **/
+    long max_rss_kb;
+} tdd_rusage_t;
+
+/**
+ * Problems with the environment a benchmark ran in, which are likely to
+ * make its timings noisy. Flags in `tdd_bench_env_t::warnings`.
+ **/
+typedef enum tdd_bench_warning_t {
+    /** The CPU frequency governor is not `performance`. **/
+    TDD_BENCH_WARN_GOVERNOR = 1 << 0,
+    /** Turbo boost is enabled, so the clock speed depends on temperature. **/
+    TDD_BENCH_WARN_TURBO = 1 << 1,
+    /** Another hardware thread shares the benchmark's CPU core. **/
+    TDD_BENCH_WARN_SMT = 1 << 2,
+    /** The system was busy: the load average was above 1. **/
+    TDD_BENCH_WARN_LOAD = 1 << 3,
+    /** The benchmark thread could not be pinned to `suite_t::bench_cpu`. **/
+    TDD_BENCH_WARN_PIN = 1 << 4,
+    /** The benchmark thread could not be given `SCHED_FIFO` priority. **/
+    TDD_BENCH_WARN_REALTIME = 1 << 5,
+    /** The process memory could not be locked. **/
+    TDD_BENCH_WARN_MLOCK = 1 << 6,
+} tdd_bench_warning_t;
+
+/**
+ * The environment a benchmark ran in, recorded when `suite_t::bench_env` is
+ * set. Values that could not be read are -1, or empty for strings.
+ **/
+typedef struct tdd_bench_env_t {
+    /** The CPU the benchmark thread started on. **/
+    int cpu;
+    /** Whether the benchmark thread was pinned to `tdd_bench_env_t::cpu`. **/
+    bool pinned;
+    /** Whether the benchmark thread ran with `SCHED_FIFO` priority. **/
+    bool realtime;
+    /** Whether the process memory was locked while the benchmark ran. **/
+    bool memory_locked;
+    /** The number of untimed warm-up runs before the timed run. **/
+    int warmup;
+    /** The CPU frequency governor of `tdd_bench_env_t::cpu`. **/
+    char governor[16];
+    /** 1 if turbo boost was enabled, 0 if it was disabled. **/
+    int turbo;
+    /** 1 if another hardware thread shared the CPU core, 0 if not. **/
+    int smt;
+    /** The one minute load average when the benchmark started. **/
+    double load;
+    /** `tdd_bench_warning_t` flags. **/
+    unsigned warnings;
+} tdd_bench_env_t;
+
+/**
+ * Repeated timings of a benchmark, taken when `suite_t::bench_ci` is set.
+ * Confidence intervals are at 95% and given as a fraction of the estimate
+ * they bound, e.g. 0.01 for ±1%.
+ *
+ * Samples are classified as outliers with Tukey's fences: a sample more
+ * than 1.5 interquartile ranges beyond the first or third quartile is a
+ * mild outlier, and one more than 3 interquartile ranges beyond is severe.
+ **/
+typedef struct tdd_samples_t {
+    /** The number of samples taken. **/
+    int n;
+    /** Whether the target interval was reached within the time budget. **/
+    bool converged;
+    /** The mean of the samples, in nanoseconds. **/
+    double mean_ns;
+    /** The median of the samples, in nanoseconds. **/
+    double median_ns;
+    /** The sample standard deviation, in nanoseconds. **/
+    double stddev_ns;
+    /** The fastest sample, in nanoseconds. **/
+    double min_ns;
+    /** The slowest sample, in nanoseconds. **/
+    double max_ns;
+    /** The half-width of the confidence interval of the mean. **/
+    double mean_ci;
+    /** The half-width of the confidence interval of the median. **/
+    double median_ci;
+    /** Samples below the lower outer fence. **/
+    int low_severe;
+    /** Samples between the lower outer and inner fences. **/
+    int low_mild;
+    /** Samples between the upper inner and outer fences. **/
+    int high_mild;
+    /** Samples above the upper outer fence. **/
+    int high_severe;
+} tdd_samples_t;
+
+/**
+ * Page sizes that `test_bench_alloc()` can back a buffer with.
+ **/
+typedef enum tdd_pages_t {
+    /** Whatever the kernel's transparent huge page policy chooses. **/
+    TDD_PAGES_DEFAULT = 0,
+    /** Base pages only, usually 4 KiB. **/
+    TDD_PAGES_SMALL = 1,
+    /** Transparent huge pages, usually 2 MiB, where the kernel has them. **/
+    TDD_PAGES_HUGE = 2,
+} tdd_pages_t;
+
+/**
+ * The state the caches are put in before each timed run of a benchmark.
+ **/
+typedef enum tdd_cache_mode_t {
+    /** The caches are left as the previous run left them. **/
+    TDD_CACHE_ANY = 0,
+    /**
+     * The buffers from `test_bench_alloc()` are read into the caches, and
+     * the files from `test_bench_file()` into the page cache.
+     **/
+    TDD_CACHE_WARM = 1,
+    /**
+     * The buffers from `test_bench_alloc()` are flushed from the caches,
+     * and a buffer twice the size of the last-level cache is streamed
+     * through to evict everything else. The files from `test_bench_file()`
+     * are dropped from the page cache.
+     **/
+    TDD_CACHE_COLD = 2,
+    /**
+     * The benchmark is timed warm, and is then also timed in both states
+     * in turn to compare them in `test_t::cache`. Only valid for
+     * `suite_t::bench_cache`.
+     **/
+    TDD_CACHE_BOTH = 3,
+} tdd_cache_mode_t;
+
+/**
+ * Timings of a benchmark with cold and with warm caches, taken when
+ * `suite_t::bench_cache` is `TDD_CACHE_BOTH`.
+ **/
+typedef struct tdd_cache_t {
+    /** The number of runs timed in each state. **/
+    int runs;
+    /** The median time of the runs with cold caches, in nanoseconds. **/
+    double cold_ns;
+    /** The median time of the runs with warm caches, in nanoseconds. **/
+    double warm_ns;
+    /** The number of bytes streamed through to evict the caches. **/
+    int64_t evict_bytes;
+} tdd_cache_t;
+
 /**
  * Testing structure which records results from tests. You will never need to
  * initialize or free this structure yourself.
@@ -146,6 +618,11 @@ typedef struct test_t {
      * errors in order of occurance. Each string is Heap allocated.
      **/
     char** err_msg;
+    /**
+     * The timestamps at which each error in `err_msg` was raised. Heap
+     * allocated.
+     **/
+    struct timespec* err_at;
     /** The timestamp at which the test was started. Heap allocated. **/
     struct timespec* start;
     /**
@@ -162,6 +639,142 @@ typedef struct test_t {
      * allocated.
      **/
     struct timespec* error_at;
+    /**
+     * The suite that is running this test. Set by `suite_next()`; `NULL` if
+     * the test is not running as part of a suite.
+     **/
+    struct suite_t* suite;
+    /**
+     * A boolean flag specifying that the test is prefixed by `fuzz_` and
+     * that the suite has enabled the fuzz engine.
+     **/
+    bool fuzzing;
+    /**
+     * Statistics recorded by `test_fuzz()`. `NULL` unless the test ran a
+     * fuzz target. Heap allocated.
+     **/
+    tdd_fuzz_stats_t* fuzz;
+    /**
+     * Statistics recorded by `test_run_parallel()`. `NULL` unless the test
+     * ran a parallel benchmark. Heap allocated.
+     **/
+    tdd_parallel_stats_t* parallel;
+    /**
+     * The thread-scaling curve recorded by `test_run_parallel()` when
+     * `suite_t::bench_sweep` is enabled; `NULL` otherwise. Heap allocated.
+     **/
+    tdd_scaling_t* scaling;
+    /**
+     * Results recorded by `test_run_open_loop()`. `NULL` unless the test
+     * ran an open-loop benchmark. Heap allocated.
+     **/
+    tdd_load_t* load;
+    /**
+     * The position of the test in the suite that is running it, or -1 if
+     * the test is not running as part of a suite.
+     **/
+    int index;
+    /**
+     * The spans and counters recorded by the test, aggregated by name once
+     * the test has finished. Heap allocated.
+     **/
+    tdd_span_stats_t* spans;
+    /** The number of entries in `test_t::spans`. **/
+    int n_spans;
+    /**
+     * The custom metrics reported by the test, aggregated by unit once the
+     * test has finished. Heap allocated.
+     **/
+    tdd_metric_t* metrics;
+    /** The number of entries in `test_t::metrics`. **/
+    int n_metrics;
+    /**
+     * The lock call sites seen while the test ran, most time spent waiting
+     * first, if the suite profiles lock contention. Heap allocated.
+     **/
+    tdd_lock_stats_t* locks;
+    /** The number of entries in `test_t::locks`. **/
+    int n_locks;
+    /** The resource usage of the test thread while the test ran. **/
+    tdd_rusage_t usage;
+    /**
+     * The environment the benchmark ran in, if `suite_t::bench_env` is set;
+     * `NULL` otherwise. Heap allocated.
+     **/
+    tdd_bench_env_t* env;
+    /**
+     * The repeated timings of the benchmark, if `suite_t::bench_ci` is set;
+     * `NULL` otherwise. Heap allocated.
+     **/
+    tdd_samples_t* samples;
+    /**
+     * The state `test_cache_prepare()` puts the caches in. Set from
+     * `suite_t::bench_cache` for tests prefixed by `bench_`.
+     **/
+    tdd_cache_mode_t cache_mode;
+    /**
+     * The timings of the benchmark with cold and with warm caches, if
+     * `suite_t::bench_cache` is `TDD_CACHE_BOTH`; `NULL` otherwise. Heap
+     * allocated.
+     **/
+    tdd_cache_t* cache;
+    /**
+     * The step an async test resumes at. Starts at 0 and is kept by the
+     * test itself, which is usually a `switch` over it.
+     **/
+    int async_state;
+    /** A pointer an async test may keep its own state in between steps. **/
+    void* async_data;
+    /**
+     * The `poll()` events of the descriptor that resumed an async test, or
+     * 0 if it was resumed by its timer or had awaited nothing.
+     **/
+    short async_events;
+    /**
+     * The buffers allocated by `test_bench_alloc()`, freed with the test.
+     * @private
+     **/
+    void* buffers;
+    /**
+     * The temporary directory and fixture files of the test, removed with
+     * the test.
+     * @private
+     **/
+    struct tdd_fixture_t* fixture;
+    /**
+     * The bytes and operations of I/O reported with `test_report_io()`
+     * since the timed region started.
+     * @private
+     **/
+    int64_t io_bytes;
+    int64_t io_ops;
+    /**
+     * The virtual clock of the test, made the first time it is used.
+     * @private
+     **/
+    struct tdd_vclock_t* clock;
+    /**
+     * The event loop entry of an async test, or `NULL` for other tests.
+     * @private
+     **/
+    struct tdd_async_task_t* task;
+    /**
+     * The per-thread buffers that spans and counters are recorded to while
+     * the test runs.
+     * @private
+     **/
+    void* span_rings;
+    /**
+     * A number that is unique to this test for the life of the process.
+     * @private
+     **/
+    uint64_t serial;
+    /**
+     * The call stack samples being taken while the benchmark runs, or `NULL`
+     * if it is not being profiled.
+     * @private
+     **/
+    struct tdd_profile_t* profile;
     /**
      * Marks the test as failed with a message explaining the reason for
      * failure.
@@ -194,9 +807,10 @@ typedef struct test_t {
  * Creates a new test function. Not to be called explicitly.
  * @private
  *
+ * @param name - the name of the test, which is borrowed, not copied
  * @return A pointer to a fully initialized `test_t` structure.
  **/
-test_t* tdd_test_new();
+test_t* tdd_test_new(const char* name);
 
 /**
  * Frees all memory associated with a `test_t` structure.  Not to be called
@@ -267,108 +881,1262 @@ void* test_timer_start(test_t* t);
 void* test_timer_end(test_t* t);
 
 /**
- * Test runner. Simple container with metadata about a testcase function.
+ * Opens a named span inside a test. Spans may be nested, and may be
+ * recorded from any thread the test starts, as long as the thread has
+ * finished by the time the test returns.
+ *
+ * Spans are written to a buffer owned by the calling thread without taking
+ * any locks, so they are cheap enough to leave in hot paths. Once the test
+ * has finished, the time spent in each span is aggregated by name into
+ * `test_t::spans`.
+ *
+ * @param t    - the running test
+ * @param name - the name of the span; must outlive the test
  **/
-typedef struct runner_t {
-    /**
-     * A character string identifier for a test.
-     *
-     * It is usually just the name of the unit itself under test. e.g.  if you
-     * are testing a function called `foo`, then this runner_t::name should be
-     * `test_foo` by convention.
-     */
-    char* name;
-    /**
-     * Is a character string description for a test.
-     *
-     * It should be a humanly readable explanation of what the test is
-     * performing. Optional field in constructor.
-     */
-    char* desc;
-    /**
-     * A pointer to a test function.
-     *
-     * @param t - pointer to a `test_t` structure to capture context of test
-     *		      results
-     */
-    void* (*fn)(void* t);
-} runner_t;
+void test_span_begin(test_t* t, const char* name);
 
 /**
- * Creates and initializes a runner_t.
+ * Closes the span most recently opened on the calling thread.
  *
- * @param f    - a pointer to a function that records information about a test
- *		         within its single `test_t*` argument
- * @param name - a character string identifier for the test; usually the name
- *		         of the test function itself
- * @param desc - a human readable description of the test; can be `NULL`
- * @return A pointer to a fully initialized runner_t structure.
+ * @param t - the running test
  **/
-runner_t* runner_new(void* (*f)(void* t), char* name, char* desc);
+void test_span_end(test_t* t);
 
 /**
- * Frees memory allocated to a runner. Should not be called manually.
+ * Adds to a named counter inside a test. Like spans, counters are recorded
+ * per thread and aggregated by name into `test_t::spans` once the test has
+ * finished.
  *
- * @private
- * @param tr - a pointer to a `runner_t` that is to be destroyed
- * @return`EXIT_SUCCESS`, otherwise `EXIT_FAILURE` if tf is `NULL`.
+ * @param t    - the running test
+ * @param name - the name of the counter; must outlive the test
+ * @param n    - the amount to add
  **/
-int tdd_runner_del(runner_t* tr);
+void test_counter_add(test_t* t, const char* name, int64_t n);
 
 /**
- * Testing suite. Contains all tests, current runtime state, and the results
- * of each test. May be used to contruct a suite_stats_t after running.
+ * Reports a value of a custom benchmark metric, such as a compression ratio
+ * or a number of rows per second. A test may report any number of values
+ * in any number of units, from any thread it starts; values are aggregated
+ * by unit into `test_t::metrics` once the test has finished, printed by the
+ * reporter, and kept with the suite's results.
+ *
+ * ```
+ * static void* bench_compress(void* t) {
+ *     for (int i = 0; i < n_blocks; i++) {
+ *         size_t out = compress(blocks[i], block_len, buf);
+ *         test_report_metric(t, "ratio", (double)block_len / out);
+ *     }
+ *     return NULL;
+ * }
+ * ```
+ *
+ * @param t     - the running test
+ * @param unit  - the unit of the metric; must outlive the test
+ * @param value - the value
  **/
-typedef struct suite_t {
-    /**
-     * A boolean flag specifying if all tests have run.
-     *
-     * If this flag is not set by the time the suite has completed all tests,
-     * then the suite must have aborted testing with a fatal failure from one
-     * of the tests in the suite.
-     **/
-    bool finished;
-    /** The number of tests in the suite. **/
-    int n_tests;
-    /** The number of segmentation faults that were caught. **/
-    int n_segv;
-    /** The index of the current test in the collection of tests to run. **/
-    int test_index;
-    /** An array of runner_t* that make up the suite. **/
-    runner_t** tests;
-    /**
-     * An array of `test_t*` that details testing results for each element in
-     * tests.
-     **/
-    test_t** results;
-    /**
-     * A FILE pointer which is where the results of the test will
-     * be printed.
-     *
-     * This is stdout by default, but may be changed manually after the suite
-     * is initialized and before it is run.
-     **/
-    FILE* outfile;
-    /**
-     * A boolean flag indicating that results should not be printed
-     * as the test suite runs; reporting can instead be done through creating
-     * a stats structure after the suite finishes.
-     **/
-    bool quiet;
-} suite_t;
+void test_report_metric(test_t* t, const char* unit, double value);
 
 /**
- * Creates and initializes a new test suite. Must be freed by `suite_del()`.
+ * Runs a fuzz target.
  *
- * @return A pointer to a fully intialized `suite_t` structure.
- * @see suite_del
+ * When the test is prefixed by `fuzz_` and `suite_t::fuzz` is enabled, this
+ * runs an in-process, coverage-guided fuzz engine on `suite_t::fuzz_workers`
+ * threads for `suite_t::fuzz_seconds`. Inputs that reach new coverage are
+ * added to the on-disk corpus in `suite_t::fuzz_corpus_dir`, and the first
+ * input that makes the target fail or raise an error is minimized, saved to
+ * the corpus as `crash-<hash>`, and reported as a test failure. An input
+ * on which the target causes a segmentation fault is abandoned and fails.
+ *
+ * Otherwise, each input in the corpus is replayed once as a regression test.
+ *
+ * Coverage feedback is only available for code compiled with
+ * `-fsanitize-coverage=trace-pc-guard` (or `trace-pc` with `gcc`); without
+ * it inputs are mutated blindly. To be called within a `runner_t::fn`.
+ *
+ * @param t  - pointer to a `test_t` structure to capture the context of the
+ *             fuzz target
+ * @param fn - the fuzz target; it is called with a scratch `test_t` and an
+ *             input buffer, and should report problems with `test_error()`
+ *             or `test_fail()` as any other test would
  **/
-suite_t* suite_new();
+void* test_fuzz(test_t* t,
+                void* (*fn)(void* t, const uint8_t* data, size_t len));
 
 /**
- * Resets a `suite_t` to its initial state, as if it were never run.
- *
- * @param s - a pointer to a `suite_t` test suite to be reset
+ * Per-thread state of a parallel benchmark. Passed to the benchmark body on
+ * each thread started by `test_run_parallel()`.
+ **/
+typedef struct tdd_pb_t {
+    /** The test running the benchmark. **/
+    test_t* t;
+    /** The argument passed to `test_run_parallel()`. **/
+    void* arg;
+    /** The index of this thread, from 0. **/
+    int id;
+    /** The number of iterations run by this thread. **/
+    unsigned long ops;
+    /** @private The round this thread is taking part in. **/
+    void* round;
+    /** @private Iterations left in the current grab of the counter. **/
+    long left;
+    /**
+     * @private The monotonic time at which this thread ran out of
+     * iterations, in nanoseconds.
+     **/
+    uint64_t end_ns;
+} tdd_pb_t;
+
+/**
+ * Reports whether a parallel benchmark body should run another iteration.
+ * Threads grab iterations from a shared counter in small batches, so faster
+ * threads run more iterations.
+ *
+ * @param pb - the per-thread state passed to the benchmark body
+ * @return true if there is another iteration to run, false otherwise
+ **/
+bool tdd_pb_next(tdd_pb_t* pb);
+
+/**
+ * Benchmarks a body on several threads at once.
+ *
+ * The body is started on `suite_t::bench_parallelism` threads, each of
+ * which should loop `while (tdd_pb_next(pb))`. All threads are released
+ * from a start gate at once, so thread start-up is not measured. The total
+ * iteration count is grown until a run lasts `suite_t::bench_seconds`; the
+ * aggregate ns/op and each thread's throughput are recorded in
+ * `test_t::parallel` and reported after the test.
+ *
+ * If `suite_t::bench_sweep` is enabled, the benchmark is rerun at 1, 2, 4,
+ * ... threads up to the thread count above, and the throughput, speedup and
+ * parallel efficiency at each count are recorded in `test_t::scaling`.
+ *
+ * To be called within a `runner_t::fn`, usually of a test prefixed by
+ * `bench_`.
+ *
+ * `test_error()` and `test_fail()` are not thread safe and should not be
+ * called from the body.
+ *
+ * @param t    - pointer to a `test_t` structure to capture the results
+ * @param body - the benchmark body, called once on each thread
+ * @param arg  - made available to the body as `tdd_pb_t::arg`
+ **/
+void* test_run_parallel(test_t* t, void (*body)(tdd_pb_t* pb), void* arg);
+
+/**
+ * Benchmarks an operation under open-loop load.
+ *
+ * A scheduler thread issues the operation at a fixed target rate for
+ * `suite_t::bench_seconds` at each rate in `suite_t::bench_rates`. If no
+ * rates are set, the peak closed-loop throughput of the operation is
+ * measured first and it is offered 25%, 50%, 75% and 90% of that.
+ *
+ * Latency is measured from each operation's intended start time rather
+ * than its actual start time, which corrects for coordinated omission: an
+ * operation that runs long delays the ones scheduled after it, and that
+ * delay shows up in their latency as it would for real clients. Latency
+ * percentiles at each load are recorded in `test_t::load` and reported
+ * after the test. A load that the operation cannot keep up with still
+ * stops after `suite_t::bench_seconds`; the operations left unissued are
+ * counted in `tdd_load_point_t::dropped`. To be called within a
+ * `runner_t::fn`, usually of a test prefixed by `bench_`.
+ *
+ * @param t   - pointer to a `test_t` structure to capture the results
+ * @param op  - the operation to issue
+ * @param arg - passed through to op
+ **/
+void* test_run_open_loop(test_t* t, void (*op)(void* arg), void* arg);
+
+/**
+ * Allocates an input buffer for a benchmark, with control over where its
+ * memory comes from. The buffer is mapped on its own, backed by the page
+ * size asked for, bound to a NUMA node if one is given, and faulted in
+ * before it is returned, so page faults are not timed. It is zeroed, and
+ * unmapped when the test is deleted.
+ *
+ * Huge pages are transparent huge pages, asked for with `madvise()`; the
+ * buffer is aligned to them, but the kernel may still back it with base
+ * pages if it has no huge pages free. Binding to a node uses the `mbind()`
+ * system call, and so only works on Linux. A placement that cannot be
+ * made is raised as an error, and the buffer is returned anyway.
+ *
+ * @param t     - the running test
+ * @param len   - the size of the buffer in bytes
+ * @param pages - the page size to back the buffer with
+ * @param node  - the NUMA node to allocate the buffer on, or -1 for the
+ *                node of the thread that first touches it
+ * @return the buffer, or `NULL` if it could not be mapped
+ **/
+void* test_bench_alloc(test_t* t, size_t len, tdd_pages_t pages, int node);
+
+/**
+ * Puts the caches in the state given by `test_t::cache_mode`, then restarts
+ * the test's timer, so that setting up the input is not timed.
+ *
+ * Benchmarks are prepared this way before each timed run when
+ * `suite_t::bench_cache` is set; a benchmark that allocates its buffers as
+ * it runs should call this once they are filled:
+ * ```
+ * static void* bench_sum(void* t) {
+ *     size_t    n   = 1 << 24;
+ *     uint64_t* buf = test_bench_alloc(t, n * 8, TDD_PAGES_HUGE, -1);
+ *     fill(buf, n);
+ *     test_cache_prepare(t);
+ *     sum(buf, n);
+ *     return NULL;
+ * }
+ * ```
+ *
+ * @param t - the running test
+ **/
+void test_cache_prepare(test_t* t);
+
+/**
+ * Returns a directory private to the test, for the files it creates. The
+ * directory is made in `$TMPDIR`, or `/tmp`, the first time it is asked
+ * for, and is removed with everything in it when the test is deleted.
+ *
+ * @param t - the running test
+ * @return the path of the directory, valid until the test is deleted, or
+ *         `NULL` if it could not be made
+ **/
+const char* test_tempdir(test_t* t);
+
+/**
+ * Creates a fixture file for an I/O benchmark in the test's temporary
+ * directory. The file holds len pseudo-random bytes, so that compressing
+ * or deduplicating file systems store all of it, and is synced to disk
+ * before it is returned.
+ *
+ * Fixture files take part in `test_cache_prepare()`: cold caches drop
+ * them from the page cache with `posix_fadvise(POSIX_FADV_DONTNEED)`, so
+ * reads go to the device, and warm caches read them in, so reads are page
+ * cache hits. Reads of fixtures by a cold benchmark should be reported with
+ * `test_report_io()`:
+ * ```
+ * static void* bench_read(void* t) {
+ *     const char* path = test_bench_file(t, "data", 64 << 20);
+ *     test_cache_prepare(t);
+ *     int fd = open(path, O_RDONLY);
+ *     while ((n = read(fd, buf, sizeof(buf))) > 0) {
+ *         test_report_io(t, n, 1);
+ *     }
+ *     close(fd);
+ *     return NULL;
+ * }
+ * ```
+ *
+ * @param t    - the running test
+ * @param name - the name of the file within the temporary directory
+ * @param len  - the size of the file in bytes
+ * @return the path of the file, valid until the test is deleted, or `NULL`
+ *         if it could not be created, which is raised as an error
+ **/
+const char* test_bench_file(test_t* t, const char* name, size_t len);
+
+/**
+ * Reports I/O done in the timed region of a benchmark. When the timed run
+ * ends, the throughput in MB/s and the operations per second are reported
+ * as custom metrics, in the units `MB/s` and `IOPS`, suffixed by ` cold` or
+ * ` warm` when the run was timed with `suite_t::bench_cache` set. May be
+ * called from any thread the test starts.
+ *
+ * @param t     - the running test
+ * @param bytes - the number of bytes read or written
+ * @param ops   - the number of I/O operations they took
+ **/
+void test_report_io(test_t* t, int64_t bytes, int64_t ops);
+
+/**
+ * Reads the test's virtual clock. Virtual time starts at the monotonic
+ * time at which the clock is first used, and only moves when the threads
+ * on the clock sleep: once every one of them is asleep, it jumps straight
+ * to the earliest time one of them sleeps until. Tests that wait out
+ * timeouts and retry backoffs this way take no real time, and always see
+ * the same times.
+ *
+ * The clock has one thread on it to begin with, the test thread; threads
+ * started with `test_thread_create()` join it. A thread on the clock that
+ * blocks on anything but the clock, or `test_thread_join()`, holds time
+ * still.
+ *
+ * @param t - the running test
+ * @return the virtual monotonic time in nanoseconds
+ **/
+int64_t test_clock_now(test_t* t);
+
+/**
+ * Sleeps on the test's virtual clock until it has advanced by ns.
+ *
+ * @param t  - the running test
+ * @param ns - the number of nanoseconds to sleep for
+ * @see test_clock_now
+ **/
+void test_sleep(test_t* t, int64_t ns);
+
+/**
+ * Starts a thread on the test's virtual clock, as `pthread_create()` does.
+ * The clock does not advance while the thread runs, and when
+ * `suite_t::virtual_clock` is set, the thread's calls to the interposed
+ * time functions use the clock too. The thread leaves the clock when fn
+ * returns, and must be joined before the test returns.
+ *
+ * @param t      - the running test
+ * @param thread - set to the new thread
+ * @param fn     - the function the thread runs
+ * @param arg    - passed to fn
+ * @return 0 if the thread was started, or an error number otherwise
+ * @see test_clock_now
+ **/
+int test_thread_create(test_t* t, pthread_t* thread, void* (*fn)(void* arg),
+                       void* arg);
+
+/**
+ * Waits for a thread to finish, as `pthread_join()` does, letting the
+ * test's virtual clock advance while the caller waits.
+ *
+ * @param t      - the running test
+ * @param thread - the thread to wait for
+ * @param ret    - set to the return value of the thread, if not `NULL`
+ * @return 0 if the thread was joined, or an error number otherwise
+ * @see test_thread_create
+ **/
+int test_thread_join(test_t* t, pthread_t thread, void** ret);
+
+/**
+ * What a step of an async test returns.
+ *
+ * @see runner_new_async
+ **/
+typedef enum tdd_async_t {
+    /** The test has finished. **/
+    TDD_ASYNC_DONE = 0,
+    /**
+     * The test is waiting on what it awaited with `test_await_fd()` and
+     * `test_await_timer()` during the step, or, if it awaited nothing, is
+     * yielding to the other tests on the loop.
+     **/
+    TDD_ASYNC_WAIT,
+} tdd_async_t;
+
+/**
+ * Makes the next step of an async test wait for a descriptor to be ready.
+ * The step is resumed once, with `test_t::async_events` set, when any of
+ * events is; a step may await one descriptor, and descriptors may not be
+ * awaited by two tests at once. To be called within a step, which then
+ * returns `TDD_ASYNC_WAIT`.
+ *
+ * @param t      - the running async test
+ * @param fd     - the descriptor to wait for
+ * @param events - the `poll()` events to wait for, such as `POLLIN`
+ * @return `EXIT_SUCCESS`, otherwise `EXIT_FAILURE` if t is not an async
+ *         test or the descriptor cannot be waited for, with errno set.
+ * @see runner_new_async
+ **/
+int test_await_fd(test_t* t, int fd, short events);
+
+/**
+ * Makes the next step of an async test wait until ns have passed. Together
+ * with `test_await_fd()`, this is a timeout: the step is resumed by
+ * whichever comes first, with `test_t::async_events` 0 on a timeout. To be
+ * called within a step, which then returns `TDD_ASYNC_WAIT`.
+ *
+ * @param t  - the running async test
+ * @param ns - the number of nanoseconds to wait for
+ * @return `EXIT_SUCCESS`, otherwise `EXIT_FAILURE` if t is not an async
+ *         test.
+ * @see runner_new_async
+ **/
+int test_await_timer(test_t* t, int64_t ns);
+
+/**
+ * Reproducible pseudo-random number generator used to generate values for
+ * property tests.
+ **/
+typedef struct tdd_rng_t {
+    /** The generator state. **/
+    uint64_t s;
+} tdd_rng_t;
+
+/**
+ * Seeds a `tdd_rng_t`. Generators seeded with the same value produce the
+ * same sequence of numbers.
+ *
+ * @param rng  - the generator to seed
+ * @param seed - the seed
+ **/
+void tdd_rng_seed(tdd_rng_t* rng, uint64_t seed);
+
+/**
+ * Returns the next 64 random bits from a `tdd_rng_t`.
+ *
+ * @param rng - the generator to draw from
+ * @return a uniformly distributed 64-bit integer
+ **/
+uint64_t tdd_rng_next(tdd_rng_t* rng);
+
+/**
+ * A variable length value. Values produced by `tdd_gen_bytes()` and
+ * `tdd_gen_array()` are `tdd_vec_t`s whose data holds `len` consecutive
+ * element values.
+ **/
+typedef struct tdd_vec_t {
+    /** The number of elements. **/
+    size_t len;
+    /** The elements. Heap allocated. **/
+    void* data;
+} tdd_vec_t;
+
+/**
+ * Value generator for property tests. Generators are composable; use the
+ * `tdd_gen_*()` constructors rather than initializing one yourself, unless
+ * you need a custom generator.
+ **/
+typedef struct tdd_gen_t {
+    /** The size in bytes of a value produced by this generator. **/
+    size_t size;
+    /** Writes a random value to out. **/
+    void (*generate)(const struct tdd_gen_t* g, tdd_rng_t* rng, void* out);
+    /**
+     * Writes the k-th simpler candidate for val to out, in order of
+     * preference. Returns false when there are no more candidates. May be
+     * `NULL` if values of this generator cannot be shrunk.
+     **/
+    bool (*shrink)(const struct tdd_gen_t* g, const void* val, int k,
+                   void* out);
+    /** Formats val into buf with the semantics of `snprintf()`. **/
+    int (*format)(const struct tdd_gen_t* g, const void* val, char* buf,
+                  size_t n);
+    /** Deep copies a value; `NULL` if values are plain data. **/
+    void (*copy)(const struct tdd_gen_t* g, void* dst, const void* src);
+    /** Frees memory owned by a value; `NULL` if values are plain data. **/
+    void (*release)(const struct tdd_gen_t* g, void* val);
+    /** Inclusive bounds of `tdd_gen_int()` values. **/
+    int64_t lo, hi;
+    /** Inclusive bounds of `tdd_gen_double()` values. **/
+    double flo, fhi;
+    /** The maximum length of `tdd_gen_array()` values. **/
+    size_t max_len;
+    /** The element generator of `tdd_gen_array()`. **/
+    struct tdd_gen_t* elem;
+    /** The member generators of `tdd_gen_tuple()`. **/
+    struct tdd_gen_t** members;
+    /** The number of member generators of `tdd_gen_tuple()`. **/
+    int n_members;
+} tdd_gen_t;
+
+/**
+ * Creates a generator of `int64_t` values in [lo, hi], biased towards the
+ * bounds and zero. Shrinks towards zero (or the bound closest to it).
+ *
+ * @param lo - the smallest value to generate
+ * @param hi - the largest value to generate
+ * @return A pointer to a new generator, or `NULL` if `lo > hi`.
+ **/
+tdd_gen_t* tdd_gen_int(int64_t lo, int64_t hi);
+
+/**
+ * Creates a generator of `double` values in [lo, hi], biased towards the
+ * bounds and zero. Shrinks towards zero and towards whole numbers.
+ *
+ * @param lo - the smallest value to generate
+ * @param hi - the largest value to generate
+ * @return A pointer to a new generator, or `NULL` if `lo > hi`.
+ **/
+tdd_gen_t* tdd_gen_double(double lo, double hi);
+
+/**
+ * Creates a generator of byte buffers. Values are `tdd_vec_t`s of up to
+ * max_len `uint8_t`s.
+ *
+ * @param max_len - the maximum length of a buffer
+ * @return A pointer to a new generator.
+ **/
+tdd_gen_t* tdd_gen_bytes(size_t max_len);
+
+/**
+ * Creates a generator of arrays. Values are `tdd_vec_t`s of up to max_len
+ * values of elem. Shrinks by removing elements, then by shrinking them.
+ *
+ * @param elem    - the element generator; owned by the new generator
+ * @param max_len - the maximum length of an array
+ * @return A pointer to a new generator.
+ **/
+tdd_gen_t* tdd_gen_array(tdd_gen_t* elem, size_t max_len);
+
+/**
+ * Creates a generator of tuples. Values hold one value of each member
+ * generator in order, each at an offset aligned to 8 bytes, so that a
+ * tuple of an int and a double may be read as
+ * `struct { int64_t i; double d; }`.
+ *
+ * @param n   - the number of member generators that follow
+ * @param ... - exactly n `tdd_gen_t*`; owned by the new generator
+ * @return A pointer to a new generator.
+ **/
+tdd_gen_t* tdd_gen_tuple(int n, ...);
+
+/**
+ * Frees a generator and all generators it is composed of.
+ *
+ * @param g - the generator to free
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+ **/
+int tdd_gen_del(tdd_gen_t* g);
+
+/**
+ * Checks that a property holds for values produced by a generator.
+ *
+ * `suite_t::prop_cases` values are generated in batches of
+ * `suite_t::prop_batch` and checked on `suite_t::prop_threads` threads.
+ * Case generation is reproducible: every case is derived from
+ * `suite_t::prop_seed` and its index alone. The first failing case is
+ * shrunk to a minimal counterexample, and the test is failed with the seed
+ * and the minimized value in `test_t::fail_msg`. To be called within a
+ * `runner_t::fn`.
+ *
+ * @param t    - pointer to a `test_t` structure to capture the context of a
+ *               property failure
+ * @param g    - the generator of values to check
+ * @param prop - returns true if the property holds for value; must be
+ *               thread safe if `suite_t::prop_threads` is not 1
+ * @param ctx  - passed through to prop
+ **/
+void* test_property(test_t* t, tdd_gen_t* g,
+                    bool (*prop)(const void* value, void* ctx), void* ctx);
+
+/**
+ * Test runner. Simple container with metadata about a testcase function.
+ **/
+typedef struct runner_t {
+    /**
+     * A character string identifier for a test.
+     *
+     * It is usually just the name of the unit itself under test. e.g.  if you
+     * are testing a function called `foo`, then this runner_t::name should be
+     * `test_foo` by convention.
+     */
+    char* name;
+    /**
+     * Is a character string description for a test.
+     *
+     * It should be a humanly readable explanation of what the test is
+     * performing. Optional field in constructor.
+     */
+    char* desc;
+    /**
+     * A pointer to a test function.
+     *
+     * @param t - pointer to a `test_t` structure to capture context of test
+     *		      results
+     */
+    void* (*fn)(void* t);
+    /**
+     * A pointer to the step function of an async test, or `NULL` if the
+     * test is not async.
+     *
+     * @see runner_new_async
+     */
+    tdd_async_t (*step)(test_t* t);
+} runner_t;
+
+/**
+ * Creates and initializes a runner_t.
+ *
+ * @param f    - a pointer to a function that records information about a test
+ *		         within its single `test_t*` argument
+ * @param name - a character string identifier for the test; usually the name
+ *		         of the test function itself
+ * @param desc - a human readable description of the test; can be `NULL`
+ * @return A pointer to a fully initialized runner_t structure.
+ **/
+runner_t* runner_new(void* (*f)(void* t), char* name, char* desc);
+
+/**
+ * Creates and initializes a runner_t for an async test. Instead of running
+ * on a thread of its own, an async test is a state machine whose step is
+ * called again each time what it awaited is ready. Runs of consecutive
+ * async tests in a suite share one thread and one event loop, up to
+ * `suite_t::async_max` at a time, and each records its results into its
+ * own `test_t`.
+ *
+ * Steps must not block. A step fails its test with `test_fail()` and then
+ * returns `TDD_ASYNC_DONE`, rather than with `test_fatal()`.
+ *
+ * @param step - the step function; returns `TDD_ASYNC_DONE` once the test
+ *               has finished, and `TDD_ASYNC_WAIT` otherwise
+ * @param name - a character string identifier for the test
+ * @param desc - a human readable description of the test; can be `NULL`
+ * @return A pointer to a fully initialized runner_t structure.
+ * @see test_await_fd
+ * @see test_await_timer
+ **/
+runner_t* runner_new_async(tdd_async_t (*step)(test_t* t), char* name,
+                           char* desc);
+
+/**
+ * Frees memory allocated to a runner. Should not be called manually.
+ *
+ * @private
+ * @param tr - a pointer to a `runner_t` that is to be destroyed
+ * @return`EXIT_SUCCESS`, otherwise `EXIT_FAILURE` if tf is `NULL`.
+ **/
+int tdd_runner_del(runner_t* tr);
+
+/**
+ * Status flags of a test in a `tdd_results_t`. A test that passed has no
+ * flags set.
+ **/
+typedef enum tdd_status_t {
+    TDD_STATUS_OK     = 0,
+    TDD_STATUS_ERROR  = 1 << 0,
+    TDD_STATUS_FAILED = 1 << 1,
+    TDD_STATUS_SEGV   = 1 << 2,
+} tdd_status_t;
+
+/** Marks an absent string in a `tdd_results_t` string table. **/
+#define TDD_NO_STRING UINT32_MAX
+
+/**
+ * A span or counter in a `tdd_results_t`; use `tdd_results_span()` to read
+ * one as a `tdd_span_stats_t`.
+ **/
+typedef struct tdd_results_span_t {
+    /** The offset of the name in the string table. **/
+    uint32_t name;
+    /** Whether this is a counter rather than a span. **/
+    bool counter;
+    /** See `tdd_span_stats_t::count`. **/
+    long count;
+    /** See `tdd_span_stats_t::total`. **/
+    int64_t total;
+    /** See `tdd_span_stats_t::max`. **/
+    int64_t max;
+} tdd_results_span_t;
+
+/**
+ * A custom metric in a `tdd_results_t`; use `tdd_results_metric()` to read
+ * one as a `tdd_metric_t`.
+ **/
+typedef struct tdd_results_metric_t {
+    /** The offset of the unit in the string table. **/
+    uint32_t unit;
+    /** See `tdd_metric_t::count`. **/
+    long count;
+    /** See `tdd_metric_t::sum`. **/
+    double sum;
+    /** See `tdd_metric_t::min`. **/
+    double min;
+    /** See `tdd_metric_t::max`. **/
+    double max;
+} tdd_results_metric_t;
+
+/**
+ * A lock call site in a `tdd_results_t`; use `tdd_results_lock()` to read
+ * one as a `tdd_lock_stats_t`.
+ **/
+typedef struct tdd_results_lock_t {
+    /** The offset of the call site in the string table. **/
+    uint32_t site;
+    /** See `tdd_lock_stats_t::kind`. **/
+    tdd_lock_kind_t kind;
+    /** See `tdd_lock_stats_t::count`. **/
+    long count;
+    /** See `tdd_lock_stats_t::contended`. **/
+    long contended;
+    /** See `tdd_lock_stats_t::wait_ns`. **/
+    int64_t wait_ns;
+    /** See `tdd_lock_stats_t::max_wait_ns`. **/
+    int64_t max_wait_ns;
+    /** See `tdd_lock_stats_t::hold_ns`. **/
+    int64_t hold_ns;
+    /** See `tdd_lock_stats_t::max_hold_ns`. **/
+    int64_t max_hold_ns;
+} tdd_results_lock_t;
+
+/**
+ * The results of the tests that ran in a suite, stored as parallel arrays
+ * with one row per test in the order the tests ran. Strings are kept in a
+ * single table and referred to by offset; use the `tdd_results_*()`
+ * accessors to read them.
+ *
+ * Keeping each field contiguous makes aggregate queries a linear scan over
+ * one or two arrays.
+ **/
+typedef struct tdd_results_t {
+    /** The number of rows. **/
+    int n;
+    /** The number of rows allocated. **/
+    int cap;
+    /** The `tdd_status_t` flags of each test. **/
+    uint8_t* status;
+    /** The number of errors each test encountered. **/
+    int32_t* n_err;
+    /**
+     * When each test started running, in nanoseconds. Recorded for every
+     * test, not only benchmarks; the timed region of a benchmark is
+     * reported with the test.
+     **/
+    int64_t* start_ns;
+    /** When each test finished running, in nanoseconds. **/
+    int64_t* end_ns;
+    /** The ns/op of each parallel benchmark; 0 for other tests. **/
+    double* ns_per_op;
+    /** The ops/s of each parallel benchmark; 0 for other tests. **/
+    double* ops_per_sec;
+    /** The offset of each test's name in `strings`. **/
+    uint32_t* name;
+    /** The offset of each failure message, or `TDD_NO_STRING`. **/
+    uint32_t* fail_msg;
+    /**
+     * The offset of each test's first error message, or `TDD_NO_STRING`.
+     * The `n_err` messages of a test are stored one after the other.
+     **/
+    uint32_t* err_msg;
+    /** The offset of each thread-scaling curve in `points`. **/
+    uint32_t* scaling;
+    /** The number of points in each thread-scaling curve. **/
+    int32_t* n_scaling;
+    /** The offset of each test's spans and counters in `span_pool`. **/
+    uint32_t* spans;
+    /** The number of spans and counters each test recorded. **/
+    int32_t* n_spans;
+    /** The user CPU time of each test, in nanoseconds. **/
+    int64_t* user_ns;
+    /** The system CPU time of each test, in nanoseconds. **/
+    int64_t* sys_ns;
+    /** The minor page faults of each test. **/
+    int32_t* minflt;
+    /** The major page faults of each test. **/
+    int32_t* majflt;
+    /** The voluntary context switches of each test. **/
+    int32_t* nvcsw;
+    /** The involuntary context switches of each test. **/
+    int32_t* nivcsw;
+    /** The bytes each test read through system calls. **/
+    int64_t* io_read;
+    /** The bytes each test wrote through system calls. **/
+    int64_t* io_write;
+    /** The peak resident set size of the process after each test, in KiB. **/
+    int32_t* max_rss_kb;
+    /** The offset of each test's custom metrics in `metric_pool`. **/
+    uint32_t* metrics;
+    /** The number of custom metrics each test reported. **/
+    int32_t* n_metrics;
+    /** The offset of each test's lock call sites in `lock_pool`. **/
+    uint32_t* locks;
+    /** The number of lock call sites seen in each test. **/
+    int32_t* n_locks;
+    /**
+     * The offset of each test's benchmark environment in `env_pool`, or -1
+     * if it was not recorded.
+     **/
+    int32_t* env;
+    /**
+     * The offset of each test's repeated timings in `samples_pool`, or -1
+     * if it was not sampled.
+     **/
+    int32_t* samples;
+    /**
+     * The offset of each test's cold and warm timings in `cache_pool`, or
+     * -1 if they were not taken.
+     **/
+    int32_t* cache;
+    /** The string table; NUL separated. **/
+    char* strings;
+    /** The number of bytes used in the string table. **/
+    size_t strings_len;
+    /** The number of bytes allocated for the string table. **/
+    size_t strings_cap;
+    /** The points of every thread-scaling curve. **/
+    tdd_scaling_point_t* points;
+    /** The number of points used. **/
+    size_t points_len;
+    /** The number of points allocated. **/
+    size_t points_cap;
+    /** The spans and counters of every test. **/
+    tdd_results_span_t* span_pool;
+    /** The number of spans used. **/
+    size_t span_pool_len;
+    /** The number of spans allocated. **/
+    size_t span_pool_cap;
+    /** The custom metrics of every test. **/
+    tdd_results_metric_t* metric_pool;
+    /** The number of metrics used. **/
+    size_t metric_pool_len;
+    /** The number of metrics allocated. **/
+    size_t metric_pool_cap;
+    /** The lock call sites of every test. **/
+    tdd_results_lock_t* lock_pool;
+    /** The number of lock call sites used. **/
+    size_t lock_pool_len;
+    /** The number of lock call sites allocated. **/
+    size_t lock_pool_cap;
+    /** The benchmark environments of every test that recorded one. **/
+    tdd_bench_env_t* env_pool;
+    /** The number of benchmark environments used. **/
+    size_t env_pool_len;
+    /** The number of benchmark environments allocated. **/
+    size_t env_pool_cap;
+    /** The repeated timings of every benchmark that was sampled. **/
+    tdd_samples_t* samples_pool;
+    /** The number of repeated timings used. **/
+    size_t samples_pool_len;
+    /** The number of repeated timings allocated. **/
+    size_t samples_pool_cap;
+    /** The cold and warm timings of every benchmark that took them. **/
+    tdd_cache_t* cache_pool;
+    /** The number of cold and warm timings used. **/
+    size_t cache_pool_len;
+    /** The number of cold and warm timings allocated. **/
+    size_t cache_pool_cap;
+    /** The number of tests that failed. **/
+    int n_fail;
+    /** The number of tests that encountered errors. **/
+    int n_error;
+} tdd_results_t;
+
+/**
+ * Returns the name of a test.
+ *
+ * @param r - the results
+ * @param i - the row of the test
+ * @return the name of the test
+ **/
+const char* tdd_results_name(const tdd_results_t* r, int i);
+
+/**
+ * Returns whether a test passed.
+ *
+ * @param r - the results
+ * @param i - the row of the test
+ * @return true if the test did not fail
+ **/
+bool tdd_results_ok(const tdd_results_t* r, int i);
+
+/**
+ * Returns the failure message of a test.
+ *
+ * @param r - the results
+ * @param i - the row of the test
+ * @return the failure message, or `NULL` if the test did not fail
+ **/
+const char* tdd_results_fail_msg(const tdd_results_t* r, int i);
+
+/**
+ * Returns an error message of a test.
+ *
+ * @param r - the results
+ * @param i - the row of the test
+ * @param j - the error, from 0 to `r->n_err[i] - 1`
+ * @return the error message, or `NULL` if there is no such error
+ **/
+const char* tdd_results_error(const tdd_results_t* r, int i, int j);
+
+/**
+ * Returns how long a test ran for.
+ *
+ * @param r - the results
+ * @param i - the row of the test
+ * @return the duration in nanoseconds
+ **/
+int64_t tdd_results_elapsed(const tdd_results_t* r, int i);
+
+/**
+ * Returns the thread-scaling curve of a test.
+ *
+ * @param r        - the results
+ * @param i        - the row of the test
+ * @param n_points - set to the number of points on the curve
+ * @return the points of the curve, or `NULL` if the test did not sweep a
+ *         parallel benchmark
+ **/
+const tdd_scaling_point_t* tdd_results_scaling(const tdd_results_t* r, int i,
+                                               int* n_points);
+
+/**
+ * Reads a span or counter recorded by a test.
+ *
+ * @param r    - the results
+ * @param i    - the row of the test
+ * @param j    - the span, from 0 to `r->n_spans[i] - 1`
+ * @param span - set to the span; its name points into the results and is
+ *               valid until they change
+ * @return true if the span exists
+ **/
+bool tdd_results_span(const tdd_results_t* r, int i, int j,
+                      tdd_span_stats_t* span);
+
+/**
+ * Reads a custom metric reported by a test.
+ *
+ * @param r      - the results
+ * @param i      - the row of the test
+ * @param j      - the metric, from 0 to `r->n_metrics[i] - 1`
+ * @param metric - set to the metric; its unit points into the results and
+ *                 is valid until they change
+ * @return true if the metric exists
+ **/
+bool tdd_results_metric(const tdd_results_t* r, int i, int j,
+                        tdd_metric_t* metric);
+
+/**
+ * Reads a lock call site seen while a test ran.
+ *
+ * @param r    - the results
+ * @param i    - the row of the test
+ * @param j    - the call site, from 0 to `r->n_locks[i] - 1`; sites are
+ *               ordered by time spent waiting, most first
+ * @param lock - set to the call site; its name points into the results and
+ *               is valid until they change
+ * @return true if the call site exists
+ **/
+bool tdd_results_lock(const tdd_results_t* r, int i, int j,
+                      tdd_lock_stats_t* lock);
+
+/**
+ * Reads the environment a benchmark ran in.
+ *
+ * @param r   - the results
+ * @param i   - the row of the test
+ * @param env - set to the environment of the benchmark
+ * @return true if the test recorded its environment
+ **/
+bool tdd_results_bench_env(const tdd_results_t* r, int i,
+                           tdd_bench_env_t* env);
+
+/**
+ * Reads the repeated timings of a benchmark.
+ *
+ * @param r       - the results
+ * @param i       - the row of the test
+ * @param samples - set to the timings of the benchmark
+ * @return true if the benchmark was sampled
+ **/
+bool tdd_results_samples(const tdd_results_t* r, int i,
+                         tdd_samples_t* samples);
+
+/**
+ * Reads the timings of a benchmark with cold and with warm caches.
+ *
+ * @param r     - the results
+ * @param i     - the row of the test
+ * @param cache - set to the timings of the benchmark
+ * @return true if the benchmark was timed in both states
+ **/
+bool tdd_results_cache(const tdd_results_t* r, int i, tdd_cache_t* cache);
+
+/**
+ * Reads the resource usage of a test.
+ *
+ * @param r     - the results
+ * @param i     - the row of the test
+ * @param usage - set to the resource usage of the test
+ * @return true if the row exists
+ **/
+bool tdd_results_rusage(const tdd_results_t* r, int i, tdd_rusage_t* usage);
+
+/**
+ * Finds the tests that used the most CPU time.
+ *
+ * @param r    - the results
+ * @param n    - the number of tests to find
+ * @param rows - set to the rows of the most expensive tests, most expensive
+ *               first; must have room for n entries
+ * @return the number of rows set, at most n
+ **/
+int tdd_results_costliest(const tdd_results_t* r, int n, int* rows);
+
+/**
+ * Counts the tests that failed.
+ *
+ * @param r - the results
+ * @return the number of failed tests
+ **/
+int tdd_results_failed(const tdd_results_t* r);
+
+/**
+ * Sums how long all tests ran for.
+ *
+ * @param r - the results
+ * @return the total duration in nanoseconds
+ **/
+int64_t tdd_results_total_ns(const tdd_results_t* r);
+
+/**
+ * Finds the tests that ran for longest.
+ *
+ * @param r    - the results
+ * @param n    - the number of tests to find
+ * @param rows - set to the rows of the slowest tests, slowest first; must
+ *               have room for n entries
+ * @return the number of rows set, at most n
+ **/
+int tdd_results_slowest(const tdd_results_t* r, int n, int* rows);
+
+/**
+ * Stats structure detailing results of test suite.
+ **/
+typedef struct suite_stats_t {
+    /** The results of the tests that ran in the suite. **/
+    const tdd_results_t* results;
+    /** The total number of tests in the suite. **/
+    int n_tests;
+    /** The total number of errors in the suite. **/
+    int n_error;
+    /** The total number of failures in the suite. **/
+    int n_fail;
+    /**
+     * The total number of tests that ran in the suite. If this count differs
+     * from `n_tests`, then some tests were skipped.
+     **/
+    int n_ran;
+    /** The percent rate of successful tests in the suite. **/
+    double success_rate;
+    /** Indicates that the suite ran with fatal failures enabled. **/
+    bool fatal_failures;
+    /**
+     * Indicates that the stats own their results, which are freed by
+     * `suite_stats_del()`.
+     * @private
+     **/
+    bool owned;
+} suite_stats_t;
+
+/**
+ * Testing suite. Contains all tests, current runtime state, and the results
+ * of each test. May be used to contruct a suite_stats_t after running.
+ **/
+typedef struct suite_t {
+    /**
+     * A boolean flag specifying if all tests have run.
+     *
+     * If this flag is not set by the time the suite has completed all tests,
+     * then the suite must have aborted testing with a fatal failure from one
+     * of the tests in the suite.
+     **/
+    bool finished;
+    /** The number of tests in the suite. **/
+    int n_tests;
+    /** The number of segmentation faults that were caught. **/
+    int n_segv;
+    /** The index of the current test in the collection of tests to run. **/
+    int test_index;
+    /** An array of runner_t* that make up the suite. **/
+    runner_t** tests;
+    /**
+     * The results of each test that has run, in the order they ran. A
+     * test's `test_t` is folded into this store and freed once the test has
+     * been reported.
+     **/
+    tdd_results_t results;
+    /**
+     * The view returned by `suite_get_stats()`.
+     * @private
+     **/
+    suite_stats_t stats;
+    /**
+     * A FILE pointer which is where the results of the test will
+     * be printed.
+     *
+     * This is stdout by default, but may be changed manually after the suite
+     * is initialized and before it is run.
+     **/
+    FILE* outfile;
+    /**
+     * A boolean flag indicating that results should not be printed
+     * as the test suite runs; reporting can instead be done through creating
+     * a stats structure after the suite finishes.
+     **/
+    bool quiet;
+    /**
+     * A boolean flag that enables the fuzz engine for tests prefixed by
+     * `fuzz_`. When disabled, fuzz targets only replay their corpus.
+     **/
+    bool fuzz;
+    /** The number of seconds to fuzz each `fuzz_` test for. **/
+    int fuzz_seconds;
+    /**
+     * The number of fuzzing worker threads. If 0, one worker is started per
+     * online CPU.
+     **/
+    int fuzz_workers;
+    /** The maximum length of an input generated by the fuzz engine. **/
+    size_t fuzz_max_len;
+    /**
+     * The directory under which each fuzz target keeps its corpus in a
+     * subdirectory named after the test. Defaults to `testdata/fuzz`.
+     **/
+    char* fuzz_corpus_dir;
+    /** The number of cases `test_property()` checks. **/
+    long prop_cases;
+    /**
+     * The seed for `test_property()`. If 0, a new seed is chosen for every
+     * property and reported on failure, so that it can be set here to
+     * reproduce the failure.
+     **/
+    uint64_t prop_seed;
+    /**
+     * The number of threads `test_property()` checks cases on. If 0, one
+     * thread is started per online CPU.
+     **/
+    int prop_threads;
+    /** The number of cases generated at once by each thread. **/
+    long prop_batch;
+    /**
+     * The number of threads `test_run_parallel()` runs a benchmark on. If 0,
+     * one thread is started per CPU in the process affinity mask.
+     **/
+    int bench_parallelism;
+    /**
+     * A boolean flag that makes `test_run_parallel()` sweep the thread count
+     * from 1 to `suite_t::bench_parallelism` in powers of two, recording a
+     * thread-scaling curve.
+     **/
+    bool bench_sweep;
+    /**
+     * A boolean flag that runs benchmarks in a controlled environment. The
+     * process memory is locked with `mlockall()` so the timed run does not
+     * page fault, and the CPU frequency governor, turbo boost, SMT siblings
+     * and system load are checked. Problems are reported as warnings, and
+     * everything is recorded in `test_t::env`.
+     **/
+    bool bench_env;
+    /**
+     * The CPU to pin benchmark threads to, or -1 to let them run anywhere.
+     * Only used when `suite_t::bench_env` is set.
+     **/
+    int bench_cpu;
+    /**
+     * A boolean flag that runs benchmark threads with `SCHED_FIFO` priority,
+     * if the process is permitted to. Only used when `suite_t::bench_env`
+     * is set.
+     **/
+    bool bench_realtime;
+    /**
+     * The number of times each benchmark is run, untimed, on the benchmark
+     * thread before the timed run, to warm caches and branch predictors.
+     **/
+    int bench_warmup;
+    /**
+     * The target half-width of the 95% confidence interval of a benchmark's
+     * median time, as a fraction of the median, e.g. 0.01 for ±1%. When
+     * set, each benchmark is run repeatedly, and timed each time, until its
+     * median is known that precisely or `suite_t::bench_budget` runs out.
+     * The timings are summarised in `test_t::samples`. 0 runs each
+     * benchmark once.
+     **/
+    double bench_ci;
+    /**
+     * The number of seconds a benchmark may be sampled for when
+     * `suite_t::bench_ci` is set.
+     **/
+    double bench_budget;
+    /**
+     * The state the caches are put in before each timed run of a benchmark,
+     * with `test_cache_prepare()`. `TDD_CACHE_BOTH` also times each
+     * benchmark with cold and with warm caches, so both can be reported
+     * from the same benchmark. Defaults to `TDD_CACHE_ANY`, which leaves
+     * the caches alone.
+     **/
+    tdd_cache_mode_t bench_cache;
+    /**
+     * The minimum number of seconds a parallel benchmark runs for, and the
+     * number of seconds an open-loop benchmark runs at each offered load.
+     **/
+    double bench_seconds;
+    /**
+     * The offered loads, in operations per second, at which
+     * `test_run_open_loop()` runs. If `NULL`, loads are derived from the
+     * measured peak throughput.
+     **/
+    double* bench_rates;
+    /** The number of entries in `suite_t::bench_rates`. **/
+    int bench_n_rates;
+    /**
+     * The event log the suite records to, or `NULL` if logging is disabled.
+     * Set with `suite_set_eventlog()`.
+     *
+     * While a log is being written, results are not kept in
+     * `suite_t::results`, so memory use does not grow with the number of
+     * tests.
+     **/
+    struct tdd_eventlog_t* eventlog;
+    /**
+     * The trace the suite exports its timeline to, or `NULL` if tracing is
+     * disabled. Set with `suite_set_trace()`.
+     **/
+    struct tdd_trace_t* trace;
+    /**
+     * The directory that benchmark profiles are written to, or `NULL` if
+     * profiling is disabled. Set with `suite_set_profile()`.
+     **/
+    char* profile_dir;
+    /**
+     * The number of call stack samples a profiled benchmark takes per second
+     * of CPU time on each of its threads. Defaults to 997, which is prime so
+     * that sampling does not fall into step with periodic work. CPU-time
+     * timers expire on scheduler ticks, so on Linux the rate achieved is at
+     * most the kernel's `HZ`.
+     **/
+    int profile_hz;
+    /**
+     * A boolean flag that profiles lock contention: while each test runs,
+     * every `pthread_mutex_lock()`, `pthread_rwlock_rdlock()`,
+     * `pthread_rwlock_wrlock()` and `pthread_cond_wait()` in the process is
+     * timed, and the results are kept per call site in `test_t::locks`.
+     *
+     * The lock functions are only interposed when the library is built with
+     * `-DTDD_LOCKPROF` (the `lock_profiling` Meson option) and the C library
+     * is linked dynamically; otherwise this flag has no effect.
+     **/
+    bool lock_profile;
+    /**
+     * A boolean flag that runs each test on its virtual clock: calls that the
+     * test thread, and threads it starts with `test_thread_create()`, make
+     * to `clock_gettime()`, `nanosleep()`, `clock_nanosleep()`, `usleep()`,
+     * `sleep()` and `poll()` read and sleep on the clock instead of real
+     * time. A `poll()` still returns as soon as a descriptor is ready.
+     * Times the suite records on the test thread, such as when errors are
+     * raised, are virtual too.
+     *
+     * The time functions are only interposed when the library is built with
+     * `-DTDD_VCLOCK` (the `virtual_clock` Meson option) and the C library is
+     * linked dynamically; otherwise this flag has no effect, and only
+     * `test_clock_now()` and `test_sleep()` use the clock.
+     *
+     * @see test_clock_now
+     **/
+    bool virtual_clock;
+    /**
+     * The most async tests run at once on one event loop. A run of more
+     * consecutive async tests is split into batches of this many; 0 runs
+     * them all at once. Defaults to 256.
+     *
+     * @see runner_new_async
+     **/
+    int async_max;
+    /**
+     * A boolean flag that makes golden file assertions rewrite the golden
+     * file with the output produced, instead of failing, when the two
+     * differ. Golden files that already match are left untouched.
+     *
+     * @see test_assert_matches_golden
+     **/
+    bool golden_update;
+} suite_t;
+
+/**
+ * Creates and initializes a new test suite. Must be freed by `suite_del()`.
+ *
+ * @return A pointer to a fully intialized `suite_t` structure.
+ * @see suite_del
+ **/
+suite_t* suite_new();
+
+/**
+ * Resets a `suite_t` to its initial state, as if it were never run.
+ *
+ * @param s - a pointer to a `suite_t` test suite to be reset
  **/
 void suite_reset(suite_t* s);
 
@@ -418,7 +2186,75 @@ int suite_add_test(suite_t* s, runner_t* r);
 int suite_run(suite_t* s, bool fatal_failures);
 
 /**
- * Runs the next test in the suite.
+ * Runs all tests in the suite on worker processes. Tests are handed out
+ * one at a time, or a run of async tests at a time, to whichever worker
+ * asks for more, so that no worker sits idle while others have a backlog.
+ * Workers stream their results back as event log records, which are
+ * merged into this suite's results, event log and trace in the order the
+ * tests finish.
+ *
+ * The coordinator starts workers of its own with `fork()`, connected over
+ * Unix domain socket pairs; more may connect to address from processes
+ * running `suite_work()` on the same suite, on this host or another. If a
+ * worker exits or disconnects while it has a test, the test is reported as
+ * crashed, and a worker the coordinator started is replaced.
+ *
+ * @param s              - the test suite to run
+ * @param workers        - the number of workers to start; may be 0 if
+ *                         address is set
+ * @param address        - the path of a Unix domain socket, or
+ *                         `tcp:HOST:PORT`, to accept workers on; or `NULL`.
+ *                         An empty HOST accepts them on the loopback
+ *                         interface only, and `*` on every interface.
+ * @param fatal_failures - true indicates that the suite should abort
+ *                         testing if any test was marked as a failure
+ * @return `EXIT_SUCCESS` once every test has run, otherwise `EXIT_FAILURE`
+ *         if testing was aborted or no worker is left to run the tests.
+ * @see suite_work
+ **/
+int suite_run_distributed(suite_t* s, int workers, const char* address,
+                          bool fatal_failures);
+
+/**
+ * Connects to a coordinator running `suite_run_distributed()` on the same
+ * suite, and runs the tests it hands out until it has no more. Results are
+ * sent to the coordinator only, and not recorded in this suite.
+ *
+ * @param s       - the test suite to take tests from
+ * @param address - the coordinator's Unix domain socket path, or
+ *                  `tcp:HOST:PORT`
+ * @return `EXIT_SUCCESS` once the coordinator has no more tests, otherwise
+ *         `EXIT_FAILURE` if it cannot be reached.
+ **/
+int suite_work(suite_t* s, const char* address);
+
+/**
+ * Serves the suite on a socket, so that a process that has set up its
+ * fixtures once can rerun any of its tests on request, in milliseconds,
+ * instead of starting again. Clients connect, send one request line and
+ * read the response until the server hangs up. Requests are served one at
+ * a time, in this process:
+ *
+ * - `run [PATTERN...]` resets the suite with `suite_reset()` and runs the
+ *   tests whose names match any of the shell wildcard patterns, or every
+ *   test if none are given. Their reports are streamed back as they
+ *   finish, followed by `done: ran N, failed N, errors N`.
+ * - `list` sends the names of the tests, one per line.
+ * - `quit` sends `bye` and stops the server.
+ *
+ * @param s       - the test suite to serve
+ * @param address - the path of a Unix domain socket, or `tcp:HOST:PORT`,
+ *                  to listen on. An empty HOST listens on the loopback
+ *                  interface only, and `*` on every interface.
+ * @return `EXIT_SUCCESS` once a client has asked the server to stop,
+ *         otherwise `EXIT_FAILURE` if the address cannot be listened on.
+ **/
+int suite_serve(suite_t* s, const char* address);
+
+/**
+ * Runs the next test in the suite. If it is an async test, the tests that
+ * follow it are run along with it, up to `suite_t::async_max` consecutive
+ * async tests.
  * @private
  *
  * @param s              - the test suite to run
@@ -430,76 +2266,228 @@ int suite_run(suite_t* s, bool fatal_failures);
 int suite_next(suite_t* s, bool fatal_failures);
 
 /**
- * Test result. This structure holds the name of a test which ran, and
- * indicates if the test passed.
+ * Enables the binary event log for a suite. Every test start and end,
+ * error, failure and benchmark sample is appended to the file at path as
+ * it happens, and results are no longer kept in memory once a test has
+ * been reported. Use `tdd_eventlog_stats()` or `tdd_eventlog_report()` to
+ * rebuild results from the log afterward.
+ *
+ * The file is truncated. Passing a `NULL` path disables logging.
+ *
+ * @param s    - the suite to log
+ * @param path - the path of the log file, or `NULL`
+ * @return `EXIT_SUCCESS`, or `EXIT_FAILURE` if the file could not be opened
+ **/
+int suite_set_eventlog(suite_t* s, const char* path);
+
+/**
+ * Enables exporting the suite timeline as a Chrome Trace Event JSON file,
+ * which can be loaded in Perfetto or `chrome://tracing`.
+ *
+ * Each test is a slice on the "tests" track, with its timed region nested
+ * inside it and an instant event for each error and failure. Worker threads
+ * started by a parallel benchmark are drawn on tracks of their own. Events
+ * are written as each test finishes; the file is completed when the suite
+ * is deleted or tracing is disabled.
+ *
+ * The file is truncated. Passing a `NULL` path disables tracing.
+ *
+ * @param s    - the suite to trace
+ * @param path - the path of the trace file, or `NULL`
+ * @return `EXIT_SUCCESS`, or `EXIT_FAILURE` if the file could not be opened
  **/
-typedef struct tdd_result_t {
-    /** The name of the test that produced this result. **/
-    char* name;
-    /** Indicates if the test that produced this result was successful. **/
-    bool ok;
-} tdd_result_t;
+int suite_set_trace(suite_t* s, const char* path);
 
 /**
- * Creates and initializes a pointer to a new `tdd_result_t`.
- * Must be freed with `tdd_result_del()`.
- * @private
- * @internal
+ * Enables the sampling profiler for the benchmarks (tests named `bench_*`)
+ * of a suite. While a benchmark runs, the test thread and the worker
+ * threads of `test_run_parallel()` are sampled `suite_t::profile_hz` times
+ * per second of CPU time each, and the samples are written to
+ * `dir/<test name>.folded` as folded stacks, one "root;...;leaf count" line
+ * per distinct stack, for `flamegraph.pl` and similar tools.
  *
- * @return A pointer to a fully intialized `tdd_result_t` structure.
+ * Frames are named with `backtrace_symbols()`, so functions only have
+ * names if they are exported; link tests with `-rdynamic` to name static
+ * functions of the test binary. Other frames are named after their module.
+ *
+ * The directory is created if it does not exist. Passing a `NULL` dir
+ * disables profiling.
+ *
+ * @param s   - the suite to profile
+ * @param dir - the directory to write profiles to, or `NULL`
+ * @return `EXIT_SUCCESS`, or `EXIT_FAILURE` if the directory could not be
+ *         created or profiling is not supported on this platform
  **/
-tdd_result_t* tdd_result_new(char* name, bool ok);
+int suite_set_profile(suite_t* s, const char* dir);
 
 /**
- * Frees memory allocated to a `tdd_result_t` struct.
- * @private
- * @internal
+ * Returns a `suite_stats_t*` detailing the results of the testing.
+ *
+ * The stats are a read-only view over the suite's results store and are
+ * returned in constant time without allocating. The view is valid until the
+ * suite is reset, run again, or deleted. If the suite writes an event log,
+ * the stats are instead rebuilt from the log into a store of their own.
  *
- * @param result - a pointer to a `tdd_result_t` that is to be destroyed
+ * @param s - the suite to get statistics for
+ * @return a suite_stats_t structure that must be released with
+ *         `suite_stats_del()`
+ **/
+suite_stats_t* suite_get_stats(suite_t* s);
+
+/**
+ * Releases a `suite_stats_t*` returned by `suite_get_stats()`. This is a
+ * no-op for views over a suite's own results.
+ *
+ * @param stats - pointer to the suite_stats_t to release
  * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
  **/
-int tdd_result_del(tdd_result_t* result);
+int suite_stats_del(suite_stats_t* stats);
 
 /**
- * Stats structure detailing results of test suite.
+ * Prints a summary of the stats: the number of tests that ran, failed and
+ * raised errors, followed by the tests that used the most CPU time with
+ * their page faults, context switches, I/O and peak RSS.
+ *
+ * @param stats - the stats to print
+ * @param f     - the file to print to
+ * @param top_n - the number of most expensive tests to list; 0 for none
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
  **/
-typedef struct suite_stats_t {
-    /**
-     * An array of `tdd_result_t` containing the results of the tests that ran
-     * in the suite.
-     **/
-    tdd_result_t** tests_run;
-    /** The total number of tests in the suite. **/
+int suite_print_stats(suite_stats_t* stats, FILE* f, int top_n);
+
+/**
+ * Kinds of records in an event log.
+ **/
+typedef enum tdd_event_type_t {
+    TDD_EVENT_SUITE_START = 1,
+    TDD_EVENT_SUITE_END   = 2,
+    TDD_EVENT_TEST_START  = 3,
+    TDD_EVENT_TEST_END    = 4,
+    TDD_EVENT_ERROR       = 5,
+    TDD_EVENT_FAIL        = 6,
+    TDD_EVENT_PARALLEL    = 7,
+    TDD_EVENT_SCALING     = 8,
+    TDD_EVENT_LOAD        = 9,
+    TDD_EVENT_FUZZ        = 10,
+    TDD_EVENT_SPAN        = 11,
+    TDD_EVENT_METRIC      = 12,
+    TDD_EVENT_RUSAGE      = 13,
+    TDD_EVENT_LOCK        = 14,
+    TDD_EVENT_BENCH_ENV   = 15,
+    TDD_EVENT_SAMPLES     = 16,
+    TDD_EVENT_CACHE       = 17,
+} tdd_event_type_t;
+
+/**
+ * A single record read from an event log. Only the fields relevant to the
+ * event's type are set. All pointers are owned by the reader and remain
+ * valid until the next call to `tdd_eventlog_next()`.
+ **/
+typedef struct tdd_event_t {
+    /** The kind of event. **/
+    tdd_event_type_t type;
+    /** The position of the test in its suite; -1 for suite events. **/
+    int index;
+    /** The monotonic time of the event in nanoseconds. **/
+    int64_t ts;
+    /** The number of tests in the suite. `TDD_EVENT_SUITE_START` only. **/
     int n_tests;
-    /** The total number of errors in the suite. **/
-    int n_error;
-    /** The total number of failures in the suite. **/
-    int n_fail;
+    /** Whether every test ran. `TDD_EVENT_SUITE_END` only. **/
+    bool finished;
+    /** The name of the test. `TDD_EVENT_TEST_START` only. **/
+    const char* name;
+    /** The description of the test. `TDD_EVENT_TEST_START` only. **/
+    const char* desc;
+    /** The message. `TDD_EVENT_ERROR` and `TDD_EVENT_FAIL` only. **/
+    const char* msg;
+    /** Whether the test failed. `TDD_EVENT_TEST_END` only. **/
+    bool failed;
     /**
-     * The total number of tests that ran in the suite. If this count differs
-     * from `n_tests`, then some tests were skipped.
+     * Whether the test failed by crashing with a segmentation fault.
+     * `TDD_EVENT_TEST_END` only.
      **/
-    int n_ran;
-    /** The percent rate of successful tests in the suite. **/
-    double success_rate;
-    /** Indicates that the suite ran with fatal failures enabled. **/
-    bool fatal_failures;
-} suite_stats_t;
+    bool crashed;
+    /** The number of errors. `TDD_EVENT_TEST_END` only. **/
+    int n_err;
+    /** The timed region in nanoseconds. `TDD_EVENT_TEST_END` only. **/
+    int64_t start;
+    int64_t end;
+    /** `TDD_EVENT_PARALLEL` only. **/
+    tdd_parallel_stats_t* parallel;
+    /** `TDD_EVENT_SCALING` only. **/
+    tdd_scaling_t* scaling;
+    /** `TDD_EVENT_LOAD` only. **/
+    tdd_load_t* load;
+    /** `TDD_EVENT_FUZZ` only. **/
+    tdd_fuzz_stats_t* fuzz;
+    /** Whether the fuzz engine ran. `TDD_EVENT_FUZZ` only. **/
+    bool fuzzing;
+    /** `TDD_EVENT_SPAN` only. **/
+    tdd_span_stats_t* span;
+    /** `TDD_EVENT_METRIC` only. **/
+    tdd_metric_t* metric;
+    /** `TDD_EVENT_RUSAGE` only. **/
+    tdd_rusage_t* usage;
+    /** `TDD_EVENT_LOCK` only. **/
+    tdd_lock_stats_t* lock;
+    /** `TDD_EVENT_BENCH_ENV` only. **/
+    tdd_bench_env_t* env;
+    /** `TDD_EVENT_SAMPLES` only. **/
+    tdd_samples_t* samples;
+    /** `TDD_EVENT_CACHE` only. **/
+    tdd_cache_t* cache;
+} tdd_event_t;
+
+/** A sequential reader over an event log. **/
+typedef struct tdd_eventlog_reader_t tdd_eventlog_reader_t;
 
 /**
- * Returns a `stats_t*` detailing the results of the testing.
+ * Opens an event log written by a suite for reading.
  *
- * @param s - the suite from which to allocate statistics
- * @return heap allocated suite_stats_t structure
+ * @param path - the path of the log file
+ * @return A reader that must be closed with `tdd_eventlog_close()`, or
+ *         `NULL` if the file could not be opened or is not an event log
+ *         of the same format version. Logs are read the same on machines
+ *         of either byte order.
  **/
-suite_stats_t* suite_get_stats(suite_t* s);
+tdd_eventlog_reader_t* tdd_eventlog_open(const char* path);
+
+/**
+ * Reads the next event from a log.
+ *
+ * @param r  - the reader
+ * @param ev - set to the event that was read
+ * @return true if an event was read, false at the end of the log or if the
+ *         rest of the log is truncated or corrupt.
+ **/
+bool tdd_eventlog_next(tdd_eventlog_reader_t* r, tdd_event_t* ev);
 
 /**
- * Frees memory allocated to a `stats_t*` returned by `suite_get_stats()`
+ * Closes an event log reader.
  *
- * @param stats - pointer to the suite_stats_t to free
+ * @param r - the reader to close
  * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
  **/
-int suite_stats_del(suite_stats_t* stats);
+int tdd_eventlog_close(tdd_eventlog_reader_t* r);
+
+/**
+ * Rebuilds the stats of the last suite run recorded in an event log. Only
+ * the tests that are in flight at any one time are held in memory.
+ *
+ * @param path - the path of the log file
+ * @return a heap allocated suite_stats_t to be freed by `suite_stats_del()`,
+ *         or `NULL` if the log could not be read
+ **/
+suite_stats_t* tdd_eventlog_stats(const char* path);
+
+/**
+ * Prints the results recorded in an event log exactly as the suite's
+ * reporter printed them while it ran.
+ *
+ * @param path - the path of the log file
+ * @param out  - the file to print to
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+ **/
+int tdd_eventlog_report(const char* path, FILE* out);
 
 #endif
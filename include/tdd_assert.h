@@ -0,0 +1,417 @@
+/**
+ * @file tdd_assert.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Inline assertions for libtdd tests.
+ *
+ * The checks in this header are `static inline`, so a passing assertion
+ * compiles to a comparison and a branch that is predicted not taken, with
+ * no call into the library and no indirect call through `test_t`. Only a
+ * failing assertion calls out, to a function that is kept out of line and
+ * marked cold so it does not crowd the caller's hot path.
+ *
+ * Every assertion returns true if it passed, so a test can stop early:
+ *
+ *  if (!test_assert_eq_int(t, got, want)) return NULL;
+ *
+ * A failed assertion marks the test as failed with a message giving the
+ * file, line, expression and values. If several assertions fail, the
+ * message of the first one is kept.
+ **/
+#ifndef __TDD_ASSERT_H__
+#define __TDD_ASSERT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tdd.h"
+
+#if defined(__GNUC__)
+#define TDD_LIKELY(x) __builtin_expect(!!(x), 1)
+#define TDD_COLD __attribute__((cold, noinline))
+#else
+#define TDD_LIKELY(x) (x)
+#define TDD_COLD
+#endif
+
+/**
+ * Records a failed boolean assertion. Not to be called explicitly.
+ * @private
+ *
+ * @return false
+ **/
+TDD_COLD bool __tdd_assert_fail(test_t* t, const char* file, int line,
+                                const char* expr);
+
+/**
+ * Records a failed comparison of signed integers. Not to be called
+ * explicitly.
+ * @private
+ *
+ * @return false
+ **/
+TDD_COLD bool __tdd_assert_fail_int(test_t* t, const char* file, int line,
+                                    const char* expr, long long a,
+                                    long long b);
+
+/**
+ * Records a failed comparison of unsigned integers. Not to be called
+ * explicitly.
+ * @private
+ *
+ * @return false
+ **/
+TDD_COLD bool __tdd_assert_fail_uint(test_t* t, const char* file, int line,
+                                     const char* expr, unsigned long long a,
+                                     unsigned long long b);
+
+/**
+ * Records a failed comparison of floating point numbers. Not to be called
+ * explicitly.
+ * @private
+ *
+ * @return false
+ **/
+TDD_COLD bool __tdd_assert_fail_double(test_t* t, const char* file, int line,
+                                       const char* expr, double a, double b);
+
+/**
+ * Records a failed comparison of pointers. Not to be called explicitly.
+ * @private
+ *
+ * @return false
+ **/
+TDD_COLD bool __tdd_assert_fail_ptr(test_t* t, const char* file, int line,
+                                    const char* expr, const void* a,
+                                    const void* b);
+
+/**
+ * Records a failed comparison of strings. Not to be called explicitly.
+ * @private
+ *
+ * @return false
+ **/
+TDD_COLD bool __tdd_assert_fail_str(test_t* t, const char* file, int line,
+                                    const char* expr, const char* a,
+                                    const char* b);
+
+/**
+ * Compares two buffers byte by byte. Not to be called explicitly.
+ * @private
+ *
+ * @return true if the buffers are equal
+ **/
+bool __tdd_assert_mem_eq(test_t* t, const void* got, const void* want,
+                         size_t n, const char* file, int line,
+                         const char* expr);
+
+/**
+ * Compares two arrays of floats to within a number of units in the last
+ * place. Not to be called explicitly.
+ * @private
+ *
+ * @return true if every pair of elements is near
+ **/
+bool __tdd_assert_f32_near_ulps(test_t* t, const float* got,
+                                const float* want, size_t n,
+                                uint32_t max_ulps, const char* file, int line,
+                                const char* expr);
+
+/**
+ * Compares two arrays of doubles to within a relative error. Not to be
+ * called explicitly.
+ * @private
+ *
+ * @return true if every pair of elements is near
+ **/
+bool __tdd_assert_f64_near_rel(test_t* t, const double* got,
+                               const double* want, size_t n, double max_rel,
+                               const char* file, int line, const char* expr);
+
+static inline bool __tdd_assert(test_t* t, bool ok, const char* file,
+                                int line, const char* expr) {
+    if (TDD_LIKELY(ok)) return true;
+    return __tdd_assert_fail(t, file, line, expr);
+}
+
+static inline bool __tdd_assert_eq_int(test_t* t, long long a, long long b,
+                                       const char* file, int line,
+                                       const char* expr) {
+    if (TDD_LIKELY(a == b)) return true;
+    return __tdd_assert_fail_int(t, file, line, expr, a, b);
+}
+
+static inline bool __tdd_assert_eq_uint(test_t* t, unsigned long long a,
+                                        unsigned long long b,
+                                        const char* file, int line,
+                                        const char* expr) {
+    if (TDD_LIKELY(a == b)) return true;
+    return __tdd_assert_fail_uint(t, file, line, expr, a, b);
+}
+
+static inline bool __tdd_assert_eq_double(test_t* t, double a, double b,
+                                          const char* file, int line,
+                                          const char* expr) {
+    if (TDD_LIKELY(a == b)) return true;
+    return __tdd_assert_fail_double(t, file, line, expr, a, b);
+}
+
+static inline bool __tdd_assert_eq_ptr(test_t* t, const void* a,
+                                       const void* b, const char* file,
+                                       int line, const char* expr) {
+    if (TDD_LIKELY(a == b)) return true;
+    return __tdd_assert_fail_ptr(t, file, line, expr, a, b);
+}
+
+static inline bool __tdd_assert_eq_str(test_t* t, const char* a,
+                                       const char* b, const char* file,
+                                       int line, const char* expr) {
+    if (TDD_LIKELY(a == b || (a != NULL && b != NULL && strcmp(a, b) == 0))) {
+        return true;
+    }
+    return __tdd_assert_fail_str(t, file, line, expr, a, b);
+}
+
+/**
+ * Asserts that a condition holds.
+ *
+ * @param t    - the running test
+ * @param cond - the condition
+ * @return true if the condition holds
+ **/
+#define test_assert(t, cond)                                                 \
+    __tdd_assert((t), (cond) ? true : false, __FILE__, __LINE__, #cond)
+
+/**
+ * Asserts that two signed integers are equal.
+ *
+ * @param t - the running test
+ * @param a - the value produced
+ * @param b - the value expected
+ * @return true if the values are equal
+ **/
+#define test_assert_eq_int(t, a, b)                                          \
+    __tdd_assert_eq_int((t), (a), (b), __FILE__, __LINE__, #a " == " #b)
+
+/**
+ * Asserts that two unsigned integers are equal.
+ *
+ * @param t - the running test
+ * @param a - the value produced
+ * @param b - the value expected
+ * @return true if the values are equal
+ **/
+#define test_assert_eq_uint(t, a, b)                                         \
+    __tdd_assert_eq_uint((t), (a), (b), __FILE__, __LINE__, #a " == " #b)
+
+/**
+ * Asserts that two floating point numbers are exactly equal.
+ *
+ * @param t - the running test
+ * @param a - the value produced
+ * @param b - the value expected
+ * @return true if the values are equal
+ **/
+#define test_assert_eq_double(t, a, b)                                       \
+    __tdd_assert_eq_double((t), (a), (b), __FILE__, __LINE__, #a " == " #b)
+
+/**
+ * Asserts that two pointers are equal.
+ *
+ * @param t - the running test
+ * @param a - the value produced
+ * @param b - the value expected
+ * @return true if the pointers are equal
+ **/
+#define test_assert_eq_ptr(t, a, b)                                          \
+    __tdd_assert_eq_ptr((t), (a), (b), __FILE__, __LINE__, #a " == " #b)
+
+/**
+ * Asserts that two NUL terminated strings are equal. Two `NULL` strings
+ * are equal; a `NULL` string is not equal to any other string.
+ *
+ * @param t - the running test
+ * @param a - the value produced
+ * @param b - the value expected
+ * @return true if the strings are equal
+ **/
+#define test_assert_eq_str(t, a, b)                                          \
+    __tdd_assert_eq_str((t), (a), (b), __FILE__, __LINE__, #a " == " #b)
+
+/*
+ * The bulk assertions below compare whole buffers with vector instructions
+ * where the CPU has them. A failure reports how many elements differ and
+ * the index and values of the first few; a pass does not allocate.
+ */
+
+/**
+ * Asserts that two buffers hold the same bytes.
+ *
+ * @param t    - the running test
+ * @param got  - the buffer produced
+ * @param want - the buffer expected
+ * @param n    - the length of both buffers in bytes
+ * @return true if the buffers are equal
+ **/
+#define test_assert_mem_eq(t, got, want, n)                                  \
+    __tdd_assert_mem_eq((t), (got), (want), (n), __FILE__, __LINE__,         \
+                        #got " == " #want)
+
+/**
+ * Asserts that two arrays of floats are equal to within `ulps` units in the
+ * last place, element by element. Zeroes of either sign are equal, as are
+ * two NaNs; a NaN is not near any number.
+ *
+ * @param t    - the running test
+ * @param got  - the array produced
+ * @param want - the array expected
+ * @param n    - the number of elements in both arrays
+ * @param ulps - the largest distance allowed between two elements
+ * @return true if every pair of elements is near
+ **/
+#define test_assert_f32_near_ulps(t, got, want, n, ulps)                     \
+    __tdd_assert_f32_near_ulps((t), (got), (want), (n), (ulps), __FILE__,    \
+                               __LINE__, #got " == " #want)
+
+/**
+ * Asserts that two arrays of doubles are equal to within a relative error,
+ * element by element: `|got - want| <= rel * max(|got|, |want|)`. Equal
+ * infinities are near, as are two NaNs; a NaN is not near any number.
+ *
+ * @param t    - the running test
+ * @param got  - the array produced
+ * @param want - the array expected
+ * @param n    - the number of elements in both arrays
+ * @param rel  - the largest relative error allowed
+ * @return true if every pair of elements is near
+ **/
+#define test_assert_f64_near_rel(t, got, want, n, rel)                       \
+    __tdd_assert_f64_near_rel((t), (got), (want), (n), (rel), __FILE__,      \
+                              __LINE__, #got " == " #want)
+
+/**
+ * Output being compared against a golden file as it is produced.
+ *
+ * @see test_golden_open
+ **/
+typedef struct tdd_golden_t tdd_golden_t;
+
+/**
+ * Starts comparing against a golden file. Not to be called explicitly.
+ * @private
+ *
+ * @return the comparison, or `NULL` if it could not be started
+ **/
+tdd_golden_t* __tdd_golden_open(test_t* t, const char* path,
+                                const char* file, int line);
+
+/**
+ * Compares a buffer with a golden file. Not to be called explicitly.
+ * @private
+ *
+ * @return true if the buffer matches
+ **/
+bool __tdd_assert_matches_golden(test_t* t, const char* path,
+                                 const void* buf, size_t len,
+                                 const char* file, int line,
+                                 const char* expr);
+
+/**
+ * Asserts that a buffer holds exactly the contents of a golden file.
+ *
+ * The golden file is mapped into memory rather than read, and compared a
+ * large chunk at a time with the fastest comparison the CPU supports. On a
+ * mismatch, the test fails with the offsets of the first few differing
+ * bytes, and the bytes around each of them in both the output and the
+ * golden file.
+ *
+ * If `suite_t::golden_update` is set, a golden file that does not match is
+ * replaced by the buffer instead, atomically, and the assertion passes.
+ *
+ * @param t    - the running test
+ * @param path - the path to the golden file
+ * @param buf  - the output produced
+ * @param len  - the length of the output in bytes
+ * @return true if the output matches the golden file
+ **/
+#define test_assert_matches_golden(t, path, buf, len)                         \
+    __tdd_assert_matches_golden((t), (path), (buf), (len), __FILE__,         \
+                                __LINE__, #buf " matches " #path)
+
+/**
+ * Starts comparing output against a golden file as it is produced, for
+ * output too large to hold in memory at once. Write the output with
+ * `test_golden_write()` and finish with `test_golden_close()`, which
+ * asserts that it matched as `test_assert_matches_golden()` does.
+ *
+ *  tdd_golden_t* g = test_golden_open(t, "out.golden");
+ *  while ((n = produce(chunk, sizeof(chunk))) > 0) {
+ *      test_golden_write(g, chunk, n);
+ *  }
+ *  test_golden_close(g);
+ *
+ * @param t    - the running test
+ * @param path - the path to the golden file
+ * @return the comparison, or `NULL` if it could not be started, in which
+ *         case the test has an error
+ **/
+#define test_golden_open(t, path)                                            \
+    __tdd_golden_open((t), (path), __FILE__, __LINE__)
+
+/**
+ * Compares the next part of the output with the golden file. Comparison
+ * stops early once enough differences have been found to report.
+ *
+ * @param g   - the comparison; may be `NULL`
+ * @param buf - the next part of the output
+ * @param len - the length of `buf` in bytes
+ * @return true if the output matches the golden file so far
+ **/
+bool test_golden_write(tdd_golden_t* g, const void* buf, size_t len);
+
+/**
+ * Finishes comparing output against a golden file and frees the
+ * comparison. Fails the test if the output did not match, or replaces the
+ * golden file if `suite_t::golden_update` is set.
+ *
+ * @param g - the comparison; may be `NULL`
+ * @return true if the output matched the golden file
+ **/
+bool test_golden_close(tdd_golden_t* g);
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+/**
+ * Asserts that two values are equal, choosing the comparison from the type
+ * of the value produced: strings are compared by content, other pointers
+ * by address, and numbers by value. Requires C11.
+ *
+ * @param t - the running test
+ * @param a - the value produced
+ * @param b - the value expected
+ * @return true if the values are equal
+ **/
+#define test_assert_eq(t, a, b)                                              \
+    _Generic((a),                                                            \
+        char*: __tdd_assert_eq_str,                                          \
+        const char*: __tdd_assert_eq_str,                                    \
+        float: __tdd_assert_eq_double,                                       \
+        double: __tdd_assert_eq_double,                                      \
+        long double: __tdd_assert_eq_double,                                 \
+        unsigned char: __tdd_assert_eq_uint,                                 \
+        unsigned short: __tdd_assert_eq_uint,                                \
+        unsigned int: __tdd_assert_eq_uint,                                  \
+        unsigned long: __tdd_assert_eq_uint,                                 \
+        unsigned long long: __tdd_assert_eq_uint,                            \
+        bool: __tdd_assert_eq_int,                                           \
+        char: __tdd_assert_eq_int,                                           \
+        signed char: __tdd_assert_eq_int,                                    \
+        short: __tdd_assert_eq_int,                                          \
+        int: __tdd_assert_eq_int,                                            \
+        long: __tdd_assert_eq_int,                                           \
+        long long: __tdd_assert_eq_int,                                      \
+        default: __tdd_assert_eq_ptr)((t), (a), (b), __FILE__, __LINE__,     \
+                                      #a " == " #b)
+#endif
+
+#endif
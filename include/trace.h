@@ -0,0 +1,95 @@
+/**
+ * @private
+ * @file trace.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private trace exporter functions for libtdd.
+ */
+#ifndef __TDD_TRACE_H__
+#define __TDD_TRACE_H__
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "tdd.h"
+
+/**
+ * A Chrome Trace Event file opened for writing.
+ * @private
+ * @internal
+ */
+typedef struct tdd_trace_t tdd_trace_t;
+
+/** The track of tests that the suite runs one at a time. */
+#define TRACE_TESTS_TID 1
+
+/**
+ * __trace_open() creates or truncates the trace file at path.
+ * @private
+ * @internal
+ *
+ * @param path - the path of the trace file
+ * @return the open trace, or NULL on error
+ */
+tdd_trace_t* __trace_open(const char* path);
+
+/**
+ * __trace_close() terminates and closes a trace.
+ * @private
+ * @internal
+ *
+ * @param tr - the trace to close; may be NULL
+ */
+void __trace_close(tdd_trace_t* tr);
+
+/**
+ * __trace_track() finds the n-th track of a kind, such as the track of the
+ * n-th worker process, naming it "KIND N" the first time it is used.
+ * @private
+ * @internal
+ *
+ * @param tr   - the trace; may be NULL
+ * @param kind - the kind of track, which must outlive the trace
+ * @param n    - the number of the track among those of its kind
+ * @return the track, or TRACE_TESTS_TID if tr is NULL or out of memory
+ */
+int __trace_track(tdd_trace_t* tr, const char* kind, int n);
+
+/**
+ * __trace_test() writes the slice of a finished test, nested slices for its
+ * timed region and for setting up and tearing down its fixtures, and an
+ * instant event for each error and failure. The slices of an async test,
+ * which may overlap others on its track, are written as async events.
+ * @private
+ * @internal
+ *
+ * @param tr      - the trace to write to
+ * @param track   - the track of whatever ran the test
+ * @param async   - whether the test shared its thread with other tests
+ * @param name    - the name of the test
+ * @param desc    - the description of the test; may be NULL
+ * @param started - the time the test thread was started
+ * @param joined  - the time the test thread was joined; the slice ends
+ *                  later if the test's fixtures were torn down after it
+ * @param t       - the finished test
+ */
+void __trace_test(tdd_trace_t* tr, int track, bool async, const char* name,
+                  const char* desc, const struct timespec* started,
+                  const struct timespec* joined, const test_t* t);
+
+/**
+ * __trace_worker() writes a slice on the track of a worker thread started
+ * by a test.
+ * @private
+ * @internal
+ *
+ * @param tr     - the trace to write to
+ * @param worker - the index of the worker thread
+ * @param name   - the name of the slice
+ * @param start  - the start of the slice
+ * @param end    - the end of the slice
+ */
+void __trace_worker(tdd_trace_t* tr, int worker, const char* name,
+                    const struct timespec* start,
+                    const struct timespec* end);
+
+#endif
@@ -0,0 +1,39 @@
+/**
+ * @private
+ * @file vclock.h
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Private virtual clock functions for libtdd.
+ */
+#ifndef __TDD_VCLOCK_H__
+#define __TDD_VCLOCK_H__
+
+#include "tdd.h"
+
+/**
+ * __vclock_enter() makes the interposed time functions called by the
+ * calling thread, which must be the test thread, use the test's virtual
+ * clock.
+ * @private
+ * @internal
+ *
+ * @param t - the test the thread runs
+ */
+void __vclock_enter(test_t* t);
+
+/**
+ * __vclock_leave() undoes __vclock_enter().
+ * @private
+ * @internal
+ */
+void __vclock_leave(void);
+
+/**
+ * __vclock_del() frees a virtual clock. No thread may be asleep on it.
+ * @private
+ * @internal
+ *
+ * @param c - the clock, or NULL
+ */
+void __vclock_del(struct tdd_vclock_t* c);
+
+#endif
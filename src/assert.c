@@ -0,0 +1,100 @@
+/**
+ * @file assert.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains the failure paths of the inline assertions in
+ *        tdd_assert.h, which are only called once an assertion has failed.
+ **/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assertutil.h"
+#include "tdd.h"
+#include "tdd_assert.h"
+
+/* Room for the location and values; the expression is added on top. */
+#define ASSERT_MSG_LEN 256
+
+bool __assert_report(test_t* t, char* msg) {
+    if (msg == NULL) return false;
+    if (t != NULL && !t->failed) {
+        test_fail(t, msg);
+    }
+    free(msg);
+
+    return false;
+}
+
+static char* __assert_msg(const char* expr, size_t extra) {
+    return malloc(ASSERT_MSG_LEN + strlen(expr) + extra);
+}
+
+bool __tdd_assert_fail(test_t* t, const char* file, int line,
+                       const char* expr) {
+    char* msg = __assert_msg(expr, strlen(file));
+    if (msg != NULL) {
+        sprintf(msg, "%s:%d: assertion failed: %s", file, line, expr);
+    }
+
+    return __assert_report(t, msg);
+}
+
+bool __tdd_assert_fail_int(test_t* t, const char* file, int line,
+                           const char* expr, long long a, long long b) {
+    char* msg = __assert_msg(expr, strlen(file));
+    if (msg != NULL) {
+        sprintf(msg, "%s:%d: %s: got %lld, want %lld", file, line, expr, a,
+                b);
+    }
+
+    return __assert_report(t, msg);
+}
+
+bool __tdd_assert_fail_uint(test_t* t, const char* file, int line,
+                            const char* expr, unsigned long long a,
+                            unsigned long long b) {
+    char* msg = __assert_msg(expr, strlen(file));
+    if (msg != NULL) {
+        sprintf(msg, "%s:%d: %s: got %llu, want %llu", file, line, expr, a,
+                b);
+    }
+
+    return __assert_report(t, msg);
+}
+
+bool __tdd_assert_fail_double(test_t* t, const char* file, int line,
+                              const char* expr, double a, double b) {
+    char* msg = __assert_msg(expr, strlen(file));
+    if (msg != NULL) {
+        sprintf(msg, "%s:%d: %s: got %.17g, want %.17g", file, line, expr, a,
+                b);
+    }
+
+    return __assert_report(t, msg);
+}
+
+bool __tdd_assert_fail_ptr(test_t* t, const char* file, int line,
+                           const char* expr, const void* a, const void* b) {
+    char* msg = __assert_msg(expr, strlen(file));
+    if (msg != NULL) {
+        sprintf(msg, "%s:%d: %s: got %p, want %p", file, line, expr, a, b);
+    }
+
+    return __assert_report(t, msg);
+}
+
+bool __tdd_assert_fail_str(test_t* t, const char* file, int line,
+                           const char* expr, const char* a, const char* b) {
+    size_t la  = a != NULL ? strlen(a) : 4;
+    size_t lb  = b != NULL ? strlen(b) : 4;
+    char*  msg = __assert_msg(expr, strlen(file) + la + lb);
+    if (msg != NULL) {
+        sprintf(msg, "%s:%d: %s: got %s%s%s, want %s%s%s", file, line, expr,
+                a != NULL ? "\"" : "", a != NULL ? a : "NULL",
+                a != NULL ? "\"" : "", b != NULL ? "\"" : "",
+                b != NULL ? b : "NULL", b != NULL ? "\"" : "");
+    }
+
+    return __assert_report(t, msg);
+}
@@ -0,0 +1,348 @@
+/**
+ * @file async.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of async tests, which
+ *        are state machines stepped by an event loop that many of them
+ *        share, instead of each blocking a thread of its own.
+ *
+ * The loop waits with epoll on Linux and with poll() elsewhere. A
+ * descriptor is watched only while its test is waiting on it, and is
+ * unwatched before the test is stepped, since the test may close it.
+ **/
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+#include "async.h"
+#include "tdd.h"
+
+/* The most ready descriptors taken from the kernel per wait. */
+#define ASYNC_EVENTS 64
+
+struct async_loop_t;
+
+/* An async test on the loop. */
+struct tdd_async_task_t {
+    runner_t*            runner;
+    test_t*              t;
+    struct async_loop_t* loop;
+    /* The descriptor the test is waiting on, or -1. */
+    int   fd;
+    short events;
+    /* Bumped on every step, so that timers of earlier steps are ignored. */
+    uint64_t gen;
+    /* Whether the test set a timer during its current step. */
+    bool timed;
+    /* Whether the test is waiting to be woken, rather than queued or done. */
+    bool waiting;
+};
+
+/* A wake up time of a task, set by test_await_timer(). */
+typedef struct async_timer_t {
+    int64_t                  at;
+    uint64_t                 gen;
+    struct tdd_async_task_t* task;
+} async_timer_t;
+
+typedef struct async_loop_t {
+#if defined(__linux__)
+    int epfd;
+#else
+    struct pollfd*            pfds;
+    struct tdd_async_task_t** polled;
+#endif
+    struct tdd_async_task_t* tasks;
+    int                      n_tasks;
+    /* The number of tasks that have not finished. */
+    int pending;
+    /* The tasks to step next, in a ring; a task is queued at most once. */
+    struct tdd_async_task_t** ready;
+    int                       head;
+    int                       n_ready;
+    /* A binary min-heap of wake up times. */
+    async_timer_t* timers;
+    int            n_timers;
+    int            cap_timers;
+} async_loop_t;
+
+static int64_t __async_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void __async_fail(test_t* t, const char* what, int err) {
+    const char* why = strerror(err);
+    char*       msg = malloc(8 + strlen(what) + strlen(why));
+    if (msg == NULL) return;
+    sprintf(msg, "%s: %s", what, why);
+    test_fail(t, msg);
+    free(msg);
+}
+
+static int __async_watch(struct tdd_async_task_t* task, int fd,
+                         short events) {
+#if defined(__linux__)
+    /* The EPOLL* event bits have the values of the POLL* ones. */
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(struct epoll_event));
+    ev.events   = (uint32_t)events;
+    ev.data.ptr = task;
+    if (epoll_ctl(task->loop->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        return errno;
+    }
+#endif
+    task->fd     = fd;
+    task->events = events;
+
+    return 0;
+}
+
+static void __async_unwatch(struct tdd_async_task_t* task) {
+    if (task->fd < 0) return;
+#if defined(__linux__)
+    epoll_ctl(task->loop->epfd, EPOLL_CTL_DEL, task->fd, NULL);
+#endif
+    task->fd = -1;
+}
+
+static void __async_push(async_loop_t* loop, struct tdd_async_task_t* task) {
+    loop->ready[(loop->head + loop->n_ready) % loop->n_tasks] = task;
+    loop->n_ready++;
+}
+
+static struct tdd_async_task_t* __async_pop(async_loop_t* loop) {
+    struct tdd_async_task_t* task = loop->ready[loop->head];
+    loop->head = (loop->head + 1) % loop->n_tasks;
+    loop->n_ready--;
+    return task;
+}
+
+/* Queues a waiting task to be stepped, with the events that woke it. */
+static void __async_wake(struct tdd_async_task_t* task, short revents) {
+    if (!task->waiting) return;
+    __async_unwatch(task);
+    task->waiting         = false;
+    task->t->async_events = revents;
+    __async_push(task->loop, task);
+}
+
+static void __async_step(struct tdd_async_task_t* task) {
+    test_t* t = task->t;
+    task->gen++;
+    task->timed = false;
+
+    tdd_async_t r = task->runner->step(t);
+    t->async_events = 0;
+    if (r == TDD_ASYNC_DONE) {
+        __async_unwatch(task);
+        if (t->end->tv_sec == 0 && t->end->tv_nsec == 0) test_timer_end(t);
+        task->loop->pending--;
+        return;
+    }
+
+    /* A test that awaited nothing yields, and is stepped again next turn. */
+    task->waiting = true;
+    if (task->fd < 0 && !task->timed) __async_wake(task, 0);
+}
+
+static void __async_sift_down(async_timer_t* h, int n, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < n && h[l].at < h[m].at) m = l;
+        if (r < n && h[r].at < h[m].at) m = r;
+        if (m == i) return;
+        async_timer_t tmp = h[i];
+        h[i]              = h[m];
+        h[m]              = tmp;
+        i                 = m;
+    }
+}
+
+static void __async_timer_pop(async_loop_t* loop) {
+    loop->timers[0] = loop->timers[--loop->n_timers];
+    __async_sift_down(loop->timers, loop->n_timers, 0);
+}
+
+/* Whether the earliest timer still belongs to a step that is waiting. */
+static bool __async_timer_live(const async_loop_t* loop) {
+    const async_timer_t* top = &loop->timers[0];
+    return top->task->waiting && top->gen == top->task->gen;
+}
+
+/* Wakes the tasks whose timers are due, dropping timers of past steps. */
+static void __async_expire(async_loop_t* loop) {
+    int64_t now = __async_now();
+    while (loop->n_timers > 0) {
+        bool live = __async_timer_live(loop);
+        if (live && loop->timers[0].at > now) return;
+        struct tdd_async_task_t* task = loop->timers[0].task;
+        __async_timer_pop(loop);
+        if (live) __async_wake(task, 0);
+    }
+}
+
+/* The number of milliseconds until the earliest timer, or -1 if none. */
+static int __async_timeout(async_loop_t* loop) {
+    while (loop->n_timers > 0 && !__async_timer_live(loop)) {
+        __async_timer_pop(loop);
+    }
+    if (loop->n_timers == 0) return -1;
+
+    int64_t ns = loop->timers[0].at - __async_now();
+    if (ns <= 0) return 0;
+    /* Round up, so that the wait does not end just short of the timer. */
+    int64_t ms = (ns + 999999) / 1000000;
+    return ms > INT_MAX ? INT_MAX : (int)ms;
+}
+
+/* Waits for descriptors to be ready, waking their tasks. */
+static void __async_wait(async_loop_t* loop, int timeout) {
+#if defined(__linux__)
+    struct epoll_event evs[ASYNC_EVENTS];
+    int n = epoll_wait(loop->epfd, evs, ASYNC_EVENTS, timeout);
+    for (int i = 0; i < n; i++) {
+        __async_wake(evs[i].data.ptr, (short)evs[i].events);
+    }
+#else
+    nfds_t n = 0;
+    for (int i = 0; i < loop->n_tasks; i++) {
+        struct tdd_async_task_t* task = &loop->tasks[i];
+        if (!task->waiting || task->fd < 0) continue;
+        loop->pfds[n].fd      = task->fd;
+        loop->pfds[n].events  = task->events;
+        loop->pfds[n].revents = 0;
+        loop->polled[n++]     = task;
+    }
+    if (poll(loop->pfds, n, timeout) <= 0) return;
+    for (nfds_t i = 0; i < n; i++) {
+        if (loop->pfds[i].revents != 0) {
+            __async_wake(loop->polled[i], loop->pfds[i].revents);
+        }
+    }
+#endif
+}
+
+static int __async_loop_init(async_loop_t* loop, int n) {
+    memset(loop, 0, sizeof(async_loop_t));
+    loop->n_tasks = n;
+    loop->tasks   = calloc((size_t)n, sizeof(struct tdd_async_task_t));
+    loop->ready   = malloc(sizeof(struct tdd_async_task_t*) * (size_t)n);
+    if (loop->tasks == NULL || loop->ready == NULL) return ENOMEM;
+#if defined(__linux__)
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) return errno;
+#else
+    loop->pfds   = malloc(sizeof(struct pollfd) * (size_t)n);
+    loop->polled = malloc(sizeof(struct tdd_async_task_t*) * (size_t)n);
+    if (loop->pfds == NULL || loop->polled == NULL) return ENOMEM;
+#endif
+
+    return 0;
+}
+
+static void __async_loop_free(async_loop_t* loop) {
+#if defined(__linux__)
+    if (loop->epfd > 0) close(loop->epfd);
+#else
+    free(loop->pfds);
+    free(loop->polled);
+#endif
+    free(loop->tasks);
+    free(loop->ready);
+    free(loop->timers);
+}
+
+void __async_run(runner_t** tests, test_t** ts, int n) {
+    async_loop_t loop;
+    int          err = __async_loop_init(&loop, n);
+    if (err != 0) {
+        for (int i = 0; i < n; i++) {
+            __async_fail(ts[i], "cannot make event loop", err);
+        }
+        __async_loop_free(&loop);
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        struct tdd_async_task_t* task = &loop.tasks[i];
+        task->runner = tests[i];
+        task->t      = ts[i];
+        task->loop   = &loop;
+        task->fd     = -1;
+        ts[i]->task  = task;
+        test_timer_start(ts[i]);
+        __async_push(&loop, task);
+    }
+    loop.pending = n;
+
+    while (loop.pending > 0) {
+        /* Tasks that yield are queued again, but stepped next turn. */
+        for (int k = loop.n_ready; k > 0; k--) {
+            __async_step(__async_pop(&loop));
+        }
+        if (loop.pending == 0) break;
+
+        __async_wait(&loop, loop.n_ready > 0 ? 0 : __async_timeout(&loop));
+        __async_expire(&loop);
+    }
+
+    for (int i = 0; i < n; i++) ts[i]->task = NULL;
+    __async_loop_free(&loop);
+}
+
+int test_await_fd(test_t* t, int fd, short events) {
+    if (t == NULL || t->task == NULL || fd < 0) {
+        errno = EINVAL;
+        return EXIT_FAILURE;
+    }
+    __async_unwatch(t->task);
+    int err = __async_watch(t->task, fd, events);
+    if (err != 0) {
+        errno = err;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int test_await_timer(test_t* t, int64_t ns) {
+    if (t == NULL || t->task == NULL) {
+        errno = EINVAL;
+        return EXIT_FAILURE;
+    }
+    async_loop_t* loop = t->task->loop;
+    if (loop->n_timers == loop->cap_timers) {
+        int            cap = loop->cap_timers > 0 ? 2 * loop->cap_timers : 64;
+        async_timer_t* tmp =
+            realloc(loop->timers, sizeof(async_timer_t) * (size_t)cap);
+        if (tmp == NULL) {
+            errno = ENOMEM;
+            return EXIT_FAILURE;
+        }
+        loop->timers     = tmp;
+        loop->cap_timers = cap;
+    }
+
+    async_timer_t timer = {__async_now() + (ns > 0 ? ns : 0), t->task->gen,
+                           t->task};
+    int           i     = loop->n_timers++;
+    while (i > 0 && loop->timers[(i - 1) / 2].at > timer.at) {
+        loop->timers[i] = loop->timers[(i - 1) / 2];
+        i               = (i - 1) / 2;
+    }
+    loop->timers[i] = timer;
+    t->task->timed  = true;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file benchenv.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of the benchmark
+ *        environment, which pins benchmark threads, locks memory and checks
+ *        the machine for sources of noise in benchmark timings.
+ *
+ * The checks read Linux sysfs and procfs; on other systems the values are
+ * left unknown and no warnings are raised for them.
+ **/
+/* sched_setaffinity(), sched_getcpu() and getloadavg() are GNU extensions. */
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "benchenv.h"
+#include "tdd.h"
+
+#define CPU_SYSFS "/sys/devices/system/cpu"
+
+/* Reads the first line of a small file, without its newline. */
+static int __benchenv_read(const char* path, char* buf, size_t n) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return EXIT_FAILURE;
+
+    bool ok = fgets(buf, (int)n, f) != NULL;
+    fclose(f);
+    if (!ok) return EXIT_FAILURE;
+    buf[strcspn(buf, "\n")] = '\0';
+
+    return EXIT_SUCCESS;
+}
+
+tdd_bench_env_t* __benchenv_new(const suite_t* s) {
+    tdd_bench_env_t* env = calloc(1, sizeof(tdd_bench_env_t));
+    if (env == NULL) return NULL;
+
+    env->cpu    = -1;
+    env->turbo  = -1;
+    env->smt    = -1;
+    env->load   = -1;
+    env->warmup = s->bench_warmup > 0 ? s->bench_warmup : 0;
+
+    return env;
+}
+
+void __benchenv_lock(tdd_bench_env_t* env) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+        env->memory_locked = true;
+    } else {
+        env->warnings |= TDD_BENCH_WARN_MLOCK;
+    }
+}
+
+void __benchenv_unlock(tdd_bench_env_t* env) {
+    if (env->memory_locked) munlockall();
+}
+
+static void __benchenv_pin(tdd_bench_env_t* env, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    if (cpu < CPU_SETSIZE && sched_setaffinity(0, sizeof(set), &set) == 0) {
+        env->pinned = true;
+    } else {
+        env->warnings |= TDD_BENCH_WARN_PIN;
+    }
+}
+
+static void __benchenv_realtime(tdd_bench_env_t* env) {
+    /* The lowest real-time priority already outranks every normal thread. */
+    struct sched_param sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp) == 0) {
+        env->realtime = true;
+    } else {
+        env->warnings |= TDD_BENCH_WARN_REALTIME;
+    }
+}
+
+static void __benchenv_check(tdd_bench_env_t* env) {
+    char path[128];
+    char buf[256];
+
+    if (env->cpu >= 0) {
+        sprintf(path, CPU_SYSFS "/cpu%d/cpufreq/scaling_governor", env->cpu);
+        if (__benchenv_read(path, buf, sizeof(buf)) == EXIT_SUCCESS) {
+            snprintf(env->governor, sizeof(env->governor), "%.*s",
+                     (int)sizeof(env->governor) - 1, buf);
+            if (strcmp(buf, "performance") != 0) {
+                env->warnings |= TDD_BENCH_WARN_GOVERNOR;
+            }
+        }
+        sprintf(path, CPU_SYSFS "/cpu%d/topology/thread_siblings_list",
+                env->cpu);
+        if (__benchenv_read(path, buf, sizeof(buf)) == EXIT_SUCCESS) {
+            env->smt = strpbrk(buf, ",-") != NULL;
+        }
+    }
+
+    /* intel_pstate reports the opposite of the generic boost switch. */
+    if (__benchenv_read(CPU_SYSFS "/intel_pstate/no_turbo", buf,
+                        sizeof(buf)) == EXIT_SUCCESS) {
+        env->turbo = atoi(buf) == 0;
+    } else if (__benchenv_read(CPU_SYSFS "/cpufreq/boost", buf,
+                               sizeof(buf)) == EXIT_SUCCESS) {
+        env->turbo = atoi(buf) != 0;
+    }
+
+    double load;
+    if (getloadavg(&load, 1) == 1) env->load = load;
+
+    if (env->turbo == 1) env->warnings |= TDD_BENCH_WARN_TURBO;
+    if (env->smt == 1) env->warnings |= TDD_BENCH_WARN_SMT;
+    if (env->load > 1.0) env->warnings |= TDD_BENCH_WARN_LOAD;
+}
+
+void __benchenv_enter(tdd_bench_env_t* env, const suite_t* s) {
+    if (s->bench_cpu >= 0) __benchenv_pin(env, s->bench_cpu);
+    if (s->bench_realtime) __benchenv_realtime(env);
+    env->cpu = sched_getcpu();
+    __benchenv_check(env);
+}
@@ -0,0 +1,488 @@
+/**
+ * @file bulk.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of the bulk assertions
+ *        in tdd_assert.h, which compare whole buffers and arrays of floating
+ *        point numbers with vector instructions.
+ *
+ * Each comparison has a kernel that returns the index of the first element
+ * that does not match. The vector kernels test a block at a time with a
+ * check that may flag an element that matches but never passes one that
+ * does not, and rescan a flagged block one element at a time with the
+ * exact check. The kernel is chosen on first use: AVX2 if the CPU has it,
+ * otherwise SSE2 on x86-64, NEON on AArch64, or plain C.
+ *
+ * The passing path does not allocate; a message is only built once a
+ * comparison has failed.
+ **/
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assertutil.h"
+#include "bulk.h"
+#include "tdd.h"
+#include "tdd_assert.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BULK_X86
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define BULK_NEON
+#include <arm_neon.h>
+#endif
+
+/* Number of mismatches described in a failure message. */
+#define BULK_REPORT 8
+
+typedef struct bulk_kernels_t {
+    const char* name;
+    size_t (*mem)(const uint8_t* a, const uint8_t* b, size_t n);
+    size_t (*f32)(const float* a, const float* b, size_t n, uint32_t ulps);
+    size_t (*f64)(const double* a, const double* b, size_t n, double rel);
+} bulk_kernels_t;
+
+/*
+ * Maps the bits of a float to an integer that orders like the float, with
+ * both zeroes at 0, so that the distance between keys counts ulps.
+ */
+static int32_t __bulk_f32_key(float f) {
+    int32_t i;
+    memcpy(&i, &f, sizeof(i));
+    return i < 0 ? -(i & INT32_MAX) : i;
+}
+
+static bool __bulk_f32_ok(float a, float b, uint32_t ulps) {
+    if (a == b) return true;
+    if (a != a || b != b) return a != a && b != b;
+
+    int64_t d = (int64_t)__bulk_f32_key(a) - (int64_t)__bulk_f32_key(b);
+    return (uint64_t)(d < 0 ? -d : d) <= ulps;
+}
+
+static bool __bulk_f64_ok(double a, double b, double rel) {
+    if (a == b) return true;
+    if (a != a || b != b) return a != a && b != b;
+
+    double d  = a > b ? a - b : b - a;
+    double ma = a < 0 ? -a : a;
+    double mb = b < 0 ? -b : b;
+    /* An infinite difference is never near, however loose the bound. */
+    return d <= (ma > mb ? ma : mb) * rel && d - d == 0;
+}
+
+static size_t __bulk_mem_c(const uint8_t* a, const uint8_t* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) return i;
+    }
+    return n;
+}
+
+static size_t __bulk_f32_c(const float* a, const float* b, size_t n,
+                           uint32_t ulps) {
+    for (size_t i = 0; i < n; i++) {
+        if (!__bulk_f32_ok(a[i], b[i], ulps)) return i;
+    }
+    return n;
+}
+
+static size_t __bulk_f64_c(const double* a, const double* b, size_t n,
+                           double rel) {
+    for (size_t i = 0; i < n; i++) {
+        if (!__bulk_f64_ok(a[i], b[i], rel)) return i;
+    }
+    return n;
+}
+
+static const bulk_kernels_t bulk_c = {"c", &__bulk_mem_c, &__bulk_f32_c,
+                                      &__bulk_f64_c};
+
+/*
+ * Rescans a block of w elements at i that a vector check flagged; returns
+ * the index of the first mismatch, or n if every element matched.
+ */
+#define BULK_RESCAN(ok, i, w, n)                                             \
+    for (size_t j = (i); j < (i) + (w); j++) {                               \
+        if (!(ok)) return j;                                                 \
+    }
+
+#if defined(BULK_X86) && defined(__SSE2__)
+static size_t __bulk_mem_sse2(const uint8_t* a, const uint8_t* b, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        int     eq = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+        if (eq != 0xffff) return i + (size_t)__builtin_ctz(~eq);
+    }
+    return i + __bulk_mem_c(a + i, b + i, n - i);
+}
+
+static size_t __bulk_f32_sse2(const float* a, const float* b, size_t n,
+                              uint32_t ulps) {
+    int32_t u    = ulps > INT32_MAX ? INT32_MAX : (int32_t)ulps;
+    __m128i vu   = _mm_set1_epi32(u);
+    __m128i vnu  = _mm_set1_epi32(-u);
+    __m128i mag  = _mm_set1_epi32(INT32_MAX);
+    size_t  i    = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128  fa = _mm_loadu_ps(a + i);
+        __m128  fb = _mm_loadu_ps(b + i);
+        __m128i ia = _mm_castps_si128(fa);
+        __m128i ib = _mm_castps_si128(fb);
+        __m128i sa = _mm_srai_epi32(ia, 31);
+        __m128i sb = _mm_srai_epi32(ib, 31);
+        __m128i ka = _mm_sub_epi32(_mm_xor_si128(_mm_and_si128(ia, mag), sa),
+                                   sa);
+        __m128i kb = _mm_sub_epi32(_mm_xor_si128(_mm_and_si128(ib, mag), sb),
+                                   sb);
+        __m128i d  = _mm_sub_epi32(ka, kb);
+        /* Out of range, or of opposite signs so d may have overflowed. */
+        __m128i bad = _mm_or_si128(_mm_cmpgt_epi32(d, vu),
+                                   _mm_cmplt_epi32(d, vnu));
+        bad         = _mm_or_si128(bad,
+                                   _mm_srai_epi32(_mm_xor_si128(ka, kb), 31));
+        __m128 ok   = _mm_andnot_ps(_mm_castsi128_ps(bad),
+                                    _mm_cmpord_ps(fa, fb));
+        ok          = _mm_or_ps(ok, _mm_cmpeq_ps(fa, fb));
+        if (_mm_movemask_ps(ok) != 0xf) {
+            BULK_RESCAN(__bulk_f32_ok(a[j], b[j], ulps), i, 4, n);
+        }
+    }
+    return i + __bulk_f32_c(a + i, b + i, n - i, ulps);
+}
+
+static size_t __bulk_f64_sse2(const double* a, const double* b, size_t n,
+                              double rel) {
+    __m128d abs  = _mm_castsi128_pd(_mm_set1_epi64x(INT64_MAX));
+    __m128d inf  = _mm_set1_pd(HUGE_VAL);
+    __m128d vrel = _mm_set1_pd(rel);
+    size_t  i    = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d fa = _mm_loadu_pd(a + i);
+        __m128d fb = _mm_loadu_pd(b + i);
+        __m128d d  = _mm_and_pd(_mm_sub_pd(fa, fb), abs);
+        __m128d m  = _mm_mul_pd(_mm_max_pd(_mm_and_pd(fa, abs),
+                                           _mm_and_pd(fb, abs)),
+                                vrel);
+        __m128d ok = _mm_and_pd(_mm_cmple_pd(d, m), _mm_cmplt_pd(d, inf));
+        ok         = _mm_or_pd(ok, _mm_cmpeq_pd(fa, fb));
+        if (_mm_movemask_pd(ok) != 0x3) {
+            BULK_RESCAN(__bulk_f64_ok(a[j], b[j], rel), i, 2, n);
+        }
+    }
+    return i + __bulk_f64_c(a + i, b + i, n - i, rel);
+}
+
+static const bulk_kernels_t bulk_sse2 = {"sse2", &__bulk_mem_sse2,
+                                         &__bulk_f32_sse2, &__bulk_f64_sse2};
+#endif
+
+#ifdef BULK_X86
+#define BULK_AVX2 __attribute__((target("avx2")))
+
+BULK_AVX2 static size_t __bulk_mem_avx2(const uint8_t* a, const uint8_t* b,
+                                        size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i  va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i  vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        uint32_t eq = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+        if (eq != 0xffffffffU) return i + (size_t)__builtin_ctz(~eq);
+    }
+    return i + __bulk_mem_c(a + i, b + i, n - i);
+}
+
+BULK_AVX2 static size_t __bulk_f32_avx2(const float* a, const float* b,
+                                        size_t n, uint32_t ulps) {
+    int32_t u   = ulps > INT32_MAX ? INT32_MAX : (int32_t)ulps;
+    __m256i vu  = _mm256_set1_epi32(u);
+    __m256i vnu = _mm256_set1_epi32(-u);
+    __m256i mag = _mm256_set1_epi32(INT32_MAX);
+    size_t  i   = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256  fa = _mm256_loadu_ps(a + i);
+        __m256  fb = _mm256_loadu_ps(b + i);
+        __m256i ia = _mm256_castps_si256(fa);
+        __m256i ib = _mm256_castps_si256(fb);
+        __m256i sa = _mm256_srai_epi32(ia, 31);
+        __m256i sb = _mm256_srai_epi32(ib, 31);
+        __m256i ka = _mm256_sub_epi32(
+            _mm256_xor_si256(_mm256_and_si256(ia, mag), sa), sa);
+        __m256i kb = _mm256_sub_epi32(
+            _mm256_xor_si256(_mm256_and_si256(ib, mag), sb), sb);
+        __m256i d  = _mm256_sub_epi32(ka, kb);
+        /* Out of range, or of opposite signs so d may have overflowed. */
+        __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi32(d, vu),
+                                      _mm256_cmpgt_epi32(vnu, d));
+        bad         = _mm256_or_si256(
+            bad, _mm256_srai_epi32(_mm256_xor_si256(ka, kb), 31));
+        __m256 ok = _mm256_andnot_ps(_mm256_castsi256_ps(bad),
+                                     _mm256_cmp_ps(fa, fb, _CMP_ORD_Q));
+        ok        = _mm256_or_ps(ok, _mm256_cmp_ps(fa, fb, _CMP_EQ_OQ));
+        if (_mm256_movemask_ps(ok) != 0xff) {
+            BULK_RESCAN(__bulk_f32_ok(a[j], b[j], ulps), i, 8, n);
+        }
+    }
+    return i + __bulk_f32_c(a + i, b + i, n - i, ulps);
+}
+
+BULK_AVX2 static size_t __bulk_f64_avx2(const double* a, const double* b,
+                                        size_t n, double rel) {
+    __m256d abs  = _mm256_castsi256_pd(_mm256_set1_epi64x(INT64_MAX));
+    __m256d inf  = _mm256_set1_pd(HUGE_VAL);
+    __m256d vrel = _mm256_set1_pd(rel);
+    size_t  i    = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d fa = _mm256_loadu_pd(a + i);
+        __m256d fb = _mm256_loadu_pd(b + i);
+        __m256d d  = _mm256_and_pd(_mm256_sub_pd(fa, fb), abs);
+        __m256d m  = _mm256_mul_pd(_mm256_max_pd(_mm256_and_pd(fa, abs),
+                                                 _mm256_and_pd(fb, abs)),
+                                   vrel);
+        __m256d ok = _mm256_and_pd(_mm256_cmp_pd(d, m, _CMP_LE_OQ),
+                                   _mm256_cmp_pd(d, inf, _CMP_LT_OQ));
+        ok         = _mm256_or_pd(ok, _mm256_cmp_pd(fa, fb, _CMP_EQ_OQ));
+        if (_mm256_movemask_pd(ok) != 0xf) {
+            BULK_RESCAN(__bulk_f64_ok(a[j], b[j], rel), i, 4, n);
+        }
+    }
+    return i + __bulk_f64_c(a + i, b + i, n - i, rel);
+}
+
+static const bulk_kernels_t bulk_avx2 = {"avx2", &__bulk_mem_avx2,
+                                         &__bulk_f32_avx2, &__bulk_f64_avx2};
+#endif
+
+#ifdef BULK_NEON
+static size_t __bulk_mem_neon(const uint8_t* a, const uint8_t* b, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        if (vminvq_u8(eq) != 0xff) break;
+    }
+    return i + __bulk_mem_c(a + i, b + i, n - i);
+}
+
+static size_t __bulk_f32_neon(const float* a, const float* b, size_t n,
+                              uint32_t ulps) {
+    int32_t   u   = ulps > INT32_MAX ? INT32_MAX : (int32_t)ulps;
+    int32x4_t vu  = vdupq_n_s32(u);
+    int32x4_t vnu = vdupq_n_s32(-u);
+    int32x4_t mag = vdupq_n_s32(INT32_MAX);
+    size_t    i   = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t fa = vld1q_f32(a + i);
+        float32x4_t fb = vld1q_f32(b + i);
+        int32x4_t   ia = vreinterpretq_s32_f32(fa);
+        int32x4_t   ib = vreinterpretq_s32_f32(fb);
+        int32x4_t   sa = vshrq_n_s32(ia, 31);
+        int32x4_t   sb = vshrq_n_s32(ib, 31);
+        int32x4_t   ka = vsubq_s32(veorq_s32(vandq_s32(ia, mag), sa), sa);
+        int32x4_t   kb = vsubq_s32(veorq_s32(vandq_s32(ib, mag), sb), sb);
+        int32x4_t   d  = vsubq_s32(ka, kb);
+        uint32x4_t  ok = vandq_u32(vcleq_s32(d, vu), vcgeq_s32(d, vnu));
+        /* Opposite signs, where d may have overflowed, are rescanned. */
+        ok = vandq_u32(ok, vcgeq_s32(veorq_s32(ka, kb), vdupq_n_s32(0)));
+        ok = vandq_u32(ok, vandq_u32(vceqq_f32(fa, fa), vceqq_f32(fb, fb)));
+        ok = vorrq_u32(ok, vceqq_f32(fa, fb));
+        if (vminvq_u32(ok) != 0xffffffffU) {
+            BULK_RESCAN(__bulk_f32_ok(a[j], b[j], ulps), i, 4, n);
+        }
+    }
+    return i + __bulk_f32_c(a + i, b + i, n - i, ulps);
+}
+
+static size_t __bulk_f64_neon(const double* a, const double* b, size_t n,
+                              double rel) {
+    float64x2_t inf  = vdupq_n_f64(HUGE_VAL);
+    float64x2_t vrel = vdupq_n_f64(rel);
+    size_t      i    = 0;
+    for (; i + 2 <= n; i += 2) {
+        float64x2_t fa = vld1q_f64(a + i);
+        float64x2_t fb = vld1q_f64(b + i);
+        float64x2_t d  = vabdq_f64(fa, fb);
+        float64x2_t m  =
+            vmulq_f64(vmaxq_f64(vabsq_f64(fa), vabsq_f64(fb)), vrel);
+        uint64x2_t ok = vandq_u64(vcleq_f64(d, m), vcltq_f64(d, inf));
+        ok            = vorrq_u64(ok, vceqq_f64(fa, fb));
+        if ((vgetq_lane_u64(ok, 0) & vgetq_lane_u64(ok, 1)) != UINT64_MAX) {
+            BULK_RESCAN(__bulk_f64_ok(a[j], b[j], rel), i, 2, n);
+        }
+    }
+    return i + __bulk_f64_c(a + i, b + i, n - i, rel);
+}
+
+static const bulk_kernels_t bulk_neon = {"neon", &__bulk_mem_neon,
+                                         &__bulk_f32_neon, &__bulk_f64_neon};
+#endif
+
+/* The kernels in use, chosen on first use or by __bulk_use(). */
+static const bulk_kernels_t* kernels = NULL;
+
+static const bulk_kernels_t* __bulk_kernels(void) {
+    const bulk_kernels_t* k = __atomic_load_n(&kernels, __ATOMIC_RELAXED);
+    if (k != NULL) return k;
+
+    k = &bulk_c;
+#ifdef BULK_X86
+#ifdef __SSE2__
+    k = &bulk_sse2;
+#endif
+    if (__builtin_cpu_supports("avx2")) k = &bulk_avx2;
+#endif
+#ifdef BULK_NEON
+    k = &bulk_neon;
+#endif
+    __atomic_store_n(&kernels, k, __ATOMIC_RELAXED);
+
+    return k;
+}
+
+int __bulk_use(const char* name) {
+    const bulk_kernels_t* k = NULL;
+    if (strcmp(name, bulk_c.name) == 0) k = &bulk_c;
+#ifdef BULK_X86
+#ifdef __SSE2__
+    if (strcmp(name, bulk_sse2.name) == 0) k = &bulk_sse2;
+#endif
+    if (strcmp(name, bulk_avx2.name) == 0 &&
+        __builtin_cpu_supports("avx2")) {
+        k = &bulk_avx2;
+    }
+#endif
+#ifdef BULK_NEON
+    if (strcmp(name, bulk_neon.name) == 0) k = &bulk_neon;
+#endif
+    if (k == NULL) return EXIT_FAILURE;
+    __atomic_store_n(&kernels, k, __ATOMIC_RELAXED);
+
+    return EXIT_SUCCESS;
+}
+
+size_t __bulk_mem_find(const void* a, const void* b, size_t n) {
+    return __bulk_kernels()->mem(a, b, n);
+}
+
+size_t __bulk_f32_find(const float* a, const float* b, size_t n,
+                       uint32_t ulps) {
+    return __bulk_kernels()->f32(a, b, n, ulps);
+}
+
+size_t __bulk_f64_find(const double* a, const double* b, size_t n,
+                       double rel) {
+    return __bulk_kernels()->f64(a, b, n, rel);
+}
+
+/* The mismatches found by a failed comparison. */
+typedef struct bulk_diff_t {
+    size_t n_diff;
+    size_t at[BULK_REPORT];
+} bulk_diff_t;
+
+static void __bulk_note(bulk_diff_t* diff, size_t i) {
+    if (diff->n_diff < BULK_REPORT) diff->at[diff->n_diff] = i;
+    diff->n_diff++;
+}
+
+/* Starts a failure message; each described mismatch needs 128 more bytes. */
+static char* __bulk_msg(const bulk_diff_t* diff, const char* file, int line,
+                        const char* expr, size_t n, const char* what) {
+    char* msg = malloc(256 + strlen(file) + strlen(expr) + 128 * BULK_REPORT);
+    if (msg == NULL) return NULL;
+    sprintf(msg, "%s:%d: %s: %zu of %zu %s differ (%s):", file, line, expr,
+            diff->n_diff, n, what, __bulk_kernels()->name);
+
+    return msg;
+}
+
+bool __tdd_assert_mem_eq(test_t* t, const void* got, const void* want,
+                         size_t n, const char* file, int line,
+                         const char* expr) {
+    const uint8_t* a = got;
+    const uint8_t* b = want;
+    size_t (*find)(const uint8_t*, const uint8_t*, size_t) =
+        __bulk_kernels()->mem;
+
+    size_t i = find(a, b, n);
+    if (TDD_LIKELY(i == n)) return true;
+
+    bulk_diff_t diff;
+    diff.n_diff = 0;
+    for (; i < n; i += 1 + find(a + i + 1, b + i + 1, n - i - 1)) {
+        __bulk_note(&diff, i);
+    }
+
+    char* msg = __bulk_msg(&diff, file, line, expr, n, "bytes");
+    for (size_t k = 0; msg != NULL && k < diff.n_diff && k < BULK_REPORT;
+         k++) {
+        size_t j = diff.at[k];
+        sprintf(msg + strlen(msg), "%s [%zu] got 0x%02x, want 0x%02x",
+                k > 0 ? "," : "", j, a[j], b[j]);
+    }
+
+    return __assert_report(t, msg);
+}
+
+bool __tdd_assert_f32_near_ulps(test_t* t, const float* got,
+                                const float* want, size_t n,
+                                uint32_t max_ulps, const char* file, int line,
+                                const char* expr) {
+    size_t (*find)(const float*, const float*, size_t, uint32_t) =
+        __bulk_kernels()->f32;
+
+    size_t i = find(got, want, n, max_ulps);
+    if (TDD_LIKELY(i == n)) return true;
+
+    bulk_diff_t diff;
+    diff.n_diff = 0;
+    for (; i < n; i += 1 + find(got + i + 1, want + i + 1, n - i - 1,
+                                max_ulps)) {
+        __bulk_note(&diff, i);
+    }
+
+    char* msg = __bulk_msg(&diff, file, line, expr, n, "floats");
+    for (size_t k = 0; msg != NULL && k < diff.n_diff && k < BULK_REPORT;
+         k++) {
+        size_t  j    = diff.at[k];
+        int64_t ulps = (int64_t)__bulk_f32_key(got[j]) -
+                       (int64_t)__bulk_f32_key(want[j]);
+        sprintf(msg + strlen(msg), "%s [%zu] got %.9g, want %.9g (%lld ulps)",
+                k > 0 ? "," : "", j, got[j], want[j],
+                (long long)(ulps < 0 ? -ulps : ulps));
+    }
+
+    return __assert_report(t, msg);
+}
+
+bool __tdd_assert_f64_near_rel(test_t* t, const double* got,
+                               const double* want, size_t n, double max_rel,
+                               const char* file, int line, const char* expr) {
+    size_t (*find)(const double*, const double*, size_t, double) =
+        __bulk_kernels()->f64;
+
+    size_t i = find(got, want, n, max_rel);
+    if (TDD_LIKELY(i == n)) return true;
+
+    bulk_diff_t diff;
+    diff.n_diff = 0;
+    for (; i < n; i += 1 + find(got + i + 1, want + i + 1, n - i - 1,
+                                max_rel)) {
+        __bulk_note(&diff, i);
+    }
+
+    char* msg = __bulk_msg(&diff, file, line, expr, n, "doubles");
+    for (size_t k = 0; msg != NULL && k < diff.n_diff && k < BULK_REPORT;
+         k++) {
+        size_t j = diff.at[k];
+        sprintf(msg + strlen(msg), "%s [%zu] got %.17g, want %.17g",
+                k > 0 ? "," : "", j, got[j], want[j]);
+    }
+
+    return __assert_report(t, msg);
+}
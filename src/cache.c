@@ -0,0 +1,328 @@
+/**
+ * @file cache.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of benchmark input
+ *        buffers, which are placed on a chosen page size and NUMA node, and
+ *        of the cache states benchmarks are timed in.
+ *
+ * Caches are made cold by flushing the benchmark's buffers line by line,
+ * where the CPU lets user code do so, and then streaming through a buffer
+ * twice the size of the last-level cache, which evicts whatever else the
+ * benchmark reads, such as data set up before the suite ran.
+ **/
+/* MAP_ANONYMOUS, madvise() and syscall() are not in POSIX.1c. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "cache.h"
+#include "fixture.h"
+#include "spans.h"
+#include "tdd.h"
+
+#define CPU_CACHE_SYSFS "/sys/devices/system/cpu/cpu0/cache"
+
+/* The stride caches are flushed and touched with. */
+#define CACHE_LINE 64
+/* The size of a transparent huge page on x86-64 and 4K-granule AArch64. */
+#define CACHE_HUGE_PAGE (2 << 20)
+/* The last-level cache size assumed when it cannot be read. */
+#define CACHE_LLC_DEFAULT (32 << 20)
+/* The number of runs timed in each state by __cache_compare(). */
+#define CACHE_RUNS 5
+/* The most NUMA nodes test_bench_alloc() can bind to. */
+#define CACHE_MAX_NODES 1024
+/* MPOL_BIND from <linux/mempolicy.h>, which libc does not provide. */
+#define CACHE_MPOL_BIND 2
+
+/* A buffer allocated by test_bench_alloc(). */
+typedef struct cache_buf_t {
+    char*               addr;
+    size_t              len;
+    struct cache_buf_t* next;
+} cache_buf_t;
+
+/* The buffer streamed through to evict the last-level cache. */
+static char*          evict     = NULL;
+static size_t         evict_len = 0;
+static pthread_once_t evict_once = PTHREAD_ONCE_INIT;
+
+static void __cache_error(test_t* t, const char* what, int err) {
+    const char* why = strerror(err);
+    char*       msg = malloc(32 + strlen(what) + strlen(why));
+    if (msg == NULL) return;
+    sprintf(msg, "test_bench_alloc: %s: %s", what, why);
+    test_error(t, msg);
+    free(msg);
+}
+
+/* Reads the first line of a small file, without its newline. */
+static int __cache_read(const char* path, char* buf, size_t n) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return EXIT_FAILURE;
+
+    bool ok = fgets(buf, (int)n, f) != NULL;
+    fclose(f);
+    if (!ok) return EXIT_FAILURE;
+    buf[strcspn(buf, "\n")] = '\0';
+
+    return EXIT_SUCCESS;
+}
+
+/* Finds the size of the highest level of cache from sysfs. */
+static size_t __cache_llc_size(void) {
+    size_t size  = 0;
+    int    level = 0;
+    for (int i = 0; i < 16; i++) {
+        char path[96], buf[32];
+        sprintf(path, CPU_CACHE_SYSFS "/index%d/level", i);
+        if (__cache_read(path, buf, sizeof(buf)) != EXIT_SUCCESS) break;
+        int l = atoi(buf);
+        sprintf(path, CPU_CACHE_SYSFS "/index%d/size", i);
+        if (__cache_read(path, buf, sizeof(buf)) != EXIT_SUCCESS) continue;
+
+        char*  unit = NULL;
+        size_t n    = strtoul(buf, &unit, 10);
+        if (*unit == 'K') n <<= 10;
+        if (*unit == 'M') n <<= 20;
+        if (l > level || (l == level && n > size)) {
+            level = l;
+            size  = n;
+        }
+    }
+
+    return size > 0 ? size : CACHE_LLC_DEFAULT;
+}
+
+static void __cache_evict_init(void) {
+    size_t len = 2 * __cache_llc_size();
+    void*  buf = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) return;
+    evict     = buf;
+    evict_len = len;
+}
+
+/* Streams through the eviction buffer, writing so dirty lines go too. */
+static void __cache_evict(void) {
+    pthread_once(&evict_once, &__cache_evict_init);
+
+    volatile char* p = evict;
+    for (size_t i = 0; i < evict_len; i += CACHE_LINE) p[i]++;
+}
+
+/* Writes back and invalidates every line of a buffer, if the CPU can. */
+static void __cache_flush(const char* p, size_t len) {
+#if defined(__SSE2__)
+    for (size_t i = 0; i < len; i += CACHE_LINE) _mm_clflush(p + i);
+    _mm_mfence();
+#elif defined(__aarch64__)
+    for (size_t i = 0; i < len; i += CACHE_LINE) {
+        __asm__ volatile("dc civac, %0" : : "r"(p + i) : "memory");
+    }
+    __asm__ volatile("dsb ish" : : : "memory");
+#else
+    (void)p;
+    (void)len;
+#endif
+}
+
+/* Reads every line of a buffer into the caches. */
+static void __cache_touch(const char* p, size_t len) {
+    const volatile char* v = p;
+    for (size_t i = 0; i < len; i += CACHE_LINE) (void)v[i];
+}
+
+/* Binds a range of memory to a NUMA node. */
+static int __cache_bind(void* addr, size_t len, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    enum { BITS = 8 * sizeof(unsigned long) };
+    unsigned long mask[CACHE_MAX_NODES / BITS] = {0};
+    if (node >= CACHE_MAX_NODES) return EINVAL;
+    mask[node / BITS] = 1UL << (node % BITS);
+
+    /* The kernel reads one bit fewer than maxnode. */
+    if (syscall(SYS_mbind, addr, len, CACHE_MPOL_BIND, mask,
+                CACHE_MAX_NODES + 1, 0) != 0) {
+        return errno;
+    }
+    return 0;
+#else
+    (void)addr;
+    (void)len;
+    (void)node;
+    return ENOSYS;
+#endif
+}
+
+/* Asks for the buffer to be backed by the given page size. */
+static int __cache_pages(void* addr, size_t len, tdd_pages_t pages) {
+    if (pages == TDD_PAGES_DEFAULT) return 0;
+#if defined(MADV_HUGEPAGE)
+    int advice = pages == TDD_PAGES_HUGE ? MADV_HUGEPAGE : MADV_NOHUGEPAGE;
+    return madvise(addr, len, advice) == 0 ? 0 : errno;
+#else
+    (void)addr;
+    (void)len;
+    return pages == TDD_PAGES_HUGE ? ENOSYS : 0;
+#endif
+}
+
+void* test_bench_alloc(test_t* t, size_t len, tdd_pages_t pages, int node) {
+    if (t == NULL || len == 0) return NULL;
+
+    size_t page  = (size_t)sysconf(_SC_PAGESIZE);
+    size_t align = pages == TDD_PAGES_HUGE ? CACHE_HUGE_PAGE : page;
+    size_t size  = (len + align - 1) / align * align;
+    size_t extra = align > page ? align : 0;
+    char*  map   = mmap(NULL, size + extra, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        __cache_error(t, "cannot map buffer", errno);
+        return NULL;
+    }
+
+    /* Trim the mapping to a huge page boundary at either end. */
+    uintptr_t at   = ((uintptr_t)map + align - 1) & ~(uintptr_t)(align - 1);
+    char*     addr = (char*)at;
+    if (addr > map) munmap(map, (size_t)(addr - map));
+    if (map + size + extra > addr + size) {
+        munmap(addr + size, (size_t)(map + size + extra - (addr + size)));
+    }
+
+    cache_buf_t* buf = malloc(sizeof(cache_buf_t));
+    if (buf == NULL) {
+        munmap(addr, size);
+        return NULL;
+    }
+    buf->addr  = addr;
+    buf->len   = size;
+    buf->next  = t->buffers;
+    t->buffers = buf;
+
+    int err = __cache_pages(addr, size, pages);
+    if (err != 0) {
+        __cache_error(t, pages == TDD_PAGES_HUGE ? "cannot use huge pages"
+                                                 : "cannot use small pages",
+                      err);
+    }
+    if (node >= 0 && (err = __cache_bind(addr, size, node)) != 0) {
+        char what[48];
+        sprintf(what, "cannot bind to NUMA node %d", node);
+        __cache_error(t, what, err);
+    }
+
+    /* Fault the pages in now, so it is not timed. */
+    volatile char* v = addr;
+    for (size_t i = 0; i < size; i += page) v[i] = 0;
+
+    return addr;
+}
+
+void __cache_free(test_t* t) {
+    cache_buf_t* buf = t->buffers;
+    while (buf != NULL) {
+        cache_buf_t* next = buf->next;
+        munmap(buf->addr, buf->len);
+        free(buf);
+        buf = next;
+    }
+    t->buffers = NULL;
+}
+
+void test_cache_prepare(test_t* t) {
+    if (t == NULL) return;
+
+    if (t->cache_mode == TDD_CACHE_COLD) {
+        for (cache_buf_t* b = t->buffers; b != NULL; b = b->next) {
+            __cache_flush(b->addr, b->len);
+        }
+        __cache_evict();
+        __fixture_evict(t);
+    } else if (t->cache_mode == TDD_CACHE_WARM) {
+        for (cache_buf_t* b = t->buffers; b != NULL; b = b->next) {
+            __cache_touch(b->addr, b->len);
+        }
+        __fixture_warm(t);
+    }
+    test_timer_start(t);
+}
+
+/*
+ * Times one run of a benchmark in a cache state, reporting what it recorded
+ * on t, or returns -1 if it fails or raises an error.
+ */
+static double __cache_time(void* (*fn)(void* t), test_t* t,
+                           tdd_cache_mode_t mode) {
+    test_t* run = tdd_test_new(t->name);
+    if (run == NULL) return -1;
+    run->suite      = t->suite;
+    run->cache_mode = mode;
+
+    test_cache_prepare(run);
+    fn(run);
+    if (run->end->tv_sec == 0 && run->end->tv_nsec == 0) {
+        test_timer_end(run);
+    }
+    double ns = (double)(run->end->tv_sec - run->start->tv_sec) * 1e9 +
+                (double)(run->end->tv_nsec - run->start->tv_nsec);
+
+    __fixture_rates(run, t);
+    for (int i = 0; i < run->err; i++) {
+        test_error(t, run->err_msg[i]);
+    }
+    if (run->failed && !t->failed) test_fail(t, run->fail_msg);
+    __spans_merge(run, t);
+    if (run->failed || run->err > 0) ns = -1;
+    tdd_test_del(run);
+
+    return ns;
+}
+
+static int __cache_cmp(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double __cache_median(double* xs, int n) {
+    qsort(xs, n, sizeof(double), &__cache_cmp);
+    return n % 2 ? xs[n / 2] : (xs[n / 2 - 1] + xs[n / 2]) / 2;
+}
+
+void __cache_compare(void* (*fn)(void* t), test_t* t) {
+    double cold[CACHE_RUNS], warm[CACHE_RUNS];
+    int    n = 0;
+    while (n < CACHE_RUNS) {
+        cold[n] = __cache_time(fn, t, TDD_CACHE_COLD);
+        if (cold[n] < 0) break;
+        warm[n] = __cache_time(fn, t, TDD_CACHE_WARM);
+        if (warm[n] < 0) break;
+        n++;
+    }
+    if (n == 0) return;
+
+    tdd_cache_t* cache = malloc(sizeof(tdd_cache_t));
+    if (cache == NULL) return;
+    cache->runs        = n;
+    cache->cold_ns     = __cache_median(cold, n);
+    cache->warm_ns     = __cache_median(warm, n);
+    cache->evict_bytes = (int64_t)evict_len;
+    free(t->cache);
+    t->cache = cache;
+}
@@ -0,0 +1,596 @@
+/**
+ * @file dist.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of running a suite on
+ *        worker processes, which take tests from a coordinator as they
+ *        finish the ones they have.
+ *
+ * Workers stream event log records to the coordinator, starting with a
+ * suite start record that says how many tests their suite has. The records
+ * are encoded the same whatever the byte order of the worker's host. A
+ * worker whose log header shows another format version is dropped before
+ * it is handed any work. Each unit of work is sent to a worker as
+ * two 32-bit integers in network byte order: the position of the first
+ * test and the number of tests to run from there, which is more than one
+ * only for a run of async tests. The coordinator sends the next unit
+ * once the worker's last test has ended, and a position of -1 once there is
+ * nothing left, after which the worker disconnects.
+ **/
+/* getaddrinfo(), socketpair() and MSG_NOSIGNAL are not in POSIX.1c. */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dist.h"
+#include "eventlog.h"
+#include "suite.h"
+#include "tdd.h"
+#include "trace.h"
+
+/* The most bytes read from a worker at once. */
+#define DIST_READ (64 << 10)
+/* The most workers waiting to be accepted at once. */
+#define DIST_BACKLOG 64
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+struct dist_t;
+
+/* A worker connected to the coordinator. */
+typedef struct dist_worker_t {
+    struct dist_t*    dist;
+    int               fd;
+    tdd_log_stream_t* stream;
+    /* The process of a worker the coordinator started, or 0. */
+    pid_t pid;
+    /* The number of the worker, which names its track in a trace. */
+    int id;
+    /* Whether the worker has said which suite it runs, and if it is ours. */
+    bool hello;
+    bool foreign;
+    /* Whether the worker has been told to stop. */
+    bool stopped;
+    /* The unit of work handed to the worker, and when. */
+    int             first;
+    int             count;
+    int             done;
+    struct timespec sent;
+} dist_worker_t;
+
+typedef struct dist_t {
+    suite_t* s;
+    bool     fatal_failures;
+    bool     aborted;
+    int      listen_fd;
+    /* The next test to hand out, and which tests have been recorded. */
+    int   next;
+    bool* recorded;
+    int   n_recorded;
+
+    dist_worker_t** workers;
+    int             n_workers;
+    int             cap_workers;
+    /* The number of workers that have ever connected. */
+    int n_joined;
+    uint8_t*        buf;
+} dist_t;
+
+/* Opens a TCP socket listening on, or connected to, HOST:PORT. */
+static int __dist_tcp(const char* address, bool listening) {
+    const char* port = strrchr(address, ':');
+    if (port == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    char   host[256];
+    size_t n = (size_t)(port - address);
+    if (n >= sizeof(host)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(host, address, n);
+    host[n] = '\0';
+
+    /* IPv6 addresses are written in brackets, as in URLs. */
+    char* name = host;
+    if (n >= 2 && host[0] == '[' && host[n - 1] == ']') {
+        host[n - 1] = '\0';
+        name++;
+    }
+
+    /*
+     * No host means loopback, which is listened on as 127.0.0.1 so that
+     * clients that name it reach the server as well as those that do not;
+     * every interface is only listened on when the host is `*`.
+     */
+    bool any = listening && strcmp(name, "*") == 0;
+    if (listening && *name == '\0') name = "127.0.0.1";
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = any ? AI_PASSIVE : 0;
+    if (getaddrinfo(*name != '\0' && !any ? name : NULL, port + 1, &hints,
+                    &res) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+                listen(fd, DIST_BACKLOG) == 0) {
+                break;
+            }
+        } else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            /* Units of work are tiny, and must not wait to be batched. */
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    return fd;
+}
+
+int __dist_socket(const char* address, bool listening) {
+    if (strncmp(address, DIST_TCP, strlen(DIST_TCP)) == 0) {
+        return __dist_tcp(address + strlen(DIST_TCP), listening);
+    }
+
+    struct sockaddr_un sun;
+    memset(&sun, 0, sizeof(struct sockaddr_un));
+    sun.sun_family = AF_UNIX;
+    if (strlen(address) >= sizeof(sun.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(sun.sun_path, address);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int rc;
+    if (listening) {
+        unlink(address);
+        rc = bind(fd, (struct sockaddr*)&sun, sizeof(struct sockaddr_un));
+        if (rc == 0) rc = listen(fd, DIST_BACKLOG);
+    } else {
+        rc = connect(fd, (struct sockaddr*)&sun, sizeof(struct sockaddr_un));
+    }
+    if (rc != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+static int __dist_send(int fd, int32_t first, int32_t count) {
+    uint32_t msg[2] = {htonl((uint32_t)first), htonl((uint32_t)count)};
+    size_t   off    = 0;
+    while (off < sizeof(msg)) {
+        ssize_t n =
+            send(fd, (char*)msg + off, sizeof(msg) - off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return EXIT_FAILURE;
+        off += (size_t)n;
+    }
+    return EXIT_SUCCESS;
+}
+
+static int __dist_recv(int fd, int32_t msg[2]) {
+    uint32_t net[2];
+    size_t   off = 0;
+    while (off < sizeof(net)) {
+        ssize_t n = read(fd, (char*)net + off, sizeof(net) - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return EXIT_FAILURE;
+        off += (size_t)n;
+    }
+    msg[0] = (int32_t)ntohl(net[0]);
+    msg[1] = (int32_t)ntohl(net[1]);
+    return EXIT_SUCCESS;
+}
+
+/* Runs the tests a coordinator hands out on a connected socket. */
+static int __dist_work(suite_t* s, int fd) {
+    tdd_eventlog_t* log = __log_stream(fd);
+    if (log == NULL) {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    /* Results go to the coordinator alone. */
+    struct tdd_eventlog_t* eventlog = s->eventlog;
+    struct tdd_trace_t*    trace    = s->trace;
+    FILE*                  outfile  = s->outfile;
+    s->eventlog                     = log;
+    s->trace                        = NULL;
+    s->outfile                      = NULL;
+    __log_suite_start(log, s->n_tests);
+
+    int32_t msg[2];
+    while (__dist_recv(fd, msg) == EXIT_SUCCESS && msg[0] >= 0 &&
+           msg[0] < s->n_tests) {
+        s->test_index = msg[0];
+        int end       = msg[0] + msg[1];
+        while (s->test_index < end && s->test_index < s->n_tests) {
+            int before = s->test_index;
+            suite_next(s, false);
+            if (s->test_index == before) break;
+        }
+    }
+
+    s->eventlog = eventlog;
+    s->trace    = trace;
+    s->outfile  = outfile;
+    __log_close(log);
+
+    return EXIT_SUCCESS;
+}
+
+int suite_work(suite_t* s, const char* address) {
+    if (s == NULL || address == NULL) return EXIT_FAILURE;
+
+    int fd = __dist_socket(address, false);
+    if (fd < 0) return EXIT_FAILURE;
+
+    return __dist_work(s, fd);
+}
+
+/* Whether a test is part of the unit of work a worker has. */
+static bool __dist_owns(const dist_worker_t* w, int index) {
+    return index >= w->first && index < w->first + w->count &&
+           !w->dist->recorded[index];
+}
+
+/* Forwards the records of running tests to the coordinator's event log. */
+static void __dist_event(void* ctx, const tdd_event_t* ev) {
+    dist_worker_t* w = ctx;
+    suite_t*       s = w->dist->s;
+
+    if (ev->type == TDD_EVENT_SUITE_START && !w->hello) {
+        w->hello   = true;
+        w->foreign = ev->n_tests != s->n_tests;
+        return;
+    }
+    if (s->eventlog == NULL || !__dist_owns(w, ev->index)) return;
+
+    struct timespec at;
+    at.tv_sec  = (time_t)(ev->ts / 1000000000LL);
+    at.tv_nsec = (long)(ev->ts % 1000000000LL);
+    switch (ev->type) {
+    case TDD_EVENT_TEST_START:
+        __log_test_start(s->eventlog, ev->index, ev->name, ev->desc);
+        break;
+    case TDD_EVENT_ERROR:
+    case TDD_EVENT_FAIL:
+        __log_message(s->eventlog, ev->type, ev->index, &at, ev->msg);
+        break;
+    default:
+        /* The rest are written again when the test is recorded. */
+        break;
+    }
+}
+
+/* Records a finished test in the suite, unless testing was aborted. */
+static void __dist_record(dist_worker_t* w, int index, test_t* t,
+                          bool crashed) {
+    dist_t* d = w->dist;
+    t->suite  = d->s;
+    t->index  = index;
+    d->recorded[index] = true;
+    d->n_recorded++;
+    w->done++;
+    if (d->aborted) return;
+    if (crashed) d->s->n_segv++;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int track = __trace_track(d->s->trace, "process", w->id);
+    if (__suite_record(d->s, d->s->tests[index], t, crashed, &w->sent, &now,
+                       track, d->fatal_failures) != EXIT_SUCCESS) {
+        d->aborted = true;
+    }
+}
+
+/* Records a test a worker finished, which may have crashed and recovered. */
+static void __dist_test(void* ctx, int index, test_t* t, bool crashed) {
+    dist_worker_t* w = ctx;
+    if (__dist_owns(w, index)) __dist_record(w, index, t, crashed);
+}
+
+static int __dist_add(dist_t* d, int fd, pid_t pid) {
+    if (d->n_workers == d->cap_workers) {
+        int             cap = d->cap_workers > 0 ? 2 * d->cap_workers : 8;
+        dist_worker_t** tmp =
+            realloc(d->workers, sizeof(dist_worker_t*) * (size_t)cap);
+        if (tmp == NULL) {
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        d->workers     = tmp;
+        d->cap_workers = cap;
+    }
+    dist_worker_t* w = calloc(1, sizeof(dist_worker_t));
+    if (w == NULL) {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    w->dist   = d;
+    w->fd     = fd;
+    w->pid    = pid;
+    w->id     = d->n_joined++;
+    w->stream = __log_stream_new(&__dist_event, &__dist_test, w);
+    if (w->stream == NULL) {
+        close(fd);
+        free(w);
+        return EXIT_FAILURE;
+    }
+    d->workers[d->n_workers++] = w;
+
+    return EXIT_SUCCESS;
+}
+
+/* Starts a worker process, connected to the coordinator by a socket pair. */
+static int __dist_spawn(dist_t* d) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return EXIT_FAILURE;
+
+    /* Output buffered before the fork would be written by both processes. */
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return EXIT_FAILURE;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        if (d->listen_fd >= 0) close(d->listen_fd);
+        for (int i = 0; i < d->n_workers; i++) close(d->workers[i]->fd);
+        int ret = __dist_work(d->s, sv[1]);
+        fflush(NULL);
+        _exit(ret);
+    }
+    close(sv[1]);
+
+    return __dist_add(d, sv[0], pid);
+}
+
+/* Hands a worker its next unit of work, or tells it to stop. */
+static void __dist_assign(dist_t* d, dist_worker_t* w) {
+    suite_t* s = d->s;
+    w->first   = 0;
+    w->count   = 0;
+    w->done    = 0;
+    if (d->aborted || w->foreign || d->next >= s->n_tests) {
+        w->stopped = true;
+        __dist_send(w->fd, -1, 0);
+        return;
+    }
+
+    /* Runs of async tests are handed out whole, as suite_next() runs them. */
+    int n = 1;
+    if (s->tests[d->next]->step != NULL) {
+        while (d->next + n < s->n_tests &&
+               s->tests[d->next + n]->step != NULL &&
+               (s->async_max <= 0 || n < s->async_max)) {
+            n++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &w->sent);
+    if (__dist_send(w->fd, d->next, n) != EXIT_SUCCESS) return;
+    w->first = d->next;
+    w->count = n;
+    d->next += n;
+}
+
+/*
+ * Drops a worker that has disconnected, reporting the tests it had not
+ * finished as crashed. A worker the coordinator started is replaced if it
+ * crashed running a test; each crash uses a test up, so this ends.
+ */
+static void __dist_drop(dist_t* d, int i) {
+    dist_worker_t* w = d->workers[i];
+    suite_t*       s = d->s;
+    d->workers[i]    = d->workers[--d->n_workers];
+    bool replace     = w->pid > 0 && w->count > w->done;
+
+    close(w->fd);
+    int status = 0;
+    if (w->pid > 0) {
+        if (w->count > w->done) kill(w->pid, SIGKILL);
+        waitpid(w->pid, &status, 0);
+    }
+    char msg[96];
+    if (w->pid == 0) {
+        sprintf(msg, "Worker disconnected while running the test");
+    } else if (WIFSIGNALED(status)) {
+        sprintf(msg, "Worker was killed by signal %d while running the test",
+                WTERMSIG(status));
+    } else {
+        sprintf(msg, "Worker exited with status %d while running the test",
+                WEXITSTATUS(status));
+    }
+    bool segv = w->pid > 0 && WIFSIGNALED(status) &&
+                WTERMSIG(status) == SIGSEGV;
+
+    for (int j = w->first; j < w->first + w->count; j++) {
+        if (d->recorded[j]) continue;
+        runner_t* test = s->tests[j];
+        test_t*   t    = __log_stream_live(w->stream, j);
+        bool      live = t != NULL;
+        if (!live) {
+            t = tdd_test_new(test->name);
+            if (t == NULL) continue;
+            if (s->eventlog != NULL && !d->aborted) {
+                __log_test_start(s->eventlog, j, test->name, test->desc);
+            }
+        }
+        t->suite = s;
+        t->index = j;
+        if (!d->aborted && !segv) test_fail(t, msg);
+        __dist_record(w, j, t, segv);
+        if (live) {
+            __log_stream_drop(w->stream, j);
+        } else {
+            tdd_test_del(t);
+        }
+    }
+
+    __log_stream_del(w->stream);
+    free(w);
+    if (replace && !d->aborted && d->next < s->n_tests) __dist_spawn(d);
+}
+
+/* Reads what a worker has sent, and hands it more work once it is done. */
+static void __dist_read(dist_t* d, int i) {
+    dist_worker_t* w = d->workers[i];
+
+    ssize_t n;
+    do {
+        n = read(w->fd, d->buf, DIST_READ);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0 || __log_stream_feed(w->stream, d->buf, (size_t)n) !=
+                      EXIT_SUCCESS) {
+        if (n > 0 && !w->hello) {
+            fprintf(stderr, "Rejected a worker whose event log has another "
+                            "version.\n");
+        }
+        __dist_drop(d, i);
+        return;
+    }
+    if (w->hello && !w->stopped && w->done == w->count) {
+        __dist_assign(d, w);
+    }
+}
+
+/* Stops the workers that are left, once testing is over. */
+static void __dist_stop(dist_t* d) {
+    for (int i = 0; i < d->n_workers; i++) {
+        dist_worker_t* w = d->workers[i];
+        if (!w->stopped && w->count == w->done) {
+            __dist_send(w->fd, -1, 0);
+        } else if (w->pid > 0 && w->count > w->done) {
+            kill(w->pid, SIGKILL);
+        }
+        close(w->fd);
+        if (w->pid > 0) waitpid(w->pid, NULL, 0);
+        __log_stream_del(w->stream);
+        free(w);
+    }
+    d->n_workers = 0;
+}
+
+int suite_run_distributed(suite_t* s, int workers, const char* address,
+                          bool fatal_failures) {
+    if (s == NULL || (workers <= 0 && address == NULL)) {
+        errno = EINVAL;
+        return EXIT_FAILURE;
+    }
+
+    dist_t d;
+    memset(&d, 0, sizeof(dist_t));
+    d.s              = s;
+    d.fatal_failures = fatal_failures;
+    d.listen_fd      = -1;
+    d.recorded       = calloc((size_t)s->n_tests + 1, sizeof(bool));
+    d.buf            = malloc(DIST_READ);
+    if (d.recorded == NULL || d.buf == NULL) {
+        free(d.recorded);
+        free(d.buf);
+        errno = ENOMEM;
+        return EXIT_FAILURE;
+    }
+    if (address != NULL && (d.listen_fd = __dist_socket(address, true)) < 0) {
+        free(d.recorded);
+        free(d.buf);
+        return EXIT_FAILURE;
+    }
+
+    s->stats.fatal_failures = fatal_failures;
+    if (s->eventlog != NULL) {
+        __log_suite_start(s->eventlog, s->n_tests);
+    }
+    for (int i = 0; i < workers; i++) {
+        __dist_spawn(&d);
+    }
+
+    struct pollfd* pfds = NULL;
+    while (d.n_recorded < s->n_tests && !d.aborted) {
+        if (d.n_workers == 0 && d.listen_fd < 0) break;
+
+        struct pollfd* tmp =
+            realloc(pfds, sizeof(struct pollfd) * (size_t)(d.n_workers + 1));
+        if (tmp == NULL) break;
+        pfds  = tmp;
+        int m = 0;
+        for (; m < d.n_workers; m++) {
+            pfds[m].fd     = d.workers[m]->fd;
+            pfds[m].events = POLLIN;
+        }
+        if (d.listen_fd >= 0) {
+            pfds[m].fd       = d.listen_fd;
+            pfds[m++].events = POLLIN;
+        }
+        if (poll(pfds, (nfds_t)m, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        /* Dropping a worker moves the last one into its place. */
+        for (int i = d.n_workers - 1; i >= 0; i--) {
+            if (pfds[i].revents != 0) __dist_read(&d, i);
+        }
+        if (d.listen_fd >= 0 && (pfds[m - 1].revents & POLLIN)) {
+            int fd = accept(d.listen_fd, NULL, NULL);
+            if (fd >= 0) __dist_add(&d, fd, 0);
+        }
+    }
+    free(pfds);
+
+    __dist_stop(&d);
+    if (d.listen_fd >= 0) {
+        close(d.listen_fd);
+        if (strncmp(address, DIST_TCP, strlen(DIST_TCP)) != 0) {
+            unlink(address);
+        }
+    }
+    bool finished = !d.aborted && d.n_recorded == s->n_tests;
+    free(d.workers);
+    free(d.recorded);
+    free(d.buf);
+    if (!finished) return EXIT_FAILURE;
+    suite_done(s);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1222 @@
+/**
+ * @file eventlog.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of the binary event log,
+ *        an append-only record of everything that happens while a suite
+ *        runs, and of the reader that reconstructs results from it.
+ *
+ * A log starts with an 8 byte header, `TDDLOG`, a format version and a byte
+ * order marker, followed by records. Each record is a one byte event type,
+ * three bytes of padding and a 32-bit payload length, followed by the
+ * payload. Integers, and the bits of doubles, are stored little endian
+ * whatever the host's byte order, so that logs and streams can be read on
+ * any machine; strings are stored as a 32-bit length followed by the
+ * bytes. Every record is
+ * written with a single write() to a file opened with `O_APPEND`, so
+ * records from different threads never interleave.
+ *
+ * The same records are streamed over sockets by distributed workers. A
+ * stream write may be partial, so writes to a stream are also serialized
+ * by a lock, and streams are read back record by record as bytes arrive.
+ * A stream whose header has another version is rejected before any of its
+ * records are read.
+ **/
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "eventlog.h"
+#include "lockprof.h"
+#include "report.h"
+#include "results.h"
+#include "spans.h"
+#include "strutil.h"
+#include "tdd.h"
+
+#define LOG_MAGIC "TDDLOG"
+#define LOG_VERSION 4
+/* The byte order marker of the header: little endian. */
+#define LOG_ORDER 1
+#define LOG_HEADER_LEN 8
+#define LOG_RECORD_HEADER_LEN 8
+/* Longest record payload; a longer length means a corrupt record. */
+#define LOG_MAX_RECORD_LEN (64u << 20)
+
+struct tdd_eventlog_t {
+    int   fd;
+    char* path;
+    /* Held while a record is written to a stream; unused for files. */
+    bool            stream;
+    pthread_mutex_t lock;
+};
+
+/* A growable buffer that one record is encoded into. */
+typedef struct log_buf_t {
+    uint8_t* data;
+    size_t   len;
+    size_t   cap;
+    bool     oom;
+} log_buf_t;
+
+/* Stores the low n bytes of v at p, least significant first. */
+static void __le_store(uint8_t* p, uint64_t v, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+/* Loads n bytes stored least significant first at p. */
+static uint64_t __le_load(const uint8_t* p, size_t n) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static int64_t __log_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return __log_ts(&now);
+}
+
+int64_t __log_ts(const struct timespec* ts) {
+    return (int64_t)ts->tv_sec * 1000000000LL + (int64_t)ts->tv_nsec;
+}
+
+static void __log_put(log_buf_t* b, const void* p, size_t n) {
+    if (b->oom) return;
+    if (b->len + n > b->cap) {
+        size_t   cap = b->cap ? b->cap : 128;
+        while (cap < b->len + n) cap *= 2;
+        uint8_t* tmp = realloc(b->data, cap);
+        if (tmp == NULL) {
+            b->oom = true;
+            return;
+        }
+        b->data = tmp;
+        b->cap  = cap;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void __log_le(log_buf_t* b, uint64_t v, size_t n) {
+    uint8_t p[8];
+    __le_store(p, v, n);
+    __log_put(b, p, n);
+}
+
+static void __log_u8(log_buf_t* b, uint8_t v) { __log_put(b, &v, sizeof(v)); }
+static void __log_i32(log_buf_t* b, int32_t v) { __log_le(b, (uint32_t)v, 4); }
+static void __log_i64(log_buf_t* b, int64_t v) { __log_le(b, (uint64_t)v, 8); }
+
+static void __log_f64(log_buf_t* b, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    __log_le(b, bits, 8);
+}
+
+static void __log_str(log_buf_t* b, const char* s) {
+    uint32_t n = s != NULL ? (uint32_t)strlen(s) : 0;
+    __log_le(b, n, 4);
+    if (n > 0) __log_put(b, s, n);
+}
+
+/* Starts a record of the given type; its length is filled in on write. */
+static void __log_begin(log_buf_t* b, uint8_t type) {
+    memset(b, 0, sizeof(log_buf_t));
+    uint8_t head[LOG_RECORD_HEADER_LEN] = {type, 0, 0, 0, 0, 0, 0, 0};
+    __log_put(b, head, sizeof(head));
+}
+
+static int __log_write(tdd_eventlog_t* log, log_buf_t* b) {
+    int ret = EXIT_FAILURE;
+    /* Readers reject a record this long, so do not write it. */
+    if (!b->oom && b->len - LOG_RECORD_HEADER_LEN <= LOG_MAX_RECORD_LEN) {
+        __le_store(b->data + 4, b->len - LOG_RECORD_HEADER_LEN, 4);
+
+        if (log->stream) pthread_mutex_lock(&log->lock);
+        size_t off = 0;
+        while (off < b->len) {
+            ssize_t n = write(log->fd, b->data + off, b->len - off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            off += (size_t)n;
+        }
+        if (log->stream) pthread_mutex_unlock(&log->lock);
+        if (off == b->len) ret = EXIT_SUCCESS;
+    }
+    free(b->data);
+    return ret;
+}
+
+tdd_eventlog_t* __log_open(const char* path) {
+    tdd_eventlog_t* log = calloc(1, sizeof(tdd_eventlog_t));
+    if (log == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    log->path = calloc(strlen(path) + 1, sizeof(char));
+    log->fd   = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (log->path == NULL || log->fd < 0) {
+        if (log->fd >= 0) close(log->fd);
+        free(log->path);
+        free(log);
+        return NULL;
+    }
+    strcpy(log->path, path);
+
+    uint8_t head[LOG_HEADER_LEN] = {'T', 'D', 'D', 'L', 'O', 'G',
+                                    LOG_VERSION, LOG_ORDER};
+    if (write(log->fd, head, sizeof(head)) != sizeof(head)) {
+        __log_close(log);
+        return NULL;
+    }
+
+    return log;
+}
+
+tdd_eventlog_t* __log_stream(int fd) {
+    tdd_eventlog_t* log = calloc(1, sizeof(tdd_eventlog_t));
+    if (log == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    log->fd     = fd;
+    log->stream = true;
+    pthread_mutex_init(&log->lock, NULL);
+
+    uint8_t head[LOG_HEADER_LEN] = {'T', 'D', 'D', 'L', 'O', 'G',
+                                    LOG_VERSION, LOG_ORDER};
+    size_t  off                  = 0;
+    while (off < sizeof(head)) {
+        ssize_t n = write(fd, head + off, sizeof(head) - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            __log_close(log);
+            return NULL;
+        }
+        off += (size_t)n;
+    }
+
+    return log;
+}
+
+void __log_close(tdd_eventlog_t* log) {
+    if (log == NULL) return;
+    close(log->fd);
+    if (log->stream) pthread_mutex_destroy(&log->lock);
+    free(log->path);
+    free(log);
+}
+
+const char* __log_path(const tdd_eventlog_t* log) {
+    return log != NULL ? log->path : NULL;
+}
+
+void __log_suite_start(tdd_eventlog_t* log, int n_tests) {
+    log_buf_t b;
+    __log_begin(&b, TDD_EVENT_SUITE_START);
+    __log_i32(&b, n_tests);
+    __log_i64(&b, __log_now());
+    __log_write(log, &b);
+}
+
+void __log_suite_end(tdd_eventlog_t* log, bool finished) {
+    log_buf_t b;
+    __log_begin(&b, TDD_EVENT_SUITE_END);
+    __log_i64(&b, __log_now());
+    __log_u8(&b, finished);
+    __log_write(log, &b);
+}
+
+void __log_test_start(tdd_eventlog_t* log, int index, const char* name,
+                      const char* desc) {
+    log_buf_t b;
+    __log_begin(&b, TDD_EVENT_TEST_START);
+    __log_i32(&b, index);
+    __log_i64(&b, __log_now());
+    __log_str(&b, name);
+    __log_str(&b, desc);
+    __log_write(log, &b);
+}
+
+void __log_message(tdd_eventlog_t* log, int type, int index,
+                   const struct timespec* at, const char* msg) {
+    log_buf_t b;
+    __log_begin(&b, (uint8_t)type);
+    __log_i32(&b, index);
+    __log_i64(&b, __log_ts(at));
+    __log_str(&b, msg);
+    __log_write(log, &b);
+}
+
+void __log_test_end(tdd_eventlog_t* log, int index, test_t* t,
+                    bool crashed) {
+    log_buf_t b;
+
+    if (t->parallel != NULL) {
+        tdd_parallel_stats_t* ps = t->parallel;
+        __log_begin(&b, TDD_EVENT_PARALLEL);
+        __log_i32(&b, index);
+        __log_i32(&b, ps->threads);
+        __log_i64(&b, (int64_t)ps->n);
+        __log_f64(&b, ps->ns_per_op);
+        __log_f64(&b, ps->ops_per_sec);
+        for (int i = 0; i < ps->threads; i++) {
+            __log_f64(&b, ps->thread_ops_per_sec[i]);
+        }
+        __log_write(log, &b);
+    }
+    if (t->scaling != NULL) {
+        __log_begin(&b, TDD_EVENT_SCALING);
+        __log_i32(&b, index);
+        __log_i32(&b, t->scaling->n_points);
+        for (int i = 0; i < t->scaling->n_points; i++) {
+            tdd_scaling_point_t* p = &t->scaling->points[i];
+            __log_i32(&b, p->threads);
+            __log_f64(&b, p->ns_per_op);
+            __log_f64(&b, p->ops_per_sec);
+            __log_f64(&b, p->speedup);
+            __log_f64(&b, p->efficiency);
+        }
+        __log_write(log, &b);
+    }
+    if (t->load != NULL) {
+        __log_begin(&b, TDD_EVENT_LOAD);
+        __log_i32(&b, index);
+        __log_f64(&b, t->load->peak_rate);
+        __log_i32(&b, t->load->n_points);
+        for (int i = 0; i < t->load->n_points; i++) {
+            tdd_load_point_t* p = &t->load->points[i];
+            __log_f64(&b, p->target_rate);
+            __log_f64(&b, p->achieved_rate);
+            __log_i64(&b, (int64_t)p->ops);
+            __log_i64(&b, (int64_t)p->dropped);
+            __log_f64(&b, p->p50);
+            __log_f64(&b, p->p90);
+            __log_f64(&b, p->p99);
+            __log_f64(&b, p->p999);
+            __log_f64(&b, p->max);
+            __log_f64(&b, p->service_p50);
+            __log_f64(&b, p->service_p99);
+        }
+        __log_write(log, &b);
+    }
+    if (t->fuzz != NULL) {
+        tdd_fuzz_stats_t* fz = t->fuzz;
+        __log_begin(&b, TDD_EVENT_FUZZ);
+        __log_i32(&b, index);
+        __log_u8(&b, t->fuzzing);
+        __log_i64(&b, (int64_t)fz->execs);
+        __log_f64(&b, fz->execs_per_sec);
+        __log_i32(&b, fz->workers);
+        __log_i32(&b, fz->corpus_size);
+        __log_i32(&b, fz->new_inputs);
+        __log_i64(&b, (int64_t)fz->edges);
+        __log_i32(&b, fz->crashers);
+        __log_write(log, &b);
+    }
+    for (int i = 0; i < t->n_spans; i++) {
+        tdd_span_stats_t* sp = &t->spans[i];
+        __log_begin(&b, TDD_EVENT_SPAN);
+        __log_i32(&b, index);
+        __log_str(&b, sp->name);
+        __log_u8(&b, sp->counter);
+        __log_i64(&b, (int64_t)sp->count);
+        __log_i64(&b, sp->total);
+        __log_i64(&b, sp->max);
+        __log_write(log, &b);
+    }
+    for (int i = 0; i < t->n_metrics; i++) {
+        tdd_metric_t* m = &t->metrics[i];
+        __log_begin(&b, TDD_EVENT_METRIC);
+        __log_i32(&b, index);
+        __log_str(&b, m->unit);
+        __log_i64(&b, (int64_t)m->count);
+        __log_f64(&b, m->sum);
+        __log_f64(&b, m->min);
+        __log_f64(&b, m->max);
+        __log_write(log, &b);
+    }
+
+    for (int i = 0; i < t->n_locks; i++) {
+        tdd_lock_stats_t* l = &t->locks[i];
+        __log_begin(&b, TDD_EVENT_LOCK);
+        __log_i32(&b, index);
+        __log_str(&b, l->site);
+        __log_u8(&b, (uint8_t)l->kind);
+        __log_i64(&b, (int64_t)l->count);
+        __log_i64(&b, (int64_t)l->contended);
+        __log_i64(&b, l->wait_ns);
+        __log_i64(&b, l->max_wait_ns);
+        __log_i64(&b, l->hold_ns);
+        __log_i64(&b, l->max_hold_ns);
+        __log_write(log, &b);
+    }
+
+    __log_begin(&b, TDD_EVENT_RUSAGE);
+    __log_i32(&b, index);
+    __log_i64(&b, t->usage.user_ns);
+    __log_i64(&b, t->usage.sys_ns);
+    __log_i64(&b, t->usage.minflt);
+    __log_i64(&b, t->usage.majflt);
+    __log_i64(&b, t->usage.nvcsw);
+    __log_i64(&b, t->usage.nivcsw);
+    __log_i64(&b, t->usage.io_read);
+    __log_i64(&b, t->usage.io_write);
+    __log_i64(&b, t->usage.max_rss_kb);
+    __log_write(log, &b);
+
+    if (t->env != NULL) {
+        __log_begin(&b, TDD_EVENT_BENCH_ENV);
+        __log_i32(&b, index);
+        __log_i32(&b, t->env->cpu);
+        __log_u8(&b, t->env->pinned);
+        __log_u8(&b, t->env->realtime);
+        __log_u8(&b, t->env->memory_locked);
+        __log_i32(&b, t->env->warmup);
+        __log_str(&b, t->env->governor);
+        __log_i32(&b, t->env->turbo);
+        __log_i32(&b, t->env->smt);
+        __log_f64(&b, t->env->load);
+        __log_i32(&b, (int32_t)t->env->warnings);
+        __log_write(log, &b);
+    }
+
+    if (t->samples != NULL) {
+        tdd_samples_t* sm = t->samples;
+        __log_begin(&b, TDD_EVENT_SAMPLES);
+        __log_i32(&b, index);
+        __log_i32(&b, sm->n);
+        __log_u8(&b, sm->converged);
+        __log_f64(&b, sm->mean_ns);
+        __log_f64(&b, sm->median_ns);
+        __log_f64(&b, sm->stddev_ns);
+        __log_f64(&b, sm->min_ns);
+        __log_f64(&b, sm->max_ns);
+        __log_f64(&b, sm->mean_ci);
+        __log_f64(&b, sm->median_ci);
+        __log_i32(&b, sm->low_severe);
+        __log_i32(&b, sm->low_mild);
+        __log_i32(&b, sm->high_mild);
+        __log_i32(&b, sm->high_severe);
+        __log_write(log, &b);
+    }
+
+    if (t->cache != NULL) {
+        __log_begin(&b, TDD_EVENT_CACHE);
+        __log_i32(&b, index);
+        __log_i32(&b, t->cache->runs);
+        __log_f64(&b, t->cache->cold_ns);
+        __log_f64(&b, t->cache->warm_ns);
+        __log_i64(&b, t->cache->evict_bytes);
+        __log_write(log, &b);
+    }
+
+    __log_begin(&b, TDD_EVENT_TEST_END);
+    __log_i32(&b, index);
+    __log_i64(&b, __log_now());
+    __log_u8(&b, (uint8_t)((t->failed ? TDD_STATUS_FAILED : 0) |
+                           (crashed ? TDD_STATUS_SEGV : 0)));
+    __log_i32(&b, t->err);
+    __log_i64(&b, __log_ts(t->start));
+    __log_i64(&b, __log_ts(t->end));
+    __log_write(log, &b);
+}
+
+int suite_set_eventlog(suite_t* s, const char* path) {
+    if (s == NULL) return EXIT_FAILURE;
+
+    if (s->eventlog != NULL) {
+        __log_close(s->eventlog);
+        s->eventlog = NULL;
+    }
+    if (path == NULL) return EXIT_SUCCESS;
+
+    s->eventlog = __log_open(path);
+    return s->eventlog != NULL ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Reader. */
+
+struct tdd_eventlog_reader_t {
+    FILE*    f;
+    uint8_t* payload;
+    size_t   cap;
+    size_t   len;
+    size_t   off;
+    bool     bad;
+
+    /* Decoded bench samples handed out with the current event. */
+    tdd_parallel_stats_t parallel;
+    tdd_scaling_t        scaling;
+    tdd_load_t           load;
+    tdd_fuzz_stats_t     fuzz;
+    tdd_span_stats_t     span;
+    tdd_metric_t         metric;
+    tdd_rusage_t         usage;
+    tdd_lock_stats_t     lock;
+    tdd_bench_env_t      env;
+    tdd_samples_t        samples;
+    tdd_cache_t          cache;
+};
+
+static void __rd_get(tdd_eventlog_reader_t* r, void* p, size_t n) {
+    if (r->bad || r->off + n > r->len) {
+        r->bad = true;
+        memset(p, 0, n);
+        return;
+    }
+    memcpy(p, r->payload + r->off, n);
+    r->off += n;
+}
+
+static uint64_t __rd_le(tdd_eventlog_reader_t* r, size_t n) {
+    uint8_t p[8];
+    __rd_get(r, p, n);
+    return __le_load(p, n);
+}
+
+static int32_t __rd_i32(tdd_eventlog_reader_t* r) {
+    return (int32_t)(uint32_t)__rd_le(r, 4);
+}
+
+static int64_t __rd_i64(tdd_eventlog_reader_t* r) {
+    return (int64_t)__rd_le(r, 8);
+}
+
+static double __rd_f64(tdd_eventlog_reader_t* r) {
+    uint64_t bits = __rd_le(r, 8);
+    double   v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static uint8_t __rd_u8(tdd_eventlog_reader_t* r) {
+    uint8_t v;
+    __rd_get(r, &v, sizeof(v));
+    return v;
+}
+
+/*
+ * Strings are NUL terminated in place by shifting them back over their
+ * length prefix, so they can be handed out without copying.
+ */
+static const char* __rd_str(tdd_eventlog_reader_t* r) {
+    uint32_t n = (uint32_t)__rd_le(r, 4);
+    if (r->bad || r->off + n > r->len) {
+        r->bad = true;
+        return "";
+    }
+    char* s = (char*)r->payload + r->off - 4;
+    memmove(s, s + 4, n);
+    s[n] = '\0';
+    r->off += n;
+    return s;
+}
+
+tdd_eventlog_reader_t* tdd_eventlog_open(const char* path) {
+    if (path == NULL) return NULL;
+
+    tdd_eventlog_reader_t* r = calloc(1, sizeof(tdd_eventlog_reader_t));
+    if (r == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    r->f = fopen(path, "rb");
+    if (r->f == NULL) {
+        free(r);
+        return NULL;
+    }
+
+    uint8_t head[LOG_HEADER_LEN];
+    if (fread(head, 1, sizeof(head), r->f) != sizeof(head) ||
+        memcmp(head, LOG_MAGIC, strlen(LOG_MAGIC)) != 0 ||
+        head[6] != LOG_VERSION || head[7] != LOG_ORDER) {
+        fclose(r->f);
+        free(r);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return r;
+}
+
+int tdd_eventlog_close(tdd_eventlog_reader_t* r) {
+    if (r == NULL) return EXIT_FAILURE;
+
+    if (r->f != NULL) fclose(r->f);
+    free(r->payload);
+    free(r->parallel.thread_ops_per_sec);
+    free(r->scaling.points);
+    free(r->load.points);
+    free(r);
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Makes room for a payload of len bytes and resets the read position;
+ * fails with EINVAL if no valid record is that long.
+ */
+static bool __rd_reserve(tdd_eventlog_reader_t* r, uint32_t len) {
+    if (len > LOG_MAX_RECORD_LEN) {
+        errno = EINVAL;
+        return false;
+    }
+    /* Keep one spare byte so the last string can be NUL terminated. */
+    size_t cap = (size_t)len + 1;
+    if (cap > r->cap) {
+        uint8_t* tmp = realloc(r->payload, cap);
+        if (tmp == NULL) return false;
+        r->payload = tmp;
+        r->cap     = cap;
+    }
+    r->len = len;
+    r->off = 0;
+    r->bad = false;
+    return true;
+}
+
+static bool __rd_decode(tdd_eventlog_reader_t* r, uint8_t type,
+                        tdd_event_t* ev);
+
+bool tdd_eventlog_next(tdd_eventlog_reader_t* r, tdd_event_t* ev) {
+    if (r == NULL || ev == NULL) return false;
+
+    uint8_t head[LOG_RECORD_HEADER_LEN];
+    if (fread(head, 1, sizeof(head), r->f) != sizeof(head)) return false;
+    uint32_t len = (uint32_t)__le_load(head + 4, 4);
+
+    if (!__rd_reserve(r, len)) return false;
+    if (fread(r->payload, 1, len, r->f) != len) return false;
+
+    return __rd_decode(r, head[0], ev);
+}
+
+/* Decodes the payload of a record of the given type. */
+static bool __rd_decode(tdd_eventlog_reader_t* r, uint8_t type,
+                        tdd_event_t* ev) {
+    memset(ev, 0, sizeof(tdd_event_t));
+    ev->type  = (tdd_event_type_t)type;
+    ev->index = -1;
+    switch (ev->type) {
+    case TDD_EVENT_SUITE_START:
+        ev->n_tests = __rd_i32(r);
+        ev->ts      = __rd_i64(r);
+        break;
+    case TDD_EVENT_SUITE_END:
+        ev->ts       = __rd_i64(r);
+        ev->finished = __rd_u8(r);
+        break;
+    case TDD_EVENT_TEST_START:
+        ev->index = __rd_i32(r);
+        ev->ts    = __rd_i64(r);
+        ev->name  = __rd_str(r);
+        ev->desc  = __rd_str(r);
+        break;
+    case TDD_EVENT_ERROR:
+    case TDD_EVENT_FAIL:
+        ev->index = __rd_i32(r);
+        ev->ts    = __rd_i64(r);
+        ev->msg   = __rd_str(r);
+        break;
+    case TDD_EVENT_TEST_END: {
+        ev->index      = __rd_i32(r);
+        ev->ts         = __rd_i64(r);
+        uint8_t status = __rd_u8(r);
+        ev->failed     = (status & TDD_STATUS_FAILED) != 0;
+        ev->crashed    = (status & TDD_STATUS_SEGV) != 0;
+        ev->n_err      = __rd_i32(r);
+        ev->start      = __rd_i64(r);
+        ev->end        = __rd_i64(r);
+        break;
+    }
+    case TDD_EVENT_PARALLEL: {
+        tdd_parallel_stats_t* ps = &r->parallel;
+        ev->index                = __rd_i32(r);
+        ps->threads              = __rd_i32(r);
+        ps->n                    = (unsigned long)__rd_i64(r);
+        ps->ns_per_op            = __rd_f64(r);
+        ps->ops_per_sec          = __rd_f64(r);
+        if (ps->threads < 0 ||
+            (size_t)ps->threads * sizeof(double) > r->len - r->off) {
+            return false;
+        }
+        double* tmp = realloc(ps->thread_ops_per_sec,
+                              sizeof(double) * (ps->threads + 1));
+        if (tmp == NULL) return false;
+        ps->thread_ops_per_sec = tmp;
+        for (int i = 0; i < ps->threads; i++) {
+            tmp[i] = __rd_f64(r);
+        }
+        ev->parallel = ps;
+        break;
+    }
+    case TDD_EVENT_SCALING: {
+        tdd_scaling_t* sc = &r->scaling;
+        ev->index         = __rd_i32(r);
+        sc->n_points      = __rd_i32(r);
+        if (sc->n_points < 0 || (size_t)sc->n_points > r->len) return false;
+        tdd_scaling_point_t* tmp = realloc(
+            sc->points, sizeof(tdd_scaling_point_t) * (sc->n_points + 1));
+        if (tmp == NULL) return false;
+        sc->points = tmp;
+        for (int i = 0; i < sc->n_points; i++) {
+            tmp[i].threads     = __rd_i32(r);
+            tmp[i].ns_per_op   = __rd_f64(r);
+            tmp[i].ops_per_sec = __rd_f64(r);
+            tmp[i].speedup     = __rd_f64(r);
+            tmp[i].efficiency  = __rd_f64(r);
+        }
+        ev->scaling = sc;
+        break;
+    }
+    case TDD_EVENT_LOAD: {
+        tdd_load_t* ld = &r->load;
+        ev->index      = __rd_i32(r);
+        ld->peak_rate  = __rd_f64(r);
+        ld->n_points   = __rd_i32(r);
+        if (ld->n_points < 0 || (size_t)ld->n_points > r->len) return false;
+        tdd_load_point_t* tmp = realloc(
+            ld->points, sizeof(tdd_load_point_t) * (ld->n_points + 1));
+        if (tmp == NULL) return false;
+        ld->points = tmp;
+        for (int i = 0; i < ld->n_points; i++) {
+            tmp[i].target_rate   = __rd_f64(r);
+            tmp[i].achieved_rate = __rd_f64(r);
+            tmp[i].ops           = (unsigned long)__rd_i64(r);
+            tmp[i].dropped       = (unsigned long)__rd_i64(r);
+            tmp[i].p50           = __rd_f64(r);
+            tmp[i].p90           = __rd_f64(r);
+            tmp[i].p99           = __rd_f64(r);
+            tmp[i].p999          = __rd_f64(r);
+            tmp[i].max           = __rd_f64(r);
+            tmp[i].service_p50   = __rd_f64(r);
+            tmp[i].service_p99   = __rd_f64(r);
+        }
+        ev->load = ld;
+        break;
+    }
+    case TDD_EVENT_FUZZ: {
+        tdd_fuzz_stats_t* fz = &r->fuzz;
+        ev->index            = __rd_i32(r);
+        ev->fuzzing          = __rd_u8(r);
+        fz->execs            = (unsigned long)__rd_i64(r);
+        fz->execs_per_sec    = __rd_f64(r);
+        fz->workers          = __rd_i32(r);
+        fz->corpus_size      = __rd_i32(r);
+        fz->new_inputs       = __rd_i32(r);
+        fz->edges            = (unsigned long)__rd_i64(r);
+        fz->crashers         = __rd_i32(r);
+        ev->fuzz             = fz;
+        break;
+    }
+    case TDD_EVENT_SPAN: {
+        tdd_span_stats_t* sp = &r->span;
+        ev->index            = __rd_i32(r);
+        sp->name             = (char*)__rd_str(r);
+        sp->counter          = __rd_u8(r);
+        sp->count            = (long)__rd_i64(r);
+        sp->total            = __rd_i64(r);
+        sp->max              = __rd_i64(r);
+        ev->span             = sp;
+        break;
+    }
+    case TDD_EVENT_METRIC: {
+        tdd_metric_t* m = &r->metric;
+        ev->index       = __rd_i32(r);
+        m->unit         = (char*)__rd_str(r);
+        m->count        = (long)__rd_i64(r);
+        m->sum          = __rd_f64(r);
+        m->min          = __rd_f64(r);
+        m->max          = __rd_f64(r);
+        m->mean         = m->count > 0 ? m->sum / (double)m->count : 0;
+        ev->metric      = m;
+        break;
+    }
+    case TDD_EVENT_RUSAGE: {
+        tdd_rusage_t* u = &r->usage;
+        ev->index       = __rd_i32(r);
+        u->user_ns      = __rd_i64(r);
+        u->sys_ns       = __rd_i64(r);
+        u->minflt       = (long)__rd_i64(r);
+        u->majflt       = (long)__rd_i64(r);
+        u->nvcsw        = (long)__rd_i64(r);
+        u->nivcsw       = (long)__rd_i64(r);
+        u->io_read      = __rd_i64(r);
+        u->io_write     = __rd_i64(r);
+        u->max_rss_kb   = (long)__rd_i64(r);
+        ev->usage       = u;
+        break;
+    }
+    case TDD_EVENT_LOCK: {
+        tdd_lock_stats_t* l = &r->lock;
+        ev->index           = __rd_i32(r);
+        l->site             = (char*)__rd_str(r);
+        l->kind             = (tdd_lock_kind_t)__rd_u8(r);
+        l->count            = (long)__rd_i64(r);
+        l->contended        = (long)__rd_i64(r);
+        l->wait_ns          = __rd_i64(r);
+        l->max_wait_ns      = __rd_i64(r);
+        l->hold_ns          = __rd_i64(r);
+        l->max_hold_ns      = __rd_i64(r);
+        ev->lock            = l;
+        break;
+    }
+    case TDD_EVENT_BENCH_ENV: {
+        tdd_bench_env_t* e = &r->env;
+        ev->index          = __rd_i32(r);
+        e->cpu             = __rd_i32(r);
+        e->pinned          = __rd_u8(r);
+        e->realtime        = __rd_u8(r);
+        e->memory_locked   = __rd_u8(r);
+        e->warmup          = __rd_i32(r);
+        e->governor[0]     = '\0';
+        strncat(e->governor, __rd_str(r), sizeof(e->governor) - 1);
+        e->turbo    = __rd_i32(r);
+        e->smt      = __rd_i32(r);
+        e->load     = __rd_f64(r);
+        e->warnings = (unsigned)__rd_i32(r);
+        ev->env     = e;
+        break;
+    }
+    case TDD_EVENT_SAMPLES: {
+        tdd_samples_t* sm = &r->samples;
+        ev->index         = __rd_i32(r);
+        sm->n             = __rd_i32(r);
+        sm->converged     = __rd_u8(r);
+        sm->mean_ns       = __rd_f64(r);
+        sm->median_ns     = __rd_f64(r);
+        sm->stddev_ns     = __rd_f64(r);
+        sm->min_ns        = __rd_f64(r);
+        sm->max_ns        = __rd_f64(r);
+        sm->mean_ci       = __rd_f64(r);
+        sm->median_ci     = __rd_f64(r);
+        sm->low_severe    = __rd_i32(r);
+        sm->low_mild      = __rd_i32(r);
+        sm->high_mild     = __rd_i32(r);
+        sm->high_severe   = __rd_i32(r);
+        ev->samples       = sm;
+        break;
+    }
+    case TDD_EVENT_CACHE: {
+        tdd_cache_t* c = &r->cache;
+        ev->index      = __rd_i32(r);
+        c->runs        = __rd_i32(r);
+        c->cold_ns     = __rd_f64(r);
+        c->warm_ns     = __rd_f64(r);
+        c->evict_bytes = __rd_i64(r);
+        ev->cache      = c;
+        break;
+    }
+    default:
+        /* Unknown events from newer writers are skipped. */
+        break;
+    }
+
+    return !r->bad;
+}
+
+/*
+ * Replay. Tests are rebuilt from their events into test_t structures, and
+ * each is handed to a callback when its end event is read and freed right
+ * after, so replaying holds only the tests that were in flight.
+ */
+
+typedef struct log_replay_t {
+    int      n_tests;
+    int      cap;
+    test_t** live;
+    char**   descs;
+    /*
+     * When each live test started, and when the last test to end ended and
+     * whether it crashed.
+     */
+    int64_t* started;
+    int64_t  ended;
+    bool     crashed;
+    void (*on_test)(struct log_replay_t* rp, int index, test_t* t,
+                    const char* desc);
+    void (*on_suite)(struct log_replay_t* rp, const tdd_event_t* ev);
+    void* ctx;
+} log_replay_t;
+
+static void __ts_set(struct timespec* ts, int64_t ns) {
+    ts->tv_sec  = (time_t)(ns / 1000000000LL);
+    ts->tv_nsec = (long)(ns % 1000000000LL);
+}
+
+static char* __strdup(const char* s) {
+    char* d = calloc(strlen(s) + 1, sizeof(char));
+    if (d != NULL) strcpy(d, s);
+    return d;
+}
+
+static test_t* __replay_live(log_replay_t* rp, int index) {
+    if (index < 0 || index >= rp->cap) return NULL;
+    return rp->live[index];
+}
+
+static void __replay_drop(log_replay_t* rp, int index) {
+    char* name = (char*)rp->live[index]->name;
+    tdd_test_del(rp->live[index]);
+    free(name);
+    free(rp->descs[index]);
+    rp->live[index]  = NULL;
+    rp->descs[index] = NULL;
+}
+
+/* Applies one event to the tests being rebuilt. */
+static void __replay_event(log_replay_t* rp, const tdd_event_t* ev) {
+    if (ev->type == TDD_EVENT_SUITE_START) {
+        for (int i = 0; i < rp->cap; i++) {
+            if (rp->live[i] != NULL) __replay_drop(rp, i);
+        }
+        rp->n_tests = ev->n_tests;
+        if (ev->n_tests > rp->cap) {
+            size_t   n    = (size_t)ev->n_tests;
+            test_t** live = realloc(rp->live, sizeof(test_t*) * n);
+            if (live != NULL) rp->live = live;
+            char** descs = realloc(rp->descs, sizeof(char*) * n);
+            if (descs != NULL) rp->descs = descs;
+            int64_t* started = realloc(rp->started, sizeof(int64_t) * n);
+            if (started != NULL) rp->started = started;
+            if (live == NULL || descs == NULL || started == NULL) return;
+            for (int i = rp->cap; i < ev->n_tests; i++) {
+                rp->live[i]  = NULL;
+                rp->descs[i] = NULL;
+            }
+            rp->cap = ev->n_tests;
+        }
+    }
+    if (ev->type == TDD_EVENT_SUITE_START ||
+        ev->type == TDD_EVENT_SUITE_END) {
+        if (rp->on_suite != NULL) rp->on_suite(rp, ev);
+        return;
+    }
+    if (ev->type == TDD_EVENT_TEST_START) {
+        if (ev->index < 0 || ev->index >= rp->cap) return;
+        if (rp->live[ev->index] != NULL) __replay_drop(rp, ev->index);
+        rp->live[ev->index]  = tdd_test_new(__strdup(ev->name));
+        rp->descs[ev->index]   = __strdup(ev->desc);
+        rp->started[ev->index] = ev->ts;
+        return;
+    }
+    test_t* t = __replay_live(rp, ev->index);
+    if (t == NULL) return;
+
+    switch (ev->type) {
+    case TDD_EVENT_ERROR:
+        test_error(t, (char*)ev->msg);
+        __ts_set(t->error_at, ev->ts);
+        if (t->err_at != NULL) t->err_at[t->err - 1] = *t->error_at;
+        break;
+    case TDD_EVENT_FAIL:
+        if (t->fail_msg != NULL) free(t->fail_msg);
+        t->fail_msg = __strdup(ev->msg);
+        t->failed   = true;
+        __ts_set(t->failed_at, ev->ts);
+        break;
+    case TDD_EVENT_PARALLEL:
+        if (t->parallel == NULL) {
+            t->parallel = calloc(1, sizeof(tdd_parallel_stats_t));
+        }
+        if (t->parallel == NULL) break;
+        free(t->parallel->thread_ops_per_sec);
+        *t->parallel = *ev->parallel;
+        t->parallel->thread_ops_per_sec =
+            calloc(ev->parallel->threads + 1, sizeof(double));
+        if (t->parallel->thread_ops_per_sec != NULL) {
+            memcpy(t->parallel->thread_ops_per_sec,
+                   ev->parallel->thread_ops_per_sec,
+                   sizeof(double) * ev->parallel->threads);
+        } else {
+            t->parallel->threads = 0;
+        }
+        break;
+    case TDD_EVENT_SCALING:
+        if (t->scaling != NULL) tdd_scaling_del(t->scaling);
+        t->scaling = tdd_scaling_copy(ev->scaling);
+        break;
+    case TDD_EVENT_LOAD:
+        if (t->load != NULL) tdd_load_del(t->load);
+        t->load = calloc(1, sizeof(tdd_load_t));
+        if (t->load == NULL) break;
+        *t->load         = *ev->load;
+        t->load->points  = calloc(ev->load->n_points + 1,
+                                  sizeof(tdd_load_point_t));
+        if (t->load->points != NULL) {
+            memcpy(t->load->points, ev->load->points,
+                   sizeof(tdd_load_point_t) * ev->load->n_points);
+        } else {
+            t->load->n_points = 0;
+        }
+        break;
+    case TDD_EVENT_FUZZ:
+        if (t->fuzz == NULL) t->fuzz = malloc(sizeof(tdd_fuzz_stats_t));
+        if (t->fuzz != NULL) *t->fuzz = *ev->fuzz;
+        t->fuzzing = ev->fuzzing;
+        break;
+    case TDD_EVENT_SPAN:
+        __spans_add(&t->spans, &t->n_spans, ev->span->name,
+                    ev->span->counter, ev->span->count, ev->span->total,
+                    ev->span->max);
+        break;
+    case TDD_EVENT_METRIC:
+        __metrics_add(&t->metrics, &t->n_metrics, ev->metric->unit,
+                      ev->metric->count, ev->metric->sum, ev->metric->min,
+                      ev->metric->max);
+        break;
+    case TDD_EVENT_RUSAGE:
+        t->usage = *ev->usage;
+        break;
+    case TDD_EVENT_LOCK:
+        __locks_add(t, ev->lock);
+        break;
+    case TDD_EVENT_BENCH_ENV:
+        if (t->env == NULL) t->env = malloc(sizeof(tdd_bench_env_t));
+        if (t->env != NULL) *t->env = *ev->env;
+        break;
+    case TDD_EVENT_SAMPLES:
+        if (t->samples == NULL) t->samples = malloc(sizeof(tdd_samples_t));
+        if (t->samples != NULL) *t->samples = *ev->samples;
+        break;
+    case TDD_EVENT_CACHE:
+        if (t->cache == NULL) t->cache = malloc(sizeof(tdd_cache_t));
+        if (t->cache != NULL) *t->cache = *ev->cache;
+        break;
+    case TDD_EVENT_TEST_END:
+        t->failed = t->failed || ev->failed;
+        __ts_set(t->start, ev->start);
+        __ts_set(t->end, ev->end);
+        rp->ended   = ev->ts;
+        rp->crashed = ev->crashed;
+        rp->on_test(rp, ev->index, t, rp->descs[ev->index]);
+        __replay_drop(rp, ev->index);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Frees the tests that never ended and the replay's arrays. */
+static void __replay_free(log_replay_t* rp) {
+    for (int i = 0; i < rp->cap; i++) {
+        if (rp->live[i] != NULL) __replay_drop(rp, i);
+    }
+    free(rp->live);
+    free(rp->descs);
+    free(rp->started);
+}
+
+static int __replay(const char* path, log_replay_t* rp) {
+    tdd_eventlog_reader_t* r = tdd_eventlog_open(path);
+    if (r == NULL) return EXIT_FAILURE;
+
+    tdd_event_t ev;
+    while (tdd_eventlog_next(r, &ev)) {
+        __replay_event(rp, &ev);
+    }
+    tdd_eventlog_close(r);
+    __replay_free(rp);
+
+    return EXIT_SUCCESS;
+}
+
+/* Rebuilding stats. Only the last run of the suite in the log counts. */
+
+static void __stats_suite(log_replay_t* rp, const tdd_event_t* ev) {
+    suite_stats_t* stats = rp->ctx;
+    if (ev->type != TDD_EVENT_SUITE_START) return;
+
+    __results_reset((tdd_results_t*)stats->results);
+    stats->n_tests = ev->n_tests;
+}
+
+static void __stats_test(log_replay_t* rp, int index, test_t* t,
+                         const char* desc) {
+    suite_stats_t* stats = rp->ctx;
+    (void)desc;
+
+    struct timespec started, ended;
+    __ts_set(&started, rp->started[index]);
+    __ts_set(&ended, rp->ended);
+    uint8_t flags = rp->crashed ? TDD_STATUS_SEGV : TDD_STATUS_OK;
+    __results_append((tdd_results_t*)stats->results, t->name, t, flags,
+                     &started, &ended);
+}
+
+suite_stats_t* tdd_eventlog_stats(const char* path) {
+    suite_stats_t* stats = __stats_new_owned();
+    if (stats == NULL) return NULL;
+
+    log_replay_t rp;
+    memset(&rp, 0, sizeof(log_replay_t));
+    rp.on_test  = &__stats_test;
+    rp.on_suite = &__stats_suite;
+    rp.ctx      = stats;
+    if (__replay(path, &rp) != EXIT_SUCCESS) {
+        suite_stats_del(stats);
+        return NULL;
+    }
+    __stats_fill(stats, stats->n_tests);
+
+    return stats;
+}
+
+/* Rebuilding reporter output. */
+
+static void __report_suite(log_replay_t* rp, const tdd_event_t* ev) {
+    FILE* f = rp->ctx;
+    if (ev->type == TDD_EVENT_SUITE_END && !ev->finished) {
+        fprintf(f, "Suite did not run all tests.\n");
+    }
+}
+
+static void __report_replayed(log_replay_t* rp, int index, test_t* t,
+                              const char* desc) {
+    __report_test(rp->ctx, index + 1, rp->n_tests, t->name, desc, t);
+}
+
+int tdd_eventlog_report(const char* path, FILE* out) {
+    if (path == NULL || out == NULL) return EXIT_FAILURE;
+
+    log_replay_t rp;
+    memset(&rp, 0, sizeof(log_replay_t));
+    rp.on_test  = &__report_replayed;
+    rp.on_suite = &__report_suite;
+    rp.ctx      = out;
+
+    return __replay(path, &rp);
+}
+
+/* Reading streams of records, as they arrive from distributed workers. */
+
+struct tdd_log_stream_t {
+    tdd_eventlog_reader_t* r;
+    log_replay_t           rp;
+    /* Bytes read that do not make up a whole record yet. */
+    uint8_t* buf;
+    size_t   len;
+    size_t   cap;
+    bool     header;
+    void (*on_event)(void* ctx, const tdd_event_t* ev);
+    void (*on_test)(void* ctx, int index, test_t* t, bool crashed);
+    void* ctx;
+};
+
+static void __stream_test(log_replay_t* rp, int index, test_t* t,
+                          const char* desc) {
+    tdd_log_stream_t* st = rp->ctx;
+    (void)desc;
+
+    st->on_test(st->ctx, index, t, rp->crashed);
+}
+
+tdd_log_stream_t* __log_stream_new(void (*on_event)(void* ctx,
+                                                    const tdd_event_t* ev),
+                                   void (*on_test)(void* ctx, int index,
+                                                   test_t* t, bool crashed),
+                                   void* ctx) {
+    tdd_log_stream_t* st = calloc(1, sizeof(tdd_log_stream_t));
+    if (st == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    st->r = calloc(1, sizeof(tdd_eventlog_reader_t));
+    if (st->r == NULL) {
+        free(st);
+        errno = ENOMEM;
+        return NULL;
+    }
+    st->rp.on_test = &__stream_test;
+    st->rp.ctx     = st;
+    st->on_event   = on_event;
+    st->on_test    = on_test;
+    st->ctx        = ctx;
+
+    return st;
+}
+
+int __log_stream_feed(tdd_log_stream_t* st, const void* data, size_t n) {
+    if (st->len + n > st->cap) {
+        size_t   cap = st->cap ? st->cap : 4096;
+        while (cap < st->len + n) cap *= 2;
+        uint8_t* tmp = realloc(st->buf, cap);
+        if (tmp == NULL) return EXIT_FAILURE;
+        st->buf = tmp;
+        st->cap = cap;
+    }
+    memcpy(st->buf + st->len, data, n);
+    st->len += n;
+
+    size_t off = 0;
+    if (!st->header) {
+        if (st->len < LOG_HEADER_LEN) return EXIT_SUCCESS;
+        if (memcmp(st->buf, LOG_MAGIC, strlen(LOG_MAGIC)) != 0 ||
+            st->buf[6] != LOG_VERSION || st->buf[7] != LOG_ORDER) {
+            return EXIT_FAILURE;
+        }
+        st->header = true;
+        off        = LOG_HEADER_LEN;
+    }
+
+    int ret = EXIT_SUCCESS;
+    while (st->len - off >= LOG_RECORD_HEADER_LEN) {
+        uint32_t len = (uint32_t)__le_load(st->buf + off + 4, 4);
+        /* Refuse a corrupt length rather than buffer up to 4 GiB for it. */
+        if (len > LOG_MAX_RECORD_LEN) {
+            errno = EINVAL;
+            ret   = EXIT_FAILURE;
+            break;
+        }
+        if (st->len - off - LOG_RECORD_HEADER_LEN < len) break;
+
+        tdd_event_t ev;
+        uint8_t     type = st->buf[off];
+        if (!__rd_reserve(st->r, len)) {
+            ret = EXIT_FAILURE;
+            break;
+        }
+        memcpy(st->r->payload, st->buf + off + LOG_RECORD_HEADER_LEN, len);
+        off += LOG_RECORD_HEADER_LEN + len;
+        if (!__rd_decode(st->r, type, &ev)) {
+            ret = EXIT_FAILURE;
+            break;
+        }
+        if (st->on_event != NULL) st->on_event(st->ctx, &ev);
+        __replay_event(&st->rp, &ev);
+    }
+    memmove(st->buf, st->buf + off, st->len - off);
+    st->len -= off;
+
+    return ret;
+}
+
+test_t* __log_stream_live(tdd_log_stream_t* st, int index) {
+    return __replay_live(&st->rp, index);
+}
+
+void __log_stream_drop(tdd_log_stream_t* st, int index) {
+    if (__replay_live(&st->rp, index) != NULL) __replay_drop(&st->rp, index);
+}
+
+void __log_stream_del(tdd_log_stream_t* st) {
+    if (st == NULL) return;
+    __replay_free(&st->rp);
+    tdd_eventlog_close(st->r);
+    free(st->buf);
+    free(st);
+}
@@ -0,0 +1,282 @@
+/**
+ * @file fixture.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of per-test temporary
+ *        directories and the fixture files of I/O benchmarks, which are
+ *        dropped from or read into the page cache between timed runs.
+ **/
+/* posix_fadvise(), mkdtemp() and nftw() are not in POSIX.1c. */
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fixture.h"
+#include "tdd.h"
+
+/* The size of the writes and reads fixture files are made and warmed by. */
+#define FIXTURE_CHUNK (1 << 20)
+
+/* A file created by test_bench_file(). */
+typedef struct fixture_file_t {
+    char*                  path;
+    struct fixture_file_t* next;
+} fixture_file_t;
+
+struct tdd_fixture_t {
+    /* The temporary directory, or NULL until it is asked for. */
+    char*            dir;
+    /* Whether the directory has been removed by __fixture_teardown(). */
+    bool             removed;
+    fixture_file_t*  files;
+    /* When fixture files were made and the directory removed, for traces. */
+    fixture_phase_t* phases;
+    int              n_phases;
+    int              cap_phases;
+};
+
+static void __fixture_error(test_t* t, const char* what, const char* path,
+                            int err) {
+    const char* why = strerror(err);
+    char*       msg = malloc(32 + strlen(what) + strlen(path) + strlen(why));
+    if (msg == NULL) return;
+    sprintf(msg, "%s %s: %s", what, path, why);
+    test_error(t, msg);
+    free(msg);
+}
+
+static struct tdd_fixture_t* __fixture(test_t* t) {
+    if (t->fixture == NULL) {
+        t->fixture = calloc(1, sizeof(struct tdd_fixture_t));
+    }
+    return t->fixture;
+}
+
+/* Records a phase of the fixtures that ran from start until now. */
+static void __fixture_phase(struct tdd_fixture_t* fx, const char* what,
+                            const char* path, const struct timespec* start) {
+    if (fx->n_phases == fx->cap_phases) {
+        int              cap = fx->cap_phases > 0 ? 2 * fx->cap_phases : 4;
+        fixture_phase_t* tmp =
+            realloc(fx->phases, sizeof(fixture_phase_t) * (size_t)cap);
+        if (tmp == NULL) return;
+        fx->phases     = tmp;
+        fx->cap_phases = cap;
+    }
+    fixture_phase_t* ph = &fx->phases[fx->n_phases++];
+    ph->what            = what;
+    ph->path            = path;
+    ph->start           = *start;
+    clock_gettime(CLOCK_MONOTONIC, &ph->end);
+}
+
+const char* test_tempdir(test_t* t) {
+    if (t == NULL) return NULL;
+    struct tdd_fixture_t* fx = __fixture(t);
+    if (fx == NULL) return NULL;
+    if (fx->dir != NULL) return fx->dir;
+
+    const char* tmp  = getenv("TMPDIR");
+    const char* name = t->name != NULL ? t->name : "test";
+    if (tmp == NULL || *tmp == '\0') tmp = "/tmp";
+    char* dir = malloc(strlen(tmp) + strlen(name) + 16);
+    if (dir == NULL) return NULL;
+
+    /* The test name is kept to a portable set of file name characters. */
+    int n = sprintf(dir, "%s/tdd-", tmp);
+    for (const char* c = name; *c != '\0'; c++) {
+        bool ok  = isalnum((unsigned char)*c) || *c == '_' || *c == '-';
+        dir[n++] = ok ? *c : '_';
+    }
+    strcpy(dir + n, "-XXXXXX");
+    if (mkdtemp(dir) == NULL) {
+        __fixture_error(t, "cannot make temporary directory", dir, errno);
+        free(dir);
+        return NULL;
+    }
+    fx->dir = dir;
+
+    return dir;
+}
+
+/* Fills a chunk with xorshift64 output, which no file system compresses. */
+static void __fixture_fill(uint64_t* chunk, size_t n, uint64_t* state) {
+    uint64_t x = *state;
+    for (size_t i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        chunk[i] = x;
+    }
+    *state = x;
+}
+
+/* Writes len pseudo-random bytes to a file and syncs it. */
+static int __fixture_write(int fd, size_t len) {
+    uint64_t* chunk = malloc(FIXTURE_CHUNK);
+    if (chunk == NULL) return ENOMEM;
+
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    int      err   = 0;
+    for (size_t done = 0; err == 0 && done < len;) {
+        size_t n = len - done < FIXTURE_CHUNK ? len - done : FIXTURE_CHUNK;
+        __fixture_fill(chunk, FIXTURE_CHUNK / sizeof(uint64_t), &state);
+        for (size_t off = 0; err == 0 && off < n;) {
+            ssize_t w = write(fd, (char*)chunk + off, n - off);
+            if (w < 0 && errno != EINTR) err = errno;
+            if (w > 0) off += (size_t)w;
+        }
+        done += n;
+    }
+    free(chunk);
+    if (err == 0 && fsync(fd) != 0) err = errno;
+
+    return err;
+}
+
+const char* test_bench_file(test_t* t, const char* name, size_t len) {
+    if (t == NULL || name == NULL) return NULL;
+    const char* dir = test_tempdir(t);
+    if (dir == NULL) return NULL;
+
+    fixture_file_t* f = malloc(sizeof(fixture_file_t));
+    if (f == NULL) return NULL;
+    f->path = malloc(strlen(dir) + strlen(name) + 2);
+    if (f->path == NULL) {
+        free(f);
+        return NULL;
+    }
+    sprintf(f->path, "%s/%s", dir, name);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int fd  = open(f->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int err = fd < 0 ? errno : __fixture_write(fd, len);
+    if (fd >= 0 && close(fd) != 0 && err == 0) err = errno;
+    if (err != 0) {
+        __fixture_error(t, "cannot create fixture file", f->path, err);
+        if (fd >= 0) unlink(f->path);
+        free(f->path);
+        free(f);
+        return NULL;
+    }
+    f->next           = t->fixture->files;
+    t->fixture->files = f;
+    __fixture_phase(t->fixture, "setup", f->path, &start);
+
+    return f->path;
+}
+
+void test_report_io(test_t* t, int64_t bytes, int64_t ops) {
+    if (t == NULL) return;
+    __atomic_add_fetch(&t->io_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&t->io_ops, ops, __ATOMIC_RELAXED);
+}
+
+void __fixture_evict(test_t* t) {
+    if (t->fixture == NULL) return;
+
+    for (fixture_file_t* f = t->fixture->files; f != NULL; f = f->next) {
+        int fd = open(f->path, O_RDONLY);
+        if (fd < 0) continue;
+        /* Dirty pages are not dropped, so write them back first. */
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+void __fixture_warm(test_t* t) {
+    if (t->fixture == NULL || t->fixture->files == NULL) return;
+    char* buf = malloc(FIXTURE_CHUNK);
+    if (buf == NULL) return;
+
+    for (fixture_file_t* f = t->fixture->files; f != NULL; f = f->next) {
+        int fd = open(f->path, O_RDONLY);
+        if (fd < 0) continue;
+        ssize_t n;
+        do {
+            n = read(fd, buf, FIXTURE_CHUNK);
+        } while (n > 0 || (n < 0 && errno == EINTR));
+        close(fd);
+    }
+    free(buf);
+}
+
+void __fixture_rates(test_t* run, test_t* into) {
+    static const char* units[][2] = {
+        {"MB/s", "IOPS"},
+        {"MB/s warm", "IOPS warm"},
+        {"MB/s cold", "IOPS cold"},
+    };
+    int64_t bytes = __atomic_exchange_n(&run->io_bytes, 0, __ATOMIC_RELAXED);
+    int64_t ops   = __atomic_exchange_n(&run->io_ops, 0, __ATOMIC_RELAXED);
+    double  secs  = (double)(run->end->tv_sec - run->start->tv_sec) +
+                   (double)(run->end->tv_nsec - run->start->tv_nsec) / 1e9;
+    if ((bytes == 0 && ops == 0) || secs <= 0) return;
+
+    int mode = run->cache_mode == TDD_CACHE_WARM   ? 1
+               : run->cache_mode == TDD_CACHE_COLD ? 2
+                                                   : 0;
+    if (bytes > 0) {
+        test_report_metric(into, units[mode][0], bytes / secs / 1e6);
+    }
+    if (ops > 0) test_report_metric(into, units[mode][1], ops / secs);
+}
+
+/* Removes one entry of a temporary directory, deepest first. */
+static int __fixture_remove(const char* path, const struct stat* st, int type,
+                            struct FTW* ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    remove(path);
+    return 0;
+}
+
+void __fixture_teardown(test_t* t) {
+    struct tdd_fixture_t* fx = t->fixture;
+    if (fx == NULL || fx->dir == NULL || fx->removed) return;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    nftw(fx->dir, &__fixture_remove, 16, FTW_DEPTH | FTW_PHYS);
+    fx->removed = true;
+    __fixture_phase(fx, "teardown", fx->dir, &start);
+}
+
+int __fixture_phases(const test_t* t, const fixture_phase_t** phases) {
+    if (t->fixture == NULL) return 0;
+    *phases = t->fixture->phases;
+    return t->fixture->n_phases;
+}
+
+void __fixture_free(test_t* t) {
+    struct tdd_fixture_t* fx = t->fixture;
+    if (fx == NULL) return;
+
+    if (fx->dir != NULL && !fx->removed) {
+        nftw(fx->dir, &__fixture_remove, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    fixture_file_t* f = fx->files;
+    while (f != NULL) {
+        fixture_file_t* next = f->next;
+        free(f->path);
+        free(f);
+        f = next;
+    }
+    free(fx->phases);
+    free(fx->dir);
+    free(fx);
+    t->fixture = NULL;
+}
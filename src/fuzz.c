@@ -0,0 +1,667 @@
+/**
+ * @file fuzz.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains the in-process, coverage-guided fuzz engine used
+ *        by tests prefixed by `fuzz_`.
+ *
+ * Coverage is collected through the `-fsanitize-coverage=trace-pc-guard`
+ * callbacks, or the `trace-pc` callback which is all that `gcc` provides.
+ * Every guard (or hashed PC) is assigned a slot in a fixed size map of 8-bit
+ * edge counters; each worker thread owns its own map so that workers never
+ * share cache lines on the hot path. Each worker also lists the slots its
+ * current execution touched, so that after the execution only those slots
+ * are folded into a shared, AFL-style bucketed "virgin" map to detect new
+ * coverage.
+ *
+ * The corpus is append-only: entries never move or change once published,
+ * so that workers pick inputs to mutate without taking a lock. Only adding
+ * an entry, which is rare once coverage settles, is serialized.
+ **/
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "signals.h"
+#include "tdd.h"
+#include "timeutil.h"
+
+/* Number of edge counters; guards are folded into this many slots. */
+#define FUZZ_MAP_SIZE (1 << 16)
+/* Number of executions between checks of the time budget. */
+#define FUZZ_CHECK_EVERY 1024
+/* Maximum number of stacked mutations applied to a single input. */
+#define FUZZ_MAX_STACK 4
+/* Number of entries in the first corpus segment; each next one doubles. */
+#define FUZZ_SEG_FIRST 64
+/* Maximum number of corpus segments. */
+#define FUZZ_SEGS 24
+
+/* Total number of guards assigned by __sanitizer_cov_trace_pc_guard_init. */
+static uint32_t tdd_cov_guards = 0;
+
+/* The edge counters of a worker, and the slots touched since last folded. */
+typedef struct fuzz_cov_t {
+    uint8_t  map[FUZZ_MAP_SIZE];
+    uint32_t touched[FUZZ_MAP_SIZE];
+    uint32_t n_touched;
+} fuzz_cov_t;
+
+/* Coverage of the fuzz worker running on this thread, if any. */
+static __thread fuzz_cov_t* tdd_cov = NULL;
+
+static inline void __fuzz_hit(fuzz_cov_t* cov, uint32_t i) {
+    if (cov->map[i]++ == 0 && cov->n_touched < FUZZ_MAP_SIZE) {
+        cov->touched[cov->n_touched++] = i;
+    }
+}
+
+void __sanitizer_cov_trace_pc_guard_init(uint32_t* start, uint32_t* stop) {
+    if (start == stop || *start != 0) return;
+    for (uint32_t* g = start; g < stop; g++) {
+        *g = ++tdd_cov_guards;
+    }
+}
+
+void __sanitizer_cov_trace_pc_guard(uint32_t* guard) {
+    fuzz_cov_t* cov = tdd_cov;
+    if (cov != NULL) {
+        __fuzz_hit(cov, *guard & (FUZZ_MAP_SIZE - 1));
+    }
+}
+
+void __sanitizer_cov_trace_pc(void) {
+    fuzz_cov_t* cov = tdd_cov;
+    if (cov != NULL) {
+        uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+        __fuzz_hit(cov, (uint32_t)((pc ^ (pc >> 16)) & (FUZZ_MAP_SIZE - 1)));
+    }
+}
+
+/* A single corpus entry. */
+typedef struct fuzz_input_t {
+    uint8_t* data;
+    size_t   len;
+} fuzz_input_t;
+
+/* State shared by all workers fuzzing a single target. */
+typedef struct fuzz_shared_t {
+    void* (*fn)(void* t, const uint8_t* data, size_t len);
+    test_t*         t;
+    char*           dir;
+    size_t          max_len;
+    struct timespec deadline;
+
+    /* Serializes adding to the corpus; reading it takes no lock. */
+    pthread_mutex_t lock;
+    /* Segment k holds FUZZ_SEG_FIRST << k entries, so none ever move. */
+    fuzz_input_t* corpus[FUZZ_SEGS];
+    /* The number of published entries; read with acquire ordering. */
+    int n_corpus;
+    int new_inputs;
+
+    uint8_t       virgin[FUZZ_MAP_SIZE];
+    unsigned long edges;
+    int           stop;
+} fuzz_shared_t;
+
+/* Per-thread worker state. */
+typedef struct fuzz_worker_t {
+    fuzz_shared_t* sh;
+    pthread_t      thread;
+    uint64_t       rng;
+    fuzz_cov_t*    cov;
+    uint8_t*       buf;
+    size_t         len;
+    test_t*        scratch;
+    unsigned long  execs;
+} fuzz_worker_t;
+
+static uint64_t __fuzz_rand(uint64_t* s) {
+    /* xorshift64* */
+    uint64_t x = *s;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *s = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t __fuzz_hash(const uint8_t* data, size_t len) {
+    /* FNV-1a */
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint8_t __fuzz_bucket(uint8_t count) {
+    if (count == 1) return 1;
+    if (count == 2) return 2;
+    if (count == 3) return 4;
+    if (count <= 7) return 8;
+    if (count <= 15) return 16;
+    if (count <= 31) return 32;
+    if (count <= 127) return 64;
+    return 128;
+}
+
+static int __fuzz_mkdirs(const char* path) {
+    char* p = calloc(strlen(path) + 1, sizeof(char));
+    if (p == NULL) return -1;
+    strcpy(p, path);
+    for (char* c = p + 1; *c != '\0'; c++) {
+        if (*c != '/') continue;
+        *c = '\0';
+        if (mkdir(p, 0755) != 0 && errno != EEXIST) {
+            free(p);
+            return -1;
+        }
+        *c = '/';
+    }
+    int ret = mkdir(p, 0755);
+    free(p);
+    return (ret == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+static char* __fuzz_path(const char* dir, const char* file) {
+    char* path = calloc(strlen(dir) + strlen(file) + 2, sizeof(char));
+    if (path != NULL) sprintf(path, "%s/%s", dir, file);
+    return path;
+}
+
+/* Writes an input to the corpus directory, returning the path written. */
+static char* __fuzz_save(const char* dir, const char* prefix,
+                         const uint8_t* data, size_t len) {
+    if (__fuzz_mkdirs(dir) != 0) return NULL;
+
+    char name[64];
+    sprintf(name, "%s%016llx", prefix,
+            (unsigned long long)__fuzz_hash(data, len));
+    char* path = __fuzz_path(dir, name);
+    if (path == NULL) return NULL;
+
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        free(path);
+        return NULL;
+    }
+    if (len > 0) fwrite(data, 1, len, f);
+    fclose(f);
+
+    return path;
+}
+
+static int __fuzz_load(const char* path, fuzz_input_t* in) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) return -1;
+
+    size_t cap = 256;
+    in->len    = 0;
+    in->data   = malloc(cap);
+    size_t n;
+    while (in->data != NULL &&
+           (n = fread(in->data + in->len, 1, cap - in->len, f)) > 0) {
+        in->len += n;
+        if (in->len == cap) {
+            cap *= 2;
+            uint8_t* tmp = realloc(in->data, cap);
+            if (tmp == NULL) free(in->data);
+            in->data = tmp;
+        }
+    }
+    fclose(f);
+
+    return in->data == NULL ? -1 : 0;
+}
+
+/* Returns a sorted list of the regular files in dir; NULL if none. */
+static char** __fuzz_list(const char* dir, int* n) {
+    *n       = 0;
+    DIR* d   = opendir(dir);
+    if (d == NULL) return NULL;
+
+    int    cap   = 0;
+    char** names = NULL;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        char*       path = __fuzz_path(dir, e->d_name);
+        struct stat st;
+        if (path == NULL || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            free(path);
+            continue;
+        }
+        if (*n == cap) {
+            cap          = cap ? cap * 2 : 16;
+            char** tmp   = realloc(names, sizeof(char*) * cap);
+            if (tmp == NULL) {
+                free(path);
+                break;
+            }
+            names = tmp;
+        }
+        names[(*n)++] = path;
+    }
+    closedir(d);
+
+    /* Insertion sort keeps replay order stable between runs. */
+    for (int i = 1; i < *n; i++) {
+        char* key = names[i];
+        int   j   = i - 1;
+        for (; j >= 0 && strcmp(names[j], key) > 0; j--) {
+            names[j + 1] = names[j];
+        }
+        names[j + 1] = key;
+    }
+
+    return names;
+}
+
+/* Resets a scratch test so that it can be reused for the next input. */
+static void __fuzz_clear(test_t* t) {
+    if (t->fail_msg != NULL) {
+        free(t->fail_msg);
+        t->fail_msg = NULL;
+    }
+    if (t->err_msg != NULL) {
+        for (int i = 0; i < t->err; i++) {
+            free(t->err_msg[i]);
+        }
+        free(t->err_msg);
+        t->err_msg = NULL;
+    }
+    free(t->err_at);
+    t->err_at = NULL;
+    t->failed = false;
+    t->err    = 0;
+}
+
+/* Runs one input on a scratch test; returns true if the input failed. */
+static bool __fuzz_exec(void* (*fn)(void*, const uint8_t*, size_t),
+                        test_t* scratch, const uint8_t* data, size_t len) {
+    __fuzz_clear(scratch);
+    /* A fault abandons the input, rather than faulting again forever. */
+    sigjmp_buf env;
+    if (sigsetjmp(env, 1) == 0) {
+        __sigsegv_resume(&env);
+        fn(scratch, data, len);
+    } else if (!scratch->failed) {
+        test_fail(scratch, "Encountered segmentation fault");
+    }
+    __sigsegv_resume(NULL);
+    return scratch->failed || scratch->err != 0;
+}
+
+/* Copies the outcome of a failed scratch test onto the real test. */
+static void __fuzz_report(test_t* t, test_t* scratch, const char* input) {
+    char* msg;
+    for (int i = 0; i < scratch->err; i++) {
+        msg = calloc(strlen(input) + strlen(scratch->err_msg[i]) + 8,
+                     sizeof(char));
+        sprintf(msg, "%s: %s", input, scratch->err_msg[i]);
+        test_error(t, msg);
+        free(msg);
+    }
+    if (scratch->failed) {
+        msg = calloc(strlen(input) + strlen(scratch->fail_msg) + 8,
+                     sizeof(char));
+        sprintf(msg, "%s: %s", input, scratch->fail_msg);
+        test_fail(t, msg);
+        free(msg);
+    }
+}
+
+/* Finds the segment and the slot within it of the i-th corpus entry. */
+static fuzz_input_t* __fuzz_entry(fuzz_shared_t* sh, int i, int* seg) {
+    unsigned long j = (unsigned long)i / FUZZ_SEG_FIRST + 1;
+    int           k = 0;
+    while (j >>= 1) k++;
+    if (seg != NULL) *seg = k;
+    if (k >= FUZZ_SEGS || sh->corpus[k] == NULL) return NULL;
+    return &sh->corpus[k][i - FUZZ_SEG_FIRST * ((1 << k) - 1)];
+}
+
+/* Picks a published corpus entry at random. */
+static const fuzz_input_t* __fuzz_pick(fuzz_shared_t* sh, uint64_t r) {
+    int n = __atomic_load_n(&sh->n_corpus, __ATOMIC_ACQUIRE);
+    return __fuzz_entry(sh, (int)(r % (uint64_t)n), NULL);
+}
+
+static void __fuzz_add(fuzz_shared_t* sh, const uint8_t* data, size_t len,
+                       bool save) {
+    pthread_mutex_lock(&sh->lock);
+    int           seg;
+    fuzz_input_t* in = __fuzz_entry(sh, sh->n_corpus, &seg);
+    if (in == NULL && seg < FUZZ_SEGS) {
+        sh->corpus[seg] =
+            malloc(sizeof(fuzz_input_t) * ((size_t)FUZZ_SEG_FIRST << seg));
+        in = __fuzz_entry(sh, sh->n_corpus, NULL);
+    }
+    uint8_t* copy = in != NULL ? malloc(len > 0 ? len : 1) : NULL;
+    if (copy != NULL) {
+        if (len > 0) memcpy(copy, data, len);
+        in->data = copy;
+        in->len  = len;
+        /* Publish the entry only once it is complete. */
+        __atomic_store_n(&sh->n_corpus, sh->n_corpus + 1, __ATOMIC_RELEASE);
+        if (save) {
+            sh->new_inputs++;
+            free(__fuzz_save(sh->dir, "", data, len));
+        }
+    }
+    pthread_mutex_unlock(&sh->lock);
+}
+
+/* Clears a worker's counters without folding them. */
+static void __fuzz_cov_reset(fuzz_cov_t* cov) {
+    for (uint32_t k = 0; k < cov->n_touched; k++) {
+        cov->map[cov->touched[k]] = 0;
+    }
+    cov->n_touched = 0;
+}
+
+/* Folds a worker's counters into the shared map; true if coverage grew. */
+static bool __fuzz_fold(fuzz_shared_t* sh, fuzz_cov_t* cov) {
+    bool grew = false;
+    for (uint32_t k = 0; k < cov->n_touched; k++) {
+        uint32_t i = cov->touched[k];
+        /* A counter that wrapped is listed twice, and cleared already. */
+        if (cov->map[i] == 0) continue;
+        uint8_t bit = __fuzz_bucket(cov->map[i]);
+        cov->map[i] = 0;
+        if (__atomic_load_n(&sh->virgin[i], __ATOMIC_RELAXED) & bit) continue;
+
+        uint8_t old = __atomic_fetch_or(&sh->virgin[i], bit, __ATOMIC_RELAXED);
+        if (old & bit) continue;
+        if (old == 0) __atomic_fetch_add(&sh->edges, 1, __ATOMIC_RELAXED);
+        grew = true;
+    }
+    cov->n_touched = 0;
+
+    return grew;
+}
+
+static void __fuzz_mutate(fuzz_worker_t* w) {
+    fuzz_shared_t* sh = w->sh;
+
+    /* Start from a random corpus entry. */
+    const fuzz_input_t* in = __fuzz_pick(sh, __fuzz_rand(&w->rng));
+    w->len = in->len < sh->max_len ? in->len : sh->max_len;
+    memcpy(w->buf, in->data, w->len);
+
+    static const uint8_t interesting[] = {0, 1, 0x7f, 0x80, 0xff, 0x20,
+                                          0x40, 0x10};
+
+    int stack = 1 + (int)(__fuzz_rand(&w->rng) % FUZZ_MAX_STACK);
+    for (int i = 0; i < stack; i++) {
+        uint64_t r   = __fuzz_rand(&w->rng);
+        size_t   pos = w->len ? (size_t)((r >> 8) % w->len) : 0;
+        switch (w->len ? r % 8 : 3) {
+        case 0: /* flip a bit */
+            w->buf[pos] ^= (uint8_t)(1u << ((r >> 4) & 7));
+            break;
+        case 1: /* set a random byte */
+            w->buf[pos] = (uint8_t)(r >> 32);
+            break;
+        case 2: /* set an interesting byte */
+            w->buf[pos] = interesting[(r >> 32) % sizeof(interesting)];
+            break;
+        case 3: /* insert a random byte */
+            if (w->len < sh->max_len) {
+                memmove(w->buf + pos + 1, w->buf + pos, w->len - pos);
+                w->buf[pos] = (uint8_t)(r >> 40);
+                w->len++;
+            }
+            break;
+        case 4: /* erase a range */
+            if (w->len > 1) {
+                size_t n = 1 + (size_t)((r >> 32) % (w->len - pos));
+                memmove(w->buf + pos, w->buf + pos + n, w->len - pos - n);
+                w->len -= n;
+            }
+            break;
+        case 5: /* small arithmetic */
+            w->buf[pos] += (uint8_t)((int)((r >> 32) % 35) - 17);
+            break;
+        case 6: { /* copy a range within the input */
+            size_t src = (size_t)((r >> 32) % w->len);
+            size_t n   = 1 + (size_t)((r >> 48) % (w->len - src));
+            if (n > w->len - pos) n = w->len - pos;
+            memmove(w->buf + pos, w->buf + src, n);
+            break;
+        }
+        default: { /* splice with another corpus entry */
+            const fuzz_input_t* o = __fuzz_pick(sh, r >> 32);
+            if (o->len > 0 && pos < sh->max_len) {
+                size_t n = o->len;
+                if (n > sh->max_len - pos) n = sh->max_len - pos;
+                memcpy(w->buf + pos, o->data, n);
+                if (pos + n > w->len) w->len = pos + n;
+            }
+            break;
+        }
+        }
+    }
+}
+
+/* Shrinks a failing input by removing ever smaller chunks of it. */
+static void __fuzz_minimize(fuzz_worker_t* w) {
+    fuzz_shared_t* sh  = w->sh;
+    uint8_t*       tmp = malloc(w->len > 0 ? w->len : 1);
+    if (tmp == NULL) return;
+
+    for (size_t chunk = w->len / 2; chunk >= 1; chunk /= 2) {
+        size_t off = 0;
+        while (off + chunk <= w->len) {
+            memcpy(tmp, w->buf, off);
+            memcpy(tmp + off, w->buf + off + chunk, w->len - off - chunk);
+            if (__fuzz_exec(sh->fn, w->scratch, tmp, w->len - chunk)) {
+                memcpy(w->buf, tmp, w->len - chunk);
+                w->len -= chunk;
+            } else {
+                off += chunk;
+            }
+        }
+    }
+    free(tmp);
+
+    /* Leave the scratch test describing the minimized input. */
+    __fuzz_exec(sh->fn, w->scratch, w->buf, w->len);
+}
+
+static void* __fuzz_worker(void* arg) {
+    fuzz_worker_t* w  = arg;
+    fuzz_shared_t* sh = w->sh;
+
+    tdd_cov = w->cov;
+    while (!__atomic_load_n(&sh->stop, __ATOMIC_RELAXED)) {
+        __fuzz_mutate(w);
+        bool failed = __fuzz_exec(sh->fn, w->scratch, w->buf, w->len);
+        w->execs++;
+
+        if (failed) {
+            __fuzz_cov_reset(w->cov);
+            int expect = 0;
+            if (__atomic_compare_exchange_n(&sh->stop, &expect, 2, false,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_RELAXED)) {
+                /* This worker found the first crasher; report it. */
+                __fuzz_minimize(w);
+                char* path = __fuzz_save(sh->dir, "crash-", w->buf, w->len);
+                __fuzz_report(sh->t, w->scratch,
+                              path ? path : "unsaved crashing input");
+                free(path);
+            }
+            break;
+        }
+        if (__fuzz_fold(sh, w->cov)) {
+            __fuzz_add(sh, w->buf, w->len, true);
+        }
+
+        if (w->execs % FUZZ_CHECK_EVERY == 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            struct timespec left = __timespec_minus(&sh->deadline, &now);
+            if (left.tv_sec < 0) {
+                int expect = 0;
+                __atomic_compare_exchange_n(&sh->stop, &expect, 1, false,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_RELAXED);
+            }
+        }
+    }
+    tdd_cov = NULL;
+
+    return NULL;
+}
+
+static void __fuzz_run(test_t* t, fuzz_shared_t* sh, int n_workers) {
+    fuzz_worker_t* w = calloc(n_workers, sizeof(fuzz_worker_t));
+    if (w == NULL) {
+        test_fail(t, "fuzz: could not allocate workers");
+        return;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int started = 0;
+    for (int i = 0; i < n_workers; i++) {
+        w[i].sh      = sh;
+        w[i].rng     = ((uint64_t)start.tv_nsec << 16) ^ (uint64_t)(i + 1) ^
+                   0x9E3779B97F4A7C15ULL;
+        w[i].cov     = calloc(1, sizeof(fuzz_cov_t));
+        w[i].buf     = malloc(sh->max_len > 0 ? sh->max_len : 1);
+        w[i].scratch = tdd_test_new(t->name);
+        if (w[i].cov == NULL || w[i].buf == NULL || w[i].scratch == NULL) {
+            break;
+        }
+        w[i].scratch->suite = t->suite;
+        if (pthread_create(&w[i].thread, NULL, &__fuzz_worker, &w[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        test_fail(t, "fuzz: could not start any workers");
+    }
+
+    for (int i = 0; i < n_workers; i++) {
+        if (i < started) pthread_join(w[i].thread, NULL);
+        t->fuzz->execs += w[i].execs;
+        free(w[i].cov);
+        free(w[i].buf);
+        tdd_test_del(w[i].scratch);
+    }
+    free(w);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    struct timespec d    = __timespec_minus(&end, &start);
+    double          secs = (double)d.tv_sec + (double)d.tv_nsec / 1e9;
+
+    t->fuzz->workers       = started;
+    t->fuzz->execs_per_sec = secs > 0 ? (double)t->fuzz->execs / secs : 0;
+    t->fuzz->edges         = sh->edges;
+    t->fuzz->new_inputs    = sh->new_inputs;
+    t->fuzz->crashers      = sh->stop == 2 ? 1 : 0;
+}
+
+void* test_fuzz(test_t* t,
+                void* (*fn)(void* t, const uint8_t* data, size_t len)) {
+    if (t == NULL || fn == NULL) return NULL;
+
+    suite_t*    s       = t->suite;
+    const char* root    = s != NULL ? s->fuzz_corpus_dir : "testdata/fuzz";
+    size_t      max_len = s != NULL ? s->fuzz_max_len : 4096;
+
+    if (t->fuzz == NULL) t->fuzz = calloc(1, sizeof(tdd_fuzz_stats_t));
+    char* dir = __fuzz_path(root, t->name);
+    if (t->fuzz == NULL || dir == NULL) {
+        free(dir);
+        return test_fail(t, "fuzz: could not allocate fuzzing state");
+    }
+
+    int    n_files = 0;
+    char** files   = __fuzz_list(dir, &n_files);
+
+    if (!t->fuzzing) {
+        /* Replay the corpus as a regression test. */
+        test_t* scratch = tdd_test_new(t->name);
+        scratch->suite  = s;
+        t->fuzz->corpus_size = n_files;
+        if (n_files == 0 && __fuzz_exec(fn, scratch, NULL, 0)) {
+            __fuzz_report(t, scratch, "empty input");
+        }
+        for (int i = 0; i < n_files && !t->failed; i++) {
+            fuzz_input_t in;
+            if (__fuzz_load(files[i], &in) != 0) {
+                test_error(t, "fuzz: could not read corpus input");
+                continue;
+            }
+            if (__fuzz_exec(fn, scratch, in.data, in.len)) {
+                __fuzz_report(t, scratch, files[i]);
+            }
+            free(in.data);
+        }
+        tdd_test_del(scratch);
+    } else {
+        fuzz_shared_t* sh = calloc(1, sizeof(fuzz_shared_t));
+        if (sh == NULL) {
+            test_fail(t, "fuzz: could not allocate fuzzing state");
+        } else {
+            pthread_mutex_init(&sh->lock, NULL);
+            sh->fn      = fn;
+            sh->t       = t;
+            sh->dir     = dir;
+            sh->max_len = max_len;
+            clock_gettime(CLOCK_MONOTONIC, &sh->deadline);
+            sh->deadline.tv_sec += s->fuzz_seconds;
+
+            /* Seed with the existing corpus, or an empty input. */
+            for (int i = 0; i < n_files; i++) {
+                fuzz_input_t in;
+                if (__fuzz_load(files[i], &in) == 0) {
+                    __fuzz_add(sh, in.data,
+                               in.len < max_len ? in.len : max_len, false);
+                    free(in.data);
+                }
+            }
+            if (sh->n_corpus == 0) __fuzz_add(sh, NULL, 0, false);
+
+            int n_workers = s->fuzz_workers;
+            if (n_workers <= 0) n_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            if (n_workers <= 0) n_workers = 1;
+            __fuzz_run(t, sh, n_workers);
+            t->fuzz->corpus_size = sh->n_corpus;
+
+            for (int i = 0; i < sh->n_corpus; i++) {
+                free(__fuzz_entry(sh, i, NULL)->data);
+            }
+            for (int k = 0; k < FUZZ_SEGS; k++) {
+                free(sh->corpus[k]);
+            }
+            pthread_mutex_destroy(&sh->lock);
+            free(sh);
+        }
+    }
+
+    for (int i = 0; i < n_files; i++) {
+        free(files[i]);
+    }
+    free(files);
+    free(dir);
+
+    return NULL;
+}
@@ -0,0 +1,330 @@
+/**
+ * @file golden.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of golden file
+ *        assertions, which compare output with a file that is mapped into
+ *        memory, and can rewrite the file instead when asked to.
+ **/
+/* posix_madvise() and mkstemp() are not in POSIX.1c. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bulk.h"
+#include "tdd.h"
+#include "tdd_assert.h"
+
+/* Number of differences described in a failure message. */
+#define GOLDEN_REPORT 4
+/* Number of bytes shown either side of a difference. */
+#define GOLDEN_CONTEXT 8
+/* Room for one described difference in a failure message. */
+#define GOLDEN_DIFF_LEN (32 + 2 * 3 * (2 * GOLDEN_CONTEXT + 1))
+
+/* A difference between the output and the golden file. */
+typedef struct golden_diff_t {
+    /* The offset of the first differing byte. */
+    size_t at;
+    /* The offset of the first byte of context. */
+    size_t from;
+    /* The context from the output, and its length. */
+    uint8_t got[2 * GOLDEN_CONTEXT];
+    int     n_got;
+    /* The context from the golden file, and its length. */
+    uint8_t want[2 * GOLDEN_CONTEXT];
+    int     n_want;
+} golden_diff_t;
+
+struct tdd_golden_t {
+    test_t*     t;
+    char*       path;
+    const char* file;
+    int         line;
+    const char* expr;
+    /* The golden file, or NULL if it is empty or missing. */
+    const uint8_t* want;
+    size_t         want_len;
+    /* The errno from opening the golden file, or 0 if it was opened. */
+    int missing;
+    /* The number of bytes of output seen so far. */
+    size_t off;
+    /* The last bytes of output, for context before a difference. */
+    uint8_t tail[GOLDEN_CONTEXT];
+    size_t  n_tail;
+    /* The first differences found; comparison stops once this is full. */
+    golden_diff_t diffs[GOLDEN_REPORT];
+    int           n_diffs;
+    /* Whether the output runs past the end of the golden file. */
+    bool longer;
+    /* The file that replaces the golden file in update mode, or -1. */
+    int   fd;
+    char* tmp;
+    int   write_errno;
+};
+
+/*
+ * Returns the output byte at pos, which must be in the current chunk or in
+ * the tail of the output before it.
+ */
+static uint8_t __golden_got(const tdd_golden_t* g, const uint8_t* buf,
+                            size_t pos) {
+    if (pos >= g->off) return buf[pos - g->off];
+    return g->tail[g->n_tail - (g->off - pos)];
+}
+
+/* Records a difference at pos, which is past the current chunk at its end. */
+static void __golden_note(tdd_golden_t* g, const uint8_t* buf, size_t len,
+                          size_t pos) {
+    golden_diff_t* d = &g->diffs[g->n_diffs++];
+
+    size_t back = g->off - g->n_tail;
+    d->at       = pos;
+    d->from     = pos - GOLDEN_CONTEXT < pos ? pos - GOLDEN_CONTEXT : 0;
+    if (d->from < back) d->from = back;
+    d->n_got  = 0;
+    d->n_want = 0;
+    for (size_t i = d->from; i < pos + GOLDEN_CONTEXT; i++) {
+        if (i < g->off + len) d->got[d->n_got++] = __golden_got(g, buf, i);
+        if (i < g->want_len) d->want[d->n_want++] = g->want[i];
+    }
+}
+
+/* Whether a difference at pos would fall in the context of the last one. */
+static bool __golden_seen(const tdd_golden_t* g, size_t pos) {
+    return g->n_diffs > 0 &&
+           pos < g->diffs[g->n_diffs - 1].at + GOLDEN_CONTEXT;
+}
+
+/* Keeps the last bytes of output, for context before the next chunk. */
+static void __golden_keep_tail(tdd_golden_t* g, const uint8_t* buf,
+                               size_t len) {
+    if (len >= GOLDEN_CONTEXT) {
+        memcpy(g->tail, buf + len - GOLDEN_CONTEXT, GOLDEN_CONTEXT);
+        g->n_tail = GOLDEN_CONTEXT;
+        return;
+    }
+    size_t keep = g->n_tail + len > GOLDEN_CONTEXT ? GOLDEN_CONTEXT - len
+                                                   : g->n_tail;
+    memmove(g->tail, g->tail + g->n_tail - keep, keep);
+    memcpy(g->tail + keep, buf, len);
+    g->n_tail = keep + len;
+}
+
+static void __golden_error(test_t* t, const char* what, const char* path,
+                           int err) {
+    const char* why = strerror(err);
+    char*       msg = malloc(32 + strlen(what) + strlen(path) + strlen(why));
+    if (msg == NULL) return;
+    sprintf(msg, "%s %s: %s", what, path, why);
+    test_error(t, msg);
+    free(msg);
+}
+
+/* Opens the file that replaces the golden file, next to it. */
+static int __golden_open_tmp(tdd_golden_t* g, mode_t mode) {
+    g->tmp = malloc(strlen(g->path) + 8);
+    if (g->tmp == NULL) return EXIT_FAILURE;
+    sprintf(g->tmp, "%s.XXXXXX", g->path);
+
+    g->fd = mkstemp(g->tmp);
+    if (g->fd < 0) {
+        __golden_error(g->t, "cannot create golden file", g->tmp, errno);
+        return EXIT_FAILURE;
+    }
+    fchmod(g->fd, mode);
+
+    return EXIT_SUCCESS;
+}
+
+static void __golden_del(tdd_golden_t* g) {
+    if (g->want != NULL) munmap((void*)g->want, g->want_len);
+    if (g->fd >= 0) {
+        close(g->fd);
+        unlink(g->tmp);
+    }
+    free(g->tmp);
+    free(g->path);
+    free(g);
+}
+
+static tdd_golden_t* __golden_new(test_t* t, const char* path,
+                                  const char* file, int line,
+                                  const char* expr) {
+    tdd_golden_t* g = calloc(1, sizeof(tdd_golden_t));
+    if (g == NULL) return NULL;
+    g->t    = t;
+    g->file = file;
+    g->line = line;
+    g->expr = expr;
+    g->fd   = -1;
+    g->path = malloc(strlen(path) + 1);
+    if (g->path == NULL) {
+        free(g);
+        return NULL;
+    }
+    strcpy(g->path, path);
+
+    bool        update = t->suite != NULL && t->suite->golden_update;
+    mode_t      mode   = 0644;
+    struct stat st;
+    int         fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        g->missing = errno;
+    } else if (st.st_size > 0) {
+        size_t len  = (size_t)st.st_size;
+        void*  want = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (want == MAP_FAILED) {
+            __golden_error(t, "cannot map golden file", path, errno);
+            close(fd);
+            __golden_del(g);
+            return NULL;
+        }
+        posix_madvise(want, len, POSIX_MADV_SEQUENTIAL);
+        g->want     = want;
+        g->want_len = len;
+    }
+    if (fd >= 0) {
+        if (g->missing == 0) mode = st.st_mode & 07777;
+        close(fd);
+    }
+    if (update && __golden_open_tmp(g, mode) != EXIT_SUCCESS) {
+        __golden_del(g);
+        return NULL;
+    }
+
+    return g;
+}
+
+tdd_golden_t* __tdd_golden_open(test_t* t, const char* path,
+                                const char* file, int line) {
+    return __golden_new(t, path, file, line, "output");
+}
+
+bool test_golden_write(tdd_golden_t* g, const void* buf, size_t len) {
+    if (g == NULL) return false;
+    const uint8_t* out = buf;
+
+    for (size_t done = 0; g->fd >= 0 && g->write_errno == 0 && done < len;) {
+        ssize_t n = write(g->fd, out + done, len - done);
+        if (n < 0 && errno != EINTR) g->write_errno = errno;
+        if (n > 0) done += (size_t)n;
+    }
+
+    size_t end = g->off < g->want_len ? g->want_len - g->off : 0;
+    if (end > len) end = len;
+    for (size_t i = 0; i < end && g->n_diffs < GOLDEN_REPORT;) {
+        i += __bulk_mem_find(out + i, g->want + g->off + i, end - i);
+        if (i == end) break;
+        __golden_note(g, out, len, g->off + i);
+        /* The bytes around a difference are shown with it. */
+        i += GOLDEN_CONTEXT;
+    }
+    if (len > end && !g->longer) {
+        /* The output runs past the end of the golden file. */
+        g->longer = true;
+        if (g->n_diffs < GOLDEN_REPORT && !__golden_seen(g, g->want_len)) {
+            __golden_note(g, out, len, g->want_len);
+        }
+    }
+
+    __golden_keep_tail(g, out, len);
+    g->off += len;
+
+    return g->n_diffs == 0 && !g->longer;
+}
+
+/* Describes how the output differs; the caller frees the message. */
+static char* __golden_msg(const tdd_golden_t* g) {
+    size_t len = 256 + strlen(g->file) + strlen(g->expr) + strlen(g->path);
+    char*  msg = malloc(len + GOLDEN_REPORT * GOLDEN_DIFF_LEN);
+    if (msg == NULL) return NULL;
+
+    int n = sprintf(msg, "%s:%d: %s: ", g->file, g->line, g->expr);
+    if (g->missing != 0) {
+        sprintf(msg + n, "cannot open golden file %s: %s", g->path,
+                strerror(g->missing));
+        return msg;
+    }
+    n += sprintf(msg + n, "differs from golden file %s (%zu bytes, want %zu)",
+                 g->path, g->off, g->want_len);
+
+    for (int k = 0; k < g->n_diffs; k++) {
+        const golden_diff_t* d = &g->diffs[k];
+        n += sprintf(msg + n, "%s [%zu] got", k > 0 ? "," : ":", d->at);
+        for (int i = 0; i < d->n_got; i++) {
+            bool at = d->from + (size_t)i == d->at;
+            n += sprintf(msg + n, at ? " [%02x]" : " %02x", d->got[i]);
+        }
+        if (d->from + (size_t)d->n_got <= d->at) {
+            n += sprintf(msg + n, " [EOF]");
+        }
+        n += sprintf(msg + n, ", want");
+        for (int i = 0; i < d->n_want; i++) {
+            bool at = d->from + (size_t)i == d->at;
+            n += sprintf(msg + n, at ? " [%02x]" : " %02x", d->want[i]);
+        }
+        if (d->from + (size_t)d->n_want <= d->at) {
+            n += sprintf(msg + n, " [EOF]");
+        }
+    }
+
+    return msg;
+}
+
+/* Replaces the golden file with the output written to the temporary file. */
+static bool __golden_replace(tdd_golden_t* g) {
+    int err = g->write_errno;
+    if (err == 0 && fsync(g->fd) != 0) err = errno;
+    if (close(g->fd) != 0 && err == 0) err = errno;
+    g->fd = -1;
+    if (err == 0 && rename(g->tmp, g->path) != 0) err = errno;
+    if (err != 0) {
+        unlink(g->tmp);
+        __golden_error(g->t, "cannot update golden file", g->path, err);
+        return false;
+    }
+
+    return true;
+}
+
+bool test_golden_close(tdd_golden_t* g) {
+    if (g == NULL) return false;
+
+    if (g->off < g->want_len && g->n_diffs < GOLDEN_REPORT &&
+        !__golden_seen(g, g->off)) {
+        /* The output ends before the golden file does. */
+        __golden_note(g, NULL, 0, g->off);
+    }
+    bool ok = g->missing == 0 && g->n_diffs == 0;
+
+    if (g->fd >= 0) {
+        ok = ok || __golden_replace(g);
+    } else if (!ok && !g->t->failed) {
+        char* msg = __golden_msg(g);
+        if (msg != NULL) test_fail(g->t, msg);
+        free(msg);
+    }
+    __golden_del(g);
+
+    return ok;
+}
+
+bool __tdd_assert_matches_golden(test_t* t, const char* path,
+                                 const void* buf, size_t len,
+                                 const char* file, int line,
+                                 const char* expr) {
+    tdd_golden_t* g = __golden_new(t, path, file, line, expr);
+    if (g == NULL) return false;
+    test_golden_write(g, buf, len);
+
+    return test_golden_close(g);
+}
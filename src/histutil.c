@@ -0,0 +1,79 @@
+/**
+ * @file histutil.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Latency histogram functions.
+ * @private
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "histutil.h"
+
+#define SUB_BITS 6
+#define SUB_COUNT (1 << SUB_BITS)
+#define EXACT (2 * SUB_COUNT)
+#define N_BUCKETS (EXACT + (64 - SUB_BITS - 1) * SUB_COUNT)
+
+static int __hist_index(uint64_t v) {
+    if (v < EXACT) return (int)v;
+    int mag   = 63 - __builtin_clzll(v);
+    int shift = mag - SUB_BITS;
+    return EXACT + (mag - SUB_BITS - 1) * SUB_COUNT +
+           (int)((v >> shift) - SUB_COUNT);
+}
+
+/* Returns the midpoint of the values recorded in bucket i. */
+static double __hist_value(int i) {
+    if (i < EXACT) return (double)i;
+    int      mag   = (i - EXACT) / SUB_COUNT + SUB_BITS + 1;
+    int      shift = mag - SUB_BITS;
+    uint64_t sub   = (uint64_t)((i - EXACT) % SUB_COUNT + SUB_COUNT);
+    return (double)(sub << shift) + (double)(1ULL << shift) / 2.0;
+}
+
+__hist_t* __hist_new(void) {
+    __hist_t* h = calloc(1, sizeof(__hist_t));
+    if (h == NULL) return NULL;
+    h->counts = calloc(N_BUCKETS, sizeof(uint64_t));
+    if (h->counts == NULL) {
+        free(h);
+        return NULL;
+    }
+    return h;
+}
+
+void __hist_del(__hist_t* h) {
+    if (h == NULL) return;
+    free(h->counts);
+    free(h);
+}
+
+void __hist_reset(__hist_t* h) {
+    memset(h->counts, 0, N_BUCKETS * sizeof(uint64_t));
+    h->total = 0;
+    h->max   = 0;
+}
+
+void __hist_record(__hist_t* h, uint64_t v) {
+    h->counts[__hist_index(v)]++;
+    h->total++;
+    if (v > h->max) h->max = v;
+}
+
+double __hist_percentile(const __hist_t* h, double p) {
+    if (h->total == 0) return 0;
+    if (p >= 100) return (double)h->max;
+
+    uint64_t rank = (uint64_t)(p / 100.0 * (double)h->total);
+    if (rank >= h->total) rank = h->total - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < N_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen > rank) {
+            double v = __hist_value(i);
+            return v > (double)h->max ? (double)h->max : v;
+        }
+    }
+    return (double)h->max;
+}
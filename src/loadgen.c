@@ -0,0 +1,206 @@
+/**
+ * @file loadgen.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of open-loop benchmarks,
+ *        which issue operations at a fixed rate and measure latency from
+ *        the time each operation was meant to start.
+ *
+ * A closed-loop benchmark only starts the next operation once the previous
+ * one has finished, so a slow operation delays (and hides) every request
+ * that should have been issued while it ran. Here each operation has an
+ * intended start time on a fixed schedule; when an operation starts late
+ * because an earlier one ran long, the delay is charged to its latency.
+ **/
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "histutil.h"
+#include "tdd.h"
+#include "timeutil.h"
+
+/* Default offered loads, as fractions of the measured peak throughput. */
+static const double default_loads[] = {0.25, 0.5, 0.75, 0.9};
+#define N_DEFAULT_LOADS (sizeof(default_loads) / sizeof(default_loads[0]))
+/* Number of seconds spent measuring peak throughput. */
+#define PEAK_SECONDS 0.1
+/* Sleep until this many nanoseconds before an operation is due, then spin. */
+#define SPIN_NS 50000
+
+typedef struct load_run_t {
+    void (*op)(void* arg);
+    void*              arg;
+    double             rate;
+    double             seconds;
+    __hist_t*          latency;
+    __hist_t*          service;
+    tdd_load_point_t*  point;
+    struct timespec    start;
+    struct timespec    end;
+} load_run_t;
+
+static uint64_t __load_ns(const struct timespec* ts) {
+    return (uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec;
+}
+
+static void __load_wait_until(uint64_t due) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t cur = __load_ns(&now);
+    if (cur + SPIN_NS < due) {
+        struct timespec nap;
+        uint64_t        d = due - cur - SPIN_NS;
+        nap.tv_sec        = (time_t)(d / 1000000000ULL);
+        nap.tv_nsec       = (long)(d % 1000000000ULL);
+        nanosleep(&nap, NULL);
+    }
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (__load_ns(&now) < due);
+}
+
+/* The scheduler thread: issues operations on a fixed schedule. */
+static void* __load_scheduler(void* arg) {
+    load_run_t* r        = arg;
+    double      interval = 1e9 / r->rate;
+    uint64_t    n        = (uint64_t)(r->rate * r->seconds);
+    if (n == 0) n = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &r->start);
+    uint64_t t0       = __load_ns(&r->start);
+    uint64_t deadline = t0 + (uint64_t)(r->seconds * 1e9);
+    uint64_t done     = t0;
+    uint64_t i;
+    /*
+     * Past the deadline the operation cannot keep up with the offered load,
+     * and the rest of the schedule would take a multiple of bench_seconds.
+     */
+    for (i = 0; i < n && (i == 0 || done < deadline); i++) {
+        uint64_t due = t0 + (uint64_t)((double)i * interval);
+        __load_wait_until(due);
+
+        struct timespec begin, end;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        r->op(r->arg);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        done = __load_ns(&end);
+        __hist_record(r->latency, done - due);
+        __hist_record(r->service, done - __load_ns(&begin));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &r->end);
+
+    struct timespec d    = __timespec_minus(&r->end, &r->start);
+    double          secs = (double)d.tv_sec + (double)d.tv_nsec / 1e9;
+
+    tdd_load_point_t* p = r->point;
+    p->target_rate      = r->rate;
+    p->ops              = (unsigned long)i;
+    p->dropped          = (unsigned long)(n - i);
+    p->achieved_rate    = secs > 0 ? (double)i / secs : 0;
+    p->p50              = __hist_percentile(r->latency, 50);
+    p->p90              = __hist_percentile(r->latency, 90);
+    p->p99              = __hist_percentile(r->latency, 99);
+    p->p999             = __hist_percentile(r->latency, 99.9);
+    p->max              = __hist_percentile(r->latency, 100);
+    p->service_p50      = __hist_percentile(r->service, 50);
+    p->service_p99      = __hist_percentile(r->service, 99);
+
+    return NULL;
+}
+
+/* Runs the operation back to back to find the peak closed-loop rate. */
+static double __load_peak(void (*op)(void* arg), void* arg) {
+    struct timespec start, now, d;
+    unsigned long   n = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        for (int i = 0; i < 16; i++) op(arg);
+        n += 16;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        d = __timespec_minus(&now, &start);
+    } while ((double)d.tv_sec + (double)d.tv_nsec / 1e9 < PEAK_SECONDS);
+
+    return (double)n / ((double)d.tv_sec + (double)d.tv_nsec / 1e9);
+}
+
+int tdd_load_del(tdd_load_t* load) {
+    if (load == NULL) return EXIT_FAILURE;
+
+    free(load->points);
+    free(load);
+
+    return EXIT_SUCCESS;
+}
+
+void* test_run_open_loop(test_t* t, void (*op)(void* arg), void* arg) {
+    if (t == NULL || op == NULL) return NULL;
+
+    suite_t*      s       = t->suite;
+    const double* rates   = s != NULL ? s->bench_rates : NULL;
+    int           n_rates = s != NULL ? s->bench_n_rates : 0;
+    double        seconds = s != NULL ? s->bench_seconds : 1.0;
+
+    /* Without explicit rates, offer fractions of the peak throughput. */
+    double peak = 0;
+    if (rates == NULL || n_rates <= 0) {
+        peak    = __load_peak(op, arg);
+        n_rates = N_DEFAULT_LOADS;
+    }
+
+    tdd_load_t* load = calloc(1, sizeof(tdd_load_t));
+    __hist_t*   lat  = __hist_new();
+    __hist_t*   svc  = __hist_new();
+    if (load != NULL) {
+        load->points = calloc(n_rates, sizeof(tdd_load_point_t));
+    }
+    if (load == NULL || load->points == NULL || lat == NULL || svc == NULL) {
+        tdd_load_del(load);
+        __hist_del(lat);
+        __hist_del(svc);
+        return test_fail(t, "open loop: out of memory");
+    }
+    load->peak_rate = peak;
+
+    for (int i = 0; i < n_rates; i++) {
+        load_run_t r;
+        memset(&r, 0, sizeof(load_run_t));
+        r.op      = op;
+        r.arg     = arg;
+        r.rate    = peak > 0 ? peak * default_loads[i] : rates[i];
+        r.seconds = seconds;
+        r.latency = lat;
+        r.service = svc;
+        r.point   = &load->points[load->n_points];
+        if (r.rate <= 0) continue;
+        __hist_reset(lat);
+        __hist_reset(svc);
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, &__load_scheduler, &r) != 0) {
+            break;
+        }
+        pthread_join(thread, NULL);
+
+        if (load->n_points == 0) *t->start = r.start;
+        *t->end = r.end;
+        load->n_points++;
+    }
+    __hist_del(lat);
+    __hist_del(svc);
+
+    if (t->load != NULL) {
+        tdd_load_del(t->load);
+    }
+    t->load = load;
+    if (load->n_points == 0) {
+        return test_fail(t, "open loop: could not start scheduler thread");
+    }
+
+    return NULL;
+}
@@ -0,0 +1,426 @@
+/**
+ * @file lockprof.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of the lock contention
+ *        profiler, which measures how long the threads of a test wait for
+ *        and hold pthread mutexes, read-write locks and condition variables.
+ *
+ * When the library is built with TDD_LOCKPROF, it defines the pthread lock
+ * functions itself, so calls made by test code bind to these definitions
+ * and are forwarded to the C library's through dlsym(RTLD_NEXT). While no
+ * test is being profiled the wrappers only forward. While one is, a lock
+ * is first tried without blocking, and only acquisitions that have to wait
+ * are timed. The hold time runs from acquisition to unlock and is charged
+ * to the call site that acquired the lock.
+ *
+ * Call sites are kept in a fixed table that threads update with atomic
+ * operations only, because the wrappers cannot take a lock themselves.
+ **/
+/* RTLD_NEXT is a GNU extension. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lockprof.h"
+#include "tdd.h"
+
+#ifdef TDD_LOCKPROF
+#include <dlfcn.h>
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
+/* Number of call sites tracked per test; a power of two. */
+#define LP_SITES 1024
+/* Number of locks a thread can hold at once and still have timed. */
+#define LP_HELD 16
+
+typedef struct lp_site_t {
+    uintptr_t pc;
+    int       kind;
+    long      count;
+    long      contended;
+    int64_t   wait_ns;
+    int64_t   max_wait_ns;
+    int64_t   hold_ns;
+    int64_t   max_hold_ns;
+} lp_site_t;
+
+/* A lock held by the calling thread, and where and when it was taken. */
+typedef struct lp_held_t {
+    const void* lock;
+    lp_site_t*  site;
+    int64_t     at;
+    unsigned    gen;
+} lp_held_t;
+
+static lp_site_t lp_sites[LP_SITES];
+static int       lp_active;
+/* Bumped by each __lockprof_begin(), so stale held locks are ignored. */
+static unsigned  lp_gen;
+
+static __thread int       tls_internal;
+static __thread lp_held_t tls_held[LP_HELD];
+static __thread int       tls_n_held;
+
+static int (*real_mutex_lock)(pthread_mutex_t*);
+static int (*real_mutex_trylock)(pthread_mutex_t*);
+static int (*real_mutex_unlock)(pthread_mutex_t*);
+static int (*real_rwlock_rdlock)(pthread_rwlock_t*);
+static int (*real_rwlock_tryrdlock)(pthread_rwlock_t*);
+static int (*real_rwlock_wrlock)(pthread_rwlock_t*);
+static int (*real_rwlock_trywrlock)(pthread_rwlock_t*);
+static int (*real_rwlock_unlock)(pthread_rwlock_t*);
+static int (*real_cond_wait)(pthread_cond_t*, pthread_mutex_t*);
+static int (*real_cond_timedwait)(pthread_cond_t*, pthread_mutex_t*,
+                                  const struct timespec*);
+
+/* Object to function pointer conversion, as POSIX recommends for dlsym. */
+#define LP_RESOLVE(fp, name)                                                 \
+    if (fp == NULL) *(void**)(&fp) = dlsym(RTLD_NEXT, name)
+
+static void __lp_resolve(void) {
+    LP_RESOLVE(real_mutex_lock, "pthread_mutex_lock");
+    LP_RESOLVE(real_mutex_trylock, "pthread_mutex_trylock");
+    LP_RESOLVE(real_mutex_unlock, "pthread_mutex_unlock");
+    LP_RESOLVE(real_rwlock_rdlock, "pthread_rwlock_rdlock");
+    LP_RESOLVE(real_rwlock_tryrdlock, "pthread_rwlock_tryrdlock");
+    LP_RESOLVE(real_rwlock_wrlock, "pthread_rwlock_wrlock");
+    LP_RESOLVE(real_rwlock_trywrlock, "pthread_rwlock_trywrlock");
+    LP_RESOLVE(real_rwlock_unlock, "pthread_rwlock_unlock");
+    LP_RESOLVE(real_cond_wait, "pthread_cond_wait");
+    LP_RESOLVE(real_cond_timedwait, "pthread_cond_timedwait");
+    if (real_mutex_lock == NULL || real_mutex_unlock == NULL) {
+        fprintf(stderr, "libtdd: could not find the pthread lock functions;"
+                        " lock profiling needs a dynamically linked libc\n");
+        abort();
+    }
+}
+
+/* Resolve before main(), while the process is still single threaded. */
+static void __lp_init(void) __attribute__((constructor));
+static void __lp_init(void) {
+    __lp_resolve();
+}
+
+static int64_t __lp_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + (int64_t)ts.tv_nsec;
+}
+
+static bool __lp_tracking(void) {
+    return __atomic_load_n(&lp_active, __ATOMIC_ACQUIRE) && tls_internal == 0;
+}
+
+static void __lp_max(int64_t* max, int64_t v) {
+    int64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (v > cur && !__atomic_compare_exchange_n(max, &cur, v, true,
+                                                   __ATOMIC_RELAXED,
+                                                   __ATOMIC_RELAXED)) {
+    }
+}
+
+/* Finds or claims the table entry of a call site; NULL if the table is full. */
+static lp_site_t* __lp_site(uintptr_t pc, int kind) {
+    size_t h = (size_t)((pc >> 2) * 0x9E3779B97F4A7C15ULL);
+    for (size_t i = 0; i < LP_SITES; i++) {
+        lp_site_t* s   = &lp_sites[(h + i) & (LP_SITES - 1)];
+        uintptr_t  cur = __atomic_load_n(&s->pc, __ATOMIC_ACQUIRE);
+        if (cur == 0) {
+            if (__atomic_compare_exchange_n(&s->pc, &cur, pc, false,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&s->kind, kind, __ATOMIC_RELAXED);
+                return s;
+            }
+        }
+        if (cur == pc) return s;
+    }
+
+    return NULL;
+}
+
+static void __lp_waited(lp_site_t* s, int64_t wait, bool contended) {
+    __atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+    if (contended) {
+        __atomic_fetch_add(&s->contended, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s->wait_ns, wait, __ATOMIC_RELAXED);
+        __lp_max(&s->max_wait_ns, wait);
+    }
+}
+
+static void __lp_acquired(const void* lock, void* pc, int kind, int64_t wait,
+                          bool contended) {
+    lp_site_t* s = __lp_site((uintptr_t)pc, kind);
+    if (s == NULL) return;
+    __lp_waited(s, wait, contended);
+
+    if (tls_n_held < LP_HELD) {
+        lp_held_t* h = &tls_held[tls_n_held++];
+        h->lock      = lock;
+        h->site      = s;
+        h->at        = __lp_now();
+        h->gen       = __atomic_load_n(&lp_gen, __ATOMIC_RELAXED);
+    }
+}
+
+/* Ends the hold of the most recent acquisition of lock by this thread. */
+static lp_held_t* __lp_release(const void* lock, bool pop) {
+    for (int i = tls_n_held - 1; i >= 0; i--) {
+        lp_held_t* h = &tls_held[i];
+        if (h->lock != lock) continue;
+
+        if (h->gen == __atomic_load_n(&lp_gen, __ATOMIC_RELAXED) &&
+            __atomic_load_n(&lp_active, __ATOMIC_ACQUIRE)) {
+            int64_t hold = __lp_now() - h->at;
+            __atomic_fetch_add(&h->site->hold_ns, hold, __ATOMIC_RELAXED);
+            __lp_max(&h->site->max_hold_ns, hold);
+        }
+        if (!pop) return h;
+        tls_held[i] = tls_held[--tls_n_held];
+        return NULL;
+    }
+
+    return NULL;
+}
+
+int pthread_mutex_lock(pthread_mutex_t* m) {
+    if (real_mutex_lock == NULL) __lp_resolve();
+    if (!__lp_tracking()) return real_mutex_lock(m);
+
+    int64_t wait = 0;
+    int     ret  = real_mutex_trylock(m);
+    bool    busy = ret == EBUSY;
+    if (busy) {
+        int64_t start = __lp_now();
+        ret           = real_mutex_lock(m);
+        wait          = __lp_now() - start;
+    }
+    if (ret == 0) {
+        __lp_acquired(m, __builtin_return_address(0), TDD_LOCK_MUTEX, wait,
+                      busy);
+    }
+
+    return ret;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t* m) {
+    if (real_mutex_unlock == NULL) __lp_resolve();
+    if (tls_n_held > 0) __lp_release(m, true);
+
+    return real_mutex_unlock(m);
+}
+
+static int __lp_rwlock(pthread_rwlock_t* l, void* pc, int kind,
+                       int (*lock)(pthread_rwlock_t*),
+                       int (*trylock)(pthread_rwlock_t*)) {
+    if (!__lp_tracking()) return lock(l);
+
+    int64_t wait = 0;
+    int     ret  = trylock(l);
+    bool    busy = ret == EBUSY;
+    if (busy) {
+        int64_t start = __lp_now();
+        ret           = lock(l);
+        wait          = __lp_now() - start;
+    }
+    if (ret == 0) __lp_acquired(l, pc, kind, wait, busy);
+
+    return ret;
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t* l) {
+    if (real_rwlock_rdlock == NULL) __lp_resolve();
+    return __lp_rwlock(l, __builtin_return_address(0), TDD_LOCK_RDLOCK,
+                       real_rwlock_rdlock, real_rwlock_tryrdlock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t* l) {
+    if (real_rwlock_wrlock == NULL) __lp_resolve();
+    return __lp_rwlock(l, __builtin_return_address(0), TDD_LOCK_WRLOCK,
+                       real_rwlock_wrlock, real_rwlock_trywrlock);
+}
+
+int pthread_rwlock_unlock(pthread_rwlock_t* l) {
+    if (real_rwlock_unlock == NULL) __lp_resolve();
+    if (tls_n_held > 0) __lp_release(l, true);
+
+    return real_rwlock_unlock(l);
+}
+
+/*
+ * Times a wait on a condition variable. The mutex is not held while
+ * waiting, so its hold is paused and restarted when the wait returns.
+ */
+static int __lp_cond(pthread_cond_t* c, pthread_mutex_t* m,
+                     const struct timespec* abstime, void* pc) {
+    if (!__lp_tracking()) {
+        return abstime != NULL ? real_cond_timedwait(c, m, abstime)
+                               : real_cond_wait(c, m);
+    }
+
+    lp_held_t* held  = __lp_release(m, false);
+    int64_t    start = __lp_now();
+    int        ret   = abstime != NULL ? real_cond_timedwait(c, m, abstime)
+                                       : real_cond_wait(c, m);
+    int64_t    now   = __lp_now();
+    if (held != NULL) held->at = now;
+
+    lp_site_t* s = __lp_site((uintptr_t)pc, TDD_LOCK_COND);
+    if (s != NULL) __lp_waited(s, now - start, true);
+
+    return ret;
+}
+
+int pthread_cond_wait(pthread_cond_t* c, pthread_mutex_t* m) {
+    if (real_cond_wait == NULL) __lp_resolve();
+    return __lp_cond(c, m, NULL, __builtin_return_address(0));
+}
+
+int pthread_cond_timedwait(pthread_cond_t* c, pthread_mutex_t* m,
+                           const struct timespec* abstime) {
+    if (real_cond_timedwait == NULL) __lp_resolve();
+    return __lp_cond(c, m, abstime, __builtin_return_address(0));
+}
+
+/*
+ * Names a call site from a backtrace_symbols() entry such as
+ * "./a.out(worker+0x2c) [0x55..]", or "./a.out(+0x11f9) [0x55..]" for code
+ * without an exported symbol, which becomes "a.out+0x11f9".
+ */
+static char* __lp_site_name(uintptr_t pc) {
+    char* name = malloc(32);
+    if (name == NULL) return NULL;
+    sprintf(name, "%#lx", (unsigned long)pc);
+#if defined(__GLIBC__)
+    void*  addr = (void*)pc;
+    char** syms = backtrace_symbols(&addr, 1);
+    if (syms == NULL) return name;
+
+    const char* sym  = syms[0];
+    const char* open = strchr(sym, '(');
+    const char* shut = open != NULL ? strchr(open, ')') : NULL;
+    if (shut != NULL) {
+        const char* from = open + 1;
+        const char* mod  = sym;
+        for (const char* c = sym; c < open; c++) {
+            if (*c == '/') mod = c + 1;
+        }
+        /* Without a symbol, prefix the offset with the module name. */
+        size_t mlen = *from == '+' ? (size_t)(open - mod) : 0;
+        size_t len  = (size_t)(shut - from);
+        char*  tmp  = malloc(mlen + len + 1);
+        if (tmp != NULL) {
+            memcpy(tmp, mod, mlen);
+            memcpy(tmp + mlen, from, len);
+            tmp[mlen + len] = '\0';
+            free(name);
+            name = tmp;
+        }
+    }
+    free(syms);
+#endif
+    return name;
+}
+
+static int __lp_cmp_wait(const void* a, const void* b) {
+    const tdd_lock_stats_t* x = a;
+    const tdd_lock_stats_t* y = b;
+    return (x->wait_ns < y->wait_ns) - (x->wait_ns > y->wait_ns);
+}
+#endif
+
+bool __lockprof_supported(void) {
+#ifdef TDD_LOCKPROF
+    return true;
+#else
+    return false;
+#endif
+}
+
+void __lockprof_begin(void) {
+#ifdef TDD_LOCKPROF
+    memset(lp_sites, 0, sizeof(lp_sites));
+    __atomic_add_fetch(&lp_gen, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&lp_active, 1, __ATOMIC_RELEASE);
+#endif
+}
+
+void __lockprof_end(test_t* t) {
+#ifdef TDD_LOCKPROF
+    __atomic_store_n(&lp_active, 0, __ATOMIC_RELEASE);
+    if (t == NULL) return;
+
+    for (size_t i = 0; i < LP_SITES; i++) {
+        lp_site_t* s = &lp_sites[i];
+        if (s->pc == 0 || s->count == 0) continue;
+
+        tdd_lock_stats_t l;
+        l.site        = __lp_site_name(s->pc);
+        l.kind        = (tdd_lock_kind_t)s->kind;
+        l.count       = s->count;
+        l.contended   = s->contended;
+        l.wait_ns     = s->wait_ns;
+        l.max_wait_ns = s->max_wait_ns;
+        l.hold_ns     = s->hold_ns;
+        l.max_hold_ns = s->max_hold_ns;
+        if (l.site != NULL) __locks_add(t, &l);
+        free(l.site);
+    }
+    if (t->n_locks > 1) {
+        qsort(t->locks, t->n_locks, sizeof(tdd_lock_stats_t), &__lp_cmp_wait);
+    }
+#else
+    (void)t;
+#endif
+}
+
+void __lockprof_internal(bool internal) {
+#ifdef TDD_LOCKPROF
+    tls_internal += internal ? 1 : -1;
+#else
+    (void)internal;
+#endif
+}
+
+int __locks_add(test_t* t, const tdd_lock_stats_t* lock) {
+    if (t == NULL || lock == NULL || lock->site == NULL) return EXIT_FAILURE;
+
+    tdd_lock_stats_t* tmp =
+        realloc(t->locks, sizeof(tdd_lock_stats_t) * (t->n_locks + 1));
+    if (tmp == NULL) {
+        errno = ENOMEM;
+        return EXIT_FAILURE;
+    }
+    t->locks            = tmp;
+    tdd_lock_stats_t* l = &tmp[t->n_locks];
+    *l                  = *lock;
+    l->site             = malloc(strlen(lock->site) + 1);
+    if (l->site == NULL) {
+        errno = ENOMEM;
+        return EXIT_FAILURE;
+    }
+    strcpy(l->site, lock->site);
+    t->n_locks++;
+
+    return EXIT_SUCCESS;
+}
+
+void __locks_free(test_t* t) {
+    if (t == NULL) return;
+
+    for (int i = 0; i < t->n_locks; i++) {
+        free(t->locks[i].site);
+    }
+    free(t->locks);
+    t->locks   = NULL;
+    t->n_locks = 0;
+}
@@ -0,0 +1,342 @@
+/**
+ * @file parallel.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of parallel benchmarks,
+ *        which run a benchmark body on several threads at once to measure
+ *        how concurrent code scales.
+ **/
+/* sched_getaffinity() and CPU_COUNT() are GNU extensions. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lockprof.h"
+#include "profile.h"
+#include "tdd.h"
+#include "timeutil.h"
+#include "trace.h"
+
+/* Target time in nanoseconds between two grabs of the shared counter. */
+#define PB_GRAIN_NS 10000.0
+/* Upper bound on the number of iterations grabbed at once. */
+#define PB_MAX_GRAIN 10000
+/* Maximum growth factor of the iteration count between two rounds. */
+#define PB_MAX_GROWTH 100
+
+/* State shared by the workers of one round of a parallel benchmark. */
+typedef struct pb_round_t {
+    void (*body)(tdd_pb_t* pb);
+    test_t*  t;
+    void*    arg;
+    long     n;
+    long     grain;
+    long     next;
+    int      ready;
+    bool     go;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    struct timespec start;
+    struct timespec end;
+} pb_round_t;
+
+static double __pb_secs(struct timespec* a, struct timespec* b) {
+    struct timespec d = __timespec_minus(a, b);
+    return (double)d.tv_sec + (double)d.tv_nsec / 1e9;
+}
+
+/* Returns the time at which a worker ran out of iterations. */
+static struct timespec __pb_end(const tdd_pb_t* pb) {
+    struct timespec end;
+    end.tv_sec  = (time_t)(pb->end_ns / 1000000000ULL);
+    end.tv_nsec = (long)(pb->end_ns % 1000000000ULL);
+    return end;
+}
+
+bool tdd_pb_next(tdd_pb_t* pb) {
+    pb_round_t* r = (pb_round_t*)pb->round;
+    if (pb->left == 0) {
+        long i = __atomic_fetch_add(&r->next, r->grain, __ATOMIC_RELAXED);
+        if (i >= r->n) return false;
+        pb->left = r->n - i < r->grain ? r->n - i : r->grain;
+    }
+    pb->left--;
+    pb->ops++;
+    return true;
+}
+
+static void* __pb_worker(void* arg) {
+    tdd_pb_t*   pb = arg;
+    pb_round_t* r  = (pb_round_t*)pb->round;
+
+    /* Wait at the start gate so thread start-up is not measured. */
+    __lockprof_internal(true);
+    pthread_mutex_lock(&r->lock);
+    r->ready++;
+    pthread_cond_broadcast(&r->cond);
+    while (!r->go) {
+        pthread_cond_wait(&r->cond, &r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+    __lockprof_internal(false);
+
+    __profile_thread_start(r->t->profile);
+    r->body(pb);
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pb->end_ns = (uint64_t)end.tv_sec * 1000000000ULL + (uint64_t)end.tv_nsec;
+    __profile_thread_stop();
+
+    return NULL;
+}
+
+/* Runs n iterations on n_threads threads; returns the elapsed seconds. */
+static double __pb_round(pb_round_t* r, tdd_pb_t* pbs, pthread_t* threads,
+                         int n_threads) {
+    r->next  = 0;
+    r->ready = 0;
+    r->go    = false;
+
+    int started = 0;
+    for (int i = 0; i < n_threads; i++) {
+        memset(&pbs[i], 0, sizeof(tdd_pb_t));
+        pbs[i].t     = r->t;
+        pbs[i].arg   = r->arg;
+        pbs[i].id    = i;
+        pbs[i].round = r;
+        if (pthread_create(&threads[i], NULL, &__pb_worker, &pbs[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    /* Open the gate once every worker is waiting at it. */
+    __lockprof_internal(true);
+    pthread_mutex_lock(&r->lock);
+    while (r->ready < started) {
+        pthread_cond_wait(&r->cond, &r->lock);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &r->start);
+    r->go = true;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    __lockprof_internal(false);
+
+    /* The round ends when the last thread runs out of iterations. */
+    r->end = r->start;
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        struct timespec end = __pb_end(&pbs[i]);
+        if (__pb_secs(&end, &r->end) > 0) r->end = end;
+    }
+
+    return started == n_threads ? __pb_secs(&r->end, &r->start) : -1;
+}
+
+/* Runs a parallel benchmark for at least the given number of seconds. */
+static tdd_parallel_stats_t* __pb_run(test_t* t, void (*body)(tdd_pb_t* pb),
+                                      void* arg, int n_threads,
+                                      double seconds) {
+    pb_round_t r;
+    memset(&r, 0, sizeof(pb_round_t));
+    r.body = body;
+    r.t    = t;
+    r.arg  = arg;
+    pthread_mutex_init(&r.lock, NULL);
+    pthread_cond_init(&r.cond, NULL);
+
+    tdd_parallel_stats_t* ps      = calloc(1, sizeof(tdd_parallel_stats_t));
+    tdd_pb_t*             pbs     = calloc(n_threads, sizeof(tdd_pb_t));
+    pthread_t*            threads = calloc(n_threads, sizeof(pthread_t));
+    double* per_thread            = calloc(n_threads, sizeof(double));
+    if (ps == NULL || pbs == NULL || threads == NULL || per_thread == NULL) {
+        free(ps);
+        ps = NULL;
+        free(per_thread);
+        goto done;
+    }
+
+    /*
+     * Grow the iteration count until a round lasts the requested time,
+     * predicting the next count from the last round's ns/op.
+     */
+    long   n       = 1;
+    double elapsed = 0;
+    for (;;) {
+        double ns_op = elapsed > 0 ? elapsed * 1e9 / (double)r.n : 0;
+        r.n          = n;
+        r.grain      = 1;
+        if (ns_op > 0) {
+            r.grain = (long)(PB_GRAIN_NS / ns_op);
+            if (r.grain < 1) r.grain = 1;
+            if (r.grain > PB_MAX_GRAIN) r.grain = PB_MAX_GRAIN;
+        }
+
+        elapsed = __pb_round(&r, pbs, threads, n_threads);
+        if (elapsed < 0) {
+            free(ps);
+            ps = NULL;
+            free(per_thread);
+            goto done;
+        }
+        if (elapsed >= seconds || n >= 1000000000L) break;
+
+        double next = elapsed > 0 ? (double)n * seconds * 1.2 / elapsed
+                                  : (double)n * PB_MAX_GROWTH;
+        if (next > (double)n * PB_MAX_GROWTH) next = (double)n * PB_MAX_GROWTH;
+        if (next < (double)n + 1) next = (double)n + 1;
+        if (next > 1e9) next = 1e9;
+        n = (long)next;
+    }
+
+    ps->threads     = n_threads;
+    ps->n           = (unsigned long)r.n;
+    ps->ns_per_op   = elapsed * 1e9 / (double)r.n;
+    ps->ops_per_sec = (double)r.n / elapsed;
+    for (int i = 0; i < n_threads; i++) {
+        struct timespec end  = __pb_end(&pbs[i]);
+        double          secs = __pb_secs(&end, &r.start);
+        per_thread[i] = secs > 0 ? (double)pbs[i].ops / secs : 0;
+    }
+    ps->thread_ops_per_sec = per_thread;
+
+    /* Draw each worker's share of the measured round on its own track. */
+    if (t->suite != NULL && t->suite->trace != NULL) {
+        for (int i = 0; i < n_threads; i++) {
+            struct timespec end = __pb_end(&pbs[i]);
+            __trace_worker(t->suite->trace, i, t->name, &r.start, &end);
+        }
+    }
+
+    /* Record the measured window as the test's timed region. */
+    *t->start = r.start;
+    *t->end   = r.end;
+
+done:
+    free(pbs);
+    free(threads);
+    pthread_mutex_destroy(&r.lock);
+    pthread_cond_destroy(&r.cond);
+
+    return ps;
+}
+
+/* Returns the number of CPUs this process may run on. */
+static int __pb_max_threads(void) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &set) == 0) {
+        return CPU_COUNT(&set);
+    }
+#endif
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+/* Runs the benchmark at 1, 2, 4, ... threads up to max_threads. */
+static tdd_scaling_t* __pb_sweep(test_t* t, void (*body)(tdd_pb_t* pb),
+                                 void* arg, int max_threads, double seconds,
+                                 tdd_parallel_stats_t** last) {
+    tdd_scaling_t* sc = calloc(1, sizeof(tdd_scaling_t));
+    if (sc == NULL) return NULL;
+
+    int n_points = 1;
+    for (int n = 1; n < max_threads; n *= 2) n_points++;
+    sc->points = calloc(n_points, sizeof(tdd_scaling_point_t));
+    if (sc->points == NULL) {
+        free(sc);
+        return NULL;
+    }
+
+    *last = NULL;
+    for (int n = 1;; n = n * 2 < max_threads ? n * 2 : max_threads) {
+        tdd_parallel_stats_t* ps = __pb_run(t, body, arg, n, seconds);
+        if (ps == NULL) break;
+
+        tdd_scaling_point_t* p = &sc->points[sc->n_points++];
+        p->threads             = n;
+        p->ns_per_op           = ps->ns_per_op;
+        p->ops_per_sec         = ps->ops_per_sec;
+        p->speedup             = ps->ops_per_sec / sc->points[0].ops_per_sec;
+        p->efficiency          = p->speedup / n;
+
+        if (*last != NULL) tdd_parallel_stats_del(*last);
+        *last = ps;
+        if (n == max_threads) break;
+    }
+
+    return sc;
+}
+
+int tdd_scaling_del(tdd_scaling_t* sc) {
+    if (sc == NULL) return EXIT_FAILURE;
+
+    free(sc->points);
+    free(sc);
+
+    return EXIT_SUCCESS;
+}
+
+tdd_scaling_t* tdd_scaling_copy(const tdd_scaling_t* sc) {
+    if (sc == NULL) return NULL;
+
+    tdd_scaling_t* cp = malloc(sizeof(tdd_scaling_t));
+    if (cp == NULL) return NULL;
+    cp->n_points = sc->n_points;
+    cp->points   = calloc(sc->n_points, sizeof(tdd_scaling_point_t));
+    if (cp->points == NULL) {
+        free(cp);
+        return NULL;
+    }
+    memcpy(cp->points, sc->points,
+           sizeof(tdd_scaling_point_t) * sc->n_points);
+
+    return cp;
+}
+
+int tdd_parallel_stats_del(tdd_parallel_stats_t* ps) {
+    if (ps == NULL) return EXIT_FAILURE;
+
+    free(ps->thread_ops_per_sec);
+    free(ps);
+
+    return EXIT_SUCCESS;
+}
+
+void* test_run_parallel(test_t* t, void (*body)(tdd_pb_t* pb), void* arg) {
+    if (t == NULL || body == NULL) return NULL;
+
+    suite_t* s         = t->suite;
+    int      n_threads = s != NULL ? s->bench_parallelism : 0;
+    double   seconds   = s != NULL ? s->bench_seconds : 1.0;
+    if (n_threads <= 0) n_threads = __pb_max_threads();
+    if (n_threads <= 0) n_threads = 1;
+
+    tdd_parallel_stats_t* ps = NULL;
+    if (s != NULL && s->bench_sweep) {
+        tdd_scaling_t* sc = __pb_sweep(t, body, arg, n_threads, seconds, &ps);
+        if (t->scaling != NULL) {
+            tdd_scaling_del(t->scaling);
+        }
+        t->scaling = sc;
+    } else {
+        ps = __pb_run(t, body, arg, n_threads, seconds);
+    }
+    if (ps == NULL) {
+        return test_fail(t, "parallel: could not start benchmark threads");
+    }
+    if (t->parallel != NULL) {
+        tdd_parallel_stats_del(t->parallel);
+    }
+    t->parallel = ps;
+
+    return NULL;
+}
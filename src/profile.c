@@ -0,0 +1,352 @@
+/**
+ * @file profile.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of the sampling
+ *        profiler, which records the call stacks of benchmark threads and
+ *        writes them as folded stacks for flame graph tools.
+ *
+ * Each profiled thread arms a timer on its own CPU-time clock that sends it
+ * SIGPROF, so a thread is only sampled while it is on a CPU. The handler
+ * unwinds the stack with backtrace() and appends the frames to a shared
+ * buffer by reserving space with a single atomic add; it never allocates or
+ * takes a lock. Samples that do not fit are counted and dropped.
+ * Addresses are turned into names only once the benchmark has finished.
+ **/
+/* timer_create(), SIGEV_THREAD_ID and backtrace() are GNU extensions. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "profile.h"
+#include "tdd.h"
+
+#if defined(__linux__) && defined(__GLIBC__)
+#define TDD_HAVE_PROFILER
+#include <execinfo.h>
+#include <sys/syscall.h>
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+/* Deepest stack recorded; deeper stacks lose their outermost frames. */
+#define PROF_DEPTH 64
+/* Frames of the signal handler and the signal trampoline. */
+#define PROF_SKIP 2
+/* Size of the sample buffer in words: about 10k samples of 25 frames. */
+#define PROF_WORDS (1L << 18)
+
+struct tdd_profile_t {
+    int        hz;
+    /* Samples, each a frame count followed by that many frames, leaf first. */
+    uintptr_t* words;
+    long       used;
+    long       dropped;
+};
+
+static __thread tdd_profile_t* tls_profile;
+#ifdef TDD_HAVE_PROFILER
+static __thread timer_t tls_timer;
+static __thread bool    tls_armed;
+
+static void __profile_handler(int sig, siginfo_t* info, void* uctx) {
+    (void)sig;
+    (void)info;
+    (void)uctx;
+    tdd_profile_t* p = tls_profile;
+    if (p == NULL) return;
+
+    int   saved = errno;
+    void* frames[PROF_DEPTH + PROF_SKIP];
+    int   n = backtrace(frames, PROF_DEPTH + PROF_SKIP) - PROF_SKIP;
+    if (n > 0) {
+        long at = __atomic_fetch_add(&p->used, n + 1, __ATOMIC_RELAXED);
+        if (at + n + 1 <= PROF_WORDS) {
+            p->words[at] = (uintptr_t)n;
+            for (int i = 0; i < n; i++) {
+                p->words[at + 1 + i] = (uintptr_t)frames[PROF_SKIP + i];
+            }
+        } else {
+            __atomic_fetch_add(&p->dropped, 1, __ATOMIC_RELAXED);
+        }
+    }
+    errno = saved;
+}
+#endif
+
+bool __profile_supported(void) {
+#ifdef TDD_HAVE_PROFILER
+    return true;
+#else
+    return false;
+#endif
+}
+
+tdd_profile_t* __profile_new(int hz) {
+#ifdef TDD_HAVE_PROFILER
+    tdd_profile_t* p = calloc(1, sizeof(tdd_profile_t));
+    if (p == NULL) return NULL;
+    p->hz    = hz > 0 ? hz : 997;
+    p->words = calloc(PROF_WORDS, sizeof(uintptr_t));
+    if (p->words == NULL) {
+        free(p);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* The first backtrace() loads the unwinder, which is not signal safe. */
+    void* frame;
+    backtrace(&frame, 1);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(struct sigaction));
+    sa.sa_flags     = SA_SIGINFO | SA_RESTART;
+    sa.sa_sigaction = &__profile_handler;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, NULL) == -1) {
+        __profile_del(p);
+        return NULL;
+    }
+
+    return p;
+#else
+    (void)hz;
+    errno = ENOSYS;
+    return NULL;
+#endif
+}
+
+void __profile_del(tdd_profile_t* p) {
+    if (p == NULL) return;
+
+    free(p->words);
+    free(p);
+}
+
+void __profile_thread_start(tdd_profile_t* p) {
+#ifdef TDD_HAVE_PROFILER
+    if (p == NULL || tls_armed) return;
+
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(struct sigevent));
+    sev.sigev_notify           = SIGEV_THREAD_ID;
+    sev.sigev_signo            = SIGPROF;
+    sev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &tls_timer) != 0) return;
+
+    long              ns = 1000000000L / p->hz;
+    struct itimerspec its;
+    its.it_interval.tv_sec  = ns / 1000000000L;
+    its.it_interval.tv_nsec = ns % 1000000000L;
+    its.it_value            = its.it_interval;
+    tls_profile             = p;
+    tls_armed               = true;
+    timer_settime(tls_timer, 0, &its, NULL);
+#else
+    (void)p;
+#endif
+}
+
+void __profile_thread_stop(void) {
+#ifdef TDD_HAVE_PROFILER
+    if (!tls_armed) return;
+
+    /* A signal that is already pending finds no profile and is ignored. */
+    timer_delete(tls_timer);
+    tls_armed   = false;
+    tls_profile = NULL;
+#endif
+}
+
+#ifdef TDD_HAVE_PROFILER
+static int __profile_cmp_pc(const void* a, const void* b) {
+    uintptr_t x = *(const uintptr_t*)a;
+    uintptr_t y = *(const uintptr_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int __profile_cmp_str(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/*
+ * Names a frame from a backtrace_symbols() entry such as
+ * "/lib/x.so(fn+0x1a) [0x7f..]". Frames without a symbol are named after
+ * their module, so that the stacks of stripped code still fold together.
+ */
+static char* __profile_frame_name(const char* sym) {
+    const char* open = strchr(sym, '(');
+    const char* from = sym;
+    size_t      len  = 0;
+    bool        mod  = true;
+    if (open != NULL) {
+        len = strcspn(open + 1, "+)");
+        if (len > 0) {
+            from = open + 1;
+            mod  = false;
+        } else {
+            for (const char* c = sym; c < open; c++) {
+                if (*c == '/') from = c + 1;
+            }
+            len = (size_t)(open - from);
+        }
+    }
+
+    char* name = malloc(len + 4);
+    if (name == NULL) return NULL;
+    if (mod) {
+        name[0] = '[';
+        memcpy(name + 1, from, len);
+        memcpy(name + 1 + len, "]", 2);
+        if (len == 0) return strcpy(name, "[?]");
+    } else {
+        memcpy(name, from, len);
+        name[len] = '\0';
+    }
+    /* Spaces and semicolons separate fields of the folded format. */
+    for (char* c = name; *c != '\0'; c++) {
+        if (*c == ' ' || *c == ';') *c = '_';
+    }
+
+    return name;
+}
+#endif
+
+int __profile_write(tdd_profile_t* p, const char* dir, const char* name) {
+#ifdef TDD_HAVE_PROFILER
+    if (p == NULL || dir == NULL || name == NULL) return EXIT_FAILURE;
+
+    /* Count the samples and frames that made it into the buffer. */
+    long end       = p->used < PROF_WORDS ? p->used : PROF_WORDS;
+    long n_samples = 0, n_frames = 0;
+    for (long at = 0; at < end && p->words[at] != 0;) {
+        long n = (long)p->words[at];
+        if (at + 1 + n > end) break;
+        n_samples++;
+        n_frames += n;
+        at += n + 1;
+    }
+
+    int        ret      = EXIT_FAILURE;
+    uintptr_t* pcs      = malloc(sizeof(uintptr_t) * (n_frames + 1));
+    char**     names    = NULL;
+    char**     lines    = calloc(n_samples + 1, sizeof(char*));
+    char**     syms     = NULL;
+    long       n_pcs    = 0;
+    long       n_unique = 0;
+    FILE*      f        = NULL;
+    char*      path     = malloc(strlen(dir) + strlen(name) + 9);
+    if (pcs == NULL || lines == NULL || path == NULL) goto done;
+
+    /* Symbolize each distinct address once. */
+    for (long at = 0, s = 0; s < n_samples; s++) {
+        long n = (long)p->words[at];
+        memcpy(&pcs[n_pcs], &p->words[at + 1], sizeof(uintptr_t) * n);
+        n_pcs += n;
+        at += n + 1;
+    }
+    qsort(pcs, n_pcs, sizeof(uintptr_t), &__profile_cmp_pc);
+    for (long i = 0; i < n_pcs; i++) {
+        if (n_unique == 0 || pcs[n_unique - 1] != pcs[i]) {
+            pcs[n_unique++] = pcs[i];
+        }
+    }
+    if (n_unique > 0) {
+        syms  = backtrace_symbols((void* const*)pcs, (int)n_unique);
+        names = calloc(n_unique, sizeof(char*));
+        if (syms == NULL || names == NULL) goto done;
+        for (long i = 0; i < n_unique; i++) {
+            names[i] = __profile_frame_name(syms[i]);
+            if (names[i] == NULL) goto done;
+        }
+    }
+
+    /* Render each sample root first, then count identical stacks. */
+    for (long at = 0, s = 0; s < n_samples; s++) {
+        long   n   = (long)p->words[at];
+        size_t len = 1;
+        for (long i = 0; i < n; i++) {
+            uintptr_t* pc = bsearch(&p->words[at + 1 + i], pcs, n_unique,
+                                    sizeof(uintptr_t), &__profile_cmp_pc);
+            len += strlen(names[pc - pcs]) + 1;
+        }
+        lines[s] = malloc(len);
+        if (lines[s] == NULL) goto done;
+        lines[s][0] = '\0';
+        char* c     = lines[s];
+        for (long i = n - 1; i >= 0; i--) {
+            uintptr_t* pc = bsearch(&p->words[at + 1 + i], pcs, n_unique,
+                                    sizeof(uintptr_t), &__profile_cmp_pc);
+            const char* fn = names[pc - pcs];
+            size_t      fl = strlen(fn);
+            memcpy(c, fn, fl);
+            c += fl;
+            *c++ = i > 0 ? ';' : '\0';
+        }
+        at += n + 1;
+    }
+    qsort(lines, n_samples, sizeof(char*), &__profile_cmp_str);
+
+    sprintf(path, "%s/%s.folded", dir, name);
+    f = fopen(path, "w");
+    if (f == NULL) goto done;
+    for (long i = 0; i < n_samples;) {
+        long j = i + 1;
+        while (j < n_samples && strcmp(lines[i], lines[j]) == 0) j++;
+        fprintf(f, "%s %ld\n", lines[i], j - i);
+        i = j;
+    }
+    if (p->dropped > 0) {
+        fprintf(f, "[dropped] %ld\n", p->dropped);
+    }
+    ret = fclose(f) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+done:
+    for (long i = 0; lines != NULL && i < n_samples; i++) free(lines[i]);
+    for (long i = 0; names != NULL && i < n_unique; i++) free(names[i]);
+    free(lines);
+    free(names);
+    free(syms);
+    free(pcs);
+    free(path);
+
+    return ret;
+#else
+    (void)p;
+    (void)dir;
+    (void)name;
+    errno = ENOSYS;
+    return EXIT_FAILURE;
+#endif
+}
+
+int suite_set_profile(suite_t* s, const char* dir) {
+    if (s == NULL) return EXIT_FAILURE;
+
+    free(s->profile_dir);
+    s->profile_dir = NULL;
+    if (dir == NULL) return EXIT_SUCCESS;
+    if (!__profile_supported()) {
+        errno = ENOSYS;
+        return EXIT_FAILURE;
+    }
+
+    if (mkdir(dir, 0777) == -1 && errno != EEXIST) return EXIT_FAILURE;
+    s->profile_dir = malloc(strlen(dir) + 1);
+    if (s->profile_dir == NULL) {
+        errno = ENOMEM;
+        return EXIT_FAILURE;
+    }
+    strcpy(s->profile_dir, dir);
+
+    return EXIT_SUCCESS;
+}
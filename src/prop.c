@@ -0,0 +1,650 @@
+/**
+ * @file prop.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of property-based
+ *        testing: composable value generators, batched evaluation of a
+ *        property over many generated cases, and shrinking of the first
+ *        counterexample.
+ *
+ * Case `i` of a run is always generated from its own random stream derived
+ * from the run seed and `i`, so the same seed produces the same cases (and
+ * the same first counterexample) regardless of batch size or thread count.
+ **/
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tdd.h"
+
+/* Maximum number of successful shrink steps before giving up. */
+#define PROP_MAX_SHRINKS 1000
+/* Maximum number of shrink candidates tried for a single array element. */
+#define PROP_ELEM_SHRINKS 16
+/* Maximum length of a formatted counterexample. */
+#define PROP_FMT_LEN 512
+/* Tuple members are laid out at offsets aligned to this many bytes. */
+#define PROP_ALIGN 8
+
+static size_t __prop_align(size_t n) {
+    return (n + PROP_ALIGN - 1) & ~(size_t)(PROP_ALIGN - 1);
+}
+
+static uint64_t __prop_mix(uint64_t z) {
+    /* splitmix64 finalizer */
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void tdd_rng_seed(tdd_rng_t* rng, uint64_t seed) {
+    rng->s = __prop_mix(seed);
+}
+
+uint64_t tdd_rng_next(tdd_rng_t* rng) {
+    rng->s += 0x9E3779B97F4A7C15ULL;
+    return __prop_mix(rng->s);
+}
+
+/* Returns a uniformly distributed integer in [0, n). */
+static uint64_t __prop_below(tdd_rng_t* rng, uint64_t n) {
+    return n == 0 ? tdd_rng_next(rng) : tdd_rng_next(rng) % n;
+}
+
+/* Value helpers shared by all generators. */
+static void __gen_copy(const tdd_gen_t* g, void* dst, const void* src) {
+    if (g->copy != NULL) {
+        g->copy(g, dst, src);
+    } else {
+        memcpy(dst, src, g->size);
+    }
+}
+
+static void __gen_release(const tdd_gen_t* g, void* val) {
+    if (g->release != NULL) g->release(g, val);
+}
+
+static tdd_gen_t* __gen_new(size_t size) {
+    tdd_gen_t* g = calloc(1, sizeof(tdd_gen_t));
+    if (g == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    g->size = size;
+    return g;
+}
+
+/* Integers; values are int64_t. */
+static void __int_generate(const tdd_gen_t* g, tdd_rng_t* rng, void* out) {
+    int64_t  v;
+    uint64_t span = (uint64_t)g->hi - (uint64_t)g->lo + 1;
+    switch (__prop_below(rng, 16)) {
+    case 0: v = g->lo; break;
+    case 1: v = g->hi; break;
+    case 2: v = (g->lo <= 0 && g->hi >= 0) ? 0 : g->lo; break;
+    default: v = (int64_t)((uint64_t)g->lo + __prop_below(rng, span)); break;
+    }
+    *(int64_t*)out = v;
+}
+
+static int64_t __int_target(const tdd_gen_t* g) {
+    if (g->lo > 0) return g->lo;
+    if (g->hi < 0) return g->hi;
+    return 0;
+}
+
+static bool __int_shrink(const tdd_gen_t* g, const void* val, int k,
+                         void* out) {
+    int64_t  v      = *(const int64_t*)val;
+    int64_t  target = __int_target(g);
+    bool     down   = v > target;
+    uint64_t dist   = down ? (uint64_t)v - (uint64_t)target
+                           : (uint64_t)target - (uint64_t)v;
+    if (k >= 64 || (dist >> k) == 0) return false;
+
+    uint64_t step  = dist >> k;
+    *(int64_t*)out = down ? (int64_t)((uint64_t)v - step)
+                          : (int64_t)((uint64_t)v + step);
+    return true;
+}
+
+static int __int_format(const tdd_gen_t* g, const void* val, char* buf,
+                        size_t n) {
+    (void)g;
+    return snprintf(buf, n, "%" PRId64, *(const int64_t*)val);
+}
+
+tdd_gen_t* tdd_gen_int(int64_t lo, int64_t hi) {
+    if (lo > hi) return NULL;
+    tdd_gen_t* g = __gen_new(sizeof(int64_t));
+    if (g == NULL) return NULL;
+    g->lo       = lo;
+    g->hi       = hi;
+    g->generate = &__int_generate;
+    g->shrink   = &__int_shrink;
+    g->format   = &__int_format;
+    return g;
+}
+
+/* Bytes; values are uint8_t. Used as the element of tdd_gen_bytes(). */
+static void __byte_generate(const tdd_gen_t* g, tdd_rng_t* rng, void* out) {
+    (void)g;
+    *(uint8_t*)out = (uint8_t)tdd_rng_next(rng);
+}
+
+static bool __byte_shrink(const tdd_gen_t* g, const void* val, int k,
+                          void* out) {
+    (void)g;
+    uint8_t v = *(const uint8_t*)val;
+    if (k >= 8 || (v >> k) == 0) return false;
+    *(uint8_t*)out = (uint8_t)(v - (v >> k));
+    return true;
+}
+
+static int __byte_format(const tdd_gen_t* g, const void* val, char* buf,
+                         size_t n) {
+    (void)g;
+    return snprintf(buf, n, "0x%02x", *(const uint8_t*)val);
+}
+
+/* Doubles. */
+static void __double_generate(const tdd_gen_t* g, tdd_rng_t* rng,
+                              void* out) {
+    double v;
+    switch (__prop_below(rng, 16)) {
+    case 0: v = g->flo; break;
+    case 1: v = g->fhi; break;
+    case 2: v = (g->flo <= 0 && g->fhi >= 0) ? 0.0 : g->flo; break;
+    default: {
+        double u = (double)(tdd_rng_next(rng) >> 11) / 9007199254740992.0;
+        v        = g->flo + u * (g->fhi - g->flo);
+        if (v > g->fhi) v = g->fhi;
+        break;
+    }
+    }
+    *(double*)out = v;
+}
+
+static bool __double_shrink(const tdd_gen_t* g, const void* val, int k,
+                            void* out) {
+    double v      = *(const double*)val;
+    double target = g->flo > 0 ? g->flo : (g->fhi < 0 ? g->fhi : 0.0);
+    if (v == target || k > 33) return false;
+    if (k == 0) {
+        *(double*)out = target;
+        return true;
+    }
+
+    /* Truncate towards zero, if that changes anything. */
+    double whole = (v > -9.2e18 && v < 9.2e18) ? (double)(int64_t)v : v;
+    if (whole != v && whole >= g->flo && whole <= g->fhi) {
+        if (k == 1) {
+            *(double*)out = whole;
+            return true;
+        }
+        k--;
+    }
+
+    /* Then move ever smaller steps towards the target. */
+    double cand = v - (v - target) / (double)(1ULL << k);
+    if (cand == v) return false;
+    *(double*)out = cand;
+    return true;
+}
+
+static int __double_format(const tdd_gen_t* g, const void* val, char* buf,
+                           size_t n) {
+    (void)g;
+    return snprintf(buf, n, "%.17g", *(const double*)val);
+}
+
+tdd_gen_t* tdd_gen_double(double lo, double hi) {
+    if (!(lo <= hi)) return NULL;
+    tdd_gen_t* g = __gen_new(sizeof(double));
+    if (g == NULL) return NULL;
+    g->flo      = lo;
+    g->fhi      = hi;
+    g->generate = &__double_generate;
+    g->shrink   = &__double_shrink;
+    g->format   = &__double_format;
+    return g;
+}
+
+/* Arrays; values are tdd_vec_t holding len contiguous element values. */
+static void __vec_release(const tdd_gen_t* g, void* val) {
+    tdd_vec_t* v = val;
+    if (g->elem->release != NULL) {
+        for (size_t i = 0; i < v->len; i++) {
+            g->elem->release(g->elem, (char*)v->data + i * g->elem->size);
+        }
+    }
+    free(v->data);
+    v->data = NULL;
+    v->len  = 0;
+}
+
+/* Deep copies src into dst, leaving out the elements [skip, skip + cut). */
+static bool __vec_copy_range(const tdd_gen_t* g, tdd_vec_t* dst,
+                             const tdd_vec_t* src, size_t skip, size_t cut) {
+    size_t es = g->elem->size;
+    dst->len  = src->len - cut;
+    dst->data = malloc(dst->len > 0 ? dst->len * es : 1);
+    if (dst->data == NULL) {
+        dst->len = 0;
+        return false;
+    }
+    size_t j = 0;
+    for (size_t i = 0; i < src->len; i++) {
+        if (i >= skip && i < skip + cut) continue;
+        __gen_copy(g->elem, (char*)dst->data + j * es,
+                   (const char*)src->data + i * es);
+        j++;
+    }
+    return true;
+}
+
+static void __vec_copy(const tdd_gen_t* g, void* dst, const void* src) {
+    __vec_copy_range(g, dst, src, 0, 0);
+}
+
+static void __vec_generate(const tdd_gen_t* g, tdd_rng_t* rng, void* out) {
+    tdd_vec_t* v  = out;
+    size_t     es = g->elem->size;
+    v->len        = (size_t)__prop_below(rng, g->max_len + 1);
+    v->data       = malloc(v->len > 0 ? v->len * es : 1);
+    if (v->data == NULL) {
+        v->len = 0;
+        return;
+    }
+    for (size_t i = 0; i < v->len; i++) {
+        g->elem->generate(g->elem, rng, (char*)v->data + i * es);
+    }
+}
+
+static bool __vec_shrink(const tdd_gen_t* g, const void* val, int k,
+                         void* out) {
+    const tdd_vec_t* v  = val;
+    tdd_vec_t*       o  = out;
+    size_t           es = g->elem->size;
+
+    /* First try to drop ever smaller chunks of elements. */
+    for (size_t chunk = v->len; chunk >= 1; chunk /= 2) {
+        for (size_t off = 0; off + chunk <= v->len; off += chunk) {
+            if (k-- == 0) return __vec_copy_range(g, o, v, off, chunk);
+        }
+    }
+
+    /* Then try to shrink each element in place. */
+    if (g->elem->shrink == NULL) return false;
+    char* elem = malloc(es);
+    if (elem == NULL) return false;
+    for (size_t i = 0; i < v->len; i++) {
+        for (int ek = 0; ek < PROP_ELEM_SHRINKS; ek++) {
+            if (!g->elem->shrink(g->elem, (const char*)v->data + i * es, ek,
+                                 elem)) {
+                break;
+            }
+            if (k-- > 0) {
+                __gen_release(g->elem, elem);
+                continue;
+            }
+            if (!__vec_copy_range(g, o, v, 0, 0)) {
+                __gen_release(g->elem, elem);
+                free(elem);
+                return false;
+            }
+            __gen_release(g->elem, (char*)o->data + i * es);
+            memcpy((char*)o->data + i * es, elem, es);
+            free(elem);
+            return true;
+        }
+    }
+    free(elem);
+
+    return false;
+}
+
+static int __vec_format(const tdd_gen_t* g, const void* val, char* buf,
+                        size_t n) {
+    const tdd_vec_t* v = val;
+    size_t           w = 0;
+#define PUT(...)                                                      \
+    w += (size_t)snprintf(buf + (w < n ? w : n), w < n ? n - w : 0, \
+                          __VA_ARGS__)
+    PUT("[");
+    for (size_t i = 0; i < v->len; i++) {
+        if (i > 0) PUT(", ");
+        w += (size_t)g->elem->format(g->elem,
+                                     (const char*)v->data + i * g->elem->size,
+                                     buf + (w < n ? w : n), w < n ? n - w : 0);
+    }
+    PUT("]");
+#undef PUT
+    return (int)w;
+}
+
+tdd_gen_t* tdd_gen_array(tdd_gen_t* elem, size_t max_len) {
+    if (elem == NULL) return NULL;
+    tdd_gen_t* g = __gen_new(sizeof(tdd_vec_t));
+    if (g == NULL) return NULL;
+    g->elem     = elem;
+    g->max_len  = max_len;
+    g->generate = &__vec_generate;
+    g->shrink   = &__vec_shrink;
+    g->format   = &__vec_format;
+    g->copy     = &__vec_copy;
+    g->release  = &__vec_release;
+    return g;
+}
+
+tdd_gen_t* tdd_gen_bytes(size_t max_len) {
+    tdd_gen_t* byte = __gen_new(sizeof(uint8_t));
+    if (byte == NULL) return NULL;
+    byte->generate = &__byte_generate;
+    byte->shrink   = &__byte_shrink;
+    byte->format   = &__byte_format;
+
+    tdd_gen_t* g = tdd_gen_array(byte, max_len);
+    if (g == NULL) free(byte);
+    return g;
+}
+
+/* Tuples; values are the member values laid out at aligned offsets. */
+static size_t __tuple_offset(const tdd_gen_t* g, int i) {
+    size_t off = 0;
+    for (int j = 0; j < i; j++) {
+        off += __prop_align(g->members[j]->size);
+    }
+    return off;
+}
+
+static void __tuple_generate(const tdd_gen_t* g, tdd_rng_t* rng,
+                             void* out) {
+    for (int i = 0; i < g->n_members; i++) {
+        tdd_gen_t* m = g->members[i];
+        m->generate(m, rng, (char*)out + __tuple_offset(g, i));
+    }
+}
+
+static void __tuple_copy(const tdd_gen_t* g, void* dst, const void* src) {
+    for (int i = 0; i < g->n_members; i++) {
+        size_t off = __tuple_offset(g, i);
+        __gen_copy(g->members[i], (char*)dst + off, (const char*)src + off);
+    }
+}
+
+static void __tuple_release(const tdd_gen_t* g, void* val) {
+    for (int i = 0; i < g->n_members; i++) {
+        __gen_release(g->members[i], (char*)val + __tuple_offset(g, i));
+    }
+}
+
+static bool __tuple_shrink(const tdd_gen_t* g, const void* val, int k,
+                           void* out) {
+    for (int i = 0; i < g->n_members; i++) {
+        tdd_gen_t* m   = g->members[i];
+        size_t     off = __tuple_offset(g, i);
+        char*      mv  = malloc(m->size);
+        if (m->shrink == NULL || mv == NULL) {
+            free(mv);
+            continue;
+        }
+        for (int mk = 0; m->shrink(m, (const char*)val + off, mk, mv); mk++) {
+            if (k-- > 0) {
+                __gen_release(m, mv);
+                continue;
+            }
+            __tuple_copy(g, out, val);
+            __gen_release(m, (char*)out + off);
+            memcpy((char*)out + off, mv, m->size);
+            free(mv);
+            return true;
+        }
+        free(mv);
+    }
+    return false;
+}
+
+static int __tuple_format(const tdd_gen_t* g, const void* val, char* buf,
+                          size_t n) {
+    size_t w = 0;
+    for (int i = 0; i < g->n_members; i++) {
+        w += (size_t)snprintf(buf + (w < n ? w : n), w < n ? n - w : 0, "%s",
+                              i == 0 ? "(" : ", ");
+        w += (size_t)g->members[i]->format(
+            g->members[i], (const char*)val + __tuple_offset(g, i),
+            buf + (w < n ? w : n), w < n ? n - w : 0);
+    }
+    w += (size_t)snprintf(buf + (w < n ? w : n), w < n ? n - w : 0, ")");
+    return (int)w;
+}
+
+tdd_gen_t* tdd_gen_tuple(int n, ...) {
+    if (n <= 0) return NULL;
+    tdd_gen_t* g = __gen_new(0);
+    if (g == NULL) return NULL;
+    g->members = calloc(n, sizeof(tdd_gen_t*));
+    if (g->members == NULL) {
+        free(g);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    va_list ap;
+    va_start(ap, n);
+    for (int i = 0; i < n; i++) {
+        g->members[i] = va_arg(ap, tdd_gen_t*);
+        g->size += __prop_align(g->members[i]->size);
+    }
+    va_end(ap);
+
+    g->n_members = n;
+    g->generate  = &__tuple_generate;
+    g->shrink    = &__tuple_shrink;
+    g->format    = &__tuple_format;
+    g->copy      = &__tuple_copy;
+    g->release   = &__tuple_release;
+    return g;
+}
+
+int tdd_gen_del(tdd_gen_t* g) {
+    if (g == NULL) return EXIT_FAILURE;
+
+    if (g->elem != NULL) {
+        tdd_gen_del(g->elem);
+    }
+    if (g->members != NULL) {
+        for (int i = 0; i < g->n_members; i++) {
+            tdd_gen_del(g->members[i]);
+        }
+        free(g->members);
+    }
+    free(g);
+
+    return EXIT_SUCCESS;
+}
+
+/* State shared by the threads evaluating a property. */
+typedef struct prop_run_t {
+    const tdd_gen_t* g;
+    bool (*prop)(const void* value, void* ctx);
+    void*    ctx;
+    uint64_t seed;
+    long     n_cases;
+    long     batch;
+    int      n_threads;
+    long     first_fail; /* lowest failing case index, or n_cases */
+} prop_run_t;
+
+typedef struct prop_worker_t {
+    prop_run_t* run;
+    int         id;
+    pthread_t   thread;
+} prop_worker_t;
+
+static void __prop_case(const prop_run_t* r, long i, void* out) {
+    tdd_rng_t rng;
+    tdd_rng_seed(&rng, r->seed ^ __prop_mix((uint64_t)i + 1));
+    r->g->generate(r->g, &rng, out);
+}
+
+/*
+ * Worker threads take batches round-robin so that low case indices are
+ * checked first. Each batch is generated in full and then evaluated, which
+ * keeps the property's working set hot and amortizes generator dispatch.
+ */
+static void* __prop_worker(void* arg) {
+    prop_worker_t*   w    = arg;
+    prop_run_t*      r    = w->run;
+    size_t           size = r->g->size;
+    char*            vals = malloc(size * (size_t)r->batch);
+    if (vals == NULL) return NULL;
+
+    for (long b = (long)w->id * r->batch; b < r->n_cases;
+         b += r->batch * r->n_threads) {
+        if (b >= __atomic_load_n(&r->first_fail, __ATOMIC_RELAXED)) break;
+
+        long n = r->n_cases - b < r->batch ? r->n_cases - b : r->batch;
+        for (long i = 0; i < n; i++) {
+            __prop_case(r, b + i, vals + i * size);
+        }
+
+        long failed = -1;
+        for (long i = 0; i < n; i++) {
+            if (!r->prop(vals + i * size, r->ctx)) {
+                failed = b + i;
+                break;
+            }
+        }
+        for (long i = 0; i < n; i++) {
+            __gen_release(r->g, vals + i * size);
+        }
+
+        if (failed >= 0) {
+            long cur = __atomic_load_n(&r->first_fail, __ATOMIC_RELAXED);
+            while (failed < cur &&
+                   !__atomic_compare_exchange_n(&r->first_fail, &cur, failed,
+                                                false, __ATOMIC_ACQ_REL,
+                                                __ATOMIC_RELAXED)) {
+            }
+            break;
+        }
+    }
+    free(vals);
+
+    return NULL;
+}
+
+/* Greedily replaces val by its first failing shrink candidate. */
+static int __prop_shrink(const prop_run_t* r, void* val) {
+    const tdd_gen_t* g     = r->g;
+    int              steps = 0;
+    void*            cand  = malloc(g->size > 0 ? g->size : 1);
+    if (cand == NULL || g->shrink == NULL) {
+        free(cand);
+        return 0;
+    }
+
+    bool improved = true;
+    while (improved && steps < PROP_MAX_SHRINKS) {
+        improved = false;
+        for (int k = 0; g->shrink(g, val, k, cand); k++) {
+            if (!r->prop(cand, r->ctx)) {
+                __gen_release(g, val);
+                memcpy(val, cand, g->size);
+                improved = true;
+                steps++;
+                break;
+            }
+            __gen_release(g, cand);
+        }
+    }
+    free(cand);
+
+    return steps;
+}
+
+void* test_property(test_t* t, tdd_gen_t* g,
+                    bool (*prop)(const void* value, void* ctx), void* ctx) {
+    if (t == NULL || g == NULL || prop == NULL) return NULL;
+
+    suite_t*   s = t->suite;
+    prop_run_t r;
+    r.g          = g;
+    r.prop       = prop;
+    r.ctx        = ctx;
+    r.seed       = s != NULL ? s->prop_seed : 0;
+    r.n_cases    = s != NULL ? s->prop_cases : 1000;
+    r.batch      = s != NULL && s->prop_batch > 0 ? s->prop_batch : 256;
+    r.n_threads  = s != NULL ? s->prop_threads : 1;
+    if (r.n_threads <= 0) r.n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (r.n_threads <= 0) r.n_threads = 1;
+    r.first_fail = r.n_cases;
+    if (r.seed == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        r.seed = __prop_mix((uint64_t)now.tv_sec * 1000000000ULL +
+                            (uint64_t)now.tv_nsec);
+    }
+
+    prop_worker_t* w = calloc(r.n_threads, sizeof(prop_worker_t));
+    if (w == NULL) return test_fail(t, "property: out of memory");
+
+    int started = 0;
+    for (int i = 1; i < r.n_threads; i++) {
+        w[i].run = &r;
+        w[i].id  = i;
+        if (pthread_create(&w[i].thread, NULL, &__prop_worker, &w[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    /* If some threads could not start, give their batches to this one. */
+    if (started + 1 < r.n_threads) {
+        for (int i = 1; i <= started; i++) pthread_join(w[i].thread, NULL);
+        r.n_threads = 1;
+        started     = 0;
+    }
+    w[0].run = &r;
+    w[0].id  = 0;
+    __prop_worker(&w[0]);
+    for (int i = 1; i <= started; i++) pthread_join(w[i].thread, NULL);
+    free(w);
+
+    if (r.first_fail >= r.n_cases) return NULL;
+
+    /* Regenerate the first counterexample and minimize it. */
+    void* val = malloc(g->size > 0 ? g->size : 1);
+    char* fmt = calloc(PROP_FMT_LEN, sizeof(char));
+    char* msg = calloc(PROP_FMT_LEN + 160, sizeof(char));
+    if (val == NULL || fmt == NULL || msg == NULL) {
+        free(val);
+        free(fmt);
+        free(msg);
+        return test_fail(t, "property: out of memory");
+    }
+    __prop_case(&r, r.first_fail, val);
+    int steps = __prop_shrink(&r, val);
+    int len   = g->format(g, val, fmt, PROP_FMT_LEN);
+    if (len >= PROP_FMT_LEN) strcpy(fmt + PROP_FMT_LEN - 4, "...");
+    __gen_release(g, val);
+
+    sprintf(msg,
+            "property failed on case %ld of %ld (seed 0x%016" PRIx64
+            ", %d shrinks): %s",
+            r.first_fail + 1, r.n_cases, r.seed, steps, fmt);
+    test_fail(t, msg);
+
+    free(val);
+    free(fmt);
+    free(msg);
+
+    return NULL;
+}
@@ -0,0 +1,343 @@
+/**
+ * @file report.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains the text reporter, which prints the result of
+ *        each test as it finishes.
+ **/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "report.h"
+#include "strutil.h"
+#include "tdd.h"
+#include "timeutil.h"
+
+/* Number of lock call sites reported per test. */
+#define REPORT_LOCK_SITES 5
+
+/* Formats a duration in nanoseconds with a unit that suits it. */
+static void __report_duration(char* buf, double ns) {
+    if (ns < 1e3) {
+        sprintf(buf, "%.1fns", ns);
+    } else if (ns < 1e6) {
+        sprintf(buf, "%.3fus", ns / 1e3);
+    } else if (ns < 1e9) {
+        sprintf(buf, "%.3fms", ns / 1e6);
+    } else {
+        sprintf(buf, "%.3fs", ns / 1e9);
+    }
+}
+
+/* Summarises repeated timings of a benchmark and their outliers. */
+static void __report_samples(FILE* f, const tdd_samples_t* sm) {
+    char median[32], mean[32], lo[32], hi[32];
+    __report_duration(median, sm->median_ns);
+    __report_duration(mean, sm->mean_ns);
+    __report_duration(lo, sm->min_ns);
+    __report_duration(hi, sm->max_ns);
+
+    char row[256];
+    sprintf(row, "%d, median %s +/-%.2f%%, mean %s +/-%.2f%%, range %s-%s\n",
+            sm->n, median, sm->median_ci * 100, mean, sm->mean_ci * 100, lo,
+            hi);
+    __INDENT(f, 6);
+    __print_desc(f, "samples: ");
+    __print_hilite(f, row);
+
+    int outliers = sm->low_severe + sm->low_mild + sm->high_mild +
+                   sm->high_severe;
+    if (outliers > 0) {
+        sprintf(row,
+                "%d (%.1f%%): %d low severe, %d low mild, %d high mild, "
+                "%d high severe\n",
+                outliers, 100.0 * outliers / sm->n, sm->low_severe,
+                sm->low_mild, sm->high_mild, sm->high_severe);
+        __INDENT(f, 15);
+        __print_desc(f, "outliers: ");
+        __print_hilite(f, row);
+    }
+    if (!sm->converged) {
+        __INDENT(f, 15);
+        __print_warning(f, "warning: the confidence interval did not reach "
+                           "its target within the time budget\n");
+    }
+}
+
+/* Compares the timings of a benchmark with cold and with warm caches. */
+static void __report_cache(FILE* f, const tdd_cache_t* c) {
+    char cold[32], warm[32], row[256];
+    __report_duration(cold, c->cold_ns);
+    __report_duration(warm, c->warm_ns);
+    sprintf(row, "cold %s, warm %s (%.2fx), median of %d runs each\n", cold,
+            warm, c->warm_ns > 0 ? c->cold_ns / c->warm_ns : 0.0, c->runs);
+    __INDENT(f, 6);
+    __print_desc(f, "cache: ");
+    __print_hilite(f, row);
+}
+
+/* Describes the environment a benchmark ran in, and warns about noise. */
+static void __report_env(FILE* f, const tdd_bench_env_t* env) {
+    static const struct {
+        unsigned    flag;
+        const char* what;
+    } warnings[] = {
+        {TDD_BENCH_WARN_GOVERNOR, "CPU frequency governor is not performance"},
+        {TDD_BENCH_WARN_TURBO, "turbo boost is enabled"},
+        {TDD_BENCH_WARN_SMT, "another hardware thread shares the CPU core"},
+        {TDD_BENCH_WARN_LOAD, "system load average is above 1"},
+        {TDD_BENCH_WARN_PIN, "could not pin the benchmark thread"},
+        {TDD_BENCH_WARN_REALTIME, "could not use SCHED_FIFO priority"},
+        {TDD_BENCH_WARN_MLOCK, "could not lock memory"},
+    };
+
+    char row[256];
+    int  n = sprintf(row, "cpu %d%s", env->cpu, env->pinned ? " (pinned)" : "");
+    if (env->realtime) n += sprintf(row + n, ", SCHED_FIFO");
+    if (env->memory_locked) n += sprintf(row + n, ", memory locked");
+    if (env->warmup > 0) {
+        n += sprintf(row + n, ", %d warm-up runs", env->warmup);
+    }
+    if (env->governor[0] != '\0') {
+        n += sprintf(row + n, ", governor %s", env->governor);
+    }
+    if (env->turbo >= 0) {
+        n += sprintf(row + n, ", turbo %s", env->turbo ? "on" : "off");
+    }
+    if (env->load >= 0) n += sprintf(row + n, ", load %.2f", env->load);
+    sprintf(row + n, "\n");
+
+    __INDENT(f, 6);
+    __print_desc(f, "env: ");
+    __print_hilite(f, row);
+    for (size_t i = 0; i < sizeof(warnings) / sizeof(warnings[0]); i++) {
+        if ((env->warnings & warnings[i].flag) == 0) continue;
+        sprintf(row, "warning: %s\n", warnings[i].what);
+        __INDENT(f, 11);
+        __print_warning(f, row);
+    }
+}
+
+void __report_test(FILE* f, int index, int n_tests, const char* name,
+                   const char* desc, test_t* t) {
+    if (f == NULL || name == NULL || t == NULL) return;
+    if (desc == NULL) desc = "";
+
+    /* Print test results. */
+    char* res = calloc(256 + strlen(name) + strlen(desc), sizeof(char));
+    if (t->failed) {
+        sprintf(res, "fail: test %d/%d (%s): ", index, n_tests, name);
+        __print_error(f, res);
+        __print_desc(f, (char*)desc);
+        fprintf(f, "\n");
+        __INDENT(f, 6);
+        __print_desc(f, t->fail_msg);
+        fprintf(f, "\n");
+    } else if (t->err != 0) {
+        sprintf(res, "err:  test %d/%d (%s): ", index, n_tests, name);
+        __print_warning(f, res);
+        __print_desc(f, (char*)desc);
+        fprintf(f, "\n");
+        char* errstr = calloc(64, sizeof(char));
+        __INDENT(f, 6);
+        sprintf(errstr, "Encountered %d errors.", t->err);
+        __print_warning(f, errstr);
+        free(errstr);
+        fprintf(f, "\n");
+        for (int i = 0; i < t->err; i++) {
+            char* why = calloc(32 + strlen(t->err_msg[i]), sizeof(char));
+            __INDENT(f, 6);
+            sprintf(why, "%d. %s\n", i + 1, t->err_msg[i]);
+            __print_desc(f, why);
+            free(why);
+        }
+    } else {
+        sprintf(res, "okay: test %d/%d (%s): ", index, n_tests, name);
+        __print_success(f, res);
+        __print_desc(f, (char*)desc);
+        fprintf(f, "\n");
+    }
+    free(res);
+
+    /* Print benchmarking info. */
+    if (__hasprefix((char*)name, "bench_")) {
+        struct timespec tdiff = __timespec_minus(t->end, t->start);
+
+        char* bench_info = calloc(64 + strlen(name), sizeof(char));
+        __INDENT(f, 6);
+        sprintf(bench_info, "bench: test (%s) took ", name);
+        __print_desc(f, bench_info);
+        char* bench_res = calloc(256, sizeof(char));
+        sprintf(bench_res, "%lds %ldns\n", tdiff.tv_sec, tdiff.tv_nsec);
+        __print_hilite(f, bench_res);
+        free(bench_info);
+        free(bench_res);
+    }
+
+    /* Print the repeated timings of an adaptively sampled benchmark. */
+    if (t->samples != NULL && t->samples->n > 0) {
+        __report_samples(f, t->samples);
+    }
+
+    /* Print the timings with cold and with warm caches. */
+    if (t->cache != NULL) {
+        __report_cache(f, t->cache);
+    }
+
+    /* Print parallel benchmarking info. */
+    if (t->parallel != NULL) {
+        tdd_parallel_stats_t* ps = t->parallel;
+
+        char* par_info = calloc(256, sizeof(char));
+        __INDENT(f, 6);
+        sprintf(par_info, "parallel: %d threads, %lu ops, ", ps->threads,
+                ps->n);
+        __print_desc(f, par_info);
+        sprintf(par_info, "%.2f ns/op, %.0f ops/s\n", ps->ns_per_op,
+                ps->ops_per_sec);
+        __print_hilite(f, par_info);
+        for (int i = 0; i < ps->threads; i++) {
+            __INDENT(f, 8);
+            sprintf(par_info, "thread %d: %.0f ops/s\n", i,
+                    ps->thread_ops_per_sec[i]);
+            __print_desc(f, par_info);
+        }
+        free(par_info);
+    }
+
+    /* Print the thread-scaling curve. */
+    if (t->scaling != NULL) {
+        char* row = calloc(256, sizeof(char));
+        __INDENT(f, 6);
+        __print_desc(f, "scaling: threads        ops/s  speedup  efficiency\n");
+        for (int i = 0; i < t->scaling->n_points; i++) {
+            tdd_scaling_point_t* p = &t->scaling->points[i];
+            __INDENT(f, 15);
+            sprintf(row, "%7d %12.0f %7.2fx %10.1f%%\n", p->threads,
+                    p->ops_per_sec, p->speedup, p->efficiency * 100);
+            if (p->efficiency < 0.5) {
+                __print_warning(f, row);
+            } else {
+                __print_hilite(f, row);
+            }
+        }
+        free(row);
+    }
+
+    /* Print open-loop latency at each offered load. */
+    if (t->load != NULL) {
+        char* row = calloc(256, sizeof(char));
+        __INDENT(f, 6);
+        __print_desc(f, "load: offered   achieved      p50      p90      "
+                        "p99    p99.9      max  (service p50/p99)\n");
+        for (int i = 0; i < t->load->n_points; i++) {
+            tdd_load_point_t* p = &t->load->points[i];
+            __INDENT(f, 12);
+            sprintf(row,
+                    "%7.0f/s %8.0f/s %7.0fns %7.0fns %7.0fns %7.0fns "
+                    "%7.0fns  (%.0fns/%.0fns)\n",
+                    p->target_rate, p->achieved_rate, p->p50, p->p90, p->p99,
+                    p->p999, p->max, p->service_p50, p->service_p99);
+            __print_hilite(f, row);
+            if (p->dropped > 0) {
+                __INDENT(f, 12);
+                sprintf(row, "%lu ops not issued: over capacity\n",
+                        p->dropped);
+                __print_hilite(f, row);
+            }
+        }
+        free(row);
+    }
+
+    /* Print fuzzing info. */
+    if (t->fuzz != NULL) {
+        tdd_fuzz_stats_t* fz = t->fuzz;
+
+        char* fuzz_info = calloc(64 + strlen(name), sizeof(char));
+        __INDENT(f, 6);
+        if (t->fuzzing) {
+            sprintf(fuzz_info, "fuzz: test (%s) ran ", name);
+        } else {
+            sprintf(fuzz_info, "fuzz: test (%s) replayed ", name);
+        }
+        __print_desc(f, fuzz_info);
+        char* fuzz_res = calloc(256, sizeof(char));
+        if (t->fuzzing) {
+            sprintf(fuzz_res,
+                    "%lu execs (%.0f/s, %d workers), corpus %d (+%d), "
+                    "edges %lu, crashers %d\n",
+                    fz->execs, fz->execs_per_sec, fz->workers,
+                    fz->corpus_size, fz->new_inputs, fz->edges,
+                    fz->crashers);
+        } else {
+            sprintf(fuzz_res, "%d corpus inputs\n", fz->corpus_size);
+        }
+        __print_hilite(f, fuzz_res);
+        free(fuzz_info);
+        free(fuzz_res);
+    }
+
+    /* Print custom metrics reported by the test. */
+    if (t->n_metrics > 0) {
+        __INDENT(f, 6);
+        __print_desc(f, "metrics: unit                 mean          min"
+                        "          max    count\n");
+        for (int i = 0; i < t->n_metrics; i++) {
+            tdd_metric_t* m   = &t->metrics[i];
+            char*         row = calloc(128 + strlen(m->unit), 1);
+            __INDENT(f, 15);
+            sprintf(row, "%-16s %12.4g %12.4g %12.4g %8ld\n", m->unit,
+                    m->mean, m->min, m->max, m->count);
+            __print_hilite(f, row);
+            free(row);
+        }
+    }
+
+    /* Print spans and counters recorded by the test. */
+    if (t->n_spans > 0) {
+        __INDENT(f, 6);
+        __print_desc(f, "spans: name                count        total"
+                        "          max\n");
+        for (int i = 0; i < t->n_spans; i++) {
+            tdd_span_stats_t* sp  = &t->spans[i];
+            char*             row = calloc(128 + strlen(sp->name), 1);
+            __INDENT(f, 13);
+            if (sp->counter) {
+                sprintf(row, "%-16s %8ld %12lld %12lld\n", sp->name,
+                        sp->count, (long long)sp->total, (long long)sp->max);
+            } else {
+                sprintf(row, "%-16s %8ld %10.3fms %10.3fms\n", sp->name,
+                        sp->count, (double)sp->total / 1e6,
+                        (double)sp->max / 1e6);
+            }
+            __print_hilite(f, row);
+            free(row);
+        }
+    }
+
+    /* Print the lock call sites that waited the longest. */
+    if (t->n_locks > 0) {
+        static const char* kinds[] = {"mutex", "rdlock", "wrlock", "cond"};
+        __INDENT(f, 6);
+        __print_desc(f, "locks: site                 kind    count contended"
+                        "         wait     max wait         hold\n");
+        for (int i = 0; i < t->n_locks && i < REPORT_LOCK_SITES; i++) {
+            tdd_lock_stats_t* l   = &t->locks[i];
+            char*             row = calloc(128 + strlen(l->site), 1);
+            __INDENT(f, 13);
+            sprintf(row, "%-20s %-6s %8ld %9ld %10.3fms %10.3fms %10.3fms\n",
+                    l->site, kinds[l->kind & 3], l->count, l->contended,
+                    (double)l->wait_ns / 1e6, (double)l->max_wait_ns / 1e6,
+                    (double)l->hold_ns / 1e6);
+            __print_hilite(f, row);
+            free(row);
+        }
+    }
+
+    /* Print the environment the benchmark ran in and what may be wrong. */
+    if (t->env != NULL) {
+        __report_env(f, t->env);
+    }
+}
@@ -0,0 +1,546 @@
+/**
+ * @file results.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of the results store,
+ *        which keeps the outcome of every test that ran in a suite as a
+ *        set of parallel arrays.
+ **/
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "results.h"
+#include "tdd.h"
+
+void __results_init(tdd_results_t* r) {
+    memset(r, 0, sizeof(tdd_results_t));
+}
+
+void __results_reset(tdd_results_t* r) {
+    r->n             = 0;
+    r->strings_len   = 0;
+    r->points_len    = 0;
+    r->span_pool_len   = 0;
+    r->metric_pool_len = 0;
+    r->lock_pool_len   = 0;
+    r->env_pool_len    = 0;
+    r->samples_pool_len = 0;
+    r->cache_pool_len   = 0;
+    r->n_fail          = 0;
+    r->n_error         = 0;
+}
+
+void __results_free(tdd_results_t* r) {
+    free(r->status);
+    free(r->n_err);
+    free(r->start_ns);
+    free(r->end_ns);
+    free(r->ns_per_op);
+    free(r->ops_per_sec);
+    free(r->name);
+    free(r->fail_msg);
+    free(r->err_msg);
+    free(r->scaling);
+    free(r->n_scaling);
+    free(r->strings);
+    free(r->points);
+    free(r->spans);
+    free(r->n_spans);
+    free(r->span_pool);
+    free(r->user_ns);
+    free(r->sys_ns);
+    free(r->minflt);
+    free(r->majflt);
+    free(r->nvcsw);
+    free(r->nivcsw);
+    free(r->io_read);
+    free(r->io_write);
+    free(r->max_rss_kb);
+    free(r->metrics);
+    free(r->n_metrics);
+    free(r->metric_pool);
+    free(r->locks);
+    free(r->n_locks);
+    free(r->lock_pool);
+    free(r->env);
+    free(r->env_pool);
+    free(r->samples);
+    free(r->samples_pool);
+    free(r->cache);
+    free(r->cache_pool);
+    __results_init(r);
+}
+
+/* Grows every column of the store to twice its number of rows. */
+static bool __results_grow(tdd_results_t* r) {
+#define COLUMN(c) {(void**)&r->c, sizeof(*r->c)}
+    struct {
+        void** col;
+        size_t size;
+    } cols[] = {
+        COLUMN(status),    COLUMN(n_err),      COLUMN(start_ns),
+        COLUMN(end_ns),    COLUMN(ns_per_op),  COLUMN(ops_per_sec),
+        COLUMN(name),      COLUMN(fail_msg),   COLUMN(err_msg),
+        COLUMN(scaling),   COLUMN(n_scaling),  COLUMN(spans),
+        COLUMN(n_spans),   COLUMN(user_ns),    COLUMN(sys_ns),
+        COLUMN(minflt),    COLUMN(majflt),     COLUMN(nvcsw),
+        COLUMN(nivcsw),    COLUMN(io_read),    COLUMN(io_write),
+        COLUMN(max_rss_kb), COLUMN(metrics),   COLUMN(n_metrics),
+        COLUMN(locks),     COLUMN(n_locks),    COLUMN(env),
+        COLUMN(samples),   COLUMN(cache),
+    };
+#undef COLUMN
+
+    int cap = r->cap ? r->cap * 2 : 64;
+    for (size_t i = 0; i < sizeof(cols) / sizeof(cols[0]); i++) {
+        void* tmp = realloc(*cols[i].col, cols[i].size * cap);
+        if (tmp == NULL) return false;
+        *cols[i].col = tmp;
+    }
+    r->cap = cap;
+
+    return true;
+}
+
+/* Adds a string to the table; returns its offset or TDD_NO_STRING. */
+static uint32_t __results_str(tdd_results_t* r, const char* s) {
+    if (s == NULL) return TDD_NO_STRING;
+
+    size_t len = strlen(s) + 1;
+    if (r->strings_len + len >= TDD_NO_STRING) return TDD_NO_STRING;
+    if (r->strings_len + len > r->strings_cap) {
+        size_t cap = r->strings_cap ? r->strings_cap : 4096;
+        while (cap < r->strings_len + len) cap *= 2;
+        char* tmp = realloc(r->strings, cap);
+        if (tmp == NULL) return TDD_NO_STRING;
+        r->strings     = tmp;
+        r->strings_cap = cap;
+    }
+    uint32_t off = (uint32_t)r->strings_len;
+    memcpy(r->strings + off, s, len);
+    r->strings_len += len;
+
+    return off;
+}
+
+static int64_t __results_ns(const struct timespec* ts) {
+    return (int64_t)ts->tv_sec * 1000000000LL + (int64_t)ts->tv_nsec;
+}
+
+int __results_append(tdd_results_t* r, const char* name, const test_t* t,
+                     uint8_t flags, const struct timespec* started,
+                     const struct timespec* ended) {
+    if (r == NULL || t == NULL) return EXIT_FAILURE;
+    if (r->n == r->cap && !__results_grow(r)) {
+        errno = ENOMEM;
+        return EXIT_FAILURE;
+    }
+
+    int i = r->n;
+    if (t->failed) flags |= TDD_STATUS_FAILED;
+    if (t->err != 0) flags |= TDD_STATUS_ERROR;
+    r->status[i]      = flags;
+    r->n_err[i]       = t->err;
+    r->start_ns[i]    = __results_ns(started);
+    r->end_ns[i]      = __results_ns(ended);
+    r->ns_per_op[i]   = t->parallel != NULL ? t->parallel->ns_per_op : 0;
+    r->ops_per_sec[i] = t->parallel != NULL ? t->parallel->ops_per_sec : 0;
+    r->name[i]        = __results_str(r, name);
+    r->fail_msg[i]    = TDD_NO_STRING;
+    r->err_msg[i]     = TDD_NO_STRING;
+    if (t->failed) r->fail_msg[i] = __results_str(r, t->fail_msg);
+    for (int j = 0; j < t->err; j++) {
+        uint32_t off = __results_str(r, t->err_msg[j]);
+        if (j == 0) r->err_msg[i] = off;
+        if (off == TDD_NO_STRING) {
+            r->n_err[i] = j;
+            break;
+        }
+    }
+
+    r->scaling[i]   = 0;
+    r->n_scaling[i] = 0;
+    if (t->scaling != NULL && t->scaling->n_points > 0) {
+        size_t need = r->points_len + t->scaling->n_points;
+        if (need > r->points_cap) {
+            size_t cap = r->points_cap ? r->points_cap : 16;
+            while (cap < need) cap *= 2;
+            tdd_scaling_point_t* tmp =
+                realloc(r->points, sizeof(tdd_scaling_point_t) * cap);
+            if (tmp != NULL) {
+                r->points     = tmp;
+                r->points_cap = cap;
+            }
+        }
+        if (need <= r->points_cap) {
+            memcpy(r->points + r->points_len, t->scaling->points,
+                   sizeof(tdd_scaling_point_t) * t->scaling->n_points);
+            r->scaling[i]   = (uint32_t)r->points_len;
+            r->n_scaling[i] = t->scaling->n_points;
+            r->points_len   = need;
+        }
+    }
+
+    r->spans[i]   = (uint32_t)r->span_pool_len;
+    r->n_spans[i] = 0;
+    if (t->n_spans > 0) {
+        size_t need = r->span_pool_len + t->n_spans;
+        if (need > r->span_pool_cap) {
+            size_t cap = r->span_pool_cap ? r->span_pool_cap : 16;
+            while (cap < need) cap *= 2;
+            tdd_results_span_t* tmp =
+                realloc(r->span_pool, sizeof(tdd_results_span_t) * cap);
+            if (tmp != NULL) {
+                r->span_pool     = tmp;
+                r->span_pool_cap = cap;
+            }
+        }
+        for (int j = 0; j < t->n_spans && r->span_pool_len < r->span_pool_cap;
+             j++) {
+            uint32_t name = __results_str(r, t->spans[j].name);
+            if (name == TDD_NO_STRING) break;
+            tdd_results_span_t* sp = &r->span_pool[r->span_pool_len++];
+            sp->name               = name;
+            sp->counter            = t->spans[j].counter;
+            sp->count              = t->spans[j].count;
+            sp->total              = t->spans[j].total;
+            sp->max                = t->spans[j].max;
+            r->n_spans[i]++;
+        }
+    }
+
+    r->user_ns[i]    = t->usage.user_ns;
+    r->sys_ns[i]     = t->usage.sys_ns;
+    r->minflt[i]     = (int32_t)t->usage.minflt;
+    r->majflt[i]     = (int32_t)t->usage.majflt;
+    r->nvcsw[i]      = (int32_t)t->usage.nvcsw;
+    r->nivcsw[i]     = (int32_t)t->usage.nivcsw;
+    r->io_read[i]    = t->usage.io_read;
+    r->io_write[i]   = t->usage.io_write;
+    r->max_rss_kb[i] = (int32_t)t->usage.max_rss_kb;
+
+    r->metrics[i]   = (uint32_t)r->metric_pool_len;
+    r->n_metrics[i] = 0;
+    if (t->n_metrics > 0) {
+        size_t need = r->metric_pool_len + t->n_metrics;
+        if (need > r->metric_pool_cap) {
+            size_t cap = r->metric_pool_cap ? r->metric_pool_cap : 16;
+            while (cap < need) cap *= 2;
+            tdd_results_metric_t* tmp =
+                realloc(r->metric_pool, sizeof(tdd_results_metric_t) * cap);
+            if (tmp != NULL) {
+                r->metric_pool     = tmp;
+                r->metric_pool_cap = cap;
+            }
+        }
+        for (int j = 0;
+             j < t->n_metrics && r->metric_pool_len < r->metric_pool_cap;
+             j++) {
+            uint32_t unit = __results_str(r, t->metrics[j].unit);
+            if (unit == TDD_NO_STRING) break;
+            tdd_results_metric_t* m = &r->metric_pool[r->metric_pool_len++];
+            m->unit                 = unit;
+            m->count                = t->metrics[j].count;
+            m->sum                  = t->metrics[j].sum;
+            m->min                  = t->metrics[j].min;
+            m->max                  = t->metrics[j].max;
+            r->n_metrics[i]++;
+        }
+    }
+
+    r->locks[i]   = (uint32_t)r->lock_pool_len;
+    r->n_locks[i] = 0;
+    if (t->n_locks > 0) {
+        size_t need = r->lock_pool_len + t->n_locks;
+        if (need > r->lock_pool_cap) {
+            size_t cap = r->lock_pool_cap ? r->lock_pool_cap : 16;
+            while (cap < need) cap *= 2;
+            tdd_results_lock_t* tmp =
+                realloc(r->lock_pool, sizeof(tdd_results_lock_t) * cap);
+            if (tmp != NULL) {
+                r->lock_pool     = tmp;
+                r->lock_pool_cap = cap;
+            }
+        }
+        for (int j = 0; j < t->n_locks && r->lock_pool_len < r->lock_pool_cap;
+             j++) {
+            const tdd_lock_stats_t* src  = &t->locks[j];
+            uint32_t                site = __results_str(r, src->site);
+            if (site == TDD_NO_STRING) break;
+            tdd_results_lock_t* l = &r->lock_pool[r->lock_pool_len++];
+            l->site               = site;
+            l->kind               = src->kind;
+            l->count              = src->count;
+            l->contended          = src->contended;
+            l->wait_ns            = src->wait_ns;
+            l->max_wait_ns        = src->max_wait_ns;
+            l->hold_ns            = src->hold_ns;
+            l->max_hold_ns        = src->max_hold_ns;
+            r->n_locks[i]++;
+        }
+    }
+
+    r->env[i] = -1;
+    if (t->env != NULL) {
+        if (r->env_pool_len == r->env_pool_cap) {
+            size_t cap = r->env_pool_cap ? r->env_pool_cap * 2 : 16;
+            tdd_bench_env_t* tmp =
+                realloc(r->env_pool, sizeof(tdd_bench_env_t) * cap);
+            if (tmp != NULL) {
+                r->env_pool     = tmp;
+                r->env_pool_cap = cap;
+            }
+        }
+        if (r->env_pool_len < r->env_pool_cap) {
+            r->env[i]                      = (int32_t)r->env_pool_len;
+            r->env_pool[r->env_pool_len++] = *t->env;
+        }
+    }
+
+    r->samples[i] = -1;
+    if (t->samples != NULL) {
+        if (r->samples_pool_len == r->samples_pool_cap) {
+            size_t cap = r->samples_pool_cap ? r->samples_pool_cap * 2 : 16;
+            tdd_samples_t* tmp =
+                realloc(r->samples_pool, sizeof(tdd_samples_t) * cap);
+            if (tmp != NULL) {
+                r->samples_pool     = tmp;
+                r->samples_pool_cap = cap;
+            }
+        }
+        if (r->samples_pool_len < r->samples_pool_cap) {
+            r->samples[i] = (int32_t)r->samples_pool_len;
+            r->samples_pool[r->samples_pool_len++] = *t->samples;
+        }
+    }
+
+    r->cache[i] = -1;
+    if (t->cache != NULL) {
+        if (r->cache_pool_len == r->cache_pool_cap) {
+            size_t cap = r->cache_pool_cap ? r->cache_pool_cap * 2 : 16;
+            tdd_cache_t* tmp =
+                realloc(r->cache_pool, sizeof(tdd_cache_t) * cap);
+            if (tmp != NULL) {
+                r->cache_pool     = tmp;
+                r->cache_pool_cap = cap;
+            }
+        }
+        if (r->cache_pool_len < r->cache_pool_cap) {
+            r->cache[i]                        = (int32_t)r->cache_pool_len;
+            r->cache_pool[r->cache_pool_len++] = *t->cache;
+        }
+    }
+
+    if (flags & (TDD_STATUS_FAILED | TDD_STATUS_SEGV)) r->n_fail++;
+    if (flags & TDD_STATUS_ERROR) r->n_error++;
+    r->n++;
+
+    return EXIT_SUCCESS;
+}
+
+const char* tdd_results_name(const tdd_results_t* r, int i) {
+    if (r == NULL || i < 0 || i >= r->n || r->name[i] == TDD_NO_STRING) {
+        return NULL;
+    }
+    return r->strings + r->name[i];
+}
+
+bool tdd_results_ok(const tdd_results_t* r, int i) {
+    if (r == NULL || i < 0 || i >= r->n) return false;
+    return (r->status[i] & (TDD_STATUS_FAILED | TDD_STATUS_SEGV)) == 0;
+}
+
+const char* tdd_results_fail_msg(const tdd_results_t* r, int i) {
+    if (r == NULL || i < 0 || i >= r->n || r->fail_msg[i] == TDD_NO_STRING) {
+        return NULL;
+    }
+    return r->strings + r->fail_msg[i];
+}
+
+const char* tdd_results_error(const tdd_results_t* r, int i, int j) {
+    if (r == NULL || i < 0 || i >= r->n || j < 0 || j >= r->n_err[i]) {
+        return NULL;
+    }
+    const char* msg = r->strings + r->err_msg[i];
+    while (j-- > 0) {
+        msg += strlen(msg) + 1;
+    }
+    return msg;
+}
+
+int64_t tdd_results_elapsed(const tdd_results_t* r, int i) {
+    if (r == NULL || i < 0 || i >= r->n) return 0;
+    return r->end_ns[i] - r->start_ns[i];
+}
+
+const tdd_scaling_point_t* tdd_results_scaling(const tdd_results_t* r, int i,
+                                               int* n_points) {
+    if (n_points != NULL) *n_points = 0;
+    if (r == NULL || i < 0 || i >= r->n || r->n_scaling[i] == 0) return NULL;
+    if (n_points != NULL) *n_points = r->n_scaling[i];
+    return r->points + r->scaling[i];
+}
+
+bool tdd_results_span(const tdd_results_t* r, int i, int j,
+                      tdd_span_stats_t* span) {
+    if (r == NULL || span == NULL || i < 0 || i >= r->n || j < 0 ||
+        j >= r->n_spans[i]) {
+        return false;
+    }
+    const tdd_results_span_t* sp = &r->span_pool[r->spans[i] + j];
+    span->name                   = r->strings + sp->name;
+    span->counter                = sp->counter;
+    span->count                  = sp->count;
+    span->total                  = sp->total;
+    span->max                    = sp->max;
+
+    return true;
+}
+
+bool tdd_results_metric(const tdd_results_t* r, int i, int j,
+                        tdd_metric_t* metric) {
+    if (r == NULL || metric == NULL || i < 0 || i >= r->n || j < 0 ||
+        j >= r->n_metrics[i]) {
+        return false;
+    }
+    const tdd_results_metric_t* m = &r->metric_pool[r->metrics[i] + j];
+    metric->unit                  = r->strings + m->unit;
+    metric->count                 = m->count;
+    metric->sum                   = m->sum;
+    metric->min                   = m->min;
+    metric->max                   = m->max;
+    metric->mean = m->count > 0 ? m->sum / (double)m->count : 0;
+
+    return true;
+}
+
+bool tdd_results_lock(const tdd_results_t* r, int i, int j,
+                      tdd_lock_stats_t* lock) {
+    if (r == NULL || lock == NULL || i < 0 || i >= r->n || j < 0 ||
+        j >= r->n_locks[i]) {
+        return false;
+    }
+    const tdd_results_lock_t* l = &r->lock_pool[r->locks[i] + j];
+    lock->site                  = r->strings + l->site;
+    lock->kind                  = l->kind;
+    lock->count                 = l->count;
+    lock->contended             = l->contended;
+    lock->wait_ns               = l->wait_ns;
+    lock->max_wait_ns           = l->max_wait_ns;
+    lock->hold_ns               = l->hold_ns;
+    lock->max_hold_ns           = l->max_hold_ns;
+
+    return true;
+}
+
+bool tdd_results_bench_env(const tdd_results_t* r, int i,
+                           tdd_bench_env_t* env) {
+    if (r == NULL || env == NULL || i < 0 || i >= r->n || r->env[i] < 0) {
+        return false;
+    }
+    *env = r->env_pool[r->env[i]];
+
+    return true;
+}
+
+bool tdd_results_samples(const tdd_results_t* r, int i,
+                         tdd_samples_t* samples) {
+    if (r == NULL || samples == NULL || i < 0 || i >= r->n ||
+        r->samples[i] < 0) {
+        return false;
+    }
+    *samples = r->samples_pool[r->samples[i]];
+
+    return true;
+}
+
+bool tdd_results_cache(const tdd_results_t* r, int i, tdd_cache_t* cache) {
+    if (r == NULL || cache == NULL || i < 0 || i >= r->n || r->cache[i] < 0) {
+        return false;
+    }
+    *cache = r->cache_pool[r->cache[i]];
+
+    return true;
+}
+
+bool tdd_results_rusage(const tdd_results_t* r, int i, tdd_rusage_t* usage) {
+    if (r == NULL || usage == NULL || i < 0 || i >= r->n) return false;
+
+    usage->user_ns    = r->user_ns[i];
+    usage->sys_ns     = r->sys_ns[i];
+    usage->minflt     = r->minflt[i];
+    usage->majflt     = r->majflt[i];
+    usage->nvcsw      = r->nvcsw[i];
+    usage->nivcsw     = r->nivcsw[i];
+    usage->io_read    = r->io_read[i];
+    usage->io_write   = r->io_write[i];
+    usage->max_rss_kb = r->max_rss_kb[i];
+
+    return true;
+}
+
+int tdd_results_costliest(const tdd_results_t* r, int n, int* rows) {
+    if (r == NULL || rows == NULL || n <= 0) return 0;
+
+    /* Keep the n most expensive rows seen so far sorted by insertion. */
+    int found = 0;
+    for (int i = 0; i < r->n; i++) {
+        int64_t c = r->user_ns[i] + r->sys_ns[i];
+        if (found == n &&
+            c <= r->user_ns[rows[n - 1]] + r->sys_ns[rows[n - 1]]) {
+            continue;
+        }
+        int j = found < n ? found++ : n - 1;
+        while (j > 0 && r->user_ns[rows[j - 1]] + r->sys_ns[rows[j - 1]] < c) {
+            rows[j] = rows[j - 1];
+            j--;
+        }
+        rows[j] = i;
+    }
+
+    return found;
+}
+
+int tdd_results_failed(const tdd_results_t* r) {
+    if (r == NULL) return 0;
+
+    int n = 0;
+    for (int i = 0; i < r->n; i++) {
+        n += (r->status[i] & (TDD_STATUS_FAILED | TDD_STATUS_SEGV)) != 0;
+    }
+    return n;
+}
+
+int64_t tdd_results_total_ns(const tdd_results_t* r) {
+    if (r == NULL) return 0;
+
+    int64_t total = 0;
+    for (int i = 0; i < r->n; i++) {
+        total += r->end_ns[i] - r->start_ns[i];
+    }
+    return total;
+}
+
+int tdd_results_slowest(const tdd_results_t* r, int n, int* rows) {
+    if (r == NULL || rows == NULL || n <= 0) return 0;
+
+    /* Keep the n slowest rows seen so far sorted by insertion. */
+    int found = 0;
+    for (int i = 0; i < r->n; i++) {
+        int64_t d = r->end_ns[i] - r->start_ns[i];
+        if (found == n &&
+            d <= r->end_ns[rows[n - 1]] - r->start_ns[rows[n - 1]]) {
+            continue;
+        }
+        int j = found < n ? found++ : n - 1;
+        while (j > 0 && r->end_ns[rows[j - 1]] - r->start_ns[rows[j - 1]] < d) {
+            rows[j] = rows[j - 1];
+            j--;
+        }
+        rows[j] = i;
+    }
+
+    return found;
+}
@@ -31,7 +31,8 @@ runner_t* runner_new(void* (*f)(void* t), char* name, char* desc) {
     } else {
         runner->desc = calloc(1, sizeof(char)); /* empty string */
     }
-    runner->fn = f;
+    runner->fn   = f;
+    runner->step = NULL;
 
     if (runner->name == NULL || runner->desc == NULL) {
         errno = ENOMEM;
@@ -53,6 +54,25 @@ runner_t* runner_new(void* (*f)(void* t), char* name, char* desc) {
     return runner;
 }
 
+/* The test function of async tests, which suite_next() steps instead. */
+static void* __runner_no_fn(void* t) {
+    return test_fail(t, "async test was run without an event loop");
+}
+
+runner_t* runner_new_async(tdd_async_t (*step)(test_t* t), char* name,
+                           char* desc) {
+    if (step == NULL) {
+        return NULL;
+    }
+
+    runner_t* runner = runner_new(&__runner_no_fn, name, desc);
+    if (runner != NULL) {
+        runner->step = step;
+    }
+
+    return runner;
+}
+
 int tdd_runner_del(runner_t* runner) {
     if (runner == NULL) return EXIT_FAILURE;
 
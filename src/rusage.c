@@ -0,0 +1,99 @@
+/**
+ * @file rusage.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of per-test resource
+ *        usage, which is measured on the thread that runs each test.
+ **/
+/* RUSAGE_THREAD is a GNU extension. */
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rusage.h"
+#include "tdd.h"
+
+static int64_t __rusage_tv_ns(const struct timeval* tv) {
+    return (int64_t)tv->tv_sec * 1000000000LL + (int64_t)tv->tv_usec * 1000LL;
+}
+
+/*
+ * Reads "name: value" from the calling thread's /proc io accounting;
+ * returns the number of bytes this read itself added to rchar.
+ */
+static int64_t __rusage_io(tdd_rusage_t* u) {
+#ifdef __linux__
+    int fd = open("/proc/thread-self/io", O_RDONLY);
+    if (fd < 0) return 0;
+
+    char    buf[512];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+
+    char* p = strstr(buf, "rchar:");
+    if (p != NULL) u->io_read = strtoll(p + 6, NULL, 10);
+    p = strstr(buf, "wchar:");
+    if (p != NULL) u->io_write = strtoll(p + 6, NULL, 10);
+
+    return (int64_t)n;
+#else
+    (void)u;
+    return 0;
+#endif
+}
+
+/* Samples usage; returns the bytes read from /proc while doing so. */
+static int64_t __rusage_read(tdd_rusage_t* u) {
+    memset(u, 0, sizeof(tdd_rusage_t));
+
+    struct rusage ru;
+#ifdef RUSAGE_THREAD
+    if (getrusage(RUSAGE_THREAD, &ru) == 0) {
+        u->user_ns = __rusage_tv_ns(&ru.ru_utime);
+        u->sys_ns  = __rusage_tv_ns(&ru.ru_stime);
+        u->minflt  = ru.ru_minflt;
+        u->majflt  = ru.ru_majflt;
+        u->nvcsw   = ru.ru_nvcsw;
+        u->nivcsw  = ru.ru_nivcsw;
+    }
+#else
+    /* Without per-thread rusage, only CPU time can be told apart. */
+    struct timespec cpu;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu) == 0) {
+        u->user_ns = (int64_t)cpu.tv_sec * 1000000000LL + cpu.tv_nsec;
+    }
+#endif
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        u->max_rss_kb = ru.ru_maxrss;
+    }
+    return __rusage_io(u);
+}
+
+void __rusage_sample(tdd_rusage_t* u) {
+    /* Count our own read of /proc so it does not show up in the delta. */
+    u->io_read += __rusage_read(u);
+}
+
+void __rusage_since(tdd_rusage_t* u, const tdd_rusage_t* start) {
+    tdd_rusage_t end;
+    __rusage_read(&end);
+
+    u->user_ns  = end.user_ns - start->user_ns;
+    u->sys_ns   = end.sys_ns - start->sys_ns;
+    u->minflt   = end.minflt - start->minflt;
+    u->majflt   = end.majflt - start->majflt;
+    u->nvcsw    = end.nvcsw - start->nvcsw;
+    u->nivcsw   = end.nivcsw - start->nivcsw;
+    u->io_read  = end.io_read - start->io_read;
+    u->io_write = end.io_write - start->io_write;
+    /* The peak RSS is a high-water mark of the process, not a delta. */
+    u->max_rss_kb = end.max_rss_kb;
+}
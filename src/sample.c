@@ -0,0 +1,196 @@
+/**
+ * @file sample.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of adaptive benchmark
+ *        sampling, which times a benchmark as many times as it takes to
+ *        estimate its median to a given precision.
+ *
+ * The interval of the median is distribution free: it is bounded by the
+ * order statistics whose ranks are n/2 -/+ 1.96 * sqrt(n) / 2, so it is
+ * not widened by the long right tail that timings usually have. The
+ * interval of the mean uses Student's t distribution and is reported
+ * alongside it.
+ **/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fixture.h"
+#include "sample.h"
+#include "spans.h"
+#include "tdd.h"
+
+/* The fewest samples an interval is computed from. */
+#define SAMPLE_MIN 10
+/* The most samples taken, whatever the budget. */
+#define SAMPLE_MAX 1000000
+/* The normal quantile of a two-sided 95% interval. */
+#define SAMPLE_Z 1.96
+
+/* Two-sided 95% quantiles of Student's t distribution for 1-30 df. */
+static const double t95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static int64_t __sample_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + (int64_t)now.tv_nsec;
+}
+
+/* Newton's method, from above; avoids linking libm for one function. */
+static double __sample_sqrt(double x) {
+    if (x <= 0) return 0;
+
+    double r = x > 1 ? x : 1;
+    for (;;) {
+        double next = 0.5 * (r + x / r);
+        if (next >= r) return r;
+        r = next;
+    }
+}
+
+static double __sample_t95(int df) {
+    if (df < 1) return 0;
+    if (df <= 30) return t95[df - 1];
+    return SAMPLE_Z + 2.4 / df;
+}
+
+static int __sample_cmp(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* The p-quantile of sorted values, interpolating between neighbours. */
+static double __sample_quantile(const double* xs, int n, double p) {
+    double h  = (n - 1) * p;
+    int    lo = (int)h;
+    if (lo >= n - 1) return xs[n - 1];
+    return xs[lo] + (h - lo) * (xs[lo + 1] - xs[lo]);
+}
+
+/* Summarises n timings, sorting them in place. */
+static void __sample_stats(double* xs, int n, tdd_samples_t* out) {
+    qsort(xs, n, sizeof(double), &__sample_cmp);
+
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += xs[i];
+    double mean = sum / n;
+    double ss   = 0;
+    for (int i = 0; i < n; i++) ss += (xs[i] - mean) * (xs[i] - mean);
+    double sd = n > 1 ? __sample_sqrt(ss / (n - 1)) : 0;
+
+    out->n         = n;
+    out->mean_ns   = mean;
+    out->median_ns = __sample_quantile(xs, n, 0.5);
+    out->stddev_ns = sd;
+    out->min_ns    = xs[0];
+    out->max_ns    = xs[n - 1];
+
+    out->mean_ci = 1;
+    if (n > 1 && mean > 0) {
+        out->mean_ci = __sample_t95(n - 1) * sd / __sample_sqrt(n) / mean;
+    }
+    out->median_ci = 1;
+    double d       = SAMPLE_Z * __sample_sqrt(n) / 2;
+    int    lo      = (int)(n / 2.0 - d);
+    int    hi      = (int)(n / 2.0 + d + 1);
+    if (n >= SAMPLE_MIN && out->median_ns > 0) {
+        if (lo < 0) lo = 0;
+        if (hi > n - 1) hi = n - 1;
+        out->median_ci = (xs[hi] - xs[lo]) / 2 / out->median_ns;
+    }
+
+    double q1  = __sample_quantile(xs, n, 0.25);
+    double q3  = __sample_quantile(xs, n, 0.75);
+    double iqr = q3 - q1;
+    out->low_severe  = 0;
+    out->low_mild    = 0;
+    out->high_mild   = 0;
+    out->high_severe = 0;
+    for (int i = 0; i < n; i++) {
+        if (xs[i] < q1 - 3 * iqr) {
+            out->low_severe++;
+        } else if (xs[i] < q1 - 1.5 * iqr) {
+            out->low_mild++;
+        } else if (xs[i] > q3 + 3 * iqr) {
+            out->high_severe++;
+        } else if (xs[i] > q3 + 1.5 * iqr) {
+            out->high_mild++;
+        }
+    }
+}
+
+void* __sample_run(void* (*fn)(void* t), test_t* t, double ci,
+                   double budget) {
+    void*   ret   = NULL;
+    double* xs    = NULL;
+    int     n     = 0;
+    int     cap   = 0;
+    int     check = SAMPLE_MIN;
+    bool    done  = false;
+    int64_t limit = __sample_now() + (int64_t)(budget * 1e9);
+
+    tdd_samples_t* out = calloc(1, sizeof(tdd_samples_t));
+    while (!done && n < SAMPLE_MAX) {
+        if (n == cap) {
+            int     ncap = cap ? cap * 2 : 64;
+            double* tmp  = realloc(xs, sizeof(double) * ncap);
+            if (tmp == NULL) break;
+            xs  = tmp;
+            cap = ncap;
+        }
+        test_t* run = t;
+        if (n > 0) {
+            run = tdd_test_new(t->name);
+            if (run == NULL) break;
+            run->suite      = t->suite;
+            run->cache_mode = t->cache_mode;
+        }
+
+        /* The run may restart its timer once its input is set up. */
+        test_cache_prepare(run);
+        void* r = fn(run);
+        if (run->end->tv_sec == 0 && run->end->tv_nsec == 0) {
+            test_timer_end(run);
+        }
+        __fixture_rates(run, t);
+        int64_t now = __sample_now();
+        xs[n++]     = (double)(run->end->tv_sec - run->start->tv_sec) * 1e9 +
+                  (double)(run->end->tv_nsec - run->start->tv_nsec);
+
+        if (run == t) {
+            ret = r;
+        } else {
+            for (int i = 0; i < run->err; i++) {
+                test_error(t, run->err_msg[i]);
+            }
+            if (run->failed && !t->failed) test_fail(t, run->fail_msg);
+            __spans_merge(run, t);
+            tdd_test_del(run);
+        }
+        /* Stop at the first error, rather than repeat it on every run. */
+        if (t->failed || t->err > 0 || now >= limit) break;
+
+        if (out != NULL && n >= check) {
+            __sample_stats(xs, n, out);
+            done  = out->median_ci <= ci;
+            check = n + (n / 16 > 1 ? n / 16 : 1);
+        }
+    }
+
+    if (out != NULL && n > 0) {
+        __sample_stats(xs, n, out);
+        out->converged = done;
+    }
+    free(xs);
+    free(t->samples);
+    t->samples = out;
+
+    return ret;
+}
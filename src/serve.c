@@ -0,0 +1,156 @@
+/**
+ * @file serve.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of serving a suite on a
+ *        socket, so that a process that has set up its fixtures once can
+ *        rerun any of its tests on request.
+ *
+ * Requests and responses are lines of text, so that a client can be as
+ * simple as `socat`. A client connects, sends one request line and reads
+ * the response until the server closes the connection.
+ **/
+#include <errno.h>
+#include <fnmatch.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "dist.h"
+#include "tdd.h"
+
+/* The longest request line. */
+#define SERVE_LINE 4096
+
+/* Reads a request line, without its line ending. */
+static int __serve_line(int fd, char* line, size_t n) {
+    size_t len = 0;
+    while (len + 1 < n) {
+        char    c;
+        ssize_t r = read(fd, &c, 1);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0 || c == '\n') break;
+        line[len++] = c;
+    }
+    if (len > 0 && line[len - 1] == '\r') len--;
+    line[len] = '\0';
+
+    return len > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool __serve_match(const char* name, char** patterns, int n) {
+    if (n == 0) return true;
+    for (int i = 0; i < n; i++) {
+        if (fnmatch(patterns[i], name, 0) == 0) return true;
+    }
+    return false;
+}
+
+/*
+ * Runs the tests matching any of the patterns after suite_reset(),
+ * reporting them to out as they finish, then a summary line.
+ */
+static void __serve_run(suite_t* s, FILE* out, char** patterns, int n) {
+    runner_t** tests = malloc(sizeof(runner_t*) * (size_t)(s->n_tests + 1));
+    if (tests == NULL) {
+        fprintf(out, "error: %s\n", strerror(ENOMEM));
+        return;
+    }
+    int n_tests = 0;
+    for (int i = 0; i < s->n_tests; i++) {
+        if (__serve_match(s->tests[i]->name, patterns, n)) {
+            tests[n_tests++] = s->tests[i];
+        }
+    }
+
+    /* The suite runs the selected tests in place of its own for now. */
+    runner_t** all     = s->tests;
+    int        n_all   = s->n_tests;
+    FILE*      outfile = s->outfile;
+    s->tests           = tests;
+    s->n_tests         = n_tests;
+    s->outfile         = out;
+    suite_reset(s);
+    suite_run(s, false);
+
+    suite_stats_t* stats = suite_get_stats(s);
+    if (stats != NULL) {
+        fprintf(out, "done: ran %d, failed %d, errors %d\n", stats->n_ran,
+                stats->n_fail, stats->n_error);
+        if (stats->owned) suite_stats_del(stats);
+    }
+    s->tests   = all;
+    s->n_tests = n_all;
+    s->outfile = outfile;
+    free(tests);
+}
+
+/* Answers a request; returns false if it asks the server to stop. */
+static bool __serve_request(suite_t* s, FILE* out, char* line) {
+    char* save    = NULL;
+    char* request = strtok_r(line, " \t", &save);
+    if (request == NULL) return true;
+
+    if (strcmp(request, "run") == 0) {
+        char* patterns[SERVE_LINE / 2];
+        int   n = 0;
+        char* p;
+        while ((p = strtok_r(NULL, " \t", &save)) != NULL) patterns[n++] = p;
+        __serve_run(s, out, patterns, n);
+    } else if (strcmp(request, "list") == 0) {
+        for (int i = 0; i < s->n_tests; i++) {
+            fprintf(out, "%s\n", s->tests[i]->name);
+        }
+    } else if (strcmp(request, "quit") == 0) {
+        fprintf(out, "bye\n");
+        return false;
+    } else {
+        fprintf(out, "error: unknown request '%s'\n", request);
+    }
+
+    return true;
+}
+
+int suite_serve(suite_t* s, const char* address) {
+    if (s == NULL || address == NULL) return EXIT_FAILURE;
+
+    int listen_fd = __dist_socket(address, true);
+    if (listen_fd < 0) return EXIT_FAILURE;
+
+    /* A client that hangs up before it has read its results is ignored. */
+    struct sigaction ignore, pipe_action;
+    memset(&ignore, 0, sizeof(struct sigaction));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &pipe_action);
+
+    bool serving = true;
+    while (serving) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+
+        char  line[SERVE_LINE];
+        FILE* out = NULL;
+        if (__serve_line(fd, line, sizeof(line)) != EXIT_SUCCESS ||
+            (out = fdopen(fd, "w")) == NULL) {
+            close(fd);
+            continue;
+        }
+        /* Results are streamed a line at a time, as tests finish. */
+        setvbuf(out, NULL, _IOLBF, 0);
+        serving = __serve_request(s, out, line);
+        fclose(out);
+    }
+
+    sigaction(SIGPIPE, &pipe_action, NULL);
+    close(listen_fd);
+    if (strncmp(address, DIST_TCP, strlen(DIST_TCP)) != 0) unlink(address);
+
+    return serving ? EXIT_FAILURE : EXIT_SUCCESS;
+}
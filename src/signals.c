@@ -3,15 +3,25 @@
  * @author Keefer Rourke <mail@krourke.org>
  * @brief This file defines signal handlers for libtdd.
  **/
+#include <setjmp.h>
 #include <signal.h>
 #include <stdlib.h>
 
+#include "signals.h"
 #include "tdd.h"
 
 volatile sig_atomic_t tdd_sigsegv_caught = 0;
 
+/* Where a fault on this thread resumes, if anywhere. */
+static __thread sigjmp_buf* tdd_sigsegv_env = NULL;
+
+void __sigsegv_resume(sigjmp_buf* env) {
+    tdd_sigsegv_env = env;
+}
+
 void tdd_sigsegv_handler(int sig) {
     if (sig != SIGSEGV) return;
 
+    if (tdd_sigsegv_env != NULL) siglongjmp(*tdd_sigsegv_env, 1);
     tdd_sigsegv_caught++;
 }
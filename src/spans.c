@@ -0,0 +1,348 @@
+/**
+ * @file spans.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of spans, counters and
+ *        custom metrics, which let a test measure phases of its own work
+ *        and report numbers of its own alongside benchmark timings.
+ *
+ * Each thread that records to a test gets a buffer of its own, which is
+ * pushed onto a list in the test with a compare-and-swap the first time the
+ * thread records anything. From then on only that thread writes to the
+ * buffer, so recording takes no locks. A thread that moves between tests,
+ * as an event loop running async tests does, finds its buffer in the list
+ * again rather than making another. Events go to a fixed-size ring; when
+ * the ring fills up, the owning thread folds it into a small table of
+ * per-name aggregates and starts over. The buffers are drained and merged
+ * by name once every thread of the test has finished.
+ **/
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "spans.h"
+#include "tdd.h"
+
+/* Number of events buffered per thread before they are folded. */
+#define SPAN_RING_SIZE 1024
+/* Maximum nesting depth of spans on one thread. */
+#define SPAN_MAX_DEPTH 32
+
+/* Kinds of recorded events. */
+#define SPAN_KIND_SPAN 0
+#define SPAN_KIND_COUNTER 1
+#define SPAN_KIND_METRIC 2
+
+typedef struct span_event_t {
+    const char* name;
+    union {
+        int64_t i;
+        double  d;
+    } value;
+    uint8_t kind;
+} span_event_t;
+
+/* Aggregates keyed by name pointer; merged by name contents on collect. */
+typedef struct span_agg_t {
+    const char* name;
+    uint8_t     kind;
+    long        count;
+    int64_t     total;
+    int64_t     max;
+    double      sum;
+    double      dmin;
+    double      dmax;
+} span_agg_t;
+
+typedef struct span_ring_t {
+    struct span_ring_t* next;
+    /* The thread that records to this ring. */
+    pthread_t           owner;
+    int                 head;
+    span_event_t        events[SPAN_RING_SIZE];
+    int                 depth;
+    const char*         open[SPAN_MAX_DEPTH];
+    int64_t             opened[SPAN_MAX_DEPTH];
+    span_agg_t*         agg;
+    int                 n_agg;
+    int                 cap_agg;
+} span_ring_t;
+
+/* The calling thread's buffer, and the serial of the test it belongs to. */
+static __thread span_ring_t* tls_ring;
+static __thread uint64_t     tls_serial;
+
+static int64_t __span_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + (int64_t)now.tv_nsec;
+}
+
+/* Returns the calling thread's buffer for t, registering one on first use. */
+static span_ring_t* __span_ring(test_t* t) {
+    if (tls_ring != NULL && tls_serial == t->serial) return tls_ring;
+
+    pthread_t    self = pthread_self();
+    span_ring_t* head = __atomic_load_n((span_ring_t**)&t->span_rings,
+                                        __ATOMIC_ACQUIRE);
+    for (span_ring_t* r = head; r != NULL; r = r->next) {
+        if (pthread_equal(r->owner, self)) {
+            tls_ring   = r;
+            tls_serial = t->serial;
+            return r;
+        }
+    }
+
+    span_ring_t* ring = calloc(1, sizeof(span_ring_t));
+    if (ring == NULL) return NULL;
+    ring->owner = self;
+
+    do {
+        ring->next = head;
+    } while (!__atomic_compare_exchange_n((span_ring_t**)&t->span_rings,
+                                          &head, ring, true, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+    tls_ring   = ring;
+    tls_serial = t->serial;
+
+    return ring;
+}
+
+/* Folds the buffered events of a ring into its aggregates. */
+static void __span_fold(span_ring_t* ring) {
+    int last = 0;
+    for (int i = 0; i < ring->head; i++) {
+        span_event_t* ev = &ring->events[i];
+
+        /* Consecutive events usually have the same name. */
+        int j = last;
+        if (j >= ring->n_agg || ring->agg[j].name != ev->name ||
+            ring->agg[j].kind != ev->kind) {
+            for (j = 0; j < ring->n_agg; j++) {
+                if (ring->agg[j].name == ev->name &&
+                    ring->agg[j].kind == ev->kind) {
+                    break;
+                }
+            }
+        }
+        if (j == ring->n_agg) {
+            if (ring->n_agg == ring->cap_agg) {
+                int         cap = ring->cap_agg ? ring->cap_agg * 2 : 8;
+                span_agg_t* tmp = realloc(ring->agg, sizeof(span_agg_t) * cap);
+                if (tmp == NULL) continue;
+                ring->agg     = tmp;
+                ring->cap_agg = cap;
+            }
+            memset(&ring->agg[j], 0, sizeof(span_agg_t));
+            ring->agg[j].name = ev->name;
+            ring->agg[j].kind = ev->kind;
+            ring->n_agg++;
+        }
+
+        span_agg_t* a = &ring->agg[j];
+        a->count++;
+        if (ev->kind == SPAN_KIND_METRIC) {
+            a->sum += ev->value.d;
+            if (a->count == 1 || ev->value.d < a->dmin) a->dmin = ev->value.d;
+            if (a->count == 1 || ev->value.d > a->dmax) a->dmax = ev->value.d;
+        } else {
+            a->total += ev->value.i;
+            if (a->count == 1 || ev->value.i > a->max) a->max = ev->value.i;
+        }
+        last = j;
+    }
+    ring->head = 0;
+}
+
+static span_event_t* __span_push(span_ring_t* ring, const char* name,
+                                 uint8_t kind) {
+    if (ring->head == SPAN_RING_SIZE) __span_fold(ring);
+    span_event_t* ev = &ring->events[ring->head++];
+    ev->name         = name;
+    ev->kind         = kind;
+    return ev;
+}
+
+void test_span_begin(test_t* t, const char* name) {
+    if (t == NULL || name == NULL) return;
+
+    span_ring_t* ring = __span_ring(t);
+    if (ring == NULL) return;
+    if (ring->depth < SPAN_MAX_DEPTH) {
+        ring->open[ring->depth]   = name;
+        ring->opened[ring->depth] = __span_now();
+    }
+    ring->depth++;
+}
+
+void test_span_end(test_t* t) {
+    if (t == NULL) return;
+
+    span_ring_t* ring = __span_ring(t);
+    if (ring == NULL || ring->depth == 0) return;
+    ring->depth--;
+    if (ring->depth < SPAN_MAX_DEPTH) {
+        int64_t now = __span_now();
+        __span_push(ring, ring->open[ring->depth], SPAN_KIND_SPAN)->value.i =
+            now - ring->opened[ring->depth];
+    }
+}
+
+void test_counter_add(test_t* t, const char* name, int64_t n) {
+    if (t == NULL || name == NULL) return;
+
+    span_ring_t* ring = __span_ring(t);
+    if (ring == NULL) return;
+    __span_push(ring, name, SPAN_KIND_COUNTER)->value.i = n;
+}
+
+void test_report_metric(test_t* t, const char* unit, double value) {
+    if (t == NULL || unit == NULL) return;
+
+    span_ring_t* ring = __span_ring(t);
+    if (ring == NULL) return;
+    __span_push(ring, unit, SPAN_KIND_METRIC)->value.d = value;
+}
+
+int __spans_add(tdd_span_stats_t** spans, int* n_spans, const char* name,
+                bool counter, long count, int64_t total, int64_t max) {
+    int i;
+    for (i = 0; i < *n_spans; i++) {
+        if ((*spans)[i].counter == counter &&
+            strcmp((*spans)[i].name, name) == 0) {
+            break;
+        }
+    }
+    if (i == *n_spans) {
+        tdd_span_stats_t* tmp =
+            realloc(*spans, sizeof(tdd_span_stats_t) * (*n_spans + 1));
+        if (tmp == NULL) {
+            errno = ENOMEM;
+            return EXIT_FAILURE;
+        }
+        *spans = tmp;
+        memset(&tmp[i], 0, sizeof(tdd_span_stats_t));
+        tmp[i].name = calloc(strlen(name) + 1, sizeof(char));
+        if (tmp[i].name == NULL) {
+            errno = ENOMEM;
+            return EXIT_FAILURE;
+        }
+        strcpy(tmp[i].name, name);
+        tmp[i].counter = counter;
+        (*n_spans)++;
+    }
+
+    tdd_span_stats_t* s = &(*spans)[i];
+    if (s->count == 0 || max > s->max) s->max = max;
+    s->count += count;
+    s->total += total;
+
+    return EXIT_SUCCESS;
+}
+
+int __metrics_add(tdd_metric_t** metrics, int* n_metrics, const char* unit,
+                  long count, double sum, double min, double max) {
+    int i;
+    for (i = 0; i < *n_metrics; i++) {
+        if (strcmp((*metrics)[i].unit, unit) == 0) break;
+    }
+    if (i == *n_metrics) {
+        tdd_metric_t* tmp =
+            realloc(*metrics, sizeof(tdd_metric_t) * (*n_metrics + 1));
+        if (tmp == NULL) {
+            errno = ENOMEM;
+            return EXIT_FAILURE;
+        }
+        *metrics = tmp;
+        memset(&tmp[i], 0, sizeof(tdd_metric_t));
+        tmp[i].unit = calloc(strlen(unit) + 1, sizeof(char));
+        if (tmp[i].unit == NULL) {
+            errno = ENOMEM;
+            return EXIT_FAILURE;
+        }
+        strcpy(tmp[i].unit, unit);
+        (*n_metrics)++;
+    }
+
+    tdd_metric_t* m = &(*metrics)[i];
+    if (m->count == 0 || min < m->min) m->min = min;
+    if (m->count == 0 || max > m->max) m->max = max;
+    m->count += count;
+    m->sum += sum;
+    m->mean = m->count > 0 ? m->sum / (double)m->count : 0;
+
+    return EXIT_SUCCESS;
+}
+
+void __spans_collect(test_t* t) {
+    if (t == NULL) return;
+
+    span_ring_t* ring =
+        __atomic_exchange_n((span_ring_t**)&t->span_rings, NULL,
+                            __ATOMIC_ACQUIRE);
+    while (ring != NULL) {
+        __span_fold(ring);
+        for (int i = 0; i < ring->n_agg; i++) {
+            span_agg_t* a = &ring->agg[i];
+            if (a->kind == SPAN_KIND_METRIC) {
+                __metrics_add(&t->metrics, &t->n_metrics, a->name, a->count,
+                              a->sum, a->dmin, a->dmax);
+            } else {
+                __spans_add(&t->spans, &t->n_spans, a->name,
+                            a->kind == SPAN_KIND_COUNTER, a->count, a->total,
+                            a->max);
+            }
+        }
+
+        span_ring_t* next = ring->next;
+        free(ring->agg);
+        free(ring);
+        ring = next;
+    }
+}
+
+void __spans_merge(test_t* run, test_t* into) {
+    if (run == NULL || into == NULL) return;
+
+    __spans_collect(run);
+    for (int i = 0; i < run->n_spans; i++) {
+        tdd_span_stats_t* sp = &run->spans[i];
+        __spans_add(&into->spans, &into->n_spans, sp->name, sp->counter,
+                    sp->count, sp->total, sp->max);
+    }
+    for (int i = 0; i < run->n_metrics; i++) {
+        tdd_metric_t* m = &run->metrics[i];
+        __metrics_add(&into->metrics, &into->n_metrics, m->unit, m->count,
+                      m->sum, m->min, m->max);
+    }
+}
+
+void __spans_free(test_t* t) {
+    if (t == NULL) return;
+
+    span_ring_t* ring = t->span_rings;
+    while (ring != NULL) {
+        span_ring_t* next = ring->next;
+        free(ring->agg);
+        free(ring);
+        ring = next;
+    }
+    t->span_rings = NULL;
+
+    for (int i = 0; i < t->n_spans; i++) {
+        free(t->spans[i].name);
+    }
+    free(t->spans);
+    t->spans   = NULL;
+    t->n_spans = 0;
+
+    for (int i = 0; i < t->n_metrics; i++) {
+        free(t->metrics[i].unit);
+    }
+    free(t->metrics);
+    t->metrics   = NULL;
+    t->n_metrics = 0;
+}
@@ -8,63 +8,103 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "eventlog.h"
+#include "results.h"
 #include "tdd.h"
 
-tdd_result_t* tdd_result_new(char* name, bool ok) {
-    tdd_result_t* r = malloc(sizeof(tdd_result_t));
-
-    r->name = calloc(strlen(name) + 1, sizeof(char));
-    strcpy(r->name, name);
-    r->ok = ok;
-
-    return r;
-}
-
-int tdd_result_del(tdd_result_t* result) {
-    if (result == NULL) return EXIT_FAILURE;
-
-    free(result->name);
-    free(result);
-
-    return EXIT_SUCCESS;
+void __stats_fill(suite_stats_t* stats, int n_tests) {
+    const tdd_results_t* r = stats->results;
+    stats->n_tests         = n_tests;
+    stats->n_ran           = r->n;
+    stats->n_error         = r->n_error;
+    stats->n_fail          = r->n_fail;
+    stats->success_rate    = 0;
+    if (r->n > 0) {
+        stats->success_rate = 100.0 * (r->n - r->n_fail) / (double)r->n;
+    }
 }
 
 suite_stats_t* suite_get_stats(suite_t* s) {
     if (s == NULL) return NULL;
+    if (s->eventlog != NULL) {
+        return tdd_eventlog_stats(__log_path(s->eventlog));
+    }
 
-    suite_stats_t* stats = malloc(sizeof(suite_stats_t));
-    stats->tests_run     = malloc(sizeof(tdd_result_t*) * (s->test_index));
+    s->stats.results = &s->results;
+    s->stats.owned   = false;
+    __stats_fill(&s->stats, s->n_tests);
 
-    int nerr = 0, nfail = 0;
-    for (int i = 0; i < s->test_index; i++) {
-        runner_t* t         = s->tests[i];
-        stats->tests_run[i] = tdd_result_new(t->name, s->results[i]->failed);
+    return &s->stats;
+}
 
-        test_t* r = s->results[i];
-        if (r->err != 0) nerr++;
-        if (r->failed != 0) nfail++;
+suite_stats_t* __stats_new_owned(void) {
+    suite_stats_t* stats = calloc(1, sizeof(suite_stats_t));
+    tdd_results_t* r     = calloc(1, sizeof(tdd_results_t));
+    if (stats == NULL || r == NULL) {
+        free(stats);
+        free(r);
+        errno = ENOMEM;
+        return NULL;
     }
-    stats->n_tests = s->n_tests;
-    stats->n_ran   = s->test_index;
-    stats->n_error = nerr;
-    stats->n_fail  = nfail;
+    __results_init(r);
+    stats->results = r;
+    stats->owned   = true;
 
     return stats;
 }
 
 int suite_stats_del(suite_stats_t* stats) {
     if (stats == NULL) return EXIT_FAILURE;
+    if (!stats->owned) return EXIT_SUCCESS;
 
-    for (int i = 0; i < stats->n_ran; i++) {
-        tdd_result_del(stats->tests_run[i]);
-    }
-    free(stats->tests_run);
+    tdd_results_t* r = (tdd_results_t*)stats->results;
+    __results_free(r);
+    free(r);
     free(stats);
 
     return EXIT_SUCCESS;
 }
 
+int suite_print_stats(suite_stats_t* stats, FILE* f, int top_n) {
+    if (stats == NULL || f == NULL) return EXIT_FAILURE;
+
+    fprintf(f, "Ran %d of %d tests.\n", stats->n_ran, stats->n_tests);
+    fprintf(f, "Failed %d of %d tests. (Fatal failures: %s)\n",
+            stats->n_fail, stats->n_ran,
+            stats->fatal_failures ? "true" : "false");
+    fprintf(f, "Errors during testing: %d\n", stats->n_error);
+    fprintf(f, "Success rate: %0.2lf\n", stats->success_rate);
+    if (top_n <= 0 || stats->n_ran == 0) return EXIT_SUCCESS;
+
+    int* rows = calloc(top_n, sizeof(int));
+    if (rows == NULL) {
+        errno = ENOMEM;
+        return EXIT_FAILURE;
+    }
+    int n = tdd_results_costliest(stats->results, top_n, rows);
+
+    fprintf(f, "\nMost expensive tests:\n");
+    fprintf(f, "  %-24s %10s %10s %8s %8s %8s %8s %10s %10s %9s\n", "test",
+            "user", "sys", "minflt", "majflt", "vcsw", "ivcsw", "read",
+            "written", "maxrss");
+    for (int i = 0; i < n; i++) {
+        tdd_rusage_t u;
+        tdd_results_rusage(stats->results, rows[i], &u);
+        fprintf(f,
+                "  %-24s %8.2fms %8.2fms %8ld %8ld %8ld %8ld %9lldB "
+                "%9lldB %7ldKiB\n",
+                tdd_results_name(stats->results, rows[i]),
+                (double)u.user_ns / 1e6, (double)u.sys_ns / 1e6, u.minflt,
+                u.majflt, u.nvcsw, u.nivcsw, (long long)u.io_read,
+                (long long)u.io_write, u.max_rss_kb);
+    }
+    free(rows);
+
+    return EXIT_SUCCESS;
+}
+
 char* suite_fmtstats(suite_stats_t* stats) {
 #define TESTS "Ran %d of %d tests."
 #define FAILS "Failed %d of %d tests. (Fatal failures: %s)"
@@ -82,10 +122,10 @@ char* suite_fmtstats(suite_stats_t* stats) {
     int   each_len = 0;
     char* each     = calloc(50, sizeof(char));
     for (int i = 0; i < stats->n_ran; i++) {
-        char* name    = stats->tests_run[i]->name;
+        const char* name = tdd_results_name(stats->results, i);
         int   res_len = strlen(name) + 20;
         char* res     = calloc(res_len, sizeof(char));
-        if (stats->tests_run[i]->ok) {
+        if (tdd_results_ok(stats->results, i)) {
             sprintf(res, "%s: okay\n", name);
         } else {
             sprintf(res, "%s: not okay\n", name);
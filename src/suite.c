@@ -9,15 +9,114 @@
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <time.h>
 
+#include "async.h"
+#include "benchenv.h"
+#include "cache.h"
+#include "eventlog.h"
+#include "fixture.h"
+#include "lockprof.h"
+#include "profile.h"
+#include "report.h"
+#include "spans.h"
+#include "results.h"
+#include "rusage.h"
+#include "sample.h"
 #include "strutil.h"
+#include "suite.h"
 #include "tdd.h"
 #include "timeutil.h"
+#include "trace.h"
+#include "vclock.h"
+
+/* A test function and the test to run it with, passed to __suite_thread(). */
+typedef struct suite_run_t {
+    void* (*fn)(void* t);
+    test_t* t;
+    /* The number of untimed runs of a benchmark before the timed one. */
+    int warmup;
+    /* Whether to sample the benchmark until its timing is precise. */
+    bool sample;
+    /* Whether to time the benchmark with cold and with warm caches too. */
+    bool compare_caches;
+} suite_run_t;
+
+/* Runs a benchmark without recording anything, to warm it up. */
+static void __suite_warmup(suite_run_t* run) {
+    for (int i = 0; i < run->warmup; i++) {
+        test_t* t = tdd_test_new(run->t->name);
+        if (t == NULL) return;
+        t->suite      = run->t->suite;
+        t->cache_mode = run->t->cache_mode;
+        run->fn(t);
+        tdd_test_del(t);
+    }
+}
+
+/*
+ * The entry point of test threads: runs a test function, recording the
+ * resource usage of the thread and, for profiled benchmarks, sampling it.
+ * Benchmarks are warmed up and have their environment and caches set up
+ * first, and may be timed again with cold and warm caches afterwards.
+ */
+static void* __suite_thread(void* arg) {
+    suite_run_t* run = arg;
+
+    if (run->t->env != NULL) __benchenv_enter(run->t->env, run->t->suite);
+    if (run->warmup > 0) __suite_warmup(run);
+
+    if (run->t->suite->virtual_clock) __vclock_enter(run->t);
+    tdd_rusage_t start;
+    __rusage_sample(&start);
+    __profile_thread_start(run->t->profile);
+    /*
+     * The timer is restarted here so that warming up, checking the
+     * environment and sampling usage, which reads /proc, are not timed.
+     */
+    bool timed = run->t->start->tv_sec != 0 || run->t->start->tv_nsec != 0;
+    if (timed) test_timer_start(run->t);
+    void* ret = NULL;
+    if (run->sample) {
+        const suite_t* s = run->t->suite;
+        ret = __sample_run(run->fn, run->t, s->bench_ci, s->bench_budget);
+    } else {
+        if (run->t->cache_mode != TDD_CACHE_ANY) test_cache_prepare(run->t);
+        ret = run->fn(run->t);
+    }
+    if (timed && run->t->end->tv_sec == 0 && run->t->end->tv_nsec == 0) {
+        test_timer_end(run->t);
+    }
+    __profile_thread_stop();
+    __rusage_since(&run->t->usage, &start);
+    __vclock_leave();
+    if (run->compare_caches && !run->t->failed) {
+        test_t* t = run->t;
+        if (t->end->tv_sec == 0 && t->end->tv_nsec == 0) test_timer_end(t);
+        __cache_compare(run->fn, t);
+    }
+
+    return ret;
+}
+
+/* A batch of async tests, passed to __suite_async_thread(). */
+typedef struct suite_batch_t {
+    runner_t** tests;
+    test_t**   ts;
+    int        n;
+} suite_batch_t;
+
+/* The entry point of the thread that runs a batch of async tests. */
+static void* __suite_async_thread(void* arg) {
+    suite_batch_t* batch = arg;
+    __async_run(batch->tests, batch->ts, batch->n);
+    return NULL;
+}
 
 suite_t* suite_new() {
     suite_t* s = malloc(sizeof(suite_t));
@@ -31,8 +130,45 @@ suite_t* suite_new() {
     s->n_segv     = 0;
     s->test_index = 0;
     s->tests      = NULL;
-    s->results    = NULL;
     s->outfile    = stdout;
+    s->quiet      = false;
+
+    s->fuzz            = false;
+    s->fuzz_seconds    = 10;
+    s->fuzz_workers    = 0;
+    s->fuzz_max_len    = 4096;
+    s->fuzz_corpus_dir = "testdata/fuzz";
+
+    s->prop_cases   = 1000;
+    s->prop_seed    = 0;
+    s->prop_threads = 1;
+    s->prop_batch   = 256;
+
+    s->bench_parallelism = 0;
+    s->bench_sweep       = false;
+    s->bench_env         = false;
+    s->bench_cpu         = -1;
+    s->bench_realtime    = false;
+    s->bench_warmup      = 0;
+    s->bench_ci          = 0;
+    s->bench_budget      = 10.0;
+    s->bench_cache       = TDD_CACHE_ANY;
+    s->bench_seconds     = 1.0;
+    s->bench_rates       = NULL;
+    s->bench_n_rates     = 0;
+
+    s->eventlog    = NULL;
+    s->trace       = NULL;
+    s->profile_dir = NULL;
+    s->profile_hz  = 997;
+
+    s->lock_profile  = false;
+    s->golden_update = false;
+    s->virtual_clock = false;
+    s->async_max     = 256;
+
+    __results_init(&s->results);
+    memset(&s->stats, 0, sizeof(suite_stats_t));
 
     return s;
 }
@@ -44,10 +180,7 @@ void suite_reset(suite_t* s) {
     s->n_segv     = 0;
     s->test_index = 0;
 
-    for (int i = 0; i < s->n_tests; i++) {
-        tdd_test_del(s->results[i]);
-        s->results[i] = NULL;
-    }
+    __results_reset(&s->results);
 
     return;
 }
@@ -57,10 +190,12 @@ int suite_del(suite_t* s) {
 
     for (int i = 0; i < s->n_tests; i++) {
         tdd_runner_del(s->tests[i]);
-        tdd_test_del(s->results[i]);
     }
     free(s->tests);
-    free(s->results);
+    __results_free(&s->results);
+    __log_close(s->eventlog);
+    __trace_close(s->trace);
+    free(s->profile_dir);
     free(s);
 
     return EXIT_SUCCESS;
@@ -69,6 +204,9 @@ int suite_del(suite_t* s) {
 void suite_done(suite_t* s) {
     if (s == NULL) return;
     s->finished = true;
+    if (s->eventlog != NULL) {
+        __log_suite_end(s->eventlog, true);
+    }
     return;
 }
 
@@ -87,13 +225,6 @@ void suite_add(suite_t* s, int n, ...) {
     }
     s->tests = tmp_tests;
 
-    test_t** tmp_results = realloc(s->results, sizeof(test_t*) * s->n_tests);
-    if (!tmp_results) {
-        errno = ENOMEM;
-        return;
-    }
-    s->results = tmp_results;
-
     /* Add tests from the va_list. */
     va_list ap;
     va_start(ap, n);
@@ -122,24 +253,13 @@ int suite_add_test(suite_t* s, runner_t* r) {
     s->tests                 = tmp_tests;
     s->tests[s->n_tests - 1] = r;
 
-    /* Grow results array with the tests. */
-    test_t** tmp_results = realloc(s->results, sizeof(test_t*) * s->n_tests);
-    if (tmp_results == NULL) {
-        if (s->results != NULL) {
-            free(s->results);
-        }
-        errno = ENOMEM;
-        return EXIT_FAILURE;
-    }
-    s->results = tmp_results;
-
     return EXIT_SUCCESS;
 }
 
 int suite_run(suite_t* s, bool fatal_failures) {
     if (s == NULL) return EXIT_FAILURE;
 
-    for (int i = 0; i < s->n_tests; i++) {
+    while (s->test_index < s->n_tests) {
         int res = suite_next(s, fatal_failures);
         if (res != EXIT_SUCCESS) {
             return res;
@@ -150,36 +270,217 @@ int suite_run(suite_t* s, bool fatal_failures) {
     return EXIT_SUCCESS;
 }
 
+/* Installs the handler that counts segmentation faults in tests. */
+static int __suite_catch_segv(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(struct sigaction));
+    sa.sa_flags   = SA_SIGINFO;
+    sa.sa_handler = &tdd_sigsegv_handler;
+    if (sigaction(SIGSEGV, &sa, NULL) == -1) {
+        perror("sigaction");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int __suite_record(suite_t* s, runner_t* test, test_t* t, bool crashed,
+                   const struct timespec* started,
+                   const struct timespec* joined, int track,
+                   bool fatal_failures) {
+    uint8_t flags = TDD_STATUS_OK;
+
+    __spans_collect(t);
+    if (t->profile != NULL) {
+        __profile_write(t->profile, s->profile_dir, test->name);
+    }
+    if (crashed) {
+        t->failed = true;
+        flags |= TDD_STATUS_SEGV;
+        char* segv_msg = "Encountered segmentation fault";
+        /* A crash on a distributed worker has been logged already. */
+        bool logged =
+            t->fail_msg != NULL && strcmp(t->fail_msg, segv_msg) == 0;
+        if (t->fail_msg != NULL) {
+            free(t->fail_msg);
+        }
+        t->fail_msg = calloc(strlen(segv_msg) + 1, sizeof(char));
+        strncpy(t->fail_msg, segv_msg, strlen(segv_msg));
+        if (s->eventlog != NULL && !logged) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            __log_message(s->eventlog, TDD_EVENT_FAIL, t->index, &now,
+                          segv_msg);
+        }
+    }
+    if (s->eventlog != NULL) {
+        __log_test_end(s->eventlog, t->index, t, crashed);
+    }
+    __fixture_teardown(t);
+    if (s->trace != NULL) {
+        __trace_test(s->trace, track, test->step != NULL, test->name,
+                     test->desc, started, joined, t);
+    }
+
+    s->test_index++;
+    s->stats.fatal_failures = fatal_failures;
+
+    /* Print test results. */
+    __report_test(s->outfile, s->test_index, s->n_tests, test->name,
+                  test->desc, t);
+
+    int ret = EXIT_SUCCESS;
+    if (t->failed && fatal_failures != 0) {
+        int left = (s->n_tests) - (s->test_index + 1);
+        printf("Aborted with %d tests remaining.\n", left);
+        ret = EXIT_FAILURE;
+        if (s->eventlog != NULL) {
+            __log_suite_end(s->eventlog, false);
+        }
+    }
+
+    /*
+     * Keep record of test results. Logged results are read back from the
+     * log instead.
+     */
+    if (s->eventlog == NULL) {
+        __results_append(&s->results, test->name, t, flags, started, joined);
+    }
+
+    return ret;
+}
+
+/*
+ * Runs the async tests from the current one up to the next test that is
+ * not async, or up to suite_t::async_max of them, on one event loop on one
+ * thread. Their results are recorded in suite order once all have finished.
+ */
+static int __suite_next_async(suite_t* s, bool fatal_failures) {
+    int first = s->test_index;
+    int n     = 0;
+    while (first + n < s->n_tests && s->tests[first + n]->step != NULL &&
+           (s->async_max <= 0 || n < s->async_max)) {
+        n++;
+    }
+
+    test_t** ts = calloc((size_t)n, sizeof(test_t*));
+    if (ts == NULL) {
+        errno = ENOMEM;
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < n; i++) {
+        ts[i] = tdd_test_new(s->tests[first + i]->name);
+        if (ts[i] == NULL) {
+            for (int j = 0; j < i; j++) tdd_test_del(ts[j]);
+            free(ts);
+            errno = ENOMEM;
+            return EXIT_FAILURE;
+        }
+        ts[i]->suite = s;
+        ts[i]->index = first + i;
+    }
+
+    if (s->eventlog != NULL) {
+        if (first == 0) {
+            __log_suite_start(s->eventlog, s->n_tests);
+        }
+        for (int i = 0; i < n; i++) {
+            runner_t* test = s->tests[first + i];
+            __log_test_start(s->eventlog, first + i, test->name, test->desc);
+        }
+    }
+
+    int crash_count = tdd_sigsegv_caught;
+    int ret         = __suite_catch_segv();
+    if (ret == EXIT_SUCCESS) {
+        suite_batch_t batch = {s->tests + first, ts, n};
+        pthread_t     thread;
+        if (pthread_create(&thread, NULL, &__suite_async_thread, &batch) !=
+            0) {
+            fprintf(stderr, "Could not create thread!\n");
+            ret = EXIT_FAILURE;
+        } else if (pthread_join(thread, NULL) != 0) {
+            fprintf(stderr, "Could not join with thread!\n");
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    /* A fault cannot be told apart from the other tests of the batch. */
+    bool crashed = crash_count != tdd_sigsegv_caught;
+    s->n_segv += tdd_sigsegv_caught - crash_count;
+    for (int i = 0; i < n; i++) {
+        if (ret == EXIT_SUCCESS) {
+            ret = __suite_record(s, s->tests[first + i], ts[i], crashed,
+                                 ts[i]->start, ts[i]->end, TRACE_TESTS_TID,
+                                 fatal_failures);
+        }
+        tdd_test_del(ts[i]);
+    }
+    free(ts);
+
+    return ret;
+}
+
 int suite_next(suite_t* s, bool fatal_failures) {
     if (s == NULL) return EXIT_FAILURE;
+    if (s->tests[s->test_index]->step != NULL) {
+        return __suite_next_async(s, fatal_failures);
+    }
 
     /* Set up test. */
     runner_t* test = s->tests[s->test_index];
     test_t*   t    = tdd_test_new(test->name);
+    t->suite       = s;
+    t->index       = s->test_index;
 
     bool bench = false;
     if (__hasprefix(test->name, "bench_")) {
         bench = true;
     }
+    if (__hasprefix(test->name, "fuzz_") && s->fuzz) {
+        t->fuzzing = true;
+    }
     int crash_count = tdd_sigsegv_caught;
 
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(struct sigaction));
-    sa.sa_flags   = SA_SIGINFO;
-    sa.sa_handler = &tdd_sigsegv_handler;
-    if (sigaction(SIGSEGV, &sa, NULL) == -1) {
-        perror("sigaction");
+    if (s->eventlog != NULL) {
+        if (s->test_index == 0) {
+            __log_suite_start(s->eventlog, s->n_tests);
+        }
+        __log_test_start(s->eventlog, t->index, test->name, test->desc);
+    }
+
+    if (__suite_catch_segv() != EXIT_SUCCESS) {
         tdd_test_del(t);
         return EXIT_FAILURE;
     }
 
+    if (bench && s->profile_dir != NULL) {
+        t->profile = __profile_new(s->profile_hz);
+    }
+    if (bench) {
+        t->cache_mode = s->bench_cache == TDD_CACHE_BOTH ? TDD_CACHE_WARM
+                                                         : s->bench_cache;
+    }
+    if (bench && s->bench_env) {
+        t->env = __benchenv_new(s);
+        if (t->env != NULL) __benchenv_lock(t->env);
+    }
+
     /* Run test, possibly with bench marking. */
+    struct timespec started, joined;
+    clock_gettime(CLOCK_MONOTONIC, &started);
     if (bench) {
         test_timer_start(t);
     }
-    pthread_t thread;
-    if (pthread_create(&thread, NULL, test->fn, t) != 0) {
+    if (s->lock_profile) {
+        __lockprof_begin();
+    }
+    suite_run_t run = {test->fn, t, bench ? s->bench_warmup : 0,
+                       bench && s->bench_ci > 0,
+                       bench && s->bench_cache == TDD_CACHE_BOTH};
+    pthread_t   thread;
+    if (pthread_create(&thread, NULL, &__suite_thread, &run) != 0) {
         fprintf(stderr, "Could not create thread!\n");
+        if (t->env != NULL) __benchenv_unlock(t->env);
         tdd_test_del(t);
         return EXIT_FAILURE;
     }
@@ -192,81 +493,22 @@ int suite_next(suite_t* s, bool fatal_failures) {
     if (bench && t->end->tv_sec == 0 && t->end->tv_nsec == 0) {
         test_timer_end(t);
     }
-    if (crash_count != tdd_sigsegv_caught) {
-        t->failed = true;
-        s->n_segv++;
-        char* segv_msg = "Encountered segmentation fault";
-        if (t->fail_msg != NULL) {
-            free(t->fail_msg);
-        }
-        t->fail_msg = calloc(strlen(segv_msg) + 1, sizeof(char));
-        strncpy(t->fail_msg, segv_msg, strlen(segv_msg));
+    if (bench) {
+        __fixture_rates(t, t);
     }
-
-    /* Keep record of test results. */
-    s->results[s->test_index++] = t;
-
-    /* Print test results. */
-    FILE* f    = s->outfile;
-    int   left = (s->n_tests) - (s->test_index + 1);
-    char* res =
-        calloc(256 + strlen(test->name) + strlen(test->desc), sizeof(char));
-    int ret = EXIT_SUCCESS;
-    if (t->failed) {
-        sprintf(res, "fail: test %d/%d (%s): ", s->test_index, s->n_tests,
-                test->name);
-        __print_error(f, res);
-        __print_desc(f, test->desc);
-        fprintf(f, "\n");
-        __INDENT(f, 6);
-        __print_desc(f, t->fail_msg);
-        fprintf(f, "\n");
-        if (fatal_failures != 0) {
-            printf("Aborted with %d tests remaining.\n", left);
-            ret = EXIT_FAILURE;
-        }
-    } else if (t->err != 0) {
-        sprintf(res, "err:  test %d/%d (%s): ", s->test_index, s->n_tests,
-                test->name);
-        __print_warning(f, res);
-        __print_desc(f, test->desc);
-        fprintf(f, "\n");
-        char* errstr = calloc(64, sizeof(char));
-        __INDENT(f, 6);
-        sprintf(errstr, "Encountered %d errors.", t->err);
-        __print_warning(f, errstr);
-        free(errstr);
-        fprintf(f, "\n");
-        for (int i = 0; i < t->err; i++) {
-            char* why = calloc(32 + strlen(t->err_msg[i]), sizeof(char));
-            __INDENT(f, 6);
-            sprintf(why, "%d. %s\n", i + 1, t->err_msg[i]);
-            __print_desc(f, why);
-            free(why);
-        }
-    } else {
-        sprintf(res, "okay: test %d/%d (%s): ", s->test_index, s->n_tests,
-                test->name);
-        __print_success(f, res);
-        __print_desc(f, test->desc);
-        fprintf(f, "\n");
+    clock_gettime(CLOCK_MONOTONIC, &joined);
+    if (t->env != NULL) __benchenv_unlock(t->env);
+    if (s->lock_profile) {
+        __lockprof_end(t);
     }
-    free(res);
-
-    /* Print benchmarking info. */
-    if (bench) {
-        struct timespec tdiff = __timespec_minus(t->end, t->start);
-
-        char* bench_info = calloc(64 + strlen(test->name), sizeof(char));
-        __INDENT(f, 6);
-        sprintf(bench_info, "bench: test (%s) took ", test->name);
-        __print_desc(f, bench_info);
-        char* bench_res = calloc(256, sizeof(char));
-        sprintf(bench_res, "%lds %ldns\n", tdiff.tv_sec, tdiff.tv_nsec);
-        __print_hilite(f, bench_res);
-        free(bench_info);
-        free(bench_res);
+    bool crashed = crash_count != tdd_sigsegv_caught;
+    if (crashed) {
+        s->n_segv++;
     }
 
+    int ret = __suite_record(s, test, t, crashed, &started, &joined,
+                             TRACE_TESTS_TID, fatal_failures);
+    tdd_test_del(t);
+
     return ret;
 }
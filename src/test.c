@@ -9,12 +9,23 @@
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include "cache.h"
+#include "eventlog.h"
+#include "fixture.h"
+#include "lockprof.h"
+#include "profile.h"
+#include "spans.h"
 #include "tdd.h"
+#include "vclock.h"
+
+/* Source of test_t::serial; 0 is never handed out. */
+static uint64_t next_serial = 0;
 
 test_t* tdd_test_new(const char* name) {
     test_t* t   = malloc(sizeof(test_t));
@@ -23,6 +34,7 @@ test_t* tdd_test_new(const char* name) {
     t->err      = 0;
     t->fail_msg = NULL;
     t->err_msg  = NULL;
+    t->err_at   = NULL;
 
     /* Initialize all time values to 0. */
     t->start     = calloc(1, sizeof(struct timespec));
@@ -30,6 +42,39 @@ test_t* tdd_test_new(const char* name) {
     t->failed_at = calloc(1, sizeof(struct timespec));
     t->error_at  = calloc(1, sizeof(struct timespec));
 
+    t->suite    = NULL;
+    t->fuzzing  = false;
+    t->fuzz     = NULL;
+    t->parallel = NULL;
+    t->scaling  = NULL;
+    t->load     = NULL;
+    t->index    = -1;
+
+    t->spans      = NULL;
+    t->n_spans    = 0;
+    t->metrics    = NULL;
+    t->n_metrics  = 0;
+    t->locks      = NULL;
+    t->n_locks    = 0;
+    memset(&t->usage, 0, sizeof(tdd_rusage_t));
+    t->env        = NULL;
+    t->samples    = NULL;
+    t->cache_mode = TDD_CACHE_ANY;
+    t->cache      = NULL;
+    t->buffers    = NULL;
+    t->fixture    = NULL;
+    t->io_bytes   = 0;
+    t->io_ops     = 0;
+    t->clock      = NULL;
+    t->task       = NULL;
+    t->span_rings = NULL;
+    t->serial     = __atomic_add_fetch(&next_serial, 1, __ATOMIC_RELAXED);
+    t->profile    = NULL;
+
+    t->async_state  = 0;
+    t->async_data   = NULL;
+    t->async_events = 0;
+
     /* Set alternative interface for fail, error, done cases. */
     t->fail  = &test_fail;
     t->error = &test_error;
@@ -53,12 +98,35 @@ int tdd_test_del(test_t* t) {
         }
         free(t->err_msg);
     }
+    free(t->err_at);
 
     free(t->start);
     free(t->end);
     free(t->failed_at);
     free(t->error_at);
 
+    if (t->fuzz != NULL) {
+        free(t->fuzz);
+    }
+    if (t->parallel != NULL) {
+        tdd_parallel_stats_del(t->parallel);
+    }
+    if (t->scaling != NULL) {
+        tdd_scaling_del(t->scaling);
+    }
+    if (t->load != NULL) {
+        tdd_load_del(t->load);
+    }
+    __spans_free(t);
+    __locks_free(t);
+    __profile_del(t->profile);
+    free(t->env);
+    free(t->samples);
+    free(t->cache);
+    __cache_free(t);
+    __fixture_free(t);
+    __vclock_del(t->clock);
+
     free(t);
 
     return EXIT_SUCCESS;
@@ -70,6 +138,10 @@ void* test_fail(test_t* t, char* msg) {
     strncpy(t->fail_msg, msg, strlen(msg));
 
     clock_gettime(CLOCK_MONOTONIC, t->failed_at);
+    if (t->suite != NULL && t->suite->eventlog != NULL && t->index >= 0) {
+        __log_message(t->suite->eventlog, TDD_EVENT_FAIL, t->index,
+                      t->failed_at, msg);
+    }
     void* retval = NULL;
     pthread_join(pthread_self(), &retval);
 
@@ -77,24 +149,45 @@ void* test_fail(test_t* t, char* msg) {
 }
 
 void* test_error(test_t* t, char* msg) {
-    t->err++;
+    /* Count the error only once it is stored, since reporters read it. */
+    int n = t->err + 1;
 
-    char** temp = realloc(t->err_msg, sizeof(char*) * (t->err));
+    char** temp = realloc(t->err_msg, sizeof(char*) * n);
     if (!temp) {
         errno = ENOMEM;
         return NULL;
     }
     t->err_msg = temp;
 
-    t->err_msg[t->err - 1] = calloc(strlen(msg) + 1, sizeof(char));
-    strncpy(t->err_msg[t->err - 1], msg, strlen(msg));
+    struct timespec* temp_at = realloc(t->err_at, sizeof(struct timespec) * n);
+    if (!temp_at) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    t->err_at = temp_at;
+
+    char* copy = calloc(strlen(msg) + 1, sizeof(char));
+    if (!copy) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    strncpy(copy, msg, strlen(msg));
 
     clock_gettime(CLOCK_MONOTONIC, t->error_at);
+    t->err_msg[n - 1] = copy;
+    t->err_at[n - 1]  = *t->error_at;
+    t->err            = n;
+    if (t->suite != NULL && t->suite->eventlog != NULL && t->index >= 0) {
+        __log_message(t->suite->eventlog, TDD_EVENT_ERROR, t->index,
+                      t->error_at, msg);
+    }
 
     return NULL;
 }
 
 void* test_timer_start(test_t* t) {
+    __atomic_store_n(&t->io_bytes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&t->io_ops, 0, __ATOMIC_RELAXED);
     clock_gettime(CLOCK_MONOTONIC, t->start);
     return NULL;
 }
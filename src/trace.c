@@ -0,0 +1,276 @@
+/**
+ * @file trace.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of the trace exporter,
+ *        which writes the suite timeline in the Chrome Trace Event format
+ *        so that it can be loaded in Perfetto or chrome://tracing.
+ *
+ * Tests that the suite runs one at a time are drawn on the "tests" track.
+ * Every other runner of tests, such as a worker process of a distributed
+ * run, gets a track of its own, as do worker threads started by a test,
+ * such as the threads of a parallel benchmark. A track only ever holds
+ * slices that nest; async tests, which overlap on the thread of their event
+ * loop, are drawn as async slices keyed by the test instead. Times are in
+ * microseconds since the trace was opened.
+ **/
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fixture.h"
+#include "tdd.h"
+#include "trace.h"
+
+/* A track after the "tests" track, named when it is first drawn on. */
+typedef struct trace_track_t {
+    const char* kind;
+    int         n;
+} trace_track_t;
+
+struct tdd_trace_t {
+    FILE*           f;
+    struct timespec origin;
+    /* Number of events written, to place separating commas. */
+    unsigned long   n_events;
+    /* The tracks that have been named; track i has tid TRACE_TESTS_TID+1+i */
+    trace_track_t* tracks;
+    int            n_tracks;
+    int            cap_tracks;
+};
+
+static double __trace_us(const tdd_trace_t* tr, const struct timespec* ts) {
+    return (double)(ts->tv_sec - tr->origin.tv_sec) * 1e6 +
+           (double)(ts->tv_nsec - tr->origin.tv_nsec) / 1e3;
+}
+
+static void __trace_sep(tdd_trace_t* tr) {
+    fputs(tr->n_events++ > 0 ? ",\n" : "\n", tr->f);
+}
+
+static void __trace_str(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; s != NULL && *s != '\0'; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static void __trace_name_track(tdd_trace_t* tr, int tid, const char* name) {
+    __trace_sep(tr);
+    fprintf(tr->f,
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":",
+            tid);
+    __trace_str(tr->f, name);
+    fputs("}}", tr->f);
+}
+
+/*
+ * Starts writing a slice, leaving its args open. A slice with a nonzero id
+ * is written as a pair of async events keyed by the id instead, so that it
+ * may overlap the slices of other ids on the same track.
+ */
+static void __trace_slice(tdd_trace_t* tr, int tid, uint64_t id,
+                          const char* cat, const char* name,
+                          const struct timespec* start,
+                          const struct timespec* end) {
+    double ts  = __trace_us(tr, start);
+    double dur = __trace_us(tr, end) - ts;
+    if (id != 0) {
+        __trace_sep(tr);
+        fputs("{\"name\":", tr->f);
+        __trace_str(tr->f, name);
+        fprintf(tr->f,
+                ",\"cat\":\"%s\",\"ph\":\"e\",\"id\":%llu,\"pid\":1,"
+                "\"tid\":%d,\"ts\":%.3f}",
+                cat, (unsigned long long)id, tid, ts + (dur > 0 ? dur : 0));
+    }
+    __trace_sep(tr);
+    fputs("{\"name\":", tr->f);
+    __trace_str(tr->f, name);
+    if (id != 0) {
+        fprintf(tr->f,
+                ",\"cat\":\"%s\",\"ph\":\"b\",\"id\":%llu,\"pid\":1,"
+                "\"tid\":%d,\"ts\":%.3f",
+                cat, (unsigned long long)id, tid, ts);
+        return;
+    }
+    fprintf(tr->f,
+            ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f",
+            cat, tid, ts, dur > 0 ? dur : 0);
+}
+
+static void __trace_instant(tdd_trace_t* tr, int tid, uint64_t id,
+                            const char* name, const struct timespec* at,
+                            const char* msg) {
+    __trace_sep(tr);
+    if (id != 0) {
+        fprintf(tr->f,
+                "{\"name\":\"%s\",\"cat\":\"test\",\"ph\":\"n\","
+                "\"id\":%llu,",
+                name, (unsigned long long)id);
+    } else {
+        fprintf(tr->f,
+                "{\"name\":\"%s\",\"cat\":\"test\",\"ph\":\"i\","
+                "\"s\":\"t\",",
+                name);
+    }
+    fprintf(tr->f, "\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"msg\":",
+            tid, __trace_us(tr, at));
+    __trace_str(tr->f, msg);
+    fputs("}}", tr->f);
+}
+
+static bool __trace_isset(const struct timespec* ts) {
+    return ts->tv_sec != 0 || ts->tv_nsec != 0;
+}
+
+tdd_trace_t* __trace_open(const char* path) {
+    tdd_trace_t* tr = calloc(1, sizeof(tdd_trace_t));
+    if (tr == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    tr->f = fopen(path, "w");
+    if (tr->f == NULL) {
+        free(tr);
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &tr->origin);
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", tr->f);
+    __trace_sep(tr);
+    fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+          "\"args\":{\"name\":\"libtdd\"}}",
+          tr->f);
+    __trace_name_track(tr, TRACE_TESTS_TID, "tests");
+
+    return tr;
+}
+
+void __trace_close(tdd_trace_t* tr) {
+    if (tr == NULL) return;
+    fputs("\n]}\n", tr->f);
+    fclose(tr->f);
+    free(tr->tracks);
+    free(tr);
+}
+
+int __trace_track(tdd_trace_t* tr, const char* kind, int n) {
+    if (tr == NULL) return TRACE_TESTS_TID;
+
+    for (int i = 0; i < tr->n_tracks; i++) {
+        if (tr->tracks[i].n == n && strcmp(tr->tracks[i].kind, kind) == 0) {
+            return TRACE_TESTS_TID + 1 + i;
+        }
+    }
+    if (tr->n_tracks == tr->cap_tracks) {
+        int            cap = tr->cap_tracks > 0 ? 2 * tr->cap_tracks : 16;
+        trace_track_t* tmp =
+            realloc(tr->tracks, sizeof(trace_track_t) * (size_t)cap);
+        if (tmp == NULL) return TRACE_TESTS_TID;
+        tr->tracks     = tmp;
+        tr->cap_tracks = cap;
+    }
+    tr->tracks[tr->n_tracks].kind = kind;
+    tr->tracks[tr->n_tracks].n    = n;
+    int tid                       = TRACE_TESTS_TID + 1 + tr->n_tracks++;
+
+    char* track = malloc(strlen(kind) + 16);
+    if (track != NULL) {
+        sprintf(track, "%s %d", kind, n);
+        __trace_name_track(tr, tid, track);
+        free(track);
+    }
+
+    return tid;
+}
+
+void __trace_test(tdd_trace_t* tr, int track, bool async, const char* name,
+                  const char* desc, const struct timespec* started,
+                  const struct timespec* joined, const test_t* t) {
+    if (tr == NULL || t == NULL) return;
+
+    /*
+     * The slices of a test that shared its thread are keyed by its serial.
+     * Nested async slices must share the category of the outermost.
+     */
+    uint64_t id = async ? t->serial : 0;
+
+    /* Fixtures are torn down after the join, but belong to the test. */
+    const fixture_phase_t* phases   = NULL;
+    int                    n_phases = __fixture_phases(t, &phases);
+    const struct timespec* end      = joined;
+    for (int i = 0; i < n_phases; i++) {
+        if (__trace_us(tr, &phases[i].end) > __trace_us(tr, end)) {
+            end = &phases[i].end;
+        }
+    }
+
+    __trace_slice(tr, track, id, "test", name, started, end);
+    fputs(",\"args\":{\"desc\":", tr->f);
+    __trace_str(tr->f, desc);
+    fprintf(tr->f, ",\"failed\":%s,\"errors\":%d}}",
+            t->failed ? "true" : "false", t->err);
+
+    /* The timed region is nested inside the test's slice. */
+    if (__trace_isset(t->start) && __trace_isset(t->end)) {
+        __trace_slice(tr, track, id, async ? "test" : "bench", "timed",
+                      t->start, t->end);
+        fputs("}", tr->f);
+    }
+    for (int i = 0; i < n_phases; i++) {
+        __trace_slice(tr, track, id, async ? "test" : "fixture",
+                      phases[i].what, &phases[i].start, &phases[i].end);
+        fputs(",\"args\":{\"path\":", tr->f);
+        __trace_str(tr->f, phases[i].path);
+        fputs("}}", tr->f);
+    }
+
+    for (int i = 0; i < t->err; i++) {
+        if (t->err_at != NULL && t->err_msg[i] != NULL) {
+            __trace_instant(tr, track, id, "error", &t->err_at[i],
+                            t->err_msg[i]);
+        }
+    }
+    if (t->failed && __trace_isset(t->failed_at)) {
+        __trace_instant(tr, track, id, "fail", t->failed_at, t->fail_msg);
+    }
+
+    fflush(tr->f);
+}
+
+void __trace_worker(tdd_trace_t* tr, int worker, const char* name,
+                    const struct timespec* start,
+                    const struct timespec* end) {
+    if (tr == NULL || worker < 0) return;
+
+    int tid = __trace_track(tr, "worker", worker);
+    __trace_slice(tr, tid, 0, "worker", name, start, end);
+    fputs("}", tr->f);
+}
+
+int suite_set_trace(suite_t* s, const char* path) {
+    if (s == NULL) return EXIT_FAILURE;
+
+    if (s->trace != NULL) {
+        __trace_close(s->trace);
+        s->trace = NULL;
+    }
+    if (path == NULL) return EXIT_SUCCESS;
+
+    s->trace = __trace_open(path);
+    return s->trace != NULL ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,446 @@
+/**
+ * @file vclock.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief This file contains implementation details of virtual clocks, which
+ *        let tests that wait on timeouts run without waiting.
+ *
+ * A clock counts the threads on it and the threads asleep on it. Virtual
+ * time stands still while any thread on the clock runs. When the last one
+ * goes to sleep, the clock jumps to the earliest time that a sleeper asked
+ * to be woken at, and wakes it. The jump waits until every thread woken by
+ * the last one has run, so the order that threads see is always the same.
+ *
+ * When the library is built with TDD_VCLOCK, it defines the time functions
+ * of the C library itself, as lockprof.c does the pthread lock functions.
+ * Calls made by a thread that is on a virtual clock and belongs to a suite
+ * with suite_t::virtual_clock set use the clock; every other call is
+ * forwarded to the C library through dlsym(RTLD_NEXT).
+ **/
+/* RTLD_NEXT, clock_nanosleep(), usleep() and poll() are not in POSIX.1c. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tdd.h"
+#include "vclock.h"
+
+/* Real milliseconds between checks of the virtual clock in poll(). */
+#define VCLOCK_POLL_MS 1
+
+/* A thread asleep on a virtual clock, and the time it wakes at. */
+typedef struct vclock_waiter_t {
+    int64_t until;
+    /* The descriptors that wake the thread sooner, if it is in poll(). */
+    const struct pollfd*    fds;
+    nfds_t                  n_fds;
+    struct vclock_waiter_t* next;
+} vclock_waiter_t;
+
+struct tdd_vclock_t {
+    pthread_mutex_t lock;
+    pthread_cond_t  tick;
+    /* The virtual monotonic time; read without the lock. */
+    int64_t now;
+    /* The offset of the real time clock from the monotonic clock. */
+    int64_t realtime;
+    /* The threads on the clock, and those of them asleep on it. */
+    int              threads;
+    int              blocked;
+    vclock_waiter_t* waiters;
+};
+
+/* The clock the interposed time functions use on this thread, if any. */
+static __thread struct tdd_vclock_t* tls_clock;
+
+#ifdef TDD_VCLOCK
+#include <dlfcn.h>
+
+static int (*real_clock_gettime)(clockid_t, struct timespec*);
+static int (*real_nanosleep)(const struct timespec*, struct timespec*);
+static int (*real_clock_nanosleep)(clockid_t, int, const struct timespec*,
+                                   struct timespec*);
+static int (*real_usleep)(useconds_t);
+static unsigned (*real_sleep)(unsigned);
+static int (*real_poll)(struct pollfd*, nfds_t, int);
+
+/* Object to function pointer conversion, as POSIX recommends for dlsym. */
+#define VC_RESOLVE(fp, name)                                                 \
+    if (fp == NULL) *(void**)(&fp) = dlsym(RTLD_NEXT, name)
+
+static void __vc_resolve(void) {
+    VC_RESOLVE(real_clock_gettime, "clock_gettime");
+    VC_RESOLVE(real_nanosleep, "nanosleep");
+    VC_RESOLVE(real_clock_nanosleep, "clock_nanosleep");
+    VC_RESOLVE(real_usleep, "usleep");
+    VC_RESOLVE(real_sleep, "sleep");
+    VC_RESOLVE(real_poll, "poll");
+    if (real_clock_gettime == NULL || real_nanosleep == NULL ||
+        real_poll == NULL) {
+        fprintf(stderr, "libtdd: could not find the time functions; the "
+                        "virtual clock needs a dynamically linked libc\n");
+        abort();
+    }
+}
+
+/* Resolve before main(), while the process is still single threaded. */
+static void __vc_init(void) __attribute__((constructor));
+static void __vc_init(void) {
+    __vc_resolve();
+}
+#endif
+
+/* Whether a thread in poll() is about to wake because a descriptor is ready. */
+static bool __vclock_ready(const vclock_waiter_t* w) {
+#ifdef TDD_VCLOCK
+    if (w->n_fds == 0) return false;
+
+    /* Polled on a copy, as the thread itself writes the events back. */
+    struct pollfd* fds = malloc(sizeof(struct pollfd) * w->n_fds);
+    if (fds == NULL) return false;
+    memcpy(fds, w->fds, sizeof(struct pollfd) * w->n_fds);
+    bool ready = real_poll(fds, w->n_fds, 0) != 0;
+    free(fds);
+
+    return ready;
+#else
+    (void)w;
+    return false;
+#endif
+}
+
+static int64_t __vclock_real(clockid_t id) {
+    struct timespec ts;
+#ifdef TDD_VCLOCK
+    if (real_clock_gettime == NULL) __vc_resolve();
+    real_clock_gettime(id, &ts);
+#else
+    clock_gettime(id, &ts);
+#endif
+    return (int64_t)ts.tv_sec * 1000000000LL + (int64_t)ts.tv_nsec;
+}
+
+static struct tdd_vclock_t* __vclock_new(void) {
+    struct tdd_vclock_t* c = calloc(1, sizeof(struct tdd_vclock_t));
+    if (c == NULL) return NULL;
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->tick, NULL);
+    c->now      = __vclock_real(CLOCK_MONOTONIC);
+    c->realtime = __vclock_real(CLOCK_REALTIME) - c->now;
+    c->threads  = 1;
+
+    return c;
+}
+
+void __vclock_del(struct tdd_vclock_t* c) {
+    if (c == NULL) return;
+    pthread_cond_destroy(&c->tick);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+/* Returns the clock of a test, making it if the test has none yet. */
+static struct tdd_vclock_t* __vclock(test_t* t) {
+    struct tdd_vclock_t* c = __atomic_load_n(&t->clock, __ATOMIC_ACQUIRE);
+    if (c != NULL) return c;
+
+    c = __vclock_new();
+    if (c == NULL) return NULL;
+    struct tdd_vclock_t* cur = NULL;
+    if (!__atomic_compare_exchange_n(&t->clock, &cur, c, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        __vclock_del(c);
+        return cur;
+    }
+
+    return c;
+}
+
+static int64_t __vclock_now(struct tdd_vclock_t* c) {
+    return __atomic_load_n(&c->now, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Moves time on to the first wake up time, if every thread on the clock is
+ * asleep and none has been woken, or has a descriptor ready, without having
+ * run yet. Called locked.
+ */
+static void __vclock_advance(struct tdd_vclock_t* c) {
+    if (c->blocked < c->threads || c->waiters == NULL) return;
+
+    int64_t next = INT64_MAX;
+    for (vclock_waiter_t* w = c->waiters; w != NULL; w = w->next) {
+        if (w->until <= c->now || __vclock_ready(w)) return;
+        if (w->until < next) next = w->until;
+    }
+    if (next == INT64_MAX) return;
+    __atomic_store_n(&c->now, next, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&c->tick);
+}
+
+/* Counts the calling thread as asleep until the given time. Called locked. */
+static void __vclock_block(struct tdd_vclock_t* c, vclock_waiter_t* w,
+                           int64_t until) {
+    w->until   = until;
+    w->fds     = NULL;
+    w->n_fds   = 0;
+    w->next    = c->waiters;
+    c->waiters = w;
+    c->blocked++;
+    __vclock_advance(c);
+}
+
+/* Counts the calling thread as running again. Called locked. */
+static void __vclock_unblock(struct tdd_vclock_t* c, vclock_waiter_t* w) {
+    for (vclock_waiter_t** p = &c->waiters; *p != NULL; p = &(*p)->next) {
+        if (*p == w) {
+            *p = w->next;
+            break;
+        }
+    }
+    c->blocked--;
+}
+
+static void __vclock_sleep(struct tdd_vclock_t* c, int64_t until) {
+    pthread_mutex_lock(&c->lock);
+    if (until > c->now) {
+        vclock_waiter_t w;
+        __vclock_block(c, &w, until);
+        while (c->now < until) pthread_cond_wait(&c->tick, &c->lock);
+        __vclock_unblock(c, &w);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+int64_t test_clock_now(test_t* t) {
+    struct tdd_vclock_t* c = t != NULL ? __vclock(t) : NULL;
+    if (c == NULL) return __vclock_real(CLOCK_MONOTONIC);
+
+    return __vclock_now(c);
+}
+
+void test_sleep(test_t* t, int64_t ns) {
+    struct tdd_vclock_t* c = t != NULL ? __vclock(t) : NULL;
+    if (c == NULL || ns <= 0) return;
+
+    __vclock_sleep(c, __vclock_now(c) + ns);
+}
+
+/* Takes a thread off a clock, which may let time move on. */
+static void __vclock_exit(struct tdd_vclock_t* c) {
+    pthread_mutex_lock(&c->lock);
+    c->threads--;
+    __vclock_advance(c);
+    pthread_mutex_unlock(&c->lock);
+}
+
+/* A thread started by test_thread_create(), passed to __vclock_thread(). */
+typedef struct vclock_start_t {
+    struct tdd_vclock_t* clock;
+    bool                 interpose;
+    void* (*fn)(void* arg);
+    void* arg;
+} vclock_start_t;
+
+static void* __vclock_thread(void* arg) {
+    vclock_start_t start = *(vclock_start_t*)arg;
+    free(arg);
+
+    if (start.interpose) tls_clock = start.clock;
+    void* ret = start.fn(start.arg);
+    tls_clock = NULL;
+    __vclock_exit(start.clock);
+
+    return ret;
+}
+
+int test_thread_create(test_t* t, pthread_t* thread, void* (*fn)(void* arg),
+                       void* arg) {
+    struct tdd_vclock_t* c = t != NULL ? __vclock(t) : NULL;
+    if (c == NULL) return ENOMEM;
+    vclock_start_t* start = malloc(sizeof(vclock_start_t));
+    if (start == NULL) return ENOMEM;
+    start->clock     = c;
+    start->interpose = t->suite != NULL && t->suite->virtual_clock;
+    start->fn        = fn;
+    start->arg       = arg;
+
+    /* The thread is on the clock before the caller can go to sleep. */
+    pthread_mutex_lock(&c->lock);
+    c->threads++;
+    pthread_mutex_unlock(&c->lock);
+    int err = pthread_create(thread, NULL, &__vclock_thread, start);
+    if (err != 0) {
+        free(start);
+        __vclock_exit(c);
+    }
+
+    return err;
+}
+
+int test_thread_join(test_t* t, pthread_t thread, void** ret) {
+    struct tdd_vclock_t* c = t != NULL ? __vclock(t) : NULL;
+    if (c == NULL) return pthread_join(thread, ret);
+
+    vclock_waiter_t w;
+    pthread_mutex_lock(&c->lock);
+    __vclock_block(c, &w, INT64_MAX);
+    pthread_mutex_unlock(&c->lock);
+    int err = pthread_join(thread, ret);
+    pthread_mutex_lock(&c->lock);
+    __vclock_unblock(c, &w);
+    pthread_mutex_unlock(&c->lock);
+
+    return err;
+}
+
+void __vclock_enter(test_t* t) {
+    tls_clock = __vclock(t);
+}
+
+void __vclock_leave(void) {
+    tls_clock = NULL;
+}
+
+#ifdef TDD_VCLOCK
+/* Whether a clock reads virtual time, rather than CPU time. */
+static bool __vc_virtual(clockid_t id) {
+    switch (id) {
+    case CLOCK_REALTIME:
+    case CLOCK_MONOTONIC:
+#ifdef CLOCK_MONOTONIC_RAW
+    case CLOCK_MONOTONIC_RAW:
+#endif
+#ifdef CLOCK_REALTIME_COARSE
+    case CLOCK_REALTIME_COARSE:
+#endif
+#ifdef CLOCK_MONOTONIC_COARSE
+    case CLOCK_MONOTONIC_COARSE:
+#endif
+#ifdef CLOCK_BOOTTIME
+    case CLOCK_BOOTTIME:
+#endif
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool __vc_realtime(clockid_t id) {
+#ifdef CLOCK_REALTIME_COARSE
+    if (id == CLOCK_REALTIME_COARSE) return true;
+#endif
+    return id == CLOCK_REALTIME;
+}
+
+static int64_t __vc_ns(const struct timespec* ts) {
+    return (int64_t)ts->tv_sec * 1000000000LL + (int64_t)ts->tv_nsec;
+}
+
+int clock_gettime(clockid_t id, struct timespec* ts) {
+    if (real_clock_gettime == NULL) __vc_resolve();
+    struct tdd_vclock_t* c = tls_clock;
+    if (c == NULL || !__vc_virtual(id)) return real_clock_gettime(id, ts);
+
+    int64_t now = __vclock_now(c);
+    if (__vc_realtime(id)) now += c->realtime;
+    ts->tv_sec  = (time_t)(now / 1000000000LL);
+    ts->tv_nsec = (long)(now % 1000000000LL);
+
+    return 0;
+}
+
+int nanosleep(const struct timespec* req, struct timespec* rem) {
+    if (real_nanosleep == NULL) __vc_resolve();
+    struct tdd_vclock_t* c = tls_clock;
+    if (c == NULL) return real_nanosleep(req, rem);
+    if (req->tv_nsec < 0 || req->tv_nsec >= 1000000000L) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    __vclock_sleep(c, __vclock_now(c) + __vc_ns(req));
+    if (rem != NULL) rem->tv_sec = rem->tv_nsec = 0;
+
+    return 0;
+}
+
+int clock_nanosleep(clockid_t id, int flags, const struct timespec* req,
+                    struct timespec* rem) {
+    if (real_clock_nanosleep == NULL) __vc_resolve();
+    struct tdd_vclock_t* c = tls_clock;
+    if (c == NULL || !__vc_virtual(id)) {
+        return real_clock_nanosleep(id, flags, req, rem);
+    }
+    if (req->tv_nsec < 0 || req->tv_nsec >= 1000000000L) return EINVAL;
+
+    int64_t until = __vc_ns(req);
+    if (!(flags & TIMER_ABSTIME)) {
+        until += __vclock_now(c);
+    } else if (__vc_realtime(id)) {
+        until -= c->realtime;
+    }
+    __vclock_sleep(c, until);
+    if (rem != NULL && !(flags & TIMER_ABSTIME)) {
+        rem->tv_sec = rem->tv_nsec = 0;
+    }
+
+    return 0;
+}
+
+int usleep(useconds_t us) {
+    if (real_usleep == NULL) __vc_resolve();
+    struct tdd_vclock_t* c = tls_clock;
+    if (c == NULL) return real_usleep(us);
+
+    __vclock_sleep(c, __vclock_now(c) + (int64_t)us * 1000);
+    return 0;
+}
+
+unsigned sleep(unsigned s) {
+    if (real_sleep == NULL) __vc_resolve();
+    struct tdd_vclock_t* c = tls_clock;
+    if (c == NULL) return real_sleep(s);
+
+    __vclock_sleep(c, __vclock_now(c) + (int64_t)s * 1000000000LL);
+    return 0;
+}
+
+/*
+ * A poll() with a timeout sleeps on the clock, but keeps polling in real
+ * time so that it still returns as soon as a descriptor is ready.
+ */
+int poll(struct pollfd* fds, nfds_t n, int timeout) {
+    if (real_poll == NULL) __vc_resolve();
+    struct tdd_vclock_t* c = tls_clock;
+    if (c == NULL || timeout == 0) return real_poll(fds, n, timeout);
+
+    int ret = real_poll(fds, n, 0);
+    if (ret != 0) return ret;
+
+    vclock_waiter_t w;
+    int64_t until = timeout < 0 ? INT64_MAX
+                                : __vclock_now(c) + (int64_t)timeout * 1000000;
+    pthread_mutex_lock(&c->lock);
+    __vclock_block(c, &w, until);
+    w.fds   = fds;
+    w.n_fds = n;
+    pthread_mutex_unlock(&c->lock);
+    do {
+        ret = real_poll(fds, n, VCLOCK_POLL_MS);
+    } while (ret == 0 && __vclock_now(c) < until);
+    pthread_mutex_lock(&c->lock);
+    __vclock_unblock(c, &w);
+    pthread_mutex_unlock(&c->lock);
+
+    return ret;
+}
+#endif
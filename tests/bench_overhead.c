@@ -0,0 +1,154 @@
+/**
+ * @file bench_overhead.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Measures the costs of libtdd itself: running and registering
+ *        tests, recording errors, reporting results and summarising them.
+ *
+ * Each measurement is printed to stdout as one JSON object per line:
+ *
+ *  {"bench":"suite_next","n":1000,"ns_per_op":1234.5,"ops_per_s":810045}
+ *
+ * so that results can be collected by `meson test --benchmark` and
+ * compared between builds. An optional argument divides every test count
+ * by the given factor, for quick runs.
+ **/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tdd.h"
+
+/* The number of errors raised by the test_error() measurement. */
+#define N_ERRORS 100000
+/* The number of times suite_get_stats() is timed. */
+#define N_STATS 100
+
+static int scale = 1;
+
+static int64_t __now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Prints one measurement of n operations that took ns nanoseconds. */
+static void __emit(const char* bench, const char* variant, long n,
+                   int64_t ns) {
+    double per = n > 0 ? (double)ns / (double)n : 0.0;
+    printf("{\"bench\":\"%s\"", bench);
+    if (variant != NULL) printf(",\"variant\":\"%s\"", variant);
+    printf(",\"n\":%ld,\"ns_per_op\":%.1f,\"ops_per_s\":%.0f}\n", n, per,
+           per > 0 ? 1e9 / per : 0.0);
+    fflush(stdout);
+}
+
+static void* __trivial(void* t) {
+    (void)t;
+    return NULL;
+}
+
+static void* __errors(void* t) {
+    int64_t start = __now();
+    for (long i = 0; i < N_ERRORS / scale; i++) {
+        test_error(t, "error");
+    }
+    __emit("test_error", NULL, N_ERRORS / scale, __now() - start);
+
+    return NULL;
+}
+
+/*
+ * Builds a suite of n trivial tests that reports to out, or not at all if
+ * out is NULL, timing their registration.
+ */
+static suite_t* __suite(long n, FILE* out, bool timed) {
+    suite_t* s = suite_new();
+    if (s == NULL) return NULL;
+    s->outfile = out;
+
+    int64_t start = __now();
+    for (long i = 0; i < n; i++) {
+        suite_add_test(s, runner_new(&__trivial, "trivial", NULL));
+    }
+    if (timed) __emit("suite_add_test", NULL, n, __now() - start);
+
+    return s;
+}
+
+/* Times suite_next() per test, with results reported to out. */
+static int __bench_next(long n, FILE* out, const char* bench,
+                        const char* variant) {
+    suite_t* s = __suite(n, out, variant == NULL);
+    if (s == NULL) return EXIT_FAILURE;
+
+    int64_t start = __now();
+    suite_run(s, false);
+    if (out != NULL) fflush(out);
+    int64_t took = __now() - start;
+    __emit(bench, variant, n, took);
+
+    if (variant == NULL) {
+        start = __now();
+        for (int i = 0; i < N_STATS; i++) {
+            suite_stats_del(suite_get_stats(s));
+        }
+        char name[32];
+        sprintf(name, "%ld tests", n);
+        __emit("suite_get_stats", name, N_STATS, __now() - start);
+    }
+    suite_del(s);
+
+    return EXIT_SUCCESS;
+}
+
+static int __bench_report(long n) {
+    FILE* null = fopen("/dev/null", "w");
+    FILE* file = tmpfile();
+    if (null == NULL || file == NULL) {
+        if (null != NULL) fclose(null);
+        if (file != NULL) fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    int ret = __bench_next(n, null, "report", "/dev/null");
+    if (ret == EXIT_SUCCESS) ret = __bench_next(n, file, "report", "file");
+    fclose(null);
+    fclose(file);
+
+    return ret;
+}
+
+static int __bench_errors(void) {
+    suite_t* s = suite_new();
+    if (s == NULL) return EXIT_FAILURE;
+    s->outfile = fopen("/dev/null", "w");
+    if (s->outfile == NULL) {
+        suite_del(s);
+        return EXIT_FAILURE;
+    }
+
+    suite_add_test(s, runner_new(&__errors, "errors", NULL));
+    suite_run(s, false);
+    fclose(s->outfile);
+    suite_del(s);
+
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) scale = atoi(argv[1]);
+    if (scale < 1) scale = 1;
+
+    static const long sizes[] = {1000, 100000, 1000000};
+    int               ret     = EXIT_SUCCESS;
+    for (size_t i = 0; ret == EXIT_SUCCESS && i < 3; i++) {
+        long n = sizes[i] / scale > 0 ? sizes[i] / scale : 1;
+        ret    = __bench_next(n, NULL, "suite_next", NULL);
+    }
+    if (ret == EXIT_SUCCESS) ret = __bench_report(100000 / scale);
+    if (ret == EXIT_SUCCESS) ret = __bench_errors();
+
+    return ret;
+}
@@ -0,0 +1,241 @@
+/**
+ * @file test_bulk.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Checks that every vector kernel of the bulk assertions agrees with
+ *        the plain C kernel.
+ *
+ * Each comparison is run on every length up to a few vector widths, with
+ * the first mismatch at every position, so that the main loop and every
+ * tail length (0, 1, width - 1, width + 1, ...) of each kernel are covered.
+ * Kernels this build or CPU lacks are skipped.
+ **/
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bulk.h"
+#include "tdd.h"
+#include "tdd_assert.h"
+
+/* The longest arrays compared; several of the widest vectors. */
+#define MAX_LEN 70
+
+static const char* kernels[] = {"sse2", "avx2", "neon"};
+#define N_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+/* Fails the test if two kernels found different first mismatches. */
+static bool __agree(test_t* t, const char* kernel, const char* what,
+                    size_t n, size_t at, size_t want, size_t got) {
+    if (want == got) return true;
+
+    char msg[256];
+    sprintf(msg, "%s: %s of %zu with a mismatch at %zu: c found %zu, %s %zu",
+            kernel, what, n, at, want, kernel, got);
+    test_fail(t, msg);
+    return false;
+}
+
+/* Returns the float ulps above f, counting through zero. */
+static float __ulps_above(float f, int32_t ulps) {
+    int32_t i;
+    memcpy(&i, &f, sizeof(i));
+    int32_t key = i < 0 ? -(i & INT32_MAX) : i;
+    key += ulps;
+    i = key < 0 ? (int32_t)((uint32_t)(-key) | 0x80000000u) : key;
+    memcpy(&f, &i, sizeof(f));
+    return f;
+}
+
+static void* test_mem(void* t) {
+    uint8_t a[MAX_LEN * 2], b[MAX_LEN * 2];
+    for (size_t i = 0; i < sizeof(a); i++) a[i] = (uint8_t)(i * 7 + 1);
+
+    for (size_t k = 0; k < N_KERNELS; k++) {
+        if (__bulk_use(kernels[k]) != EXIT_SUCCESS) continue;
+        for (size_t n = 0; n <= sizeof(a); n++) {
+            for (size_t at = 0; at <= n; at++) {
+                memcpy(b, a, sizeof(b));
+                /* A second mismatch after the first must not be found. */
+                if (at < n) b[at] ^= 0x80;
+                if (at + 3 < n) b[at + 3] ^= 0x01;
+
+                __bulk_use("c");
+                size_t want = __bulk_mem_find(a, b, n);
+                __bulk_use(kernels[k]);
+                size_t got = __bulk_mem_find(a, b, n);
+                if (!__agree(t, kernels[k], "bytes", n, at, want, got)) {
+                    return NULL;
+                }
+            }
+        }
+    }
+    __bulk_use("c");
+
+    return NULL;
+}
+
+/* A pair of floats and whether they are within 2 ulps of each other. */
+typedef struct f32_case_t {
+    float a;
+    float b;
+    bool  near;
+} f32_case_t;
+
+static void* test_f32(void* t) {
+    float denorm = __ulps_above(0.0f, 1);
+    f32_case_t cases[] = {
+        {1.5f, 1.5f, true},
+        {0.0f, -0.0f, true},
+        {NAN, NAN, true},
+        {NAN, 1.0f, false},
+        {1.0f, NAN, false},
+        {INFINITY, INFINITY, true},
+        {INFINITY, -INFINITY, false},
+        {FLT_MAX, INFINITY, true},
+        {1.0f, __ulps_above(1.0f, 2), true},
+        {1.0f, __ulps_above(1.0f, 3), false},
+        {-1.0f, __ulps_above(-1.0f, -2), true},
+        {-1.0f, __ulps_above(-1.0f, -3), false},
+        {-denorm, denorm, true},
+        {-denorm, __ulps_above(denorm, 1), false},
+        {1e30f, -1e30f, false},
+    };
+    float a[MAX_LEN], b[MAX_LEN];
+
+    for (size_t k = 0; k < N_KERNELS; k++) {
+        if (__bulk_use(kernels[k]) != EXIT_SUCCESS) continue;
+        for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+            for (size_t n = 0; n <= MAX_LEN; n++) {
+                for (size_t at = 0; at <= n; at++) {
+                    for (size_t i = 0; i < MAX_LEN; i++) {
+                        a[i] = b[i] = (float)i * 0.25f - 3.0f;
+                    }
+                    if (at < n) {
+                        a[at] = cases[c].a;
+                        b[at] = cases[c].b;
+                    }
+                    if (at + 5 < n) b[at + 5] += 1.0f;
+
+                    __bulk_use("c");
+                    size_t want = __bulk_f32_find(a, b, n, 2);
+                    __bulk_use(kernels[k]);
+                    size_t got = __bulk_f32_find(a, b, n, 2);
+                    if (!__agree(t, kernels[k], "floats", n, at, want, got)) {
+                        return NULL;
+                    }
+                }
+            }
+        }
+    }
+    __bulk_use("c");
+
+    /* The scalar kernel itself must judge each case as documented. */
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        size_t got = __bulk_f32_find(&cases[c].a, &cases[c].b, 1, 2);
+        test_assert_eq_uint(t, got, cases[c].near ? 1u : 0u);
+    }
+
+    return NULL;
+}
+
+/* A pair of doubles and whether they are within 1e-9 of each other. */
+typedef struct f64_case_t {
+    double a;
+    double b;
+    bool   near;
+} f64_case_t;
+
+static void* test_f64(void* t) {
+    f64_case_t cases[] = {
+        {1.5, 1.5, true},
+        {0.0, -0.0, true},
+        {NAN, NAN, true},
+        {NAN, 1.0, false},
+        {INFINITY, INFINITY, true},
+        {INFINITY, -INFINITY, false},
+        {INFINITY, DBL_MAX, false},
+        {1.0, 1.0 + 0.5e-9, true},
+        {1.0, 1.0 + 2e-9, false},
+        {-1e300, -1e300 * (1 + 0.5e-9), true},
+        {1e-300, -1e-300, false},
+        {0.0, DBL_MIN, false},
+    };
+    double a[MAX_LEN], b[MAX_LEN];
+
+    for (size_t k = 0; k < N_KERNELS; k++) {
+        if (__bulk_use(kernels[k]) != EXIT_SUCCESS) continue;
+        for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+            for (size_t n = 0; n <= MAX_LEN; n++) {
+                for (size_t at = 0; at <= n; at++) {
+                    for (size_t i = 0; i < MAX_LEN; i++) {
+                        a[i] = b[i] = (double)i * 0.25 - 3.0;
+                    }
+                    if (at < n) {
+                        a[at] = cases[c].a;
+                        b[at] = cases[c].b;
+                    }
+                    if (at + 3 < n) b[at + 3] += 1.0;
+
+                    __bulk_use("c");
+                    size_t want = __bulk_f64_find(a, b, n, 1e-9);
+                    __bulk_use(kernels[k]);
+                    size_t got = __bulk_f64_find(a, b, n, 1e-9);
+                    if (!__agree(t, kernels[k], "doubles", n, at, want,
+                                 got)) {
+                        return NULL;
+                    }
+                }
+            }
+        }
+    }
+    __bulk_use("c");
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        size_t got = __bulk_f64_find(&cases[c].a, &cases[c].b, 1, 1e-9);
+        test_assert_eq_uint(t, got, cases[c].near ? 1u : 0u);
+    }
+
+    return NULL;
+}
+
+/* The assertions pass and fail on a test of their own, not the real one. */
+static void* test_assertions(void* t) {
+    float  fa[9] = {0}, fb[9] = {0};
+    double da[5] = {0}, db[5] = {0};
+    fb[8]        = -0.0f;
+    db[4]        = NAN;
+
+    test_t* scratch = tdd_test_new("scratch");
+    test_assert(t, test_assert_f32_near_ulps(scratch, fa, fb, 9, 0));
+    test_assert(t, test_assert_mem_eq(scratch, fa, fa, sizeof(fa)));
+    test_assert(t, !scratch->failed);
+
+    test_assert(t, !test_assert_f64_near_rel(scratch, da, db, 5, 1e300));
+    test_assert(t, scratch->failed);
+    test_assert(t, scratch->fail_msg != NULL &&
+                       strstr(scratch->fail_msg, "1 of 5 doubles") != NULL);
+    tdd_test_del(scratch);
+
+    return NULL;
+}
+
+int main(void) {
+    suite_t* s = suite_new();
+    suite_add(s, 4, runner_new(&test_mem, "test_mem", "byte kernels"),
+              runner_new(&test_f32, "test_f32", "float ulps kernels"),
+              runner_new(&test_f64, "test_f64", "double relative kernels"),
+              runner_new(&test_assertions, "test_assertions",
+                         "bulk assertions pass and fail"));
+    suite_run(s, false);
+
+    suite_stats_t* stats = suite_get_stats(s);
+    int            ret   = stats->n_fail + stats->n_error;
+    suite_stats_del(stats);
+    suite_del(s);
+
+    return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file test_dist.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Checks that distributed runs report crashes on worker processes,
+ *        and replace workers that die part way through the suite.
+ *
+ * Each check runs an inner suite on worker processes forked by the test
+ * and reads its results back, so that the crashes it provokes happen in
+ * the workers rather than in this process.
+ **/
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tdd.h"
+#include "tdd_assert.h"
+
+static void* inner_ok(void* t) {
+    (void)t;
+    return NULL;
+}
+
+/* Crashes, but is caught by the handler the worker's suite installed. */
+static void* inner_caught(void* t) {
+    (void)t;
+    raise(SIGSEGV);
+    return NULL;
+}
+
+/* Crashes without the handler, which kills the worker. */
+static void* inner_killed(void* t) {
+    (void)t;
+    signal(SIGSEGV, SIG_DFL);
+    raise(SIGSEGV);
+    return NULL;
+}
+
+static void* inner_exits(void* t) {
+    (void)t;
+    _exit(3);
+}
+
+/* Returns the results row of the named test, or -1. */
+static int __row(const tdd_results_t* r, const char* name) {
+    for (int i = 0; i < r->n; i++) {
+        if (strcmp(tdd_results_name(r, i), name) == 0) return i;
+    }
+    return -1;
+}
+
+/* Checks that the named test passed, failed, or crashed. */
+static void __check(test_t* t, const tdd_results_t* r, const char* name,
+                    uint8_t status) {
+    int i = __row(r, name);
+    if (!test_assert(t, i >= 0)) return;
+    test_assert_eq_uint(t, r->status[i] & (TDD_STATUS_FAILED |
+                                           TDD_STATUS_SEGV),
+                        status);
+}
+
+static void* test_caught_crash(void* t) {
+    suite_t* s = suite_new();
+    s->outfile = NULL;
+    suite_add(s, 3, runner_new(&inner_ok, "ok_1", NULL),
+              runner_new(&inner_caught, "caught", NULL),
+              runner_new(&inner_ok, "ok_2", NULL));
+
+    test_assert_eq_int(t, suite_run_distributed(s, 2, NULL, false),
+                       EXIT_SUCCESS);
+    test_assert_eq_int(t, s->n_segv, 1);
+
+    suite_stats_t* stats = suite_get_stats(s);
+    test_assert_eq_int(t, stats->n_ran, 3);
+    test_assert_eq_int(t, stats->n_fail, 1);
+    __check(t, stats->results, "ok_1", TDD_STATUS_OK);
+    __check(t, stats->results, "caught",
+            TDD_STATUS_FAILED | TDD_STATUS_SEGV);
+    __check(t, stats->results, "ok_2", TDD_STATUS_OK);
+    int i = __row(stats->results, "caught");
+    if (i >= 0) {
+        test_assert_eq_str(t, tdd_results_fail_msg(stats->results, i),
+                           "Encountered segmentation fault");
+    }
+    suite_stats_del(stats);
+    suite_del(s);
+
+    return NULL;
+}
+
+/* A crash streamed from a worker is logged once, and read back as one. */
+static void* test_caught_crash_logged(void* t) {
+    char path[64];
+    sprintf(path, "test_dist.%ld.log", (long)getpid());
+
+    suite_t* s = suite_new();
+    s->outfile = NULL;
+    suite_add(s, 2, runner_new(&inner_caught, "caught", NULL),
+              runner_new(&inner_ok, "ok", NULL));
+    test_assert_eq_int(t, suite_set_eventlog(s, path), EXIT_SUCCESS);
+    test_assert_eq_int(t, suite_run_distributed(s, 1, NULL, false),
+                       EXIT_SUCCESS);
+    suite_set_eventlog(s, NULL);
+    suite_del(s);
+
+    int                    fails = 0, crashes = 0;
+    tdd_eventlog_reader_t* r     = tdd_eventlog_open(path);
+    if (!test_assert(t, r != NULL)) return NULL;
+    tdd_event_t ev;
+    while (tdd_eventlog_next(r, &ev)) {
+        if (ev.type == TDD_EVENT_FAIL && ev.index == 0) fails++;
+        if (ev.type == TDD_EVENT_TEST_END && ev.crashed) crashes++;
+    }
+    tdd_eventlog_close(r);
+    test_assert_eq_int(t, fails, 1);
+    test_assert_eq_int(t, crashes, 1);
+
+    suite_stats_t* stats = tdd_eventlog_stats(path);
+    if (test_assert(t, stats != NULL)) {
+        __check(t, stats->results, "caught",
+                TDD_STATUS_FAILED | TDD_STATUS_SEGV);
+        __check(t, stats->results, "ok", TDD_STATUS_OK);
+        suite_stats_del(stats);
+    }
+    unlink(path);
+
+    return NULL;
+}
+
+/* A single worker that dies is replaced, so every test still runs. */
+static void* test_worker_replaced(void* t) {
+    suite_t* s = suite_new();
+    s->outfile = NULL;
+    suite_add(s, 6, runner_new(&inner_ok, "ok_1", NULL),
+              runner_new(&inner_killed, "killed", NULL),
+              runner_new(&inner_ok, "ok_2", NULL),
+              runner_new(&inner_exits, "exits", NULL),
+              runner_new(&inner_ok, "ok_3", NULL),
+              runner_new(&inner_ok, "ok_4", NULL));
+
+    test_assert_eq_int(t, suite_run_distributed(s, 1, NULL, false),
+                       EXIT_SUCCESS);
+    test_assert_eq_int(t, s->n_segv, 1);
+
+    suite_stats_t* stats = suite_get_stats(s);
+    test_assert_eq_int(t, stats->n_ran, 6);
+    test_assert_eq_int(t, stats->n_fail, 2);
+    __check(t, stats->results, "killed",
+            TDD_STATUS_FAILED | TDD_STATUS_SEGV);
+    __check(t, stats->results, "exits", TDD_STATUS_FAILED);
+    __check(t, stats->results, "ok_4", TDD_STATUS_OK);
+    int i = __row(stats->results, "exits");
+    if (i >= 0) {
+        test_assert_eq_str(t, tdd_results_fail_msg(stats->results, i),
+                           "Worker exited with status 3 while running the "
+                           "test");
+    }
+    suite_stats_del(stats);
+    suite_del(s);
+
+    return NULL;
+}
+
+int main(void) {
+    suite_t* s = suite_new();
+    suite_add(s, 3,
+              runner_new(&test_caught_crash, "test_caught_crash",
+                         "crashes caught on workers are reported"),
+              runner_new(&test_caught_crash_logged,
+                         "test_caught_crash_logged",
+                         "crashes on workers are logged once"),
+              runner_new(&test_worker_replaced, "test_worker_replaced",
+                         "workers that die are replaced"));
+    suite_run(s, false);
+
+    suite_stats_t* stats = suite_get_stats(s);
+    int            ret   = stats->n_fail + stats->n_error;
+    suite_stats_del(stats);
+    suite_del(s);
+
+    return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+/**
+ * @file test_golden.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Checks that golden file assertions pass on a match, describe a
+ *        mismatch, and rewrite the golden file in update mode.
+ *
+ * Each check runs its assertion on a scratch test, so that a failure the
+ * check expects does not fail the suite. Golden files are written to the
+ * working directory and removed afterwards.
+ **/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tdd.h"
+#include "tdd_assert.h"
+
+/* Length of the output compared a chunk at a time. */
+#define BIG_LEN (1 << 20)
+#define CHUNK_LEN 4000
+
+static char golden[64];
+
+static void __golden_set(const void* buf, size_t len) {
+    FILE* f = fopen(golden, "wb");
+    if (f == NULL) return;
+    fwrite(buf, 1, len, f);
+    fclose(f);
+}
+
+/* Returns the contents of the golden file; the caller frees them. */
+static char* __golden_get(size_t* len) {
+    FILE* f = fopen(golden, "rb");
+    if (f == NULL) return NULL;
+    fseek(f, 0, SEEK_END);
+    *len      = (size_t)ftell(f);
+    char* buf = malloc(*len + 1);
+    rewind(f);
+    if (buf != NULL) buf[fread(buf, 1, *len, f)] = '\0';
+    fclose(f);
+
+    return buf;
+}
+
+/*
+ * Compares out with the golden file on a scratch test belonging to s, and
+ * checks that it passes, or fails with a message containing each of the
+ * strings in want, which ends with NULL.
+ */
+static void __check(test_t* t, suite_t* s, const char* out, bool pass,
+                    const char** want) {
+    test_t* scratch = tdd_test_new("scratch");
+    scratch->suite  = s;
+
+    bool ok = test_assert_matches_golden(scratch, golden, out, strlen(out));
+    test_assert(t, ok == pass);
+    test_assert(t, scratch->failed != pass);
+    for (int i = 0; want != NULL && want[i] != NULL; i++) {
+        if (!test_assert(t, scratch->fail_msg != NULL &&
+                                strstr(scratch->fail_msg, want[i]) != NULL)) {
+            break;
+        }
+    }
+    tdd_test_del(scratch);
+}
+
+static void* test_match(void* t) {
+    __golden_set("hello, world\n", 13);
+    __check(t, NULL, "hello, world\n", true, NULL);
+
+    __golden_set("", 0);
+    __check(t, NULL, "", true, NULL);
+
+    return NULL;
+}
+
+static void* test_mismatch(void* t) {
+    __golden_set("hello, world\n", 13);
+
+    const char* differ[] = {"differs from golden file", "(13 bytes, want 13)",
+                            "[7] got", "[57]", "[77]", NULL};
+    __check(t, NULL, "hello, World\n", false, differ);
+
+    const char* shorter[] = {"(5 bytes, want 13)", "[5] got", "[EOF]",
+                             "[2c]", NULL};
+    __check(t, NULL, "hello", false, shorter);
+
+    const char* longer[] = {"(15 bytes, want 13)", "[13] got", "[21]",
+                            "[EOF]", NULL};
+    __check(t, NULL, "hello, world\n!!", false, longer);
+
+    /* A difference is shown with the bytes around it, not reported again. */
+    const char* many[] = {"[0] got [48] 45", "[8] got", NULL};
+    __check(t, NULL, "HELLO, WORLD\n", false, many);
+
+    unlink(golden);
+    const char* missing[] = {"cannot open golden file", NULL};
+    __check(t, NULL, "hello", false, missing);
+
+    return NULL;
+}
+
+/* Output produced a chunk at a time is compared across the chunk edges. */
+static void* test_stream(void* t) {
+    char* want = malloc(BIG_LEN);
+    if (want == NULL) return test_error(t, "out of memory");
+    for (size_t i = 0; i < BIG_LEN; i++) want[i] = (char)('a' + i % 26);
+    __golden_set(want, BIG_LEN);
+
+    size_t at[] = {CHUNK_LEN - 1, CHUNK_LEN, BIG_LEN - 1};
+    for (size_t k = 0; k <= sizeof(at) / sizeof(at[0]); k++) {
+        char* out = malloc(BIG_LEN);
+        if (out == NULL) break;
+        memcpy(out, want, BIG_LEN);
+        if (k < sizeof(at) / sizeof(at[0])) out[at[k]] = '!';
+
+        test_t*       scratch = tdd_test_new("scratch");
+        tdd_golden_t* g       = test_golden_open(scratch, golden);
+        for (size_t i = 0; i < BIG_LEN; i += CHUNK_LEN) {
+            size_t n = BIG_LEN - i < CHUNK_LEN ? BIG_LEN - i : CHUNK_LEN;
+            test_golden_write(g, out + i, n);
+        }
+        bool ok = test_golden_close(g);
+
+        if (k < sizeof(at) / sizeof(at[0])) {
+            char where[32];
+            sprintf(where, "[%zu] got", at[k]);
+            test_assert(t, !ok);
+            test_assert(t, scratch->fail_msg != NULL &&
+                               strstr(scratch->fail_msg, where) != NULL);
+        } else {
+            test_assert(t, ok);
+            test_assert(t, !scratch->failed);
+        }
+        tdd_test_del(scratch);
+        free(out);
+    }
+    free(want);
+
+    return NULL;
+}
+
+static void* test_update(void* t) {
+    suite_t* s = ((test_t*)t)->suite;
+    s->golden_update = true;
+
+    /* A golden file that differs is replaced, keeping its mode. */
+    __golden_set("hello, world\n", 13);
+    chmod(golden, 0600);
+    __check(t, s, "goodbye\n", true, NULL);
+    size_t len = 0;
+    char*  got = __golden_get(&len);
+    test_assert(t, got != NULL && strcmp(got, "goodbye\n") == 0);
+    free(got);
+    struct stat st;
+    test_assert(t, stat(golden, &st) == 0 && (st.st_mode & 0777) == 0600);
+
+    /* A missing golden file is created. */
+    unlink(golden);
+    __check(t, s, "created\n", true, NULL);
+    got = __golden_get(&len);
+    test_assert(t, got != NULL && strcmp(got, "created\n") == 0);
+    free(got);
+
+    /* A golden file that matches is left as it is. */
+    __check(t, s, "created\n", true, NULL);
+    got = __golden_get(&len);
+    test_assert(t, got != NULL && strcmp(got, "created\n") == 0);
+    free(got);
+
+    s->golden_update = false;
+    __check(t, s, "changed\n", false, NULL);
+
+    return NULL;
+}
+
+int main(void) {
+    sprintf(golden, "test_golden.%ld.golden", (long)getpid());
+
+    suite_t* s = suite_new();
+    suite_add(s, 4, runner_new(&test_match, "test_match", "golden matches"),
+              runner_new(&test_mismatch, "test_mismatch",
+                         "mismatches are described"),
+              runner_new(&test_stream, "test_stream",
+                         "streamed output is compared"),
+              runner_new(&test_update, "test_update",
+                         "update mode rewrites golden files"));
+    suite_run(s, false);
+    unlink(golden);
+
+    suite_stats_t* stats = suite_get_stats(s);
+    int            ret   = stats->n_fail + stats->n_error;
+    suite_stats_del(stats);
+    suite_del(s);
+
+    return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
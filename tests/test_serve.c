@@ -0,0 +1,163 @@
+/**
+ * @file test_serve.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief Checks that a served suite answers each request on its socket,
+ *        and stops when asked to.
+ *
+ * The server runs in a forked process, so that the tests it reruns report
+ * to its clients rather than to this suite.
+ **/
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tdd.h"
+#include "tdd_assert.h"
+
+/* The longest response read, and how long to wait for the server. */
+#define RESPONSE_LEN 4096
+#define CONNECT_TRIES 500
+
+static char address[96];
+
+static void* inner_ok(void* t) {
+    (void)t;
+    return NULL;
+}
+
+static void* inner_fails(void* t) {
+    return test_fail(t, "failed on purpose");
+}
+
+/* Serves a suite of three tests until a client asks it to stop. */
+static int __serve(void) {
+    suite_t* s = suite_new();
+    suite_add(s, 3, runner_new(&inner_ok, "slow_a", NULL),
+              runner_new(&inner_fails, "slow_b", NULL),
+              runner_new(&inner_ok, "fast", NULL));
+    int ret = suite_serve(s, address);
+    suite_del(s);
+
+    return ret;
+}
+
+/*
+ * Sends a request line to the server and reads the whole response into
+ * buf; returns false if the server could not be reached.
+ */
+static bool __request(const char* line, char* buf, size_t len) {
+    struct sockaddr_un sun;
+    memset(&sun, 0, sizeof(struct sockaddr_un));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, address);
+
+    int fd = -1;
+    for (int i = 0; i < CONNECT_TRIES && fd < 0; i++) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+        if (connect(fd, (struct sockaddr*)&sun, sizeof(sun)) != 0) {
+            /* The server may not be listening yet. */
+            close(fd);
+            fd                 = -1;
+            struct timespec ms = {0, 10000000L};
+            nanosleep(&ms, NULL);
+        }
+    }
+    if (fd < 0) return false;
+
+    bool   ok  = write(fd, line, strlen(line)) == (ssize_t)strlen(line);
+    size_t off = 0;
+    while (ok && off + 1 < len) {
+        ssize_t n = read(fd, buf + off, len - off - 1);
+        if (n <= 0) break;
+        off += (size_t)n;
+    }
+    buf[off] = '\0';
+    close(fd);
+
+    return ok;
+}
+
+/* Checks that a response contains want. */
+static void __expect(test_t* t, const char* got, const char* want) {
+    if (!test_assert(t, strstr(got, want) != NULL)) {
+        char* msg = malloc(strlen(got) + strlen(want) + 32);
+        if (msg == NULL) return;
+        sprintf(msg, "wanted \"%s\" in \"%s\"", want, got);
+        test_error(t, msg);
+        free(msg);
+    }
+}
+
+static void* test_serve(void* t) {
+    const char* tmp = getenv("TMPDIR");
+    if (tmp == NULL || *tmp == '\0') tmp = "/tmp";
+    if (strlen(tmp) > 48) tmp = "/tmp";
+    sprintf(address, "%s/test_serve.%ld.sock", tmp, (long)getpid());
+    unlink(address);
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) return test_fail(t, "cannot fork the server");
+    if (pid == 0) {
+        int ret = __serve();
+        fflush(NULL);
+        _exit(ret);
+    }
+
+    char got[RESPONSE_LEN];
+    if (!__request("list\r\n", got, sizeof(got))) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return test_fail(t, "cannot reach the server");
+    }
+    test_assert_eq_str(t, got, "slow_a\nslow_b\nfast\n");
+
+    __request("run slow*\n", got, sizeof(got));
+    __expect(t, got, "slow_a");
+    __expect(t, got, "failed on purpose");
+    __expect(t, got, "done: ran 2, failed 1, errors 0\n");
+    test_assert(t, strstr(got, "fast") == NULL);
+
+    /* Each run starts from a reset suite. */
+    __request("run\n", got, sizeof(got));
+    __expect(t, got, "fast");
+    __expect(t, got, "done: ran 3, failed 1, errors 0\n");
+
+    __request("run nothing*\n", got, sizeof(got));
+    test_assert_eq_str(t, got, "done: ran 0, failed 0, errors 0\n");
+
+    __request("bogus\n", got, sizeof(got));
+    test_assert_eq_str(t, got, "error: unknown request 'bogus'\n");
+
+    __request("quit\n", got, sizeof(got));
+    test_assert_eq_str(t, got, "bye\n");
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    test_assert(t, WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+    test_assert(t, access(address, F_OK) != 0);
+
+    return NULL;
+}
+
+int main(void) {
+    suite_t* s = suite_new();
+    suite_add(s, 1, runner_new(&test_serve, "test_serve",
+                               "requests are answered until quit"));
+    suite_run(s, false);
+
+    suite_stats_t* stats = suite_get_stats(s);
+    int            ret   = stats->n_fail + stats->n_error;
+    suite_stats_del(stats);
+    suite_del(s);
+
+    return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+#!/bin/sh
+# libtdd amalgamation
+# Keefer Rourke <mail@krourke.org>
+#
+# Writes the whole library as one header, tdd_single.h, so that a test
+# program can be built as a single translation unit and the compiler can
+# inline across what would otherwise be library calls.
+#
+# Include tdd_single.h wherever tdd.h would be included. In exactly one
+# source file, define TDD_IMPLEMENTATION and include tdd_single.h before
+# any other header, so that the feature test macros it sets take effect.
+#
+# usage: amalgamate.sh [output]
+#
+# See LICENSE file included at the project root.
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=${1:-tdd_single.h}
+
+# Private headers in dependency order: every one of them needs only tdd.h.
+PRIVATE="assertutil.h async.h benchenv.h bulk.h cache.h dist.h eventlog.h
+fixture.h histutil.h lockprof.h profile.h report.h results.h rusage.h sample.h
+signals.h spans.h strutil.h suite.h timeutil.h trace.h vclock.h"
+
+# Drops includes of the library's own headers, which are inlined instead,
+# and the per-file feature test macros, which are set once at the top.
+strip() {
+    sed -e '/^#include "[a-z_]*\.h"/d' -e '/^#define _GNU_SOURCE/d' "$1"
+}
+
+{
+    echo "/**"
+    echo " * @file tdd_single.h"
+    echo " * @brief libtdd as a single header. Generated by"
+    echo " *        tools/amalgamate.sh; do not edit."
+    echo " *"
+    echo " * Define TDD_IMPLEMENTATION in one source file before including"
+    echo " * this header, and include it before any other header there."
+    echo " **/"
+    echo "#ifndef __TDD_SINGLE_H__"
+    echo "#define __TDD_SINGLE_H__"
+    echo "#if defined(TDD_IMPLEMENTATION) && !defined(_GNU_SOURCE)"
+    echo "#define _GNU_SOURCE"
+    echo "#endif"
+    echo
+    strip "$ROOT/include/tdd.h"
+    strip "$ROOT/include/tdd_assert.h"
+    echo
+    echo "#ifdef TDD_IMPLEMENTATION"
+    for h in $PRIVATE; do
+        strip "$ROOT/include/$h"
+    done
+    for c in "$ROOT"/src/*.c; do
+        echo
+        echo "/* ---- src/$(basename "$c") ---- */"
+        strip "$c"
+        # Macros are private to their source file; do not let them leak.
+        sed -n 's/^#define \([A-Za-z_0-9]*\).*/#undef \1/p' "$c" |
+            grep -v _GNU_SOURCE | sort -u
+    done
+    echo "#endif /* TDD_IMPLEMENTATION */"
+    echo
+    echo "#endif /* __TDD_SINGLE_H__ */"
+} > "$OUT"
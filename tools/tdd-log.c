@@ -0,0 +1,162 @@
+/**
+ * @file tdd-log.c
+ * @author Keefer Rourke <mail@krourke.org>
+ * @brief A command line reader for event logs written by libtdd suites.
+ *
+ * Usage:
+ *   tdd-log report <log>   print the results as the suite printed them
+ *   tdd-log stats <log>    print summary statistics
+ *   tdd-log dump <log>     print every event, one per line
+ **/
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tdd.h"
+
+static const char* event_names[] = {
+    "?",     "suite_start", "suite_end", "test_start", "test_end", "error",
+    "fail",  "parallel",    "scaling",   "load",       "fuzz",
+    "span",  "metric",      "rusage",    "lock",       "bench_env",
+    "samples", "cache",
+};
+
+static void usage(const char* prog) {
+    fprintf(stderr, "usage: %s report|stats|dump <log>\n", prog);
+}
+
+static int dump(const char* path) {
+    tdd_eventlog_reader_t* r = tdd_eventlog_open(path);
+    if (r == NULL) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    tdd_event_t ev;
+    while (tdd_eventlog_next(r, &ev)) {
+        const char* name = "?";
+        if (ev.type < sizeof(event_names) / sizeof(event_names[0])) {
+            name = event_names[ev.type];
+        }
+        printf("%-11s %3d", name, ev.index);
+        switch (ev.type) {
+        case TDD_EVENT_SUITE_START:
+            printf(" t=%" PRId64 " tests=%d", ev.ts, ev.n_tests);
+            break;
+        case TDD_EVENT_SUITE_END:
+            printf(" t=%" PRId64 " finished=%d", ev.ts, ev.finished);
+            break;
+        case TDD_EVENT_TEST_START:
+            printf(" t=%" PRId64 " %s", ev.ts, ev.name);
+            break;
+        case TDD_EVENT_TEST_END:
+            printf(" t=%" PRId64 " failed=%d crashed=%d errors=%d"
+                   " elapsed=%" PRId64 "ns",
+                   ev.ts, ev.failed, ev.crashed, ev.n_err, ev.end - ev.start);
+            break;
+        case TDD_EVENT_ERROR:
+        case TDD_EVENT_FAIL:
+            printf(" t=%" PRId64 " %s", ev.ts, ev.msg);
+            break;
+        case TDD_EVENT_PARALLEL:
+            printf(" threads=%d ns/op=%.2f", ev.parallel->threads,
+                   ev.parallel->ns_per_op);
+            break;
+        case TDD_EVENT_SCALING:
+            printf(" points=%d", ev.scaling->n_points);
+            break;
+        case TDD_EVENT_LOAD:
+            printf(" points=%d", ev.load->n_points);
+            break;
+        case TDD_EVENT_FUZZ:
+            printf(" execs=%lu edges=%lu", ev.fuzz->execs, ev.fuzz->edges);
+            break;
+        case TDD_EVENT_SPAN:
+            printf(" %s count=%ld total=%" PRId64 " max=%" PRId64,
+                   ev.span->name, ev.span->count, ev.span->total,
+                   ev.span->max);
+            break;
+        case TDD_EVENT_METRIC:
+            printf(" %s count=%ld mean=%g min=%g max=%g", ev.metric->unit,
+                   ev.metric->count, ev.metric->mean, ev.metric->min,
+                   ev.metric->max);
+            break;
+        case TDD_EVENT_RUSAGE:
+            printf(" user=%" PRId64 "ns sys=%" PRId64 "ns minflt=%ld "
+                   "majflt=%ld nvcsw=%ld nivcsw=%ld",
+                   ev.usage->user_ns, ev.usage->sys_ns, ev.usage->minflt,
+                   ev.usage->majflt, ev.usage->nvcsw, ev.usage->nivcsw);
+            break;
+        case TDD_EVENT_LOCK:
+            printf(" %s count=%ld contended=%ld wait=%" PRId64
+                   "ns hold=%" PRId64 "ns",
+                   ev.lock->site, ev.lock->count, ev.lock->contended,
+                   ev.lock->wait_ns, ev.lock->hold_ns);
+            break;
+        case TDD_EVENT_BENCH_ENV:
+            printf(" cpu=%d pinned=%d realtime=%d mlock=%d warmup=%d "
+                   "governor=%s turbo=%d smt=%d load=%.2f warnings=%#x",
+                   ev.env->cpu, ev.env->pinned, ev.env->realtime,
+                   ev.env->memory_locked, ev.env->warmup, ev.env->governor,
+                   ev.env->turbo, ev.env->smt, ev.env->load,
+                   ev.env->warnings);
+            break;
+        case TDD_EVENT_SAMPLES:
+            printf(" n=%d converged=%d median=%.0fns ci=%.4f mean=%.0fns "
+                   "ci=%.4f outliers=%d/%d/%d/%d",
+                   ev.samples->n, ev.samples->converged,
+                   ev.samples->median_ns, ev.samples->median_ci,
+                   ev.samples->mean_ns, ev.samples->mean_ci,
+                   ev.samples->low_severe, ev.samples->low_mild,
+                   ev.samples->high_mild, ev.samples->high_severe);
+            break;
+        case TDD_EVENT_CACHE:
+            printf(" runs=%d cold=%.0fns warm=%.0fns evict=%" PRId64,
+                   ev.cache->runs, ev.cache->cold_ns, ev.cache->warm_ns,
+                   ev.cache->evict_bytes);
+            break;
+        }
+        printf("\n");
+    }
+    tdd_eventlog_close(r);
+
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (strcmp(argv[1], "report") == 0) {
+        if (tdd_eventlog_report(argv[2], stdout) != EXIT_SUCCESS) {
+            perror(argv[2]);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (strcmp(argv[1], "stats") == 0) {
+        suite_stats_t* stats = tdd_eventlog_stats(argv[2]);
+        if (stats == NULL) {
+            perror(argv[2]);
+            return EXIT_FAILURE;
+        }
+        suite_print_stats(stats, stdout, 10);
+        printf("\n");
+        for (int i = 0; i < stats->n_ran; i++) {
+            printf("%s: %s\n", tdd_results_name(stats->results, i),
+                   tdd_results_ok(stats->results, i) ? "okay" : "not okay");
+        }
+        int ret = stats->n_fail != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+        suite_stats_del(stats);
+        return ret;
+    }
+    if (strcmp(argv[1], "dump") == 0) {
+        return dump(argv[2]);
+    }
+
+    usage(argv[0]);
+    return EXIT_FAILURE;
+}